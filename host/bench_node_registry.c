@@ -0,0 +1,161 @@
+// Lookup cost of the node registry versus the former linear scan over nodes[]
+//
+// Usage: bench_node_registry [lookups per fleet size]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "node_registry.h"
+
+#define DEFAULT_LOOKUPS 1000000
+
+static const size_t fleet_sizes[] = {10, 50, 100, 250, 500, 1000};
+
+// Copy of the table layout and scans the provisioner used before the registry,
+// sized to the fleet under test like CONFIG_BLE_MESH_MAX_PROV_NODES was
+static esp_ble_mesh_node_info_t linear_nodes[NODE_REGISTRY_MAX_NODES];
+static size_t linear_capacity;
+
+static esp_ble_mesh_node_info_t *linear_find_addr(uint16_t unicast)
+{
+    for (size_t i = 0; i < linear_capacity; i++)
+    {
+        if (linear_nodes[i].unicast <= unicast && linear_nodes[i].unicast + linear_nodes[i].elem_num > unicast)
+        {
+            return &linear_nodes[i];
+        }
+    }
+
+    return NULL;
+}
+
+static esp_ble_mesh_node_info_t *linear_find_uuid(const uint8_t uuid[16])
+{
+    for (size_t i = 0; i < linear_capacity; i++)
+    {
+        if (!memcmp(linear_nodes[i].uuid, uuid, 16))
+        {
+            return &linear_nodes[i];
+        }
+    }
+
+    return NULL;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void make_uuid(uint8_t uuid[16], uint32_t seed)
+{
+    // Same shape as ble_mesh_get_dev_uuid(): BD_ADDR at offset 2, rest zero
+    memset(uuid, 0, 16);
+    uuid[2] = 0x24;
+    uuid[3] = 0x6f;
+    uuid[4] = 0x28;
+    uuid[5] = seed >> 16;
+    uuid[6] = seed >> 8;
+    uuid[7] = seed;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t uuids[NODE_REGISTRY_MAX_NODES][16];
+    static uint16_t addrs[NODE_REGISTRY_MAX_NODES];
+    size_t lookups = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_LOOKUPS;
+    volatile uintptr_t sink = 0;
+
+    printf("%6s %14s %14s %14s %14s\n", "nodes", "addr linear", "addr indexed", "uuid linear", "uuid indexed");
+
+    for (size_t f = 0; f < sizeof(fleet_sizes) / sizeof(fleet_sizes[0]); f++)
+    {
+        size_t count = fleet_sizes[f];
+        uint16_t unicast = 0x0005;
+        double start;
+        double t[4];
+
+        ble_mesh_registry_init();
+        memset(linear_nodes, 0, sizeof(linear_nodes));
+        linear_capacity = count;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint8_t elem_num = 1 + i % 3;
+
+            make_uuid(uuids[i], (uint32_t)(i * 2654435761u));
+            addrs[i] = unicast + i % elem_num;
+            ble_mesh_registry_store(uuids[i], unicast, elem_num);
+            memcpy(linear_nodes[i].uuid, uuids[i], 16);
+            linear_nodes[i].unicast = unicast;
+            linear_nodes[i].elem_num = elem_num;
+            unicast += elem_num;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            esp_ble_mesh_node_info_t *node = ble_mesh_registry_find_addr(addrs[i]);
+            if (!node || node != ble_mesh_registry_find_uuid(uuids[i])
+                || linear_find_addr(addrs[i])->unicast != node->unicast)
+            {
+                fprintf(stderr, "lookup mismatch for node %zu\n", i);
+                return 1;
+            }
+        }
+
+        // Free and re-register every third node to exercise slot reuse
+        for (size_t i = 0; i < count; i += 3)
+        {
+            esp_ble_mesh_node_info_t node = *ble_mesh_registry_find_uuid(uuids[i]);
+            ble_mesh_registry_remove(ble_mesh_registry_find_uuid(uuids[i]));
+            if (ble_mesh_registry_find_uuid(uuids[i]) || ble_mesh_registry_find_addr(addrs[i]))
+            {
+                fprintf(stderr, "removed node %zu still indexed\n", i);
+                return 1;
+            }
+            ble_mesh_registry_store(node.uuid, node.unicast, node.elem_num);
+        }
+        if (ble_mesh_registry_count() != count || !ble_mesh_registry_find_addr(addrs[0]))
+        {
+            fprintf(stderr, "slot reuse failed\n");
+            return 1;
+        }
+
+        start = now_ns();
+        for (size_t i = 0; i < lookups; i++)
+        {
+            sink += (uintptr_t)linear_find_addr(addrs[i % count]);
+        }
+        t[0] = (now_ns() - start) / lookups;
+
+        start = now_ns();
+        for (size_t i = 0; i < lookups; i++)
+        {
+            sink += (uintptr_t)ble_mesh_registry_find_addr(addrs[i % count]);
+        }
+        t[1] = (now_ns() - start) / lookups;
+
+        start = now_ns();
+        for (size_t i = 0; i < lookups; i++)
+        {
+            sink += (uintptr_t)linear_find_uuid(uuids[i % count]);
+        }
+        t[2] = (now_ns() - start) / lookups;
+
+        start = now_ns();
+        for (size_t i = 0; i < lookups; i++)
+        {
+            sink += (uintptr_t)ble_mesh_registry_find_uuid(uuids[i % count]);
+        }
+        t[3] = (now_ns() - start) / lookups;
+
+        printf("%6zu %11.1f ns %11.1f ns %11.1f ns %11.1f ns\n", count, t[0], t[1], t[2], t[3]);
+    }
+
+    return sink == 0;
+}
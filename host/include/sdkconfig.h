@@ -0,0 +1,10 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_HOST_SDKCONFIG_H
+#define DEZIBOT_BLUETOOTH_MESH_HOST_SDKCONFIG_H
+
+// Values mirrored from sdkconfig.esp32s3usbotg
+
+#define CONFIG_BLE_MESH_MAX_PROV_NODES      10
+#define CONFIG_BLE_MESH_MODEL_GROUP_COUNT   3
+#define CONFIG_BLE_MESH_ADV_BUF_COUNT       60
+
+#endif //DEZIBOT_BLUETOOTH_MESH_HOST_SDKCONFIG_H
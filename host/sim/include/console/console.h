@@ -0,0 +1,6 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_CONSOLE_CONSOLE_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_CONSOLE_CONSOLE_H
+
+#include "esp_console.h"
+
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_CONSOLE_CONSOLE_H
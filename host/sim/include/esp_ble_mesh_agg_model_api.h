@@ -0,0 +1,36 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_ESP_BLE_MESH_AGG_MODEL_API_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_ESP_BLE_MESH_AGG_MODEL_API_H
+
+// Opcodes Aggregator client subset; the servers answering it live in sim_mesh.c
+
+#include "esp_ble_mesh_defs.h"
+#define ESP_BLE_MESH_MODEL_OP_AGG_SEQUENCE ESP_BLE_MESH_MODEL_OP_2(0xB8, 0x09)
+#define ESP_BLE_MESH_MODEL_OP_AGG_STATUS ESP_BLE_MESH_MODEL_OP_2(0xB8, 0x10)
+#define ESP_BLE_MESH_MODEL_AGG_CLI(cli) ESP_BLE_MESH_SIG_MODEL(ESP_BLE_MESH_MODEL_ID_AGG_CLI, NULL, cli)
+typedef struct { uint16_t element_addr; struct net_buf_simple *items; } esp_ble_mesh_agg_sequence_t;
+typedef union {
+    esp_ble_mesh_agg_sequence_t agg_sequence;
+} esp_ble_mesh_agg_client_msg_t;
+typedef struct { uint8_t status; uint16_t element_addr; struct net_buf_simple *items; } esp_ble_mesh_agg_status_t;
+typedef union {
+    esp_ble_mesh_agg_status_t agg_status;
+} esp_ble_mesh_agg_client_recv_t;
+typedef union {
+    struct { int err_code; esp_ble_mesh_client_common_param_t *params; } send;
+    struct { esp_ble_mesh_client_common_param_t *params; esp_ble_mesh_agg_client_recv_t recv; } recv;
+} esp_ble_mesh_agg_client_cb_param_t;
+typedef union {
+    esp_ble_mesh_agg_client_cb_param_t client;
+} esp_ble_mesh_agg_cb_param_t;
+typedef enum {
+    ESP_BLE_MESH_AGG_CLIENT_SEND_COMP_EVT,
+    ESP_BLE_MESH_AGG_CLIENT_SEND_TIMEOUT_EVT,
+    ESP_BLE_MESH_AGG_CLIENT_RECV_RSP_EVT,
+    ESP_BLE_MESH_AGG_CLIENT_RECV_PUB_EVT,
+    ESP_BLE_MESH_AGG_SERVER_RECV_MSG_EVT,
+    ESP_BLE_MESH_AGG_EVT_MAX,
+} esp_ble_mesh_agg_cb_event_t;
+typedef void (*esp_ble_mesh_agg_cb_t)(esp_ble_mesh_agg_cb_event_t event, esp_ble_mesh_agg_cb_param_t *param);
+esp_err_t esp_ble_mesh_register_agg_callback(esp_ble_mesh_agg_cb_t callback);
+esp_err_t esp_ble_mesh_agg_client_send(esp_ble_mesh_client_common_param_t *params, esp_ble_mesh_agg_client_msg_t *msg);
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_ESP_BLE_MESH_AGG_MODEL_API_H
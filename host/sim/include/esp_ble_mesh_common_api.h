@@ -0,0 +1,8 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_ESP_BLE_MESH_COMMON_API_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_ESP_BLE_MESH_COMMON_API_H
+
+// Mesh stack entry point, implemented in sim_mesh.c
+
+#include "esp_ble_mesh_defs.h"
+esp_err_t esp_ble_mesh_init(esp_ble_mesh_prov_t *prov, esp_ble_mesh_comp_t *comp);
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_ESP_BLE_MESH_COMMON_API_H
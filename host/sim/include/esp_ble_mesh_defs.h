@@ -0,0 +1,431 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_ESP_BLE_MESH_DEFS_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_ESP_BLE_MESH_DEFS_H
+
+// Stand-in for the ESP-IDF BLE Mesh type definitions used by lib/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "esp_err.h"
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#endif
+
+#define BD_ADDR_LEN 6
+typedef uint8_t esp_ble_mesh_bd_addr_t[BD_ADDR_LEN];
+typedef uint8_t esp_ble_mesh_octet16_t[16];
+typedef uint8_t esp_ble_mesh_octet8_t[8];
+typedef uint32_t esp_ble_mesh_opcode_t;
+typedef uint8_t esp_ble_mesh_addr_type_t;
+
+#define ESP_BLE_MESH_ADDR_UNASSIGNED 0x0000
+#define ESP_BLE_MESH_ADDR_ALL_NODES 0xFFFF
+#define ESP_BLE_MESH_ADDR_PROXIES 0xFFFC
+#define ESP_BLE_MESH_ADDR_FRIENDS 0xFFFD
+#define ESP_BLE_MESH_ADDR_RELAYS 0xFFFE
+#define ESP_BLE_MESH_ADDR_IS_UNICAST(addr) ((addr) && (addr) < 0x8000)
+#define ESP_BLE_MESH_ADDR_IS_GROUP(addr) ((addr) >= 0xC000 && (addr) <= 0xFF00)
+#define ESP_BLE_MESH_ADDR_IS_VIRTUAL(addr) ((addr) >= 0x8000 && (addr) < 0xC000)
+
+#define ESP_BLE_MESH_KEY_PRIMARY 0x0000
+#define ESP_BLE_MESH_KEY_UNUSED 0xFFFF
+#define ESP_BLE_MESH_KEY_DEV 0xFFFE
+#define ESP_BLE_MESH_CID_NVAL 0xFFFF
+#define ESP_BLE_MESH_TTL_DEFAULT 0xFF
+#define ESP_BLE_MESH_TTL_MAX 0x7F
+
+#define ESP_BLE_MESH_FEATURE_RELAY (1 << 0)
+#define ESP_BLE_MESH_FEATURE_PROXY (1 << 1)
+#define ESP_BLE_MESH_FEATURE_FRIEND (1 << 2)
+#define ESP_BLE_MESH_FEATURE_LOW_POWER (1 << 3)
+#define ESP_BLE_MESH_FEATURE_ALL_SUPPORTED 0x000F
+
+#define ESP_BLE_MESH_RELAY_DISABLED 0x00
+#define ESP_BLE_MESH_RELAY_ENABLED 0x01
+#define ESP_BLE_MESH_BEACON_DISABLED 0x00
+#define ESP_BLE_MESH_BEACON_ENABLED 0x01
+#define ESP_BLE_MESH_GATT_PROXY_ENABLED 0x01
+#define ESP_BLE_MESH_FRIEND_NOT_SUPPORTED 0x02
+#define ESP_BLE_MESH_TRANSMIT(count, int_ms) ((count) | (((int_ms / 10) - 1) << 3))
+#define ESP_BLE_MESH_GET_TRANSMIT_COUNT(t) ((t) & 0x07)
+#define ESP_BLE_MESH_GET_TRANSMIT_INTERVAL(t) ((((t) >> 3) + 1) * 10)
+
+#define ESP_BLE_MESH_MODEL_OP_1(b0) (b0)
+#define ESP_BLE_MESH_MODEL_OP_2(b0, b1) (((b0) << 8) | (b1))
+#define ESP_BLE_MESH_MODEL_OP_3(b0, cid) ((((b0) << 16) | 0xC00000) | (cid))
+
+#define ROLE_NODE 0
+#define ROLE_PROVISIONER 1
+#define ROLE_FAST_PROV 2
+
+struct net_buf_simple {
+    uint8_t *data;
+    uint16_t len;
+    uint16_t size;
+    uint8_t *__buf;
+};
+
+#define NET_BUF_SIMPLE_DEFINE(_name, _size) \
+    uint8_t net_buf_data_##_name[_size]; \
+    struct net_buf_simple _name = { .data = net_buf_data_##_name, .len = 0, .size = _size, .__buf = net_buf_data_##_name }
+
+static inline void net_buf_simple_init(struct net_buf_simple *buf, size_t reserve) { buf->data = buf->__buf + reserve; buf->len = 0; }
+static inline void *net_buf_simple_add(struct net_buf_simple *buf, size_t len) { uint8_t *t = buf->data + buf->len; buf->len += len; return t; }
+static inline void *net_buf_simple_add_mem(struct net_buf_simple *buf, const void *mem, size_t len) { return memcpy(net_buf_simple_add(buf, len), mem, len); }
+static inline void net_buf_simple_add_u8(struct net_buf_simple *buf, uint8_t val) { *(uint8_t *)net_buf_simple_add(buf, 1) = val; }
+static inline void net_buf_simple_add_le16(struct net_buf_simple *buf, uint16_t val) { uint8_t *p = net_buf_simple_add(buf, 2); p[0] = val; p[1] = val >> 8; }
+static inline void net_buf_simple_add_be16(struct net_buf_simple *buf, uint16_t val) { uint8_t *p = net_buf_simple_add(buf, 2); p[0] = val >> 8; p[1] = val; }
+static inline size_t net_buf_simple_tailroom(struct net_buf_simple *buf) { return buf->size - (buf->data - buf->__buf) - buf->len; }
+static inline void net_buf_simple_reset(struct net_buf_simple *buf) { buf->len = 0; buf->data = buf->__buf; }
+
+typedef struct {
+    uint16_t net_idx;
+    uint16_t app_idx;
+    uint16_t addr;
+    uint16_t recv_dst;
+    int8_t recv_rssi;
+    uint8_t recv_cred;
+    uint8_t recv_tag;
+    uint8_t send_szmic:1;
+    uint8_t send_ttl;
+    uint8_t send_cred;
+    uint8_t send_tag;
+    uint32_t recv_op;
+    struct esp_ble_mesh_model *model;
+    bool srv_send;
+    uint8_t recv_ttl;
+} esp_ble_mesh_msg_ctx_t;
+
+typedef struct {
+    uint16_t publish_addr;
+    uint16_t app_idx;
+    uint8_t ttl;
+    uint8_t period;
+    uint8_t retransmit;
+    struct net_buf_simple *msg;
+} esp_ble_mesh_model_pub_t;
+
+#define ESP_BLE_MESH_NODE_NAME_MAX_LEN 31
+
+typedef struct {
+    esp_ble_mesh_bd_addr_t addr;
+    esp_ble_mesh_addr_type_t addr_type;
+    uint8_t dev_uuid[16];
+    uint16_t oob_info;
+    uint16_t unicast_addr;
+    uint8_t element_num;
+    uint16_t net_idx;
+    uint8_t flags;
+    uint32_t iv_index;
+    uint8_t dev_key[16];
+    char name[ESP_BLE_MESH_NODE_NAME_MAX_LEN + 1];
+    uint16_t comp_length;
+    uint8_t *comp_data;
+} esp_ble_mesh_node_t;
+
+typedef struct esp_ble_mesh_model {
+    union { const uint16_t model_id; struct { uint16_t company_id; uint16_t model_id; } vnd; };
+    uint8_t element_idx;
+    uint8_t model_idx;
+    uint16_t flags;
+    struct esp_ble_mesh_elem *element;
+    esp_ble_mesh_model_pub_t *pub;
+    uint16_t keys[3];
+    uint16_t groups[3];
+    void *op;
+    void *cb;
+    void *user_data;
+} esp_ble_mesh_model_t;
+
+typedef struct esp_ble_mesh_elem {
+    uint16_t element_addr;
+    const uint16_t location;
+    const uint8_t sig_model_count;
+    const uint8_t vnd_model_count;
+    esp_ble_mesh_model_t *sig_models;
+    esp_ble_mesh_model_t *vnd_models;
+} esp_ble_mesh_elem_t;
+
+typedef struct {
+    uint16_t cid;
+    uint16_t pid;
+    uint16_t vid;
+    size_t element_count;
+    esp_ble_mesh_elem_t *elements;
+} esp_ble_mesh_comp_t;
+
+typedef struct {
+    esp_ble_mesh_model_t *model;
+    void *op_pair;
+    size_t op_pair_size;
+    void *internal_data;
+    uint8_t msg_role;
+} esp_ble_mesh_client_t;
+
+typedef struct {
+    uint8_t net_transmit;
+    uint8_t relay;
+    uint8_t relay_retransmit;
+    uint8_t beacon;
+    uint8_t gatt_proxy;
+    uint8_t friend_state;
+    uint8_t default_ttl;
+} esp_ble_mesh_cfg_srv_t;
+
+#define ESP_BLE_MESH_MODEL_NONE ((esp_ble_mesh_model_t []){})
+#define ESP_BLE_MESH_SIG_MODEL(_id, _pub, _user) { .model_id = (_id), .pub = (_pub), .keys = { [0 ... 2] = ESP_BLE_MESH_KEY_UNUSED }, .user_data = (_user) }
+#define ESP_BLE_MESH_ELEMENT(_loc, _sig, _vnd) { .location = (_loc), .sig_model_count = ARRAY_SIZE(_sig), .vnd_model_count = ARRAY_SIZE(_vnd), .sig_models = (_sig), .vnd_models = (_vnd) }
+
+#define ESP_BLE_MESH_MODEL_ID_CONFIG_SRV 0x0000
+#define ESP_BLE_MESH_MODEL_ID_CONFIG_CLI 0x0001
+#define ESP_BLE_MESH_MODEL_ID_HEALTH_SRV 0x0002
+#define ESP_BLE_MESH_MODEL_ID_HEALTH_CLI 0x0003
+#define ESP_BLE_MESH_MODEL_ID_AGG_SRV 0x0010
+#define ESP_BLE_MESH_MODEL_ID_AGG_CLI 0x0011
+#define ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_SRV 0x1000
+#define ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_CLI 0x1001
+#define ESP_BLE_MESH_MODEL_ID_GEN_LEVEL_SRV 0x1002
+#define ESP_BLE_MESH_MODEL_ID_GEN_LEVEL_CLI 0x1003
+#define ESP_BLE_MESH_MODEL_ID_GEN_DEF_TRANS_TIME_SRV 0x1004
+#define ESP_BLE_MESH_MODEL_ID_GEN_DEF_TRANS_TIME_CLI 0x1005
+#define ESP_BLE_MESH_MODEL_ID_GEN_POWER_ONOFF_SRV 0x1006
+#define ESP_BLE_MESH_MODEL_ID_GEN_POWER_ONOFF_SETUP_SRV 0x1007
+#define ESP_BLE_MESH_MODEL_ID_GEN_POWER_ONOFF_CLI 0x1008
+#define ESP_BLE_MESH_MODEL_ID_GEN_POWER_LEVEL_SRV 0x1009
+#define ESP_BLE_MESH_MODEL_ID_GEN_POWER_LEVEL_SETUP_SRV 0x100a
+#define ESP_BLE_MESH_MODEL_ID_GEN_POWER_LEVEL_CLI 0x100b
+#define ESP_BLE_MESH_MODEL_ID_GEN_BATTERY_SRV 0x100c
+#define ESP_BLE_MESH_MODEL_ID_GEN_BATTERY_CLI 0x100d
+#define ESP_BLE_MESH_MODEL_ID_GEN_LOCATION_SRV 0x100e
+#define ESP_BLE_MESH_MODEL_ID_GEN_LOCATION_SETUP_SRV 0x100f
+#define ESP_BLE_MESH_MODEL_ID_GEN_LOCATION_CLI 0x1010
+#define ESP_BLE_MESH_MODEL_ID_GEN_ADMIN_PROP_SRV 0x1011
+#define ESP_BLE_MESH_MODEL_ID_GEN_MANUFACTURER_PROP_SRV 0x1012
+#define ESP_BLE_MESH_MODEL_ID_GEN_USER_PROP_SRV 0x1013
+#define ESP_BLE_MESH_MODEL_ID_GEN_CLIENT_PROP_SRV 0x1014
+#define ESP_BLE_MESH_MODEL_ID_GEN_PROP_CLI 0x1015
+
+#define ESP_BLE_MESH_MODEL_CFG_SRV(srv) ESP_BLE_MESH_SIG_MODEL(ESP_BLE_MESH_MODEL_ID_CONFIG_SRV, NULL, srv)
+#define ESP_BLE_MESH_MODEL_CFG_CLI(cli) ESP_BLE_MESH_SIG_MODEL(ESP_BLE_MESH_MODEL_ID_CONFIG_CLI, NULL, cli)
+#define ESP_BLE_MESH_MODEL_GEN_ONOFF_CLI(p, c) ESP_BLE_MESH_SIG_MODEL(ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_CLI, p, c)
+#define ESP_BLE_MESH_MODEL_GEN_LEVEL_CLI(p, c) ESP_BLE_MESH_SIG_MODEL(ESP_BLE_MESH_MODEL_ID_GEN_LEVEL_CLI, p, c)
+#define ESP_BLE_MESH_MODEL_GEN_DEF_TRANS_TIME_CLI(p, c) ESP_BLE_MESH_SIG_MODEL(ESP_BLE_MESH_MODEL_ID_GEN_DEF_TRANS_TIME_CLI, p, c)
+#define ESP_BLE_MESH_MODEL_GEN_POWER_LEVEL_CLI(p, c) ESP_BLE_MESH_SIG_MODEL(ESP_BLE_MESH_MODEL_ID_GEN_POWER_LEVEL_CLI, p, c)
+#define ESP_BLE_MESH_MODEL_GEN_BATTERY_CLI(p, c) ESP_BLE_MESH_SIG_MODEL(ESP_BLE_MESH_MODEL_ID_GEN_BATTERY_CLI, p, c)
+#define ESP_BLE_MESH_MODEL_GEN_LOCATION_CLI(p, c) ESP_BLE_MESH_SIG_MODEL(ESP_BLE_MESH_MODEL_ID_GEN_LOCATION_CLI, p, c)
+#define ESP_BLE_MESH_MODEL_GEN_PROPERTY_CLI(p, c) ESP_BLE_MESH_SIG_MODEL(ESP_BLE_MESH_MODEL_ID_GEN_PROP_CLI, p, c)
+
+typedef enum {
+    ESP_BLE_MESH_PROV_ADV = 1 << 0,
+    ESP_BLE_MESH_PROV_GATT = 1 << 1,
+} esp_ble_mesh_prov_bearer_t;
+
+typedef struct {
+    const uint8_t *uuid;
+    const uint8_t *prov_uuid;
+    uint16_t prov_unicast_addr;
+    uint16_t prov_start_address;
+    uint8_t prov_attention;
+    uint8_t prov_algorithm;
+    uint8_t prov_pub_key_oob;
+    const uint8_t *prov_static_oob_val;
+    uint8_t prov_static_oob_len;
+    uint8_t flags;
+    uint32_t iv_index;
+} esp_ble_mesh_prov_t;
+
+typedef struct {
+    esp_ble_mesh_bd_addr_t addr;
+    esp_ble_mesh_addr_type_t addr_type;
+    uint8_t uuid[16];
+    uint16_t oob_info;
+    esp_ble_mesh_prov_bearer_t bearer;
+} esp_ble_mesh_unprov_dev_add_t;
+
+#define ADD_DEV_RM_AFTER_PROV_FLAG (1 << 0)
+#define ADD_DEV_START_PROV_NOW_FLAG (1 << 1)
+#define ADD_DEV_FLUSHABLE_DEV_FLAG (1 << 2)
+typedef uint8_t esp_ble_mesh_dev_add_flag_t;
+
+#define DEL_DEV_ADDR_FLAG (1 << 0)
+#define DEL_DEV_UUID_FLAG (1 << 1)
+typedef struct {
+    union { struct { esp_ble_mesh_bd_addr_t addr; esp_ble_mesh_addr_type_t addr_type; }; uint8_t uuid[16]; };
+    uint8_t flag;
+} esp_ble_mesh_device_delete_t;
+
+#define PROV_DATA_NET_IDX_FLAG  (1 << 0)
+#define PROV_DATA_FLAGS_FLAG    (1 << 1)
+#define PROV_DATA_IV_INDEX_FLAG (1 << 2)
+
+typedef struct {
+    union { uint16_t net_idx; uint8_t flags; uint32_t iv_index; };
+    uint8_t flag;
+} esp_ble_mesh_prov_data_info_t;
+
+#define ESP_BLE_MESH_PROVISIONER_HB_FILTER_REJECT_LIST 0x00
+#define ESP_BLE_MESH_PROVISIONER_HB_FILTER_ACCEPT_LIST 0x01
+#define ESP_BLE_MESH_PROVISIONER_HB_FILTER_ADD 0x00
+#define ESP_BLE_MESH_PROVISIONER_HB_FILTER_REMOVE 0x01
+
+typedef enum {
+    ESP_BLE_MESH_PROV_REGISTER_COMP_EVT,
+    ESP_BLE_MESH_NODE_SET_UNPROV_DEV_NAME_COMP_EVT,
+    ESP_BLE_MESH_NODE_PROV_ENABLE_COMP_EVT,
+    ESP_BLE_MESH_NODE_PROV_DISABLE_COMP_EVT,
+    ESP_BLE_MESH_NODE_PROV_LINK_OPEN_EVT,
+    ESP_BLE_MESH_NODE_PROV_LINK_CLOSE_EVT,
+    ESP_BLE_MESH_NODE_PROV_COMPLETE_EVT,
+    ESP_BLE_MESH_NODE_PROV_RESET_EVT,
+    ESP_BLE_MESH_NODE_ADD_LOCAL_NET_KEY_COMP_EVT,
+    ESP_BLE_MESH_NODE_ADD_LOCAL_APP_KEY_COMP_EVT,
+    ESP_BLE_MESH_NODE_BIND_APP_KEY_TO_MODEL_COMP_EVT,
+    ESP_BLE_MESH_NODE_PROXY_IDENTITY_ENABLE_COMP_EVT,
+    ESP_BLE_MESH_PROVISIONER_PROV_ENABLE_COMP_EVT,
+    ESP_BLE_MESH_PROVISIONER_PROV_DISABLE_COMP_EVT,
+    ESP_BLE_MESH_PROVISIONER_RECV_UNPROV_ADV_PKT_EVT,
+    ESP_BLE_MESH_PROVISIONER_PROV_LINK_OPEN_EVT,
+    ESP_BLE_MESH_PROVISIONER_PROV_LINK_CLOSE_EVT,
+    ESP_BLE_MESH_PROVISIONER_PROV_COMPLETE_EVT,
+    ESP_BLE_MESH_PROVISIONER_ADD_UNPROV_DEV_COMP_EVT,
+    ESP_BLE_MESH_PROVISIONER_PROV_DEV_WITH_ADDR_COMP_EVT,
+    ESP_BLE_MESH_PROVISIONER_DELETE_DEV_COMP_EVT,
+    ESP_BLE_MESH_PROVISIONER_SET_DEV_UUID_MATCH_COMP_EVT,
+    ESP_BLE_MESH_PROVISIONER_SET_PROV_DATA_INFO_COMP_EVT,
+    ESP_BLE_MESH_PROVISIONER_SET_NODE_NAME_COMP_EVT,
+    ESP_BLE_MESH_PROVISIONER_ADD_LOCAL_APP_KEY_COMP_EVT,
+    ESP_BLE_MESH_PROVISIONER_BIND_APP_KEY_TO_MODEL_COMP_EVT,
+    ESP_BLE_MESH_PROVISIONER_ADD_LOCAL_NET_KEY_COMP_EVT,
+    ESP_BLE_MESH_PROVISIONER_UPDATE_LOCAL_NET_KEY_COMP_EVT,
+    ESP_BLE_MESH_PROVISIONER_DELETE_NODE_WITH_UUID_COMP_EVT,
+    ESP_BLE_MESH_PROVISIONER_DELETE_NODE_WITH_ADDR_COMP_EVT,
+    ESP_BLE_MESH_PROVISIONER_ENABLE_HEARTBEAT_RECV_COMP_EVT,
+    ESP_BLE_MESH_PROVISIONER_SET_HEARTBEAT_FILTER_TYPE_COMP_EVT,
+    ESP_BLE_MESH_PROVISIONER_SET_HEARTBEAT_FILTER_INFO_COMP_EVT,
+    ESP_BLE_MESH_PROVISIONER_RECV_HEARTBEAT_MESSAGE_EVT,
+    ESP_BLE_MESH_PROXY_CLIENT_RECV_ADV_PKT_EVT,
+    ESP_BLE_MESH_PROXY_CLIENT_CONNECTED_EVT,
+    ESP_BLE_MESH_PROXY_CLIENT_DISCONNECTED_EVT,
+    ESP_BLE_MESH_PROV_EVT_MAX,
+} esp_ble_mesh_prov_cb_event_t;
+
+typedef union {
+    struct { int err_code; } prov_register_comp;
+    struct { int err_code; } node_prov_enable_comp;
+    struct { int err_code; } node_prov_disable_comp;
+    struct { esp_ble_mesh_prov_bearer_t bearer; } node_prov_link_open;
+    struct { esp_ble_mesh_prov_bearer_t bearer; uint8_t reason; } node_prov_link_close;
+    struct { uint16_t net_idx; uint8_t net_key[16]; uint16_t addr; uint8_t flags; uint32_t iv_index; } node_prov_complete;
+    struct { uint8_t addr[6]; uint8_t addr_type; uint16_t net_idx; uint8_t net_id[8]; int8_t rssi; } proxy_client_recv_adv_pkt;
+    struct { int err_code; uint16_t net_idx; uint16_t app_idx; } node_add_app_key_comp;
+    struct { int err_code; uint16_t element_addr; uint16_t app_idx; uint16_t company_id; uint16_t model_id; } node_bind_app_key_to_model_comp;
+    struct { int err_code; } provisioner_prov_enable_comp;
+    struct { int err_code; } provisioner_prov_disable_comp;
+    struct {
+        uint8_t dev_uuid[16];
+        esp_ble_mesh_bd_addr_t addr;
+        esp_ble_mesh_addr_type_t addr_type;
+        uint16_t oob_info;
+        uint8_t adv_type;
+        esp_ble_mesh_prov_bearer_t bearer;
+        int8_t rssi;
+    } provisioner_recv_unprov_adv_pkt;
+    struct { esp_ble_mesh_prov_bearer_t bearer; } provisioner_prov_link_open;
+    struct { esp_ble_mesh_prov_bearer_t bearer; uint8_t reason; } provisioner_prov_link_close;
+    struct { uint16_t node_idx; esp_ble_mesh_octet16_t device_uuid; uint16_t unicast_addr; uint8_t element_num; uint16_t netkey_idx; } provisioner_prov_complete;
+    struct { int err_code; } provisioner_add_unprov_dev_comp;
+    struct { int err_code; } provisioner_prov_dev_with_addr_comp;
+    struct { int err_code; } provisioner_delete_dev_comp;
+    struct { int err_code; } provisioner_set_dev_uuid_match_comp;
+    struct { int err_code; uint16_t node_index; } provisioner_set_node_name_comp;
+    struct { int err_code; } provisioner_set_prov_data_info_comp;
+    struct { int err_code; uint16_t net_idx; uint16_t app_idx; } provisioner_add_app_key_comp;
+    struct { int err_code; } provisioner_bind_app_key_to_model_comp;
+    struct { int err_code; uint16_t net_idx; } provisioner_add_net_key_comp;
+    struct { int err_code; uint16_t net_idx; } provisioner_update_net_key_comp;
+    struct { int err_code; uint8_t uuid[16]; } provisioner_delete_node_with_uuid_comp;
+    struct { int err_code; uint16_t unicast_addr; } provisioner_delete_node_with_addr_comp;
+    struct { int err_code; bool enable; } provisioner_enable_heartbeat_recv_comp;
+    struct { int err_code; uint8_t type; } provisioner_set_heartbeat_filter_type_comp;
+    struct { int err_code; uint8_t op; uint16_t hb_src; uint16_t hb_dst; } provisioner_set_heartbeat_filter_info_comp;
+    struct { uint16_t hb_src; uint16_t hb_dst; uint8_t init_ttl; uint8_t rx_ttl; uint8_t hops; uint16_t feature; int8_t rssi; } provisioner_recv_heartbeat;
+} esp_ble_mesh_prov_cb_param_t;
+
+typedef void (*esp_ble_mesh_prov_cb_t)(esp_ble_mesh_prov_cb_event_t event, esp_ble_mesh_prov_cb_param_t *param);
+
+typedef struct {
+    esp_ble_mesh_opcode_t opcode;
+    esp_ble_mesh_model_t *model;
+    esp_ble_mesh_msg_ctx_t ctx;
+    int32_t msg_timeout;
+    uint8_t msg_role;
+} esp_ble_mesh_client_common_param_t;
+
+typedef struct {
+    uint16_t cid;
+    uint16_t pid;
+    uint16_t vid;
+    uint16_t crpl;
+    uint16_t features;
+} esp_ble_mesh_comp_data_hdr_stub_t;
+
+#define ESP_BLE_MESH_MODEL_OP_BEACON_GET ESP_BLE_MESH_MODEL_OP_2(0x80, 0x09)
+#define ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET ESP_BLE_MESH_MODEL_OP_2(0x80, 0x08)
+#define ESP_BLE_MESH_MODEL_OP_DEFAULT_TTL_GET ESP_BLE_MESH_MODEL_OP_2(0x80, 0x0C)
+#define ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD ESP_BLE_MESH_MODEL_OP_1(0x00)
+#define ESP_BLE_MESH_MODEL_OP_NET_KEY_ADD ESP_BLE_MESH_MODEL_OP_2(0x80, 0x40)
+#define ESP_BLE_MESH_MODEL_OP_NET_KEY_DELETE ESP_BLE_MESH_MODEL_OP_2(0x80, 0x41)
+#define ESP_BLE_MESH_MODEL_OP_APP_KEY_DELETE ESP_BLE_MESH_MODEL_OP_2(0x80, 0x00)
+#define ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND ESP_BLE_MESH_MODEL_OP_2(0x80, 0x3D)
+#define ESP_BLE_MESH_MODEL_OP_MODEL_APP_UNBIND ESP_BLE_MESH_MODEL_OP_2(0x80, 0x3F)
+#define ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD ESP_BLE_MESH_MODEL_OP_2(0x80, 0x1B)
+#define ESP_BLE_MESH_MODEL_OP_MODEL_PUB_SET ESP_BLE_MESH_MODEL_OP_1(0x03)
+#define ESP_BLE_MESH_MODEL_OP_HEARTBEAT_PUB_SET ESP_BLE_MESH_MODEL_OP_2(0x80, 0x39)
+#define ESP_BLE_MESH_MODEL_OP_HEARTBEAT_SUB_SET ESP_BLE_MESH_MODEL_OP_2(0x80, 0x3B)
+#define ESP_BLE_MESH_MODEL_OP_HEARTBEAT_SUB_GET ESP_BLE_MESH_MODEL_OP_2(0x80, 0x3A)
+#define ESP_BLE_MESH_MODEL_OP_NODE_RESET ESP_BLE_MESH_MODEL_OP_2(0x80, 0x49)
+#define ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_STATUS ESP_BLE_MESH_MODEL_OP_1(0x02)
+#define ESP_BLE_MESH_MODEL_OP_APP_KEY_STATUS ESP_BLE_MESH_MODEL_OP_2(0x80, 0x03)
+#define ESP_BLE_MESH_MODEL_OP_MODEL_APP_STATUS ESP_BLE_MESH_MODEL_OP_2(0x80, 0x3E)
+#define ESP_BLE_MESH_MODEL_OP_MODEL_SUB_STATUS ESP_BLE_MESH_MODEL_OP_2(0x80, 0x1F)
+#define ESP_BLE_MESH_MODEL_OP_NET_KEY_STATUS ESP_BLE_MESH_MODEL_OP_2(0x80, 0x44)
+#define ESP_BLE_MESH_MODEL_OP_HEARTBEAT_PUB_STATUS ESP_BLE_MESH_MODEL_OP_1(0x06)
+#define ESP_BLE_MESH_MODEL_OP_HEARTBEAT_SUB_STATUS ESP_BLE_MESH_MODEL_OP_2(0x80, 0x3C)
+#define ESP_BLE_MESH_MODEL_OP_MODEL_PUB_STATUS ESP_BLE_MESH_MODEL_OP_2(0x80, 0x19)
+
+#define ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_GET ESP_BLE_MESH_MODEL_OP_2(0x82, 0x01)
+#define ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_SET ESP_BLE_MESH_MODEL_OP_2(0x82, 0x02)
+#define ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_SET_UNACK ESP_BLE_MESH_MODEL_OP_2(0x82, 0x03)
+#define ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_STATUS ESP_BLE_MESH_MODEL_OP_2(0x82, 0x04)
+#define ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_GET ESP_BLE_MESH_MODEL_OP_2(0x82, 0x05)
+#define ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_SET ESP_BLE_MESH_MODEL_OP_2(0x82, 0x06)
+#define ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_SET_UNACK ESP_BLE_MESH_MODEL_OP_2(0x82, 0x07)
+#define ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_STATUS ESP_BLE_MESH_MODEL_OP_2(0x82, 0x08)
+#define ESP_BLE_MESH_MODEL_OP_GEN_DEF_TRANS_TIME_GET ESP_BLE_MESH_MODEL_OP_2(0x82, 0x0D)
+#define ESP_BLE_MESH_MODEL_OP_GEN_DEF_TRANS_TIME_SET ESP_BLE_MESH_MODEL_OP_2(0x82, 0x0E)
+#define ESP_BLE_MESH_MODEL_OP_GEN_DEF_TRANS_TIME_SET_UNACK ESP_BLE_MESH_MODEL_OP_2(0x82, 0x0F)
+#define ESP_BLE_MESH_MODEL_OP_GEN_DEF_TRANS_TIME_STATUS ESP_BLE_MESH_MODEL_OP_2(0x82, 0x10)
+#define ESP_BLE_MESH_MODEL_OP_GEN_POWER_LEVEL_GET ESP_BLE_MESH_MODEL_OP_2(0x82, 0x15)
+#define ESP_BLE_MESH_MODEL_OP_GEN_POWER_LEVEL_SET ESP_BLE_MESH_MODEL_OP_2(0x82, 0x16)
+#define ESP_BLE_MESH_MODEL_OP_GEN_POWER_LEVEL_SET_UNACK ESP_BLE_MESH_MODEL_OP_2(0x82, 0x17)
+#define ESP_BLE_MESH_MODEL_OP_GEN_POWER_LEVEL_STATUS ESP_BLE_MESH_MODEL_OP_2(0x82, 0x18)
+#define ESP_BLE_MESH_MODEL_OP_GEN_BATTERY_GET ESP_BLE_MESH_MODEL_OP_2(0x82, 0x23)
+#define ESP_BLE_MESH_MODEL_OP_GEN_BATTERY_STATUS ESP_BLE_MESH_MODEL_OP_2(0x82, 0x24)
+#define ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_GET ESP_BLE_MESH_MODEL_OP_2(0x82, 0x25)
+#define ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_STATUS ESP_BLE_MESH_MODEL_OP_1(0x40)
+#define ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_SET ESP_BLE_MESH_MODEL_OP_1(0x41)
+#define ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_SET_UNACK ESP_BLE_MESH_MODEL_OP_1(0x42)
+#define ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_GET ESP_BLE_MESH_MODEL_OP_2(0x82, 0x2F)
+#define ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_SET ESP_BLE_MESH_MODEL_OP_1(0x4C)
+#define ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_SET_UNACK ESP_BLE_MESH_MODEL_OP_1(0x4D)
+#define ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_STATUS ESP_BLE_MESH_MODEL_OP_1(0x4E)
+
+
+const char *bt_hex(const void *buf, size_t len);
+#ifndef MIN
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_ESP_BLE_MESH_DEFS_H
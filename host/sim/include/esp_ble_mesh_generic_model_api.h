@@ -0,0 +1,57 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_ESP_BLE_MESH_GENERIC_MODEL_API_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_ESP_BLE_MESH_GENERIC_MODEL_API_H
+
+// Generic client subset; the simulated nodes run the matching servers
+
+#include "esp_ble_mesh_defs.h"
+typedef struct { bool op_en; uint8_t onoff; uint8_t tid; uint8_t trans_time; uint8_t delay; } esp_ble_mesh_gen_onoff_set_t;
+typedef struct { bool op_en; int16_t level; uint8_t tid; uint8_t trans_time; uint8_t delay; } esp_ble_mesh_gen_level_set_t;
+typedef struct { uint8_t trans_time; } esp_ble_mesh_gen_def_trans_time_set_t;
+typedef struct { bool op_en; uint16_t power; uint8_t tid; uint8_t trans_time; uint8_t delay; } esp_ble_mesh_gen_power_level_set_t;
+typedef struct { int32_t global_latitude; int32_t global_longitude; int16_t global_altitude; } esp_ble_mesh_gen_loc_global_set_t;
+typedef struct { uint16_t property_id; struct net_buf_simple *property_value; } esp_ble_mesh_gen_user_property_set_t;
+typedef struct { uint16_t property_id; } esp_ble_mesh_gen_user_property_get_t;
+typedef union {
+    esp_ble_mesh_gen_onoff_set_t onoff_set;
+    esp_ble_mesh_gen_level_set_t level_set;
+    esp_ble_mesh_gen_def_trans_time_set_t def_trans_time_set;
+    esp_ble_mesh_gen_power_level_set_t power_level_set;
+    esp_ble_mesh_gen_loc_global_set_t loc_global_set;
+    esp_ble_mesh_gen_user_property_set_t user_property_set;
+} esp_ble_mesh_generic_client_set_state_t;
+typedef union {
+    esp_ble_mesh_gen_user_property_get_t user_property_get;
+} esp_ble_mesh_generic_client_get_state_t;
+typedef struct { bool op_en; uint8_t present_onoff; uint8_t target_onoff; uint8_t remain_time; } esp_ble_mesh_gen_onoff_status_cb_t;
+typedef struct { bool op_en; int16_t present_level; int16_t target_level; uint8_t remain_time; } esp_ble_mesh_gen_level_status_cb_t;
+typedef struct { uint8_t trans_time; } esp_ble_mesh_gen_def_trans_time_status_cb_t;
+typedef struct { bool op_en; uint16_t present_power; uint16_t target_power; uint8_t remain_time; } esp_ble_mesh_gen_power_level_status_cb_t;
+typedef struct { uint32_t battery_level : 8; uint32_t time_to_discharge : 24; uint32_t time_to_charge : 24; uint32_t flags : 8; } esp_ble_mesh_gen_battery_status_cb_t;
+typedef struct { int32_t global_latitude; int32_t global_longitude; int16_t global_altitude; } esp_ble_mesh_gen_loc_global_status_cb_t;
+typedef struct { bool op_en; uint16_t property_id; uint8_t user_access; struct net_buf_simple *property_value; } esp_ble_mesh_gen_user_property_status_cb_t;
+typedef union {
+    esp_ble_mesh_gen_onoff_status_cb_t onoff_status;
+    esp_ble_mesh_gen_level_status_cb_t level_status;
+    esp_ble_mesh_gen_def_trans_time_status_cb_t def_trans_time_status;
+    esp_ble_mesh_gen_power_level_status_cb_t power_level_status;
+    esp_ble_mesh_gen_battery_status_cb_t battery_status;
+    esp_ble_mesh_gen_loc_global_status_cb_t location_global_status;
+    esp_ble_mesh_gen_user_property_status_cb_t user_property_status;
+} esp_ble_mesh_gen_client_status_cb_t;
+typedef struct {
+    int error_code;
+    esp_ble_mesh_client_common_param_t *params;
+    esp_ble_mesh_gen_client_status_cb_t status_cb;
+} esp_ble_mesh_generic_client_cb_param_t;
+typedef enum {
+    ESP_BLE_MESH_GENERIC_CLIENT_GET_STATE_EVT,
+    ESP_BLE_MESH_GENERIC_CLIENT_SET_STATE_EVT,
+    ESP_BLE_MESH_GENERIC_CLIENT_PUBLISH_EVT,
+    ESP_BLE_MESH_GENERIC_CLIENT_TIMEOUT_EVT,
+    ESP_BLE_MESH_GENERIC_CLIENT_EVT_MAX,
+} esp_ble_mesh_generic_client_cb_event_t;
+typedef void (*esp_ble_mesh_generic_client_cb_t)(esp_ble_mesh_generic_client_cb_event_t event, esp_ble_mesh_generic_client_cb_param_t *param);
+esp_err_t esp_ble_mesh_register_generic_client_callback(esp_ble_mesh_generic_client_cb_t callback);
+esp_err_t esp_ble_mesh_generic_client_get_state(esp_ble_mesh_client_common_param_t *params, esp_ble_mesh_generic_client_get_state_t *get_state);
+esp_err_t esp_ble_mesh_generic_client_set_state(esp_ble_mesh_client_common_param_t *params, esp_ble_mesh_generic_client_set_state_t *set_state);
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_ESP_BLE_MESH_GENERIC_MODEL_API_H
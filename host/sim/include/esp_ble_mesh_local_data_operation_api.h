@@ -0,0 +1,10 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_ESP_BLE_MESH_LOCAL_DATA_OPERATION_API_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_ESP_BLE_MESH_LOCAL_DATA_OPERATION_API_H
+
+// Local data operations, the simulator implements AppKey add and binding for the node role
+
+#include "esp_ble_mesh_defs.h"
+esp_err_t esp_ble_mesh_node_add_local_app_key(const uint8_t app_key[16], uint16_t net_idx, uint16_t app_idx);
+esp_err_t esp_ble_mesh_node_bind_app_key_to_local_model(uint16_t element_addr, uint16_t company_id, uint16_t model_id, uint16_t app_idx);
+esp_err_t esp_ble_mesh_model_subscribe_group_addr(uint16_t element_addr, uint16_t company_id, uint16_t model_id, uint16_t group_addr);
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_ESP_BLE_MESH_LOCAL_DATA_OPERATION_API_H
@@ -0,0 +1,23 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_ESP_BLE_MESH_NETWORKING_API_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_ESP_BLE_MESH_NETWORKING_API_H
+
+// Provisioner networking calls, implemented in sim_mesh.c
+
+#include "esp_ble_mesh_defs.h"
+esp_err_t esp_ble_mesh_provisioner_set_node_name(uint16_t index, const char *name);
+const char *esp_ble_mesh_provisioner_get_node_name(uint16_t index);
+esp_err_t esp_ble_mesh_provisioner_add_local_app_key(const uint8_t app_key[16], uint16_t net_idx, uint16_t app_idx);
+const uint8_t *esp_ble_mesh_provisioner_get_local_app_key(uint16_t net_idx, uint16_t app_idx);
+esp_err_t esp_ble_mesh_provisioner_add_local_net_key(const uint8_t net_key[16], uint16_t net_idx);
+esp_err_t esp_ble_mesh_provisioner_update_local_net_key(const uint8_t net_key[16], uint16_t net_idx);
+esp_err_t esp_ble_mesh_provisioner_bind_app_key_to_local_model(uint16_t element_addr, uint16_t app_idx, uint16_t model_id, uint16_t company_id);
+esp_err_t esp_ble_mesh_provisioner_delete_node_with_uuid(const uint8_t uuid[16]);
+esp_err_t esp_ble_mesh_provisioner_delete_node_with_addr(uint16_t unicast_addr);
+esp_err_t esp_ble_mesh_provisioner_recv_heartbeat(bool enable);
+esp_err_t esp_ble_mesh_provisioner_set_heartbeat_filter_type(uint8_t type);
+esp_err_t esp_ble_mesh_provisioner_set_heartbeat_filter_info(uint8_t op, uint16_t hb_src, uint16_t hb_dst);
+uint16_t esp_ble_mesh_get_primary_element_address(void);
+esp_ble_mesh_node_t *esp_ble_mesh_provisioner_get_node_with_uuid(const uint8_t uuid[16]);
+uint16_t esp_ble_mesh_provisioner_get_prov_node_count(void);
+const esp_ble_mesh_node_t **esp_ble_mesh_provisioner_get_node_table_entry(void);
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_ESP_BLE_MESH_NETWORKING_API_H
@@ -0,0 +1,8 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_ESP_RANDOM_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_ESP_RANDOM_H
+
+// Seeded from the simulator command line so runs are repeatable
+
+#include <stdint.h>
+uint32_t esp_random(void);
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_ESP_RANDOM_H
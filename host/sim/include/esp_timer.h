@@ -0,0 +1,19 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_ESP_TIMER_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_ESP_TIMER_H
+
+// Timers run on virtual time, see sim_kernel.c
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+typedef struct esp_timer *esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+typedef enum { ESP_TIMER_TASK } esp_timer_dispatch_t;
+typedef struct { esp_timer_cb_t callback; void *arg; esp_timer_dispatch_t dispatch_method; const char *name; bool skip_unhandled_events; } esp_timer_create_args_t;
+int64_t esp_timer_get_time(void);
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out);
+esp_err_t esp_timer_start_once(esp_timer_handle_t t, uint64_t us);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t t, uint64_t us);
+esp_err_t esp_timer_stop(esp_timer_handle_t t);
+bool esp_timer_is_active(esp_timer_handle_t t);
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_ESP_TIMER_H
@@ -0,0 +1,40 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_FREERTOS_FREERTOS_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_FREERTOS_FREERTOS_H
+
+// FreeRTOS subset backed by the virtual time kernel in sim_kernel.c
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define pdPASS                  1
+#define pdFAIL                  0
+#define portMAX_DELAY           0xffffffffUL
+#define configTICK_RATE_HZ      CONFIG_FREERTOS_HZ
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000U))
+#define pdTICKS_TO_MS(t)        ((TickType_t)(((uint64_t)(t) * 1000U) / configTICK_RATE_HZ))
+#define portTICK_PERIOD_MS      (1000 / configTICK_RATE_HZ)
+#define tskNO_AFFINITY          0x7fffffff
+
+// Critical sections never block in virtual time, a host mutex is enough
+typedef struct {
+    pthread_mutex_t mutex;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    { PTHREAD_MUTEX_INITIALIZER }
+
+#define taskENTER_CRITICAL(m)   pthread_mutex_lock(&(m)->mutex)
+#define taskEXIT_CRITICAL(m)    pthread_mutex_unlock(&(m)->mutex)
+#define portENTER_CRITICAL(m)   taskENTER_CRITICAL(m)
+#define portEXIT_CRITICAL(m)    taskEXIT_CRITICAL(m)
+
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_FREERTOS_FREERTOS_H
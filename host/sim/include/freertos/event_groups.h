@@ -0,0 +1,14 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_FREERTOS_EVENT_GROUPS_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_FREERTOS_EVENT_GROUPS_H
+
+// Event groups on the virtual time kernel
+
+#include "freertos/FreeRTOS.h"
+typedef struct EventGroupDef_t *EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+EventGroupHandle_t xEventGroupCreate(void);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t g, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t g, EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t g);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t g, EventBits_t bits, BaseType_t clear, BaseType_t all, TickType_t wait);
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_FREERTOS_EVENT_GROUPS_H
@@ -0,0 +1,12 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_FREERTOS_QUEUE_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_FREERTOS_QUEUE_H
+
+// Queues on the virtual time kernel
+
+#include "freertos/FreeRTOS.h"
+typedef struct QueueDefinition *QueueHandle_t;
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q);
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_FREERTOS_QUEUE_H
@@ -0,0 +1,14 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_FREERTOS_SEMPHR_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_FREERTOS_SEMPHR_H
+
+// Semaphores and mutexes on the virtual time kernel
+
+#include "freertos/FreeRTOS.h"
+typedef struct QueueDefinition *SemaphoreHandle_t;
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s);
+void vSemaphoreDelete(SemaphoreHandle_t s);
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_FREERTOS_SEMPHR_H
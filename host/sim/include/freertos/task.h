@@ -0,0 +1,19 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_FREERTOS_TASK_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_FREERTOS_TASK_H
+
+// Tasks are host threads scheduled by the virtual time kernel
+
+#include "freertos/FreeRTOS.h"
+typedef struct tskTaskControlBlock *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *out);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *out, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelete(TaskHandle_t t);
+TickType_t xTaskGetTickCount(void);
+BaseType_t xTaskNotifyGive(TaskHandle_t t);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+#define tskIDLE_PRIORITY 0
+BaseType_t xPortGetCoreID(void);
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_FREERTOS_TASK_H
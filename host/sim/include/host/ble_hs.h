@@ -0,0 +1,17 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_HOST_BLE_HS_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_HOST_BLE_HS_H
+
+// NimBLE host stand-in, sync is reported as soon as the host task runs
+
+#include <assert.h>
+#include <stdint.h>
+typedef void ble_hs_reset_fn(int reason);
+typedef void ble_hs_sync_fn(void);
+struct ble_store_status_event;
+typedef int ble_store_status_fn(struct ble_store_status_event *event, void *arg);
+struct ble_hs_cfg { ble_hs_reset_fn *reset_cb; ble_hs_sync_fn *sync_cb; ble_store_status_fn *store_status_cb; };
+extern struct ble_hs_cfg ble_hs_cfg;
+int ble_hs_id_infer_auto(int privacy, uint8_t *out_addr_type);
+int ble_hs_id_copy_addr(uint8_t id_addr_type, uint8_t *out_id_addr, int *out_is_nrpa);
+int ble_store_util_status_rr(struct ble_store_status_event *event, void *arg);
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_HOST_BLE_HS_H
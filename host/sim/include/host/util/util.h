@@ -0,0 +1,7 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_HOST_UTIL_UTIL_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_HOST_UTIL_UTIL_H
+
+// NimBLE address helper stand-in
+
+int ble_hs_util_ensure_addr(int prefer_random);
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_HOST_UTIL_UTIL_H
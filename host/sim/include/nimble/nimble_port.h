@@ -0,0 +1,9 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_NIMBLE_NIMBLE_PORT_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_NIMBLE_NIMBLE_PORT_H
+
+// NimBLE port stand-in
+
+#include "esp_err.h"
+esp_err_t nimble_port_init(void);
+void nimble_port_run(void);
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_NIMBLE_NIMBLE_PORT_H
@@ -0,0 +1,10 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_NIMBLE_NIMBLE_PORT_FREERTOS_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_NIMBLE_NIMBLE_PORT_FREERTOS_H
+
+// NimBLE host task stand-in
+
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+void nimble_port_freertos_init(TaskFunction_t host_task_fn);
+void nimble_port_freertos_deinit(void);
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_NIMBLE_NIMBLE_PORT_FREERTOS_H
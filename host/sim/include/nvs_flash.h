@@ -0,0 +1,9 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_NVS_FLASH_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_NVS_FLASH_H
+
+// In-memory flash of the simulator, see sim_nvs_load() and sim_nvs_save()
+
+#include "nvs.h"
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_NVS_FLASH_H
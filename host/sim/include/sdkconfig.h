@@ -0,0 +1,24 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_SDKCONFIG_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_SDKCONFIG_H
+
+// Values mirrored from sdkconfig.esp32s3usbotg, except for the node limit which
+// is raised so the provisioner can hold a simulated fleet of up to 1000 nodes
+
+#define CONFIG_BLE_MESH_MAX_PROV_NODES                  1024
+#define CONFIG_BLE_MESH_ADV_BUF_COUNT                   60
+#define CONFIG_BLE_MESH_PBA_SAME_TIME                   2
+#define CONFIG_BLE_MESH_PBG_SAME_TIME                   1
+#define CONFIG_BLE_MESH_CLIENT_MSG_TIMEOUT              4000
+#define CONFIG_BLE_MESH_UNPROVISIONED_BEACON_INTERVAL   5
+#define CONFIG_BLE_MESH_PROVISIONER_SUBNET_COUNT        3
+#define CONFIG_BLE_MESH_PROVISIONER_APP_KEY_COUNT       3
+#define CONFIG_BLE_MESH_MODEL_KEY_COUNT                 3
+#define CONFIG_BLE_MESH_MODEL_GROUP_COUNT               3
+#define CONFIG_BLE_MESH_CRPL                            10
+#define CONFIG_BLE_MESH_TX_SEG_MAX                      32
+#define CONFIG_BLE_MESH_RX_SDU_MAX                      384
+#define CONFIG_BLE_MESH_AGG_CLI                         1
+#define CONFIG_BLE_MESH_PROVISIONER_RECV_HB             1
+#define CONFIG_FREERTOS_HZ                              100
+
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_SDKCONFIG_H
@@ -0,0 +1,115 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SIM_H
+#define DEZIBOT_BLUETOOTH_MESH_SIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Virtual time kernel. Every FreeRTOS task is a host thread; time only moves when
+// all of them are blocked, and then jumps to the earliest deadline or event.
+#define SIM_FOREVER     INT64_MAX
+
+typedef void (*sim_event_fn_t)(void *arg);
+
+// Registers the calling thread as the first task and starts the event task
+void sim_kernel_init(uint64_t seed);
+
+int64_t sim_now(void);
+
+// Runs fn(arg) on the event task once virtual time reaches at_us
+void sim_schedule(int64_t at_us, sim_event_fn_t fn, void *arg);
+
+// Uniform in [0, 1), from the seeded generator behind esp_random()
+double sim_random_unit(void);
+
+// Whether the caller runs on the event task, which stands in for the mesh stack's task
+bool sim_on_event_task(void);
+
+// Simulated mesh: the unprovisioned devices, the radio between them and us, and
+// the stack calls lib/ makes
+typedef struct {
+    uint32_t nodes;
+    uint8_t  elem_num;          // elements per node
+    bool     elem_mixed;        // node i has 1 + i % elem_num elements instead
+    double   loss;              // per advertising packet, 0 to 1
+    uint32_t latency_us;        // air to stack, jittered by up to half of it
+    uint32_t adv_bufs;          // local ADV buffer pool
+    uint32_t prov_us;           // PB-ADV provisioning duration without loss
+    uint32_t node_delay_us;     // node processing before it answers
+    double   agg;               // share of nodes with an Opcodes Aggregator Server
+    uint32_t strangers;         // devices of another fleet beaconing in range, with the same UUID prefix
+    uint8_t  max_hops;          // robots are placed up to max_hops hops away, relays in between
+    uint16_t node_net_idx;      // subnet, and AppKey index, the local node is provisioned and configured with
+} sim_mesh_config_t;
+
+typedef struct {
+    uint32_t pdus;              // network PDUs we put on air
+    uint32_t adv_full;          // sends refused for lack of ADV buffers
+    uint32_t adv_peak;
+    uint32_t busy;              // acked sends refused, request to that node outstanding
+    uint32_t delivered;         // access messages that reached a node
+    uint32_t lost;              // access messages lost on the way to a node
+    uint32_t replies;           // statuses that reached us
+    uint32_t replies_lost;
+    uint32_t timeouts;
+    uint32_t provisioned;
+    uint32_t prov_failed;
+    uint32_t prov_timeouts;     // failed links that held their slot until the transaction timeout
+    uint32_t beacons;           // unprovisioned device beacons reported to the provisioner
+    uint32_t out_of_reach;      // access messages whose TTL ran out before the node
+    uint32_t relayed;           // network PDUs relays put on air for our messages
+    uint32_t heartbeats;        // published by the robots
+    uint32_t hb_relayed;        // heartbeat PDUs relays put on air
+    uint32_t callbacks;         // provisioning, config and aggregator client callbacks the stack invoked
+    uint64_t dwell_ns;          // wall clock spent in them, virtual time stands still meanwhile
+    uint64_t dwell_max_ns;
+} sim_mesh_stats_t;
+
+void sim_mesh_init(const sim_mesh_config_t *config);
+
+void sim_mesh_get_stats(sim_mesh_stats_t *stats);
+
+// UUID of the index-th device, strangers follow the nodes. False past the end.
+bool sim_mesh_get_uuid(uint32_t index, uint8_t uuid[16]);
+
+// Factory resets the device holding the address: it drops its keys and beacons
+// again under the same UUID while the stack keeps its record. False when no
+// provisioned device has the address.
+bool sim_mesh_reset_node(uint16_t unicast);
+
+// Switches the robot holding the address off for good: it neither answers, relays nor
+// sends heartbeats, and robots reached through it only may drop out of reach. False
+// when no provisioned robot has the address.
+bool sim_mesh_power_off(uint16_t unicast);
+
+// Whether two provisioned robots, or a robot and the provisioner at its own address,
+// are powered and in radio range of each other
+bool sim_mesh_linked(uint16_t a, uint16_t b);
+
+// Pairs of sim_mesh_linked() nodes, the provisioner included
+uint32_t sim_mesh_links(void);
+
+// Highest unicast address the stack ever assigned
+uint16_t sim_mesh_addr_high(void);
+
+// Set messages a node applied, duplicates dropped by its TID check excluded
+uint32_t sim_mesh_node_sets(uint16_t unicast);
+
+// Generic OnOff state of the element at the address. False when no provisioned robot
+// has the address.
+bool sim_mesh_node_onoff(uint16_t unicast, uint8_t *onoff);
+
+// Primary addresses of the nodes holding an AppKey, ascending, returns the count. What
+// a device without the provisioner knows about the fleet comes from elsewhere.
+size_t sim_mesh_get_nodes(uint16_t *addrs, size_t max);
+
+// Fleet and stack node database of a previous run, for warm starts. Loading
+// fails when the node count or element layout differ. Call after sim_mesh_init().
+bool sim_mesh_load(const char *path);
+bool sim_mesh_save(const char *path);
+
+// Flash contents of a previous run
+bool sim_nvs_load(const char *path);
+bool sim_nvs_save(const char *path);
+
+#endif //DEZIBOT_BLUETOOTH_MESH_SIM_H
@@ -0,0 +1,796 @@
+// Virtual time kernel behind the FreeRTOS and esp_timer stand-ins.
+//
+// Tasks are host threads, but at most the tasks marked running make progress in
+// virtual time: a task blocking on a semaphore, notification, delay or queue
+// gives up its running slot, and when the last running task blocks the clock
+// jumps to the earliest deadline among blocked tasks. Every give wakes all
+// blocked tasks, which re-check their condition and block again if it still
+// does not hold. CPU time of lib/ code is therefore free, only the radio and
+// timers consume virtual time.
+
+#include "sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#define SIM_TASKS_MAX   32
+#define SIM_TICK_US     (1000000 / configTICK_RATE_HZ)
+
+struct tskTaskControlBlock {
+    bool used;
+    bool blocked;
+    int64_t deadline;
+    uint32_t notify;
+    pthread_cond_t cond;
+    TaskFunction_t fn;
+    void *arg;
+    const char *name;
+};
+
+struct QueueDefinition {
+    UBaseType_t count;
+    UBaseType_t max;
+    // Queues only, count is then the number of items stored
+    UBaseType_t item_size;
+    UBaseType_t head;
+    uint8_t *items;
+};
+
+struct EventGroupDef_t {
+    EventBits_t bits;
+};
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    bool active;
+    uint32_t gen;
+    uint64_t period_us;
+};
+
+typedef struct {
+    int64_t at_us;
+    uint64_t seq;
+    sim_event_fn_t fn;
+    void *arg;
+} sim_event_t;
+
+typedef struct {
+    esp_timer_handle_t timer;
+    uint32_t gen;
+} sim_timer_fire_t;
+
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static int64_t sim_now_us;
+static int sim_running;
+static struct tskTaskControlBlock sim_tasks[SIM_TASKS_MAX];
+static __thread struct tskTaskControlBlock *sim_self;
+
+static sim_event_t *event_heap;
+static size_t event_count;
+static size_t event_capacity;
+static uint64_t event_seq;
+static TaskHandle_t event_task;
+
+static pthread_mutex_t random_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t random_state;
+
+static void sim_wake_locked(struct tskTaskControlBlock *task)
+{
+    if (task->used && task->blocked)
+    {
+        task->blocked = false;
+        sim_running++;
+        pthread_cond_signal(&task->cond);
+    }
+}
+
+static void sim_wake_all_locked(void)
+{
+    for (int i = 0; i < SIM_TASKS_MAX; i++)
+    {
+        sim_wake_locked(&sim_tasks[i]);
+    }
+}
+
+// Called with no task running, moves the clock to the next deadline
+static void sim_advance_locked(void)
+{
+    int64_t next = SIM_FOREVER;
+
+    for (int i = 0; i < SIM_TASKS_MAX; i++)
+    {
+        if (sim_tasks[i].used && sim_tasks[i].blocked && sim_tasks[i].deadline < next)
+        {
+            next = sim_tasks[i].deadline;
+        }
+    }
+
+    if (next == SIM_FOREVER)
+    {
+        fprintf(stderr, "sim: deadlock at %.3f s, every task waits forever\n", sim_now_us / 1e6);
+        for (int i = 0; i < SIM_TASKS_MAX; i++)
+        {
+            if (sim_tasks[i].used)
+            {
+                fprintf(stderr, "sim:   task %s\n", sim_tasks[i].name);
+            }
+        }
+        exit(3);
+    }
+
+    if (next > sim_now_us)
+    {
+        sim_now_us = next;
+    }
+
+    for (int i = 0; i < SIM_TASKS_MAX; i++)
+    {
+        if (sim_tasks[i].used && sim_tasks[i].blocked && sim_tasks[i].deadline <= sim_now_us)
+        {
+            sim_wake_locked(&sim_tasks[i]);
+        }
+    }
+}
+
+// Blocks the calling task until it is woken or the deadline passed, sim_lock held
+static void sim_wait_locked(int64_t deadline)
+{
+    struct tskTaskControlBlock *self = sim_self;
+
+    if (deadline <= sim_now_us)
+    {
+        return;
+    }
+
+    self->blocked = true;
+    self->deadline = deadline;
+    if (--sim_running == 0)
+    {
+        sim_advance_locked();
+    }
+
+    while (self->blocked)
+    {
+        pthread_cond_wait(&self->cond, &sim_lock);
+    }
+}
+
+static int64_t sim_deadline_locked(TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        return SIM_FOREVER;
+    }
+
+    return sim_now_us + (int64_t)ticks * SIM_TICK_US;
+}
+
+static bool event_before(const sim_event_t *a, const sim_event_t *b)
+{
+    return a->at_us < b->at_us || (a->at_us == b->at_us && a->seq < b->seq);
+}
+
+static void event_push_locked(sim_event_t event)
+{
+    size_t pos = event_count++;
+
+    if (event_count > event_capacity)
+    {
+        event_capacity = event_capacity ? event_capacity * 2 : 256;
+        event_heap = realloc(event_heap, event_capacity * sizeof(event_heap[0]));
+        if (!event_heap)
+        {
+            abort();
+        }
+    }
+
+    while (pos > 0 && event_before(&event, &event_heap[(pos - 1) / 2]))
+    {
+        event_heap[pos] = event_heap[(pos - 1) / 2];
+        pos = (pos - 1) / 2;
+    }
+    event_heap[pos] = event;
+}
+
+static sim_event_t event_pop_locked(void)
+{
+    sim_event_t top = event_heap[0];
+    sim_event_t last = event_heap[--event_count];
+    size_t pos = 0;
+
+    for (;;)
+    {
+        size_t child = pos * 2 + 1;
+        if (child >= event_count)
+        {
+            break;
+        }
+        if (child + 1 < event_count && event_before(&event_heap[child + 1], &event_heap[child]))
+        {
+            child++;
+        }
+        if (!event_before(&event_heap[child], &last))
+        {
+            break;
+        }
+        event_heap[pos] = event_heap[child];
+        pos = child;
+    }
+    event_heap[pos] = last;
+
+    return top;
+}
+
+// Plays the role of both the esp_timer task and the mesh stack's task
+static void sim_event_task(void *arg)
+{
+    pthread_mutex_lock(&sim_lock);
+    for (;;)
+    {
+        while (!event_count || event_heap[0].at_us > sim_now_us)
+        {
+            sim_wait_locked(event_count ? event_heap[0].at_us : SIM_FOREVER);
+        }
+
+        sim_event_t event = event_pop_locked();
+        pthread_mutex_unlock(&sim_lock);
+        event.fn(event.arg);
+        pthread_mutex_lock(&sim_lock);
+    }
+}
+
+void sim_schedule(int64_t at_us, sim_event_fn_t fn, void *arg)
+{
+    pthread_mutex_lock(&sim_lock);
+    if (at_us < sim_now_us)
+    {
+        at_us = sim_now_us;
+    }
+    event_push_locked((sim_event_t) { .at_us = at_us, .seq = event_seq++, .fn = fn, .arg = arg });
+    if (event_task->blocked && at_us < event_task->deadline)
+    {
+        sim_wake_locked(event_task);
+    }
+    pthread_mutex_unlock(&sim_lock);
+}
+
+bool sim_on_event_task(void)
+{
+    return sim_self == event_task;
+}
+
+int64_t sim_now(void)
+{
+    int64_t now;
+
+    pthread_mutex_lock(&sim_lock);
+    now = sim_now_us;
+    pthread_mutex_unlock(&sim_lock);
+
+    return now;
+}
+
+static void *sim_task_main(void *arg)
+{
+    sim_self = arg;
+    sim_self->fn(sim_self->arg);
+    vTaskDelete(NULL);
+
+    return NULL;
+}
+
+void sim_kernel_init(uint64_t seed)
+{
+    random_state = seed ? seed : 1;
+
+    pthread_mutex_lock(&sim_lock);
+    sim_self = &sim_tasks[0];
+    sim_self->used = true;
+    sim_self->name = "main";
+    pthread_cond_init(&sim_self->cond, NULL);
+    sim_running = 1;
+    pthread_mutex_unlock(&sim_lock);
+
+    if (xTaskCreate(sim_event_task, "sim_event", 0, NULL, 0, &event_task) != pdPASS)
+    {
+        abort();
+    }
+}
+
+uint32_t esp_random(void)
+{
+    uint64_t x;
+
+    // xorshift64*
+    pthread_mutex_lock(&random_lock);
+    x = random_state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    random_state = x;
+    pthread_mutex_unlock(&random_lock);
+
+    return (x * 0x2545F4914F6CDD1DULL) >> 32;
+}
+
+double sim_random_unit(void)
+{
+    return esp_random() / 4294967296.0;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *out, BaseType_t core)
+{
+    struct tskTaskControlBlock *task = NULL;
+    pthread_t thread;
+
+    pthread_mutex_lock(&sim_lock);
+    for (int i = 0; i < SIM_TASKS_MAX && !task; i++)
+    {
+        if (!sim_tasks[i].used)
+        {
+            task = &sim_tasks[i];
+        }
+    }
+    if (!task)
+    {
+        pthread_mutex_unlock(&sim_lock);
+        return pdFAIL;
+    }
+
+    memset(task, 0, sizeof(*task));
+    pthread_cond_init(&task->cond, NULL);
+    task->used = true;
+    task->fn = fn;
+    task->arg = arg;
+    task->name = name;
+    sim_running++;
+    if (out)
+    {
+        *out = task;
+    }
+    pthread_mutex_unlock(&sim_lock);
+
+    if (pthread_create(&thread, NULL, sim_task_main, task))
+    {
+        abort();
+    }
+    pthread_detach(thread);
+
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                       UBaseType_t prio, TaskHandle_t *out)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack, arg, prio, out, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    // Tasks in lib/ only ever delete themselves
+    if (task && task != sim_self)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&sim_lock);
+    sim_self->used = false;
+    if (--sim_running == 0)
+    {
+        sim_advance_locked();
+    }
+    pthread_mutex_unlock(&sim_lock);
+
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    pthread_mutex_lock(&sim_lock);
+    int64_t deadline = sim_deadline_locked(ticks);
+    while (sim_now_us < deadline)
+    {
+        sim_wait_locked(deadline);
+    }
+    pthread_mutex_unlock(&sim_lock);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return sim_now() / SIM_TICK_US;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return sim_self;
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+    return 0;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&sim_lock);
+    task->notify++;
+    sim_wake_locked(task);
+    pthread_mutex_unlock(&sim_lock);
+
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+    uint32_t value;
+
+    pthread_mutex_lock(&sim_lock);
+    int64_t deadline = sim_deadline_locked(wait);
+    while (!sim_self->notify && sim_now_us < deadline)
+    {
+        sim_wait_locked(deadline);
+    }
+    value = sim_self->notify;
+    if (value)
+    {
+        sim_self->notify = clear ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&sim_lock);
+
+    return value;
+}
+
+static SemaphoreHandle_t semaphore_create(UBaseType_t max, UBaseType_t initial)
+{
+    struct QueueDefinition *sem = calloc(1, sizeof(*sem));
+
+    if (sem)
+    {
+        sem->max = max;
+        sem->count = initial;
+    }
+
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return semaphore_create(1, 0);
+}
+
+// Mutexes are binary semaphores here, priority inheritance means nothing in virtual time
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return semaphore_create(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    return semaphore_create(max, initial);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait)
+{
+    BaseType_t taken = pdFALSE;
+
+    pthread_mutex_lock(&sim_lock);
+    int64_t deadline = sim_deadline_locked(wait);
+    while (!sem->count && sim_now_us < deadline)
+    {
+        sim_wait_locked(deadline);
+    }
+    if (sem->count)
+    {
+        sem->count--;
+        taken = pdTRUE;
+    }
+    pthread_mutex_unlock(&sim_lock);
+
+    return taken;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    BaseType_t given = pdFALSE;
+
+    pthread_mutex_lock(&sim_lock);
+    if (sem->count < sem->max)
+    {
+        sem->count++;
+        given = pdTRUE;
+        sim_wake_all_locked();
+    }
+    pthread_mutex_unlock(&sim_lock);
+
+    return given;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    free(sem);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size)
+{
+    struct QueueDefinition *queue = calloc(1, sizeof(*queue));
+
+    if (!queue)
+    {
+        return NULL;
+    }
+
+    queue->items = calloc(len, item_size);
+    if (!queue->items)
+    {
+        free(queue);
+        return NULL;
+    }
+    queue->max = len;
+    queue->item_size = item_size;
+
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+    BaseType_t sent = pdFALSE;
+
+    pthread_mutex_lock(&sim_lock);
+    int64_t deadline = sim_deadline_locked(wait);
+    while (queue->count == queue->max && sim_now_us < deadline)
+    {
+        sim_wait_locked(deadline);
+    }
+    if (queue->count < queue->max)
+    {
+        UBaseType_t tail = (queue->head + queue->count) % queue->max;
+        memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+        queue->count++;
+        sent = pdTRUE;
+        sim_wake_all_locked();
+    }
+    pthread_mutex_unlock(&sim_lock);
+
+    return sent;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+    BaseType_t received = pdFALSE;
+
+    pthread_mutex_lock(&sim_lock);
+    int64_t deadline = sim_deadline_locked(wait);
+    while (!queue->count && sim_now_us < deadline)
+    {
+        sim_wait_locked(deadline);
+    }
+    if (queue->count)
+    {
+        memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+        queue->head = (queue->head + 1) % queue->max;
+        queue->count--;
+        received = pdTRUE;
+        sim_wake_all_locked();
+    }
+    pthread_mutex_unlock(&sim_lock);
+
+    return received;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    UBaseType_t count;
+
+    pthread_mutex_lock(&sim_lock);
+    count = queue->count;
+    pthread_mutex_unlock(&sim_lock);
+
+    return count;
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return calloc(1, sizeof(struct EventGroupDef_t));
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    EventBits_t value;
+
+    pthread_mutex_lock(&sim_lock);
+    group->bits |= bits;
+    value = group->bits;
+    sim_wake_all_locked();
+    pthread_mutex_unlock(&sim_lock);
+
+    return value;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    EventBits_t value;
+
+    pthread_mutex_lock(&sim_lock);
+    value = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&sim_lock);
+
+    return value;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    EventBits_t value;
+
+    pthread_mutex_lock(&sim_lock);
+    value = group->bits;
+    pthread_mutex_unlock(&sim_lock);
+
+    return value;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear,
+                                BaseType_t all, TickType_t wait)
+{
+    EventBits_t value;
+
+    pthread_mutex_lock(&sim_lock);
+    int64_t deadline = sim_deadline_locked(wait);
+    for (;;)
+    {
+        value = group->bits;
+        bool met = all ? (value & bits) == bits : (value & bits) != 0;
+        if (met)
+        {
+            if (clear)
+            {
+                group->bits &= ~bits;
+            }
+            break;
+        }
+        if (sim_now_us >= deadline)
+        {
+            break;
+        }
+        sim_wait_locked(deadline);
+    }
+    pthread_mutex_unlock(&sim_lock);
+
+    return value;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return sim_now();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out)
+{
+    esp_timer_handle_t timer;
+
+    if (!args || !args->callback || !out)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    timer = calloc(1, sizeof(*timer));
+    if (!timer)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    *out = timer;
+
+    return ESP_OK;
+}
+
+static void timer_fire(void *arg)
+{
+    sim_timer_fire_t *fire = arg;
+    esp_timer_handle_t timer = fire->timer;
+    bool run = false;
+
+    // A stop or restart since scheduling bumped the generation
+    pthread_mutex_lock(&sim_lock);
+    if (timer->active && timer->gen == fire->gen)
+    {
+        run = true;
+        if (!timer->period_us)
+        {
+            timer->active = false;
+        }
+    }
+    pthread_mutex_unlock(&sim_lock);
+
+    if (run && timer->period_us)
+    {
+        sim_schedule(sim_now() + timer->period_us, timer_fire, fire);
+    }
+    else
+    {
+        free(fire);
+    }
+
+    if (run)
+    {
+        timer->callback(timer->arg);
+    }
+}
+
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us)
+{
+    sim_timer_fire_t *fire = malloc(sizeof(*fire));
+    int64_t at_us;
+
+    if (!fire)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    pthread_mutex_lock(&sim_lock);
+    if (timer->active)
+    {
+        pthread_mutex_unlock(&sim_lock);
+        free(fire);
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = true;
+    timer->period_us = period_us;
+    fire->timer = timer;
+    fire->gen = ++timer->gen;
+    at_us = sim_now_us + timeout_us;
+    pthread_mutex_unlock(&sim_lock);
+
+    sim_schedule(at_us, timer_fire, fire);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    return timer_start(timer, period_us, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    esp_err_t err = ESP_OK;
+
+    pthread_mutex_lock(&sim_lock);
+    if (!timer->active)
+    {
+        err = ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    timer->gen++;
+    pthread_mutex_unlock(&sim_lock);
+
+    return err;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    bool active;
+
+    pthread_mutex_lock(&sim_lock);
+    active = timer->active;
+    pthread_mutex_unlock(&sim_lock);
+
+    return active;
+}
@@ -0,0 +1,959 @@
+// Fleet simulator: runs lib/'s provisioner and client against a simulated mesh of
+// virtual robots in virtual time, then reports time-to-operational, command
+// latency and throughput, and what commanding the fleet costs through unicast
+// versus group sends
+//
+// Usage: fleet_sim [--nodes N] [--loss P] [--latency-ms MS] [--adv-bufs N]
+//                  [--prov-ms MS] [--elements N] [--mixed-elements] [--agg P] [--strangers N] [--hops N]
+//                  [--commands N] [--reset N] [--topology S] [--fade N] [--seed S]
+//                  [--state PREFIX] [--self-prov] [--client-only] [--teams N] [--metrics]
+//                  [--trace FILE] [-v]
+//
+// --mixed-elements gives robot i 1 + i % N elements instead of N, so the provisioner
+// cannot go by the last robot's count when it reserves addresses
+//
+// --agg is the share of nodes with an Opcodes Aggregator Server, configured through
+// aggregated sequences instead of one message per step
+//
+// --strangers adds N devices of another fleet in range; they carry the fleet's UUID
+// prefix but are not on the provisioner's allowlist
+//
+// --hops places the robots up to N hops away, each within radio range of one placed
+// before; a message only reaches those its TTL covers and every relay within reach
+// floods it on
+//
+// --reset factory resets N robots at the end; the first half is removed from the
+// provisioner before, the others come back unannounced
+//
+// --topology idles S seconds at the end while the provisioner maps the fleet from
+// heartbeats, --fade switches N robots off as that starts. The map is then checked
+// against the robots' positions.
+//
+// --state keeps the fleet and the provisioner's flash in PREFIX.mesh and PREFIX.nvs,
+// a second run with the same PREFIX then measures the warm start
+//
+// --self-prov stores network credentials before the client starts, which then
+// provisions and configures itself instead of waiting for the provisioner
+//
+// --client-only runs the client on a robot of its own against the fleet saved with
+// --state, without the provisioner: it only knows the nodes from what it hears. Implies
+// --self-prov; the saved state is left as it was.
+//
+// --teams splits the robots into N teams, robot i joins team i % N; each team gets
+// its own subnet, AppKey and group address, the acked group command goes to each
+//
+// --trace writes the trace records still in the ring at the end to FILE, in the
+// format host/trace_decode reads
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim.h"
+
+#include "boot_profile.h"
+#include "client.h"
+#include "init.h"
+#include "lifecycle.h"
+#include "metrics.h"
+#include "peer_dir.h"
+#include "provisioner.h"
+#include "self_prov.h"
+#include "trace.h"
+
+#define TAG                 "FLEET_SIM"
+
+#define SIM_GROUP_ADDR      0xC000
+#define SIM_WINDOW          16      // acked commands outstanding at once
+#define SIM_POLL_MS         500
+#define SIM_SETTLE_MS       10000   // let retries and repeats finish between phases
+
+typedef struct {
+    uint32_t nodes;
+    uint32_t commands;
+    uint32_t reset;
+    uint32_t topology_s;
+    uint32_t fade;
+    uint64_t seed;
+    const char *state;
+    bool self_prov;
+    bool client_only;
+    uint8_t teams;
+    bool metrics;
+    const char *trace;
+} sim_options_t;
+
+static SemaphoreHandle_t window;
+static int64_t *latencies;
+static uint32_t completed;
+static uint32_t failed;
+
+static int compare_latency(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static double percentile_ms(const int64_t *sorted, size_t count, double p)
+{
+    if (!count)
+    {
+        return 0;
+    }
+
+    return sorted[(size_t)(p * (count - 1))] / 1000.0;
+}
+
+static void command_done(const ble_mesh_client_result_t *result, void *arg)
+{
+    int64_t sent_us = (int64_t)(intptr_t)arg;
+
+    if (result->err == ESP_OK)
+    {
+        latencies[completed++] = sim_now() - sent_us;
+    }
+    else
+    {
+        failed++;
+    }
+    xSemaphoreGive(window);
+}
+
+// Virtual time each lifecycle bit of the local client was last set at
+static int64_t lifecycle_at_us[4];
+
+static void lifecycle_changed(EventBits_t set, EventBits_t cleared, void *arg)
+{
+    for (int i = 0; i < ARRAY_SIZE(lifecycle_at_us); i++)
+    {
+        if (set & (1 << i))
+        {
+            lifecycle_at_us[i] = sim_now();
+        }
+    }
+}
+
+static void report_lifecycle(void)
+{
+    char bits[64];
+
+    ble_mesh_boot_span_t spans[BOOT_PHASE_COUNT];
+
+    ble_mesh_boot_begin(BOOT_READY);
+    if (ble_mesh_lifecycle_wait(LIFECYCLE_READY, SIM_SETTLE_MS) != ESP_OK)
+    {
+        printf("lifecycle: client not ready, %s\n", ble_mesh_lifecycle_str(ble_mesh_lifecycle_get(), bits, sizeof(bits)));
+        return;
+    }
+    ble_mesh_boot_end(BOOT_READY);
+    printf("lifecycle: stack up at %.1f ms, provisioned at %.1f ms, AppKey at %.1f ms, models bound at %.1f ms\n",
+           lifecycle_at_us[0] / 1e3, lifecycle_at_us[1] / 1e3, lifecycle_at_us[2] / 1e3, lifecycle_at_us[3] / 1e3);
+
+    ble_mesh_boot_get(spans);
+    printf("boot: host synced at %.1f ms, provisioner stack up at %.1f ms, client stack up at %.1f ms, "
+           "client ready at %.1f ms\n", spans[BOOT_HOST_SYNC].end_us / 1e3, spans[BOOT_PROVISIONER].end_us / 1e3,
+           spans[BOOT_CLIENT].end_us / 1e3, spans[BOOT_READY].end_us / 1e3);
+}
+
+// The client shares the provisioner's device and with it the primary address. On a robot
+// of its own it takes the address the provisioner is not using.
+static void store_credentials(uint8_t client_team)
+{
+    ble_mesh_credentials_t creds = {
+        .net_idx = BLE_MESH_TEAM_NET_IDX(client_team),
+        .app_idx = BLE_MESH_TEAM_APP_IDX(client_team),
+        .addr = 0x0001,
+    };
+
+    memset(creds.net_key, 0x11, sizeof(creds.net_key));
+    memset(creds.app_key, 0x12, sizeof(creds.app_key));
+    ESP_ERROR_CHECK(ble_mesh_self_prov_store(&creds));
+}
+
+static void wait_operational(uint32_t nodes)
+{
+    ble_mesh_provisioner_fleet_stats_t fleet = {};
+    int64_t start = sim_now();
+    // Generous bound: every node gets a few provisioning attempts one link at a time
+    int64_t deadline = start + (int64_t)nodes * 20 * 1000000 + 60 * 1000000LL;
+
+    while (sim_now() < deadline)
+    {
+        ble_mesh_provisioner_get_fleet_stats(&fleet);
+        if (fleet.operational + fleet.failed >= nodes)
+        {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(SIM_POLL_MS));
+    }
+
+    printf("provisioning: %u/%u operational, %u failed in %.1f s, %u config retries\n",
+           fleet.operational, nodes, fleet.failed, (sim_now() - start) / 1e6, fleet.retries);
+    printf("  time to operational: avg %u ms, max %u ms\n", fleet.ttop_avg_ms, fleet.ttop_max_ms);
+    printf("  restored from flash: %u nodes, boot to all operational: %u ms\n", fleet.restored,
+           fleet.boot_ready_ms);
+}
+
+static void report_ttop(uint16_t *addrs, size_t count)
+{
+    int64_t *ttop = calloc(count ? count : 1, sizeof(*ttop));
+
+    if (!ttop)
+    {
+        abort();
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        ttop[i] = ble_mesh_provisioner_time_to_operational(addrs[i]) * 1000LL;
+    }
+    qsort(ttop, count, sizeof(*ttop), compare_latency);
+    printf("  time to operational: p50 %.0f ms, p90 %.0f ms, p99 %.0f ms\n", percentile_ms(ttop, count, 0.5),
+           percentile_ms(ttop, count, 0.9), percentile_ms(ttop, count, 0.99));
+    free(ttop);
+}
+
+static void report_path(const char *name, const ble_mesh_provisioner_path_stats_t *path)
+{
+    if (path->nodes)
+    {
+        printf("  %-10s %u nodes, %.1f round trips and %u ms to operational per node\n", name, path->nodes,
+               (double)path->round_trips / path->nodes, path->config_ms / path->nodes);
+    }
+}
+
+// Only nodes configured during this run are counted, a warm start reports none
+static void report_config_paths(void)
+{
+    ble_mesh_provisioner_fleet_stats_t fleet;
+
+    ble_mesh_provisioner_get_fleet_stats(&fleet);
+    report_path("aggregated", &fleet.aggregated);
+    report_path("chain", &fleet.chain);
+}
+
+static esp_err_t wait_acked(esp_err_t err, const ble_mesh_client_handle_t *handle)
+{
+    ble_mesh_client_result_t result;
+
+    if (err == ESP_OK)
+    {
+        err = ble_mesh_client_wait(*handle, SIM_SETTLE_MS, &result);
+    }
+    if (err == ESP_OK)
+    {
+        err = result.err;
+    }
+
+    return err;
+}
+
+// The client has no composition data to go by. It takes the element to lack the Battery
+// Server once its OnOff Server answered and battery gets time out often enough in a row.
+static esp_err_t probe_battery(uint16_t addr)
+{
+    ble_mesh_client_handle_t handle;
+    esp_err_t err;
+
+    for (int i = 0; i < 5; i++)
+    {
+        err = ble_mesh_client_send_acked(0, addr, NULL, NULL, &handle);
+        if (wait_acked(err, &handle) == ESP_OK)
+        {
+            break;
+        }
+    }
+    for (int i = 0; i < PEER_DIR_SILENT_MAX; i++)
+    {
+        err = ble_mesh_client_send_battery_acked(addr, NULL, NULL, &handle);
+        wait_acked(err, &handle);
+    }
+
+    return ble_mesh_client_send_battery(0, addr);
+}
+
+// Capability index built from the composition data, the secondary elements only
+// have OnOff and Level servers. Without the provisioner only the client's probe is left,
+// with mixed element counts addrs[0] + 1 may be the next robot's primary element.
+static void report_models(const uint16_t *addrs, size_t count, uint8_t elem_num, bool mixed, bool provisioner)
+{
+    size_t max = count * elem_num;
+    uint16_t *elems = calloc(max ? max : 1, sizeof(*elems));
+    const char *sep = "";
+
+    if (!elems)
+    {
+        abort();
+    }
+    printf("  models:");
+    if (provisioner)
+    {
+        size_t onoff = ble_mesh_provisioner_get_nodes_with_model(ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_SRV, elems, max);
+        size_t battery = ble_mesh_provisioner_get_nodes_with_model(ESP_BLE_MESH_MODEL_ID_GEN_BATTERY_SRV, elems, max);
+
+        printf(" %u OnOff servers, %u Battery servers", (unsigned)onoff, (unsigned)battery);
+        sep = ",";
+    }
+    if (count && elem_num > 1 && !mixed)
+    {
+        printf("%s battery get to a secondary element: %s", sep,
+               esp_err_to_name(probe_battery(addrs[0] + 1)));
+    }
+    printf("\n");
+    free(elems);
+}
+
+static void run_acked(const uint16_t *addrs, size_t count, uint32_t commands)
+{
+    int64_t start = sim_now();
+    double seconds;
+
+    latencies = calloc(commands ? commands : 1, sizeof(*latencies));
+    window = xSemaphoreCreateCounting(SIM_WINDOW, SIM_WINDOW);
+    if (!latencies || !window)
+    {
+        abort();
+    }
+
+    for (uint32_t i = 0; i < commands; i++)
+    {
+        xSemaphoreTake(window, portMAX_DELAY);
+        while (ble_mesh_client_send_acked(i & 1, addrs[i % count], command_done,
+                                          (void *)(intptr_t)sim_now(), NULL) != ESP_OK)
+        {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+    for (int i = 0; i < SIM_WINDOW; i++)
+    {
+        xSemaphoreTake(window, portMAX_DELAY);
+    }
+
+    seconds = (sim_now() - start) / 1e6;
+    qsort(latencies, completed, sizeof(*latencies), compare_latency);
+    printf("acked unicast: %u commands, %u ok, %u failed in %.1f s, %.1f cmd/s\n",
+           commands, completed, failed, seconds, completed / seconds);
+    printf("  latency: p50 %.0f ms, p90 %.0f ms, p99 %.0f ms, max %.0f ms\n",
+           percentile_ms(latencies, completed, 0.5), percentile_ms(latencies, completed, 0.9),
+           percentile_ms(latencies, completed, 0.99), percentile_ms(latencies, completed, 1.0));
+
+    vSemaphoreDelete(window);
+    free(latencies);
+}
+
+static void run_unacked(const uint16_t *addrs, size_t count, uint32_t commands)
+{
+    ble_mesh_client_tx_stats_t before;
+    ble_mesh_client_tx_stats_t tx;
+    int64_t start = sim_now();
+    double seconds;
+    uint32_t sets = 0;
+    uint32_t applied = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        sets += sim_mesh_node_sets(addrs[i]);
+    }
+    ble_mesh_client_get_tx_stats(&before);
+
+    // Only the Generic OnOff Server is bound, so toggle it; values still queued for a
+    // node are coalesced by the sender
+    ble_mesh_client_set_min_interval(ESP_BLE_MESH_ADDR_UNASSIGNED, 0);
+    for (uint32_t i = 0; i < commands; i++)
+    {
+        do
+        {
+            ble_mesh_client_wait_queue(portMAX_DELAY);
+        } while (ble_mesh_client_send((i / count) & 1, addrs[i % count]) == ESP_ERR_NO_MEM);
+    }
+    // Done once every command was either handed to the stack or merged into another
+    do
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        ble_mesh_client_get_tx_stats(&tx);
+    } while (tx.depth || (tx.sent - before.sent) + (tx.coalesced - before.coalesced)
+                         + (tx.dropped_error - before.dropped_error) < commands);
+    seconds = (sim_now() - start) / 1e6;
+    vTaskDelay(pdMS_TO_TICKS(SIM_SETTLE_MS));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        applied += sim_mesh_node_sets(addrs[i]);
+    }
+    applied -= sets;
+
+    printf("unacked unicast: %u queued, %u sent, %u coalesced, %u applied by nodes, queue drained in %.1f s\n",
+           commands, tx.sent - before.sent, tx.coalesced - before.coalesced, applied, seconds);
+    printf("  queue: avg %u ms, max %u ms to air, depth max %u\n",
+           tx.latency_avg_us / 1000, tx.latency_max_us / 1000, tx.depth_max);
+}
+
+static void run_group(uint8_t teams)
+{
+    static ble_mesh_client_group_result_t result;
+
+    for (uint8_t team = 0; team < teams; team++)
+    {
+        int64_t start = sim_now();
+        esp_err_t err;
+
+        err = ble_mesh_client_send_group_acked(1, SIM_GROUP_ADDR + team, NULL, 0, 2000, &result);
+        printf("acked group");
+        if (teams > 1)
+        {
+            printf(" of team %u", team);
+        }
+        printf(": %s, %u/%u confirmed, %u by the group message, %u unicast retries in %.1f s\n",
+               esp_err_to_name(err), result.responded_count, result.member_count, result.group_responses,
+               result.retried, (sim_now() - start) / 1e6);
+    }
+}
+
+// Time until every robot applied the command and PDUs it cost, the whole fleet
+// commanded once with a unicast send per robot, once with a send per team group
+static void fanout_measure(const uint16_t *addrs, size_t count, uint32_t *before, uint8_t teams, bool group,
+                           uint8_t val)
+{
+    sim_mesh_stats_t start;
+    sim_mesh_stats_t stats;
+    int64_t start_us = sim_now();
+    int64_t deadline = start_us + SIM_SETTLE_MS * 1000LL;
+    size_t applied;
+
+    sim_mesh_get_stats(&start);
+    for (size_t i = 0; i < count; i++)
+    {
+        before[i] = sim_mesh_node_sets(addrs[i]);
+    }
+
+    for (size_t i = 0; i < (group ? teams : count); i++)
+    {
+        esp_err_t err;
+
+        do
+        {
+            ble_mesh_client_wait_queue(SIM_SETTLE_MS);
+            err = group ? ble_mesh_client_send_group(val, SIM_GROUP_ADDR + i) : ble_mesh_client_send(val, addrs[i]);
+        } while (err == ESP_ERR_NO_MEM);
+    }
+
+    do
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        applied = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            applied += sim_mesh_node_sets(addrs[i]) != before[i];
+        }
+    } while (applied < count && sim_now() < deadline);
+    sim_mesh_get_stats(&stats);
+
+    printf("  %-7s %4u messages, %5u PDUs, %5u relayed, %u/%u applied in %.0f ms\n", group ? "group" : "unicast",
+           group ? teams : (unsigned)count, stats.pdus - start.pdus, stats.relayed - start.relayed,
+           (unsigned)applied, (unsigned)count, (sim_now() - start_us) / 1e3);
+    vTaskDelay(pdMS_TO_TICKS(SIM_SETTLE_MS));
+}
+
+static void run_fanout(const uint16_t *addrs, size_t count, uint8_t teams)
+{
+    uint32_t *before = calloc(count, sizeof(*before));
+
+    if (!before)
+    {
+        abort();
+    }
+    printf("fan-out to the fleet:\n");
+    fanout_measure(addrs, count, before, teams, false, 0);
+    fanout_measure(addrs, count, before, teams, true, 1);
+    free(before);
+}
+
+// Reads every robot's OnOff state back from the client's cache, filled by the statuses
+// of the acked group command: fresh, with no age allowed, and after a set made it stale
+static void run_cache(const uint16_t *addrs, size_t count)
+{
+    uint32_t hits = 0;
+    uint32_t matching = 0;
+    uint32_t stale = 0;
+    uint8_t cached;
+    uint8_t onoff;
+
+    vTaskDelay(pdMS_TO_TICKS(SIM_POLL_MS));
+    for (size_t i = 0; i < count; i++)
+    {
+        if (ble_mesh_client_get_cached_onoff(addrs[i], SIM_SETTLE_MS, &cached) == ESP_OK)
+        {
+            hits++;
+            matching += sim_mesh_node_onoff(addrs[i], &onoff) && onoff == cached;
+        }
+        stale += ble_mesh_client_get_cached_onoff(addrs[i], 0, &cached) == ESP_ERR_NOT_FOUND;
+    }
+    // The group command switched every robot on
+    ble_mesh_client_send(0, addrs[0]);
+
+    printf("cached state: %u/%u robots read back, %u matching the robot, %u older than 0 ms, "
+           "after a set %s\n", hits, (unsigned)count, matching, stale,
+           ble_mesh_client_get_cached_onoff(addrs[0], SIM_SETTLE_MS, &cached) == ESP_ERR_NOT_FOUND ? "stale" : "still cached");
+    vTaskDelay(pdMS_TO_TICKS(SIM_SETTLE_MS));
+}
+
+static int compare_addr(const void *a, const void *b)
+{
+    return *(const uint16_t *)a - *(const uint16_t *)b;
+}
+
+// Reset robots come back under their UUID: the unannounced ones should get their old
+// range, the removed ones a reclaimed range, so the address space does not grow
+static void run_reset(const uint16_t *addrs, size_t count, uint32_t reset)
+{
+    uint16_t *after = calloc(count ? count : 1, sizeof(*after));
+    uint16_t high = ble_mesh_provisioner_addr_high();
+    uint16_t stack_high = sim_mesh_addr_high();
+    sim_mesh_stats_t stats;
+    uint32_t provisioned;
+    uint32_t removed = 0;
+    size_t returned;
+    int64_t start = sim_now();
+    int64_t deadline = start + (int64_t)reset * 20 * 1000000 + 60 * 1000000LL;
+
+    if (!after)
+    {
+        abort();
+    }
+
+    reset = MIN(reset, count);
+    sim_mesh_get_stats(&stats);
+    provisioned = stats.provisioned;
+    for (uint32_t i = 0; i < reset; i++)
+    {
+        uint16_t addr = addrs[i * count / reset];
+
+        sim_mesh_reset_node(addr);
+        if (i < reset / 2 && ble_mesh_provisioner_remove_node(addr) == ESP_OK)
+        {
+            removed++;
+        }
+    }
+
+    do
+    {
+        vTaskDelay(pdMS_TO_TICKS(SIM_POLL_MS));
+        sim_mesh_get_stats(&stats);
+    } while (stats.provisioned < provisioned + reset && sim_now() < deadline);
+    wait_operational(count);
+
+    returned = ble_mesh_provisioner_get_operational(after, count);
+    qsort(after, returned, sizeof(*after), compare_addr);
+    printf("reset: %u robots, %u removed first, %u provisioned again in %.1f s, addresses %s\n", reset, removed,
+           stats.provisioned - provisioned, (sim_now() - start) / 1e6,
+           returned == count && !memcmp(addrs, after, count * sizeof(*after)) ? "unchanged" : "changed");
+    printf("  highest unicast: 0x%04x before, 0x%04x after (stack 0x%04x before, 0x%04x after)\n", high,
+           ble_mesh_provisioner_addr_high(), stack_high, sim_mesh_addr_high());
+    free(after);
+}
+
+// Links the provisioner found by probing against the true ones between powered robots,
+// and the robots it reports at risk against those switched off
+static void run_topology(const uint16_t *addrs, size_t count, uint32_t seconds, uint32_t fade)
+{
+    ble_mesh_provisioner_fleet_stats_t fleet;
+    uint16_t *neighbors = calloc(count + 1, sizeof(*neighbors));
+    uint16_t *at_risk = calloc(count + 1, sizeof(*at_risk));
+    uint16_t *faded = calloc(count + 1, sizeof(*faded));
+    uint32_t found = 0;
+    uint32_t wrong = 0;
+    uint32_t faded_found = 0;
+    size_t risk_count;
+
+    if (!neighbors || !at_risk || !faded)
+    {
+        abort();
+    }
+
+    fade = MIN(fade, count);
+    for (uint32_t i = 0; i < fade; i++)
+    {
+        faded[i] = addrs[(2 * i + 1) * count / (2 * fade)];
+        sim_mesh_power_off(faded[i]);
+    }
+    vTaskDelay(pdMS_TO_TICKS(seconds * 1000LL));
+
+    // Every link is listed at both ends, counted at the lower address
+    for (size_t i = 0; i <= count; i++)
+    {
+        uint16_t addr = i < count ? addrs[i] : 0x0001;
+        size_t n = ble_mesh_provisioner_get_neighbors(addr, neighbors, count + 1);
+
+        for (size_t j = 0; j < n; j++)
+        {
+            if (neighbors[j] > addr)
+            {
+                found += sim_mesh_linked(addr, neighbors[j]);
+                wrong += !sim_mesh_linked(addr, neighbors[j]);
+            }
+        }
+    }
+
+    risk_count = ble_mesh_provisioner_get_at_risk(at_risk, count + 1);
+    for (size_t i = 0; i < risk_count; i++)
+    {
+        for (uint32_t j = 0; j < fade; j++)
+        {
+            faded_found += at_risk[i] == faded[j];
+        }
+    }
+
+    ble_mesh_provisioner_get_fleet_stats(&fleet);
+    printf("topology: %u of %u links found, %u not or no longer there, %u nodes mapped up to %u hops "
+           "after %u s\n", found, sim_mesh_links(), wrong, fleet.topology.nodes, fleet.topology.hops_max, seconds);
+    printf("  %u heartbeats, %u probes; %u robots at risk, %u of %u switched off among them\n",
+           fleet.topology.heartbeats, fleet.topology.probes, (unsigned)risk_count, faded_found, fade);
+    if (sim_log_level > ESP_LOG_ERROR)
+    {
+        ble_mesh_provisioner_dump_topology();
+    }
+
+    free(neighbors);
+    free(at_risk);
+    free(faded);
+}
+
+static void report_link_stats(const char *bearer, const ble_mesh_admission_link_stats_t *link)
+{
+    uint32_t closed = link->completed + link->failed;
+
+    printf("  %s: %u started, %u complete, %u failed (%.0f %%), %u refused\n", bearer, link->started,
+           link->completed, link->failed, closed ? 100.0 * link->failed / closed : 0.0, link->refused);
+}
+
+static void report_admission(const ble_mesh_admission_stats_t *admission)
+{
+    printf("admission: %u queued, %u linking, %u dropped from a full queue, longest wait %u ms\n",
+           admission->queued, admission->linking, admission->dropped, admission->wait_max_ms);
+    report_link_stats("PB-ADV", &admission->adv);
+    report_link_stats("PB-GATT", &admission->gatt);
+}
+
+static void trace_write_file(const void *data, size_t len, void *arg)
+{
+    fwrite(data, 1, len, arg);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [--nodes N] [--loss P] [--latency-ms MS] [--adv-bufs N] [--prov-ms MS]\n"
+                    "       [--elements N] [--mixed-elements] [--agg P] [--strangers N] [--hops N] [--commands N] [--reset N]\n"
+                    "       [--topology S] [--fade N] [--seed S] [--state PREFIX] [--self-prov] [--client-only]\n"
+                    "       [--teams N] [--client-team N] [--metrics] [--trace FILE] [-v]\n",
+            name);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        {"nodes", required_argument, NULL, 'n'},
+        {"loss", required_argument, NULL, 'l'},
+        {"latency-ms", required_argument, NULL, 'L'},
+        {"adv-bufs", required_argument, NULL, 'a'},
+        {"prov-ms", required_argument, NULL, 'p'},
+        {"elements", required_argument, NULL, 'e'},
+        {"mixed-elements", no_argument, NULL, 'E'},
+        {"agg", required_argument, NULL, 'g'},
+        {"strangers", required_argument, NULL, 'x'},
+        {"hops", required_argument, NULL, 'H'},
+        {"commands", required_argument, NULL, 'c'},
+        {"reset", required_argument, NULL, 'r'},
+        {"topology", required_argument, NULL, 'T'},
+        {"fade", required_argument, NULL, 'F'},
+        {"seed", required_argument, NULL, 's'},
+        {"state", required_argument, NULL, 'S'},
+        {"self-prov", no_argument, NULL, 'P'},
+        {"client-only", no_argument, NULL, 'O'},
+        {"teams", required_argument, NULL, 't'},
+        {"client-team", required_argument, NULL, 'C'},
+        {"metrics", no_argument, NULL, 'm'},
+        {"trace", required_argument, NULL, 'R'},
+        {"verbose", no_argument, NULL, 'v'},
+        {NULL, 0, NULL, 0},
+    };
+    sim_mesh_config_t mesh = {
+        .nodes = 10,
+        .elem_num = 1,
+        .loss = 0.0,
+        .latency_us = 5000,
+        .adv_bufs = CONFIG_BLE_MESH_ADV_BUF_COUNT,
+        .prov_us = 3000000,
+        .node_delay_us = 5000,
+        .agg = 0.5,
+        .max_hops = 1,
+    };
+    sim_options_t options = {.commands = 0, .seed = 1, .teams = 1};
+    sim_mesh_stats_t stats;
+    ble_mesh_provisioner_fleet_stats_t fleet;
+    ble_mesh_client_tx_stats_t tx;
+    ble_mesh_client_cache_stats_t cache;
+    ble_mesh_peer_stats_t peers;
+    uint16_t *addrs;
+    size_t count;
+    char path[256];
+    bool warm = false;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "n:l:L:a:p:e:Eg:x:H:c:r:T:F:s:POt:C:mR:v", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                mesh.nodes = strtoul(optarg, NULL, 10);
+                break;
+            case 'l':
+                mesh.loss = strtod(optarg, NULL);
+                break;
+            case 'L':
+                mesh.latency_us = strtoul(optarg, NULL, 10) * 1000;
+                break;
+            case 'a':
+                mesh.adv_bufs = strtoul(optarg, NULL, 10);
+                break;
+            case 'p':
+                mesh.prov_us = strtoul(optarg, NULL, 10) * 1000;
+                break;
+            case 'e':
+                mesh.elem_num = strtoul(optarg, NULL, 10);
+                break;
+            case 'E':
+                mesh.elem_mixed = true;
+                break;
+            case 'g':
+                mesh.agg = strtod(optarg, NULL);
+                break;
+            case 'x':
+                mesh.strangers = strtoul(optarg, NULL, 10);
+                break;
+            case 'H':
+                mesh.max_hops = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                options.commands = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                options.reset = strtoul(optarg, NULL, 10);
+                break;
+            case 'T':
+                options.topology_s = strtoul(optarg, NULL, 10);
+                break;
+            case 'F':
+                options.fade = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                options.seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'S':
+                options.state = optarg;
+                break;
+            case 'P':
+                options.self_prov = true;
+                break;
+            case 'O':
+                options.client_only = true;
+                options.self_prov = true;
+                break;
+            case 't':
+                options.teams = strtoul(optarg, NULL, 10);
+                break;
+            case 'C':
+                mesh.node_net_idx = BLE_MESH_TEAM_NET_IDX(strtoul(optarg, NULL, 10));
+                break;
+            case 'm':
+                options.metrics = true;
+                break;
+            case 'R':
+                options.trace = optarg;
+                break;
+            case 'v':
+                sim_log_level++;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (!mesh.nodes || mesh.nodes > CONFIG_BLE_MESH_MAX_PROV_NODES || mesh.loss < 0 || mesh.loss >= 1
+        || mesh.agg < 0 || mesh.agg > 1 || !mesh.max_hops || mesh.max_hops > 127 || !options.teams
+        || options.teams > BLE_MESH_TEAMS_MAX || BLE_MESH_NET_IDX_TEAM(mesh.node_net_idx) >= options.teams
+        || (options.client_only && !options.state))
+    {
+        usage(argv[0]);
+    }
+    options.nodes = mesh.nodes;
+    if (!options.commands)
+    {
+        options.commands = 10 * mesh.nodes;
+    }
+
+    sim_kernel_init(options.seed);
+    sim_mesh_init(&mesh);
+    if (options.state)
+    {
+        snprintf(path, sizeof(path), "%s.mesh", options.state);
+        warm = sim_mesh_load(path);
+        snprintf(path, sizeof(path), "%s.nvs", options.state);
+        warm = sim_nvs_load(path) && warm;
+    }
+
+    printf("%u nodes in %u team(s), client in team %u, %u strangers, %s%u element(s), up to %u hops, "
+           "aggregator %.2f, loss %.2f, latency %u ms, %u ADV buffers, seed %llu, %s start\n", mesh.nodes,
+           options.teams, BLE_MESH_NET_IDX_TEAM(mesh.node_net_idx), mesh.strangers, mesh.elem_mixed ? "1 to " : "", mesh.elem_num, mesh.max_hops,
+           mesh.agg, mesh.loss, mesh.latency_us / 1000, mesh.adv_bufs, (unsigned long long)options.seed,
+           warm ? "warm" : "cold");
+
+    if (options.client_only && !warm)
+    {
+        fprintf(stderr, "--client-only needs the fleet saved by an earlier run with --state %s\n", options.state);
+        return 2;
+    }
+
+    // Only the fleet's own robots are provisioned
+    for (uint32_t i = 0; i < mesh.nodes && !options.client_only; i++)
+    {
+        uint8_t uuid[16];
+
+        sim_mesh_get_uuid(i, uuid);
+        ESP_ERROR_CHECK(ble_mesh_provisioner_allow_device(uuid));
+        ESP_ERROR_CHECK(ble_mesh_provisioner_set_team(uuid, i % options.teams));
+    }
+
+    ESP_ERROR_CHECK(ble_mesh_lifecycle_init());
+    ESP_ERROR_CHECK(ble_mesh_lifecycle_subscribe(lifecycle_changed, NULL));
+    ESP_ERROR_CHECK(pre_init());
+    if (options.self_prov)
+    {
+        store_credentials(BLE_MESH_NET_IDX_TEAM(mesh.node_net_idx));
+    }
+    if (!options.client_only)
+    {
+        ESP_ERROR_CHECK(ble_mesh_provisioner_init());
+    }
+    ESP_ERROR_CHECK(ble_mesh_client_init());
+    // Every robot subscribes to all of them, only its own team's reaches it. The
+    // client's own team needs no route, it is the default.
+    for (uint8_t team = 0; team < options.teams; team++)
+    {
+        if (!options.client_only)
+        {
+            ESP_ERROR_CHECK(ble_mesh_provisioner_add_group(SIM_GROUP_ADDR + team));
+        }
+        if (team != BLE_MESH_NET_IDX_TEAM(mesh.node_net_idx))
+        {
+            ESP_ERROR_CHECK(ble_mesh_client_set_team(SIM_GROUP_ADDR + team, team));
+        }
+    }
+
+    report_lifecycle();
+    addrs = calloc(options.nodes, sizeof(*addrs));
+    if (!addrs)
+    {
+        abort();
+    }
+    if (options.client_only)
+    {
+        count = sim_mesh_get_nodes(addrs, options.nodes);
+        printf("client only: %u nodes in the saved fleet, none known to the client\n", (unsigned)count);
+    }
+    else
+    {
+        wait_operational(options.nodes);
+        count = ble_mesh_provisioner_get_operational(addrs, options.nodes);
+        report_ttop(addrs, count);
+        report_config_paths();
+    }
+    report_models(addrs, count, mesh.elem_num, mesh.elem_mixed, !options.client_only);
+
+    if (count)
+    {
+        run_acked(addrs, count, options.commands);
+        vTaskDelay(pdMS_TO_TICKS(SIM_SETTLE_MS));
+        run_unacked(addrs, count, options.commands);
+        run_group(options.teams);
+        run_cache(addrs, count);
+        run_fanout(addrs, count, options.teams);
+        if (options.reset && !options.client_only)
+        {
+            run_reset(addrs, count, options.reset);
+        }
+        if (options.topology_s && !options.client_only)
+        {
+            run_topology(addrs, count, options.topology_s, options.fade);
+        }
+    }
+
+    sim_mesh_get_stats(&stats);
+    ble_mesh_client_get_tx_stats(&tx);
+    printf("radio: %u PDUs, ADV peak %u/%u, %u ADV full, %u busy, %u delivered, %u lost, "
+           "%u replies, %u replies lost, %u timeouts\n", stats.pdus, stats.adv_peak, mesh.adv_bufs,
+           stats.adv_full, stats.busy, stats.delivered, stats.lost, stats.replies, stats.replies_lost,
+           stats.timeouts);
+    printf("provisioning links: %u complete, %u failed (%u timed out); tx queue: %u dropped full, %u dropped error, "
+           "%u resent\n", stats.provisioned, stats.prov_failed, stats.prov_timeouts, tx.dropped_full, tx.dropped_error,
+           tx.resent);
+    ble_mesh_provisioner_get_fleet_stats(&fleet);
+    printf("beacons: %u reported, %u passed on, %u repeats dropped, %u foreign dropped\n",
+           fleet.beacons.received, fleet.beacons.admitted, fleet.beacons.repeated, fleet.beacons.foreign);
+    report_admission(&fleet.admission);
+    printf("ttl: %u relayed PDUs, %u messages out of reach; %u hop counts learned, %u sends from them, "
+           "%u with the default, %u evicted\n", stats.relayed, stats.out_of_reach, fleet.ttl.learned, fleet.ttl.hits,
+           fleet.ttl.misses, fleet.ttl.evicted);
+    printf("heartbeats: %u published, %u relayed PDUs\n", stats.heartbeats, stats.hb_relayed);
+    ble_mesh_client_get_cache_stats(&cache);
+    printf("state cache: %u updates, %u hits, %u misses, %u evictions\n", cache.updates, cache.hits, cache.misses,
+           cache.evictions);
+    ble_mesh_peer_get_stats(&peers);
+    printf("peers: %u statuses learned, %u servers taken to be missing, %u evictions\n", peers.learned, peers.silent,
+           peers.evicted);
+    printf("callbacks: %u, %.1f us avg and %.1f us max in the stack's task; %u dispatched, %u dropped, "
+           "%u lost, pool peak %u/%u, %u us max wait\n", stats.callbacks,
+           stats.callbacks ? stats.dwell_ns / 1e3 / stats.callbacks : 0.0, stats.dwell_max_ns / 1e3,
+           fleet.dispatch.handled, fleet.dispatch.dropped, fleet.dispatch.lost, fleet.dispatch.pool_peak, DISPATCH_POOL_SIZE,
+           fleet.dispatch.wait_max_us);
+
+    if (options.metrics)
+    {
+        ble_mesh_metrics_dump();
+    }
+
+    if (options.trace)
+    {
+        FILE *file = fopen(options.trace, "wb");
+
+        if (file)
+        {
+            ble_mesh_trace_export(trace_write_file, file);
+            fclose(file);
+        }
+        else
+        {
+            fprintf(stderr, "cannot write %s\n", options.trace);
+        }
+    }
+
+    if (options.state && !options.client_only)
+    {
+        // Records are written shortly after the last change, give the flush time to run
+        vTaskDelay(pdMS_TO_TICKS(SIM_SETTLE_MS));
+        snprintf(path, sizeof(path), "%s.mesh", options.state);
+        if (!sim_mesh_save(path))
+        {
+            fprintf(stderr, "cannot write %s\n", path);
+        }
+        snprintf(path, sizeof(path), "%s.nvs", options.state);
+        if (!sim_nvs_save(path))
+        {
+            fprintf(stderr, "cannot write %s\n", path);
+        }
+    }
+
+    free(addrs);
+    fflush(stdout);
+    exit(0);
+}
@@ -0,0 +1,3278 @@
+// Simulated mesh stack and fleet.
+//
+// Implements the esp_ble_mesh_* calls lib/ makes on top of a population of
+// virtual devices. Each device beacons while unprovisioned, goes through a
+// PB-ADV link of configurable length, then runs a Configuration Server and the
+// Generic servers the robots expose. Like the real stack every call is handed to
+// the stack task (here the event task) and reports back through the registered
+// callbacks, never from inside the call.
+//
+// Radio model: our own advertiser sends one network PDU at a time, each PDU
+// (net_transmit count + 1) times, and holds one ADV buffer per PDU until it is
+// on air. A PDU reaches a node when at least one of its copies survives the loss
+// rate; segmented unicast messages get SAR retransmissions. Nodes answer on their
+// own advertiser after the response delay of the Mesh Model specification.
+// Collisions, relaying and the PB-ADV traffic itself are not modeled.
+//
+// Subnets: every robot holds the one NetKey it was provisioned with and only
+// receives, relays and hears heartbeats of messages on that subnet. The hop
+// counts still run through all robots, as if every subnet had relays everywhere.
+
+#include "sim.h"
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_ble_mesh_agg_model_api.h"
+#include "esp_ble_mesh_common_api.h"
+#include "esp_ble_mesh_config_model_api.h"
+#include "esp_ble_mesh_generic_model_api.h"
+#include "esp_ble_mesh_networking_api.h"
+#include "esp_ble_mesh_provisioning_api.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#define TAG                     "SIM_MESH"
+
+#define SIM_STACKS_MAX          2
+#define SIM_PENDING_MAX         256
+#define SIM_ELEMS_MAX           3
+#define SIM_MODELS_MAX          10
+#define SIM_NODE_NAME_LEN       31
+#define SIM_APP_KEYS_MAX        16
+
+#define SIM_ACCESS_UNSEG_MAX    11      // access payload of one unsegmented PDU
+#define SIM_SEG_LEN             12      // segment payload, TransMIC included
+#define SIM_MIC_LEN             4
+#define SIM_ACCESS_MAX          380     // 32 segments, TransMIC excluded
+#define SIM_SAR_ATTEMPTS        3
+#define SIM_NODE_TRANSMIT       ESP_BLE_MESH_TRANSMIT(2, 20)
+#define SIM_NODE_TTL            7       // default TTL of the robots, their statuses leave with it
+#define SIM_TID_WINDOW_US       6000000
+#define SIM_LINK_OPEN_US        60000
+#define SIM_BEACON_REPORTS      3       // per beacon interval: two ADV beacon copies, one PB-GATT advert
+#define SIM_BEACON_GAP_US       20000
+#define SIM_LINK_TIMEOUT_US     30000000    // PB-ADV transaction timeout
+// Below these RSSI a link times out with 4 % more probability per dB; a GATT connection
+// retransmits on the link layer and reaches further
+#define SIM_EDGE_RSSI_ADV       (-80)
+#define SIM_EDGE_RSSI_GATT      (-88)
+#define SIM_EDGE_FAIL_PER_DB    0.04
+#define SIM_STATE_MAGIC         0x4d534d44  // "DMSM"
+
+// Robots this close hear each other directly, each is placed 0.5 to 1 range away from
+// one placed before it
+#define SIM_RANGE               1.0
+#define SIM_HOPS_NONE           0xff        // no path through powered robots
+#define SIM_HB_MIN_HOPS_NONE    0x7f        // heartbeat subscription minimum before the first one
+
+// Status codes of the Configuration Server
+#define CFG_STATUS_SUCCESS          0x00
+#define CFG_STATUS_INVALID_MODEL    0x02
+#define CFG_STATUS_INVALID_APPKEY   0x03
+#define CFG_STATUS_INVALID_NETKEY   0x04
+#define CFG_STATUS_NO_RESOURCES     0x05
+
+// Status codes of the Opcodes Aggregator Server
+#define AGG_STATUS_SUCCESS          0x00
+#define AGG_STATUS_INVALID_ADDRESS  0x01
+#define AGG_STATUS_WRONG_ACCESS_KEY 0x03
+#define AGG_STATUS_WRONG_OPCODE     0x04
+#define AGG_STATUS_NOT_UNDERSTOOD   0x05
+
+typedef enum {
+    SIM_CLIENT_GENERIC,
+    SIM_CLIENT_CONFIG,
+    SIM_CLIENT_AGG,
+} sim_client_t;
+
+typedef struct {
+    esp_ble_mesh_prov_cb_t prov_cb;
+    esp_ble_mesh_cfg_client_cb_t cfg_cb;
+    esp_ble_mesh_cfg_server_cb_t cfg_srv_cb;
+    esp_ble_mesh_generic_client_cb_t generic_cb;
+    esp_ble_mesh_agg_cb_t agg_cb;
+    esp_ble_mesh_prov_t *prov;
+    esp_ble_mesh_comp_t *comp;
+} sim_stack_t;
+
+typedef struct {
+    uint8_t uuid[16];
+    uint8_t bd_addr[BD_ADDR_LEN];
+    uint16_t unicast;
+    uint16_t node_idx;
+    uint8_t elem_num;
+    uint16_t assign_addr;   // unicast the provisioner asked for, 0 for the stack's next one
+    bool linking;
+    bool link_timeout;      // the current link dies at the transaction timeout
+    esp_ble_mesh_prov_bearer_t link_bearer;
+    int8_t rssi;            // at the provisioner, reports jitter around it
+    uint8_t hops;           // from us, 1 for a neighbor, SIM_HOPS_NONE when cut off
+    double x;               // position, the provisioner sits at the origin
+    double y;
+    bool off;               // powered off, silent and no longer relaying
+    bool reset;             // factory reset, beaconing while the stack may still hold its record
+    char name[SIM_NODE_NAME_LEN + 1];
+    int64_t tx_free_us;
+
+    uint16_t app_keys;      // bit per AppKey index
+    uint32_t bound;         // bit per model slot, elem * SIM_MODELS_MAX + model
+    uint16_t subs[SIM_ELEMS_MAX * SIM_MODELS_MAX][CONFIG_BLE_MESH_MODEL_GROUP_COUNT];
+
+    uint8_t onoff[SIM_ELEMS_MAX];
+    int16_t level[SIM_ELEMS_MAX];
+    uint8_t trans_time;
+    uint16_t power;
+    uint8_t battery;
+    int32_t latitude;
+    int32_t longitude;
+    int16_t altitude;
+
+    // Last transaction, retransmissions of it are not applied twice
+    bool agg;               // has an Opcodes Aggregator Server
+
+    uint16_t tid_src;
+    uint16_t tid_dst;
+    uint8_t tid;
+    int64_t tid_us;
+
+    uint32_t sets;
+
+    // Heartbeat publication and subscription of the Configuration Server
+    uint16_t hb_dst;        // unassigned while not publishing
+    uint8_t hb_period_log;
+    uint8_t hb_ttl;
+    uint16_t hb_gen;        // bumped on every change, the timer of the old one stops
+    uint16_t hb_sub_src;
+    uint16_t hb_sub_dst;
+    int64_t hb_sub_end_us;
+    uint16_t hb_sub_count;
+    uint8_t hb_sub_min_hops;
+    uint8_t hb_sub_max_hops;
+
+    esp_ble_mesh_node_t info;       // the provisioner stack's record of the node
+} sim_node_t;
+
+typedef struct {
+    sim_stack_t *stack;
+    sim_client_t client;
+    bool get;
+    esp_ble_mesh_client_common_param_t params;
+    union {
+        esp_ble_mesh_cfg_client_get_state_t cfg_get;
+        esp_ble_mesh_cfg_client_set_state_t cfg_set;
+        esp_ble_mesh_generic_client_get_state_t gen_get;
+        esp_ble_mesh_generic_client_set_state_t gen_set;
+        esp_ble_mesh_agg_client_msg_t agg_msg;
+    };
+    uint8_t value[SIM_ACCESS_MAX];  // copy of a user property value or aggregated items
+    uint16_t value_len;
+    uint16_t src;
+    sim_node_t *node;       // receiver of this copy
+} sim_request_t;
+
+typedef struct {
+    sim_stack_t *stack;
+    esp_ble_mesh_model_t *model;
+    sim_client_t client;
+    uint16_t src;
+    uint16_t net_idx;
+    uint8_t recv_ttl;
+    uint32_t opcode;
+    esp_ble_mesh_cfg_client_common_cb_param_t cfg_status;
+    esp_ble_mesh_gen_client_status_cb_t gen_status;
+    esp_ble_mesh_agg_status_t agg_status;
+    struct net_buf_simple buf;
+    uint8_t data[SIM_ACCESS_MAX];
+} sim_reply_t;
+
+typedef struct {
+    bool used;
+    uint16_t gen;
+    sim_client_t client;
+    bool get;
+    sim_stack_t *stack;
+    esp_ble_mesh_client_common_param_t params;
+    uint32_t status_op;
+} sim_pending_t;
+
+typedef struct {
+    sim_stack_t *stack;
+    esp_ble_mesh_prov_cb_event_t event;
+    esp_ble_mesh_prov_cb_param_t param;
+} sim_prov_event_t;
+
+typedef struct {
+    sim_stack_t *stack;
+    esp_ble_mesh_cfg_server_cb_param_t param;
+} sim_cfg_srv_event_t;
+
+typedef struct {
+    sim_stack_t *stack;
+    sim_client_t client;
+    bool get;
+    int error_code;
+    esp_ble_mesh_client_common_param_t params;
+} sim_error_event_t;
+
+static const uint16_t primary_models[] = {
+    ESP_BLE_MESH_MODEL_ID_CONFIG_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_LEVEL_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_DEF_TRANS_TIME_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_POWER_LEVEL_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_POWER_LEVEL_SETUP_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_BATTERY_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_LOCATION_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_LOCATION_SETUP_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_USER_PROP_SRV,
+};
+
+static const uint16_t secondary_models[] = {
+    ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_LEVEL_SRV,
+};
+
+static const uint16_t client_models[] = {
+    ESP_BLE_MESH_MODEL_ID_CONFIG_CLI,
+    ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_CLI,
+    ESP_BLE_MESH_MODEL_ID_GEN_LEVEL_CLI,
+    ESP_BLE_MESH_MODEL_ID_GEN_DEF_TRANS_TIME_CLI,
+    ESP_BLE_MESH_MODEL_ID_GEN_POWER_ONOFF_CLI,
+    ESP_BLE_MESH_MODEL_ID_GEN_POWER_LEVEL_CLI,
+    ESP_BLE_MESH_MODEL_ID_GEN_BATTERY_CLI,
+    ESP_BLE_MESH_MODEL_ID_GEN_LOCATION_CLI,
+    ESP_BLE_MESH_MODEL_ID_GEN_PROP_CLI,
+    ESP_BLE_MESH_MODEL_ID_AGG_CLI,
+};
+
+static pthread_mutex_t mesh_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static sim_mesh_config_t config;
+static sim_mesh_stats_t stats;
+
+static sim_stack_t stacks[SIM_STACKS_MAX];
+static size_t stack_count;
+static sim_stack_t registering;
+static sim_stack_t *prov_stack;
+static sim_stack_t *node_stack;
+static bool node_provisioned;
+
+static sim_node_t *nodes;
+static sim_node_t *nodes_by_addr[0x8000];
+static sim_node_t *nodes_by_idx[CONFIG_BLE_MESH_MAX_PROV_NODES];
+
+// Hops between the robots of the fleet, [i * config.nodes + j]
+static uint8_t *hops_between;
+
+static sim_pending_t pending[SIM_PENDING_MAX];
+
+static int64_t bearer_free_us;
+static uint32_t adv_in_use;
+
+static struct {
+    bool enabled;
+    uint8_t match[16];
+    uint8_t match_len;
+    uint8_t match_offset;
+    bool after_match;
+    uint16_t next_addr;
+    uint8_t adv_links;
+    uint8_t gatt_links;
+    uint16_t node_count;
+    uint16_t addr_high;
+    bool restored;
+    bool hb_recv;
+    uint8_t hb_filter;
+    uint32_t net_keys;      // local NetKeys by index besides the primary one
+    uint16_t net_idx;       // subnet new devices are provisioned into
+    struct {
+        bool used;
+        uint16_t net_idx;
+        uint8_t key[16];
+    } app_keys[SIM_APP_KEYS_MAX];
+} prov;
+
+static uint16_t own_addr(void)
+{
+    if (prov_stack && prov_stack->prov->prov_unicast_addr)
+    {
+        return prov_stack->prov->prov_unicast_addr;
+    }
+
+    return 0x0001;
+}
+
+static bool net_key_known_locked(uint16_t net_idx)
+{
+    return net_idx == ESP_BLE_MESH_KEY_PRIMARY || (net_idx < 32 && prov.net_keys & 1u << net_idx);
+}
+
+static sim_stack_t *stack_of_model(const esp_ble_mesh_model_t *model)
+{
+    for (size_t i = 0; i < stack_count; i++)
+    {
+        esp_ble_mesh_comp_t *comp = stacks[i].comp;
+
+        for (size_t e = 0; e < comp->element_count; e++)
+        {
+            esp_ble_mesh_elem_t *elem = &comp->elements[e];
+            if (model >= elem->sig_models && model < elem->sig_models + elem->sig_model_count)
+            {
+                return &stacks[i];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// Air time of one PDU sent with the transmit state of the stack's Configuration Server
+static int64_t pdu_airtime_us(uint8_t net_transmit)
+{
+    return (int64_t)(ESP_BLE_MESH_GET_TRANSMIT_COUNT(net_transmit) + 1)
+           * (ESP_BLE_MESH_GET_TRANSMIT_INTERVAL(net_transmit) + 10) * 1000;
+}
+
+static uint8_t stack_net_transmit(const sim_stack_t *stack)
+{
+    esp_ble_mesh_elem_t *elem = &stack->comp->elements[0];
+
+    for (size_t i = 0; i < elem->sig_model_count; i++)
+    {
+        if (elem->sig_models[i].model_id == ESP_BLE_MESH_MODEL_ID_CONFIG_SRV && elem->sig_models[i].user_data)
+        {
+            return ((esp_ble_mesh_cfg_srv_t *)elem->sig_models[i].user_data)->net_transmit;
+        }
+    }
+
+    return SIM_NODE_TRANSMIT;
+}
+
+static int64_t jittered_latency_us(void)
+{
+    return config.latency_us + (int64_t)(sim_random_unit() * config.latency_us / 2);
+}
+
+static size_t opcode_len(uint32_t opcode)
+{
+    return opcode > 0xffff ? 3 : opcode > 0xff ? 2 : 1;
+}
+
+// Access payload length of a message, parameters of variable size passed as extra
+static size_t access_len(uint32_t opcode, size_t extra)
+{
+    size_t params = 0;
+
+    switch (opcode)
+    {
+        case ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_DEF_TRANS_TIME_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_DEF_TRANS_TIME_SET_UNACK:
+        case ESP_BLE_MESH_MODEL_OP_GEN_DEF_TRANS_TIME_STATUS:
+            params = 1;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD:
+            params = 19;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_NET_KEY_ADD:
+            params = 18;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND:
+        case ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD:
+            params = 6;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_HEARTBEAT_PUB_SET:
+        case ESP_BLE_MESH_MODEL_OP_HEARTBEAT_SUB_STATUS:
+            params = 9;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_HEARTBEAT_PUB_STATUS:
+            params = 10;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_MODEL_APP_STATUS:
+        case ESP_BLE_MESH_MODEL_OP_MODEL_SUB_STATUS:
+            params = 7;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_APP_KEY_STATUS:
+        case ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_SET_UNACK:
+            params = 4;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_NET_KEY_STATUS:
+        case ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_STATUS:
+            params = 3;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_HEARTBEAT_SUB_SET:
+            params = 5;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_SET_UNACK:
+        case ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_STATUS:
+        case ESP_BLE_MESH_MODEL_OP_GEN_POWER_LEVEL_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_POWER_LEVEL_SET_UNACK:
+        case ESP_BLE_MESH_MODEL_OP_GEN_POWER_LEVEL_STATUS:
+            params = 5;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_GEN_BATTERY_STATUS:
+            params = 8;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_SET_UNACK:
+        case ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_STATUS:
+            params = 10;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_GET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_SET_UNACK:
+        case ESP_BLE_MESH_MODEL_OP_AGG_SEQUENCE:
+            params = 2;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_STATUS:
+        case ESP_BLE_MESH_MODEL_OP_AGG_STATUS:
+            params = 3;
+            break;
+        default:
+            break;
+    }
+
+    return opcode_len(opcode) + params + extra;
+}
+
+static uint8_t segment_count(size_t len)
+{
+    if (len <= SIM_ACCESS_UNSEG_MAX)
+    {
+        return 1;
+    }
+
+    return (len + SIM_MIC_LEN + SIM_SEG_LEN - 1) / SIM_SEG_LEN;
+}
+
+// Whether all segments made it, each with copies chances per attempt
+static bool message_survives(uint8_t segments, uint8_t net_transmit, bool unicast)
+{
+    int copies = ESP_BLE_MESH_GET_TRANSMIT_COUNT(net_transmit) + 1;
+    int attempts = (unicast && segments > 1) ? SIM_SAR_ATTEMPTS : 1;
+
+    for (uint8_t s = 0; s < segments; s++)
+    {
+        bool received = false;
+        for (int c = 0; c < copies * attempts && !received; c++)
+        {
+            received = sim_random_unit() >= config.loss;
+        }
+        if (!received)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Opcode of the status that completes an acknowledged request, 0 for unacknowledged ones
+static uint32_t status_opcode(uint32_t opcode)
+{
+    switch (opcode)
+    {
+        case ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET:
+            return ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_STATUS;
+        case ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD:
+            return ESP_BLE_MESH_MODEL_OP_APP_KEY_STATUS;
+        case ESP_BLE_MESH_MODEL_OP_NET_KEY_ADD:
+            return ESP_BLE_MESH_MODEL_OP_NET_KEY_STATUS;
+        case ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND:
+            return ESP_BLE_MESH_MODEL_OP_MODEL_APP_STATUS;
+        case ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD:
+            return ESP_BLE_MESH_MODEL_OP_MODEL_SUB_STATUS;
+        case ESP_BLE_MESH_MODEL_OP_HEARTBEAT_PUB_SET:
+            return ESP_BLE_MESH_MODEL_OP_HEARTBEAT_PUB_STATUS;
+        case ESP_BLE_MESH_MODEL_OP_HEARTBEAT_SUB_SET:
+        case ESP_BLE_MESH_MODEL_OP_HEARTBEAT_SUB_GET:
+            return ESP_BLE_MESH_MODEL_OP_HEARTBEAT_SUB_STATUS;
+        case ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_GET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_SET:
+            return ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_STATUS;
+        case ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_GET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_SET:
+            return ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_STATUS;
+        case ESP_BLE_MESH_MODEL_OP_GEN_DEF_TRANS_TIME_GET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_DEF_TRANS_TIME_SET:
+            return ESP_BLE_MESH_MODEL_OP_GEN_DEF_TRANS_TIME_STATUS;
+        case ESP_BLE_MESH_MODEL_OP_GEN_POWER_LEVEL_GET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_POWER_LEVEL_SET:
+            return ESP_BLE_MESH_MODEL_OP_GEN_POWER_LEVEL_STATUS;
+        case ESP_BLE_MESH_MODEL_OP_GEN_BATTERY_GET:
+            return ESP_BLE_MESH_MODEL_OP_GEN_BATTERY_STATUS;
+        case ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_GET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_SET:
+            return ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_STATUS;
+        case ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_GET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_SET:
+            return ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_STATUS;
+        case ESP_BLE_MESH_MODEL_OP_AGG_SEQUENCE:
+            return ESP_BLE_MESH_MODEL_OP_AGG_STATUS;
+        default:
+            return 0;
+    }
+}
+
+// Server model handling a Generic opcode
+static uint16_t server_model(uint32_t opcode)
+{
+    switch (opcode)
+    {
+        case ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_GET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_SET_UNACK:
+            return ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_SRV;
+        case ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_GET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_SET_UNACK:
+            return ESP_BLE_MESH_MODEL_ID_GEN_LEVEL_SRV;
+        case ESP_BLE_MESH_MODEL_OP_GEN_DEF_TRANS_TIME_GET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_DEF_TRANS_TIME_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_DEF_TRANS_TIME_SET_UNACK:
+            return ESP_BLE_MESH_MODEL_ID_GEN_DEF_TRANS_TIME_SRV;
+        case ESP_BLE_MESH_MODEL_OP_GEN_POWER_LEVEL_GET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_POWER_LEVEL_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_POWER_LEVEL_SET_UNACK:
+            return ESP_BLE_MESH_MODEL_ID_GEN_POWER_LEVEL_SRV;
+        case ESP_BLE_MESH_MODEL_OP_GEN_BATTERY_GET:
+            return ESP_BLE_MESH_MODEL_ID_GEN_BATTERY_SRV;
+        case ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_GET:
+            return ESP_BLE_MESH_MODEL_ID_GEN_LOCATION_SRV;
+        case ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_SET_UNACK:
+            return ESP_BLE_MESH_MODEL_ID_GEN_LOCATION_SETUP_SRV;
+        case ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_GET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_SET_UNACK:
+            return ESP_BLE_MESH_MODEL_ID_GEN_USER_PROP_SRV;
+        default:
+            return ESP_BLE_MESH_MODEL_ID_CONFIG_SRV;
+    }
+}
+
+// Slot of model_id on element elem, -1 when the element has no such model
+static int model_slot(const sim_node_t *node, uint8_t elem, uint16_t model_id)
+{
+    const uint16_t *models = elem ? secondary_models : primary_models;
+    size_t count = elem ? ARRAY_SIZE(secondary_models) : ARRAY_SIZE(primary_models);
+
+    if (elem >= node->elem_num)
+    {
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (models[i] == model_id)
+        {
+            return elem * SIM_MODELS_MAX + i;
+        }
+    }
+
+    return -1;
+}
+
+static bool slot_subscribed(const sim_node_t *node, int slot, uint16_t group)
+{
+    for (int i = 0; i < CONFIG_BLE_MESH_MODEL_GROUP_COUNT; i++)
+    {
+        if (node->subs[slot][i] == group)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Element of the node the message is addressed to, -1 if the node ignores it
+static int target_element(const sim_node_t *node, uint16_t dst, uint16_t model_id)
+{
+    if (ESP_BLE_MESH_ADDR_IS_UNICAST(dst))
+    {
+        int elem = dst - node->unicast;
+        return model_slot(node, elem, model_id) >= 0 ? elem : -1;
+    }
+
+    for (uint8_t elem = 0; elem < node->elem_num; elem++)
+    {
+        int slot = model_slot(node, elem, model_id);
+        if (slot >= 0 && (dst == ESP_BLE_MESH_ADDR_ALL_NODES || slot_subscribed(node, slot, dst)))
+        {
+            return elem;
+        }
+    }
+
+    return -1;
+}
+
+static int64_t dwell_start(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// The stack's task is held up for as long as a callback runs
+static void dwell_end(int64_t start_ns)
+{
+    int64_t took = dwell_start() - start_ns;
+
+    pthread_mutex_lock(&mesh_lock);
+    stats.callbacks++;
+    stats.dwell_ns += took;
+    stats.dwell_max_ns = MAX(stats.dwell_max_ns, (uint64_t)took);
+    pthread_mutex_unlock(&mesh_lock);
+}
+
+static void prov_event_fire(void *arg)
+{
+    sim_prov_event_t *event = arg;
+
+    if (event->stack && event->stack->prov_cb)
+    {
+        int64_t start = dwell_start();
+
+        event->stack->prov_cb(event->event, &event->param);
+        dwell_end(start);
+    }
+    free(event);
+}
+
+static void prov_event_post(sim_stack_t *stack, esp_ble_mesh_prov_cb_event_t event,
+                            const esp_ble_mesh_prov_cb_param_t *param, int64_t at_us)
+{
+    sim_prov_event_t *post = calloc(1, sizeof(*post));
+
+    if (!post)
+    {
+        abort();
+    }
+    post->stack = stack;
+    post->event = event;
+    if (param)
+    {
+        post->param = *param;
+    }
+    sim_schedule(at_us, prov_event_fire, post);
+}
+
+static void cfg_srv_event_fire(void *arg)
+{
+    sim_cfg_srv_event_t *event = arg;
+    esp_ble_mesh_model_t *model = event->param.model;
+
+    // The stack changes the model before it reports the change
+    if (event->param.ctx.recv_op == ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND)
+    {
+        model->keys[0] = event->param.value.state_change.mod_app_bind.app_idx;
+    }
+    if (event->stack->cfg_srv_cb)
+    {
+        int64_t start = dwell_start();
+
+        event->stack->cfg_srv_cb(ESP_BLE_MESH_CFG_SERVER_STATE_CHANGE_EVT, &event->param);
+        dwell_end(start);
+    }
+    free(event);
+}
+
+static void cfg_srv_event_post(sim_stack_t *stack, uint32_t op, esp_ble_mesh_model_t *model,
+                               const esp_ble_mesh_cfg_server_state_change_t *change, int64_t at_us)
+{
+    sim_cfg_srv_event_t *post = calloc(1, sizeof(*post));
+
+    if (!post)
+    {
+        abort();
+    }
+    post->stack = stack;
+    post->param.model = model;
+    post->param.ctx.recv_op = op;
+    post->param.ctx.addr = own_addr();
+    post->param.value.state_change = *change;
+    sim_schedule(at_us, cfg_srv_event_fire, post);
+}
+
+// The local node is configured the way an operator does it in nRF Mesh: its team's
+// AppKey is added, then bound to the Generic OnOff Client only
+static void node_configure(sim_stack_t *stack)
+{
+    esp_ble_mesh_cfg_server_state_change_t change = {};
+    esp_ble_mesh_model_t *cfg_srv = &stack->comp->elements[0].sig_models[0];
+    int64_t at_us = sim_now() + jittered_latency_us();
+
+    change.appkey_add.net_idx = config.node_net_idx;
+    change.appkey_add.app_idx = config.node_net_idx;
+    cfg_srv_event_post(stack, ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD, cfg_srv, &change, at_us);
+
+    for (size_t e = 0; e < stack->comp->element_count; e++)
+    {
+        esp_ble_mesh_elem_t *elem = &stack->comp->elements[e];
+
+        for (size_t i = 0; i < elem->sig_model_count; i++)
+        {
+            esp_ble_mesh_model_t *model = &elem->sig_models[i];
+
+            if (model->model_id != ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_CLI)
+            {
+                continue;
+            }
+            memset(&change, 0, sizeof(change));
+            change.mod_app_bind.element_addr = elem->element_addr;
+            change.mod_app_bind.app_idx = config.node_net_idx;
+            change.mod_app_bind.company_id = ESP_BLE_MESH_CID_NVAL;
+            change.mod_app_bind.model_id = model->model_id;
+            at_us += jittered_latency_us();
+            cfg_srv_event_post(stack, ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND, model, &change, at_us);
+        }
+    }
+}
+
+static void client_error_fire(void *arg)
+{
+    sim_error_event_t *event = arg;
+
+    if (event->client == SIM_CLIENT_CONFIG && event->stack->cfg_cb)
+    {
+        esp_ble_mesh_cfg_client_cb_param_t param = { .error_code = event->error_code, .params = &event->params };
+        int64_t start = dwell_start();
+
+        event->stack->cfg_cb(event->get ? ESP_BLE_MESH_CFG_CLIENT_GET_STATE_EVT : ESP_BLE_MESH_CFG_CLIENT_SET_STATE_EVT,
+                             &param);
+        dwell_end(start);
+    }
+    else if (event->client == SIM_CLIENT_AGG && event->stack->agg_cb)
+    {
+        esp_ble_mesh_agg_cb_param_t param = {
+            .client.send = { .err_code = event->error_code, .params = &event->params },
+        };
+        int64_t start = dwell_start();
+
+        event->stack->agg_cb(ESP_BLE_MESH_AGG_CLIENT_SEND_COMP_EVT, &param);
+        dwell_end(start);
+    }
+    else if (event->client == SIM_CLIENT_GENERIC && event->stack->generic_cb)
+    {
+        esp_ble_mesh_generic_client_cb_param_t param = { .error_code = event->error_code, .params = &event->params };
+        event->stack->generic_cb(event->get ? ESP_BLE_MESH_GENERIC_CLIENT_GET_STATE_EVT
+                                            : ESP_BLE_MESH_GENERIC_CLIENT_SET_STATE_EVT, &param);
+    }
+    free(event);
+}
+
+static void adv_release(void *arg)
+{
+    pthread_mutex_lock(&mesh_lock);
+    adv_in_use -= (uintptr_t)arg;
+    pthread_mutex_unlock(&mesh_lock);
+}
+
+static void pending_timeout(void *arg)
+{
+    uintptr_t id = (uintptr_t)arg;
+    sim_pending_t *entry = &pending[id & 0xffff];
+    sim_pending_t copy;
+
+    pthread_mutex_lock(&mesh_lock);
+    if (!entry->used || entry->gen != id >> 16)
+    {
+        pthread_mutex_unlock(&mesh_lock);
+        return;
+    }
+    copy = *entry;
+    entry->used = false;
+    entry->gen++;
+    stats.timeouts++;
+    pthread_mutex_unlock(&mesh_lock);
+
+    if (copy.client == SIM_CLIENT_CONFIG)
+    {
+        esp_ble_mesh_cfg_client_cb_param_t param = { .params = &copy.params };
+        int64_t start = dwell_start();
+
+        copy.stack->cfg_cb(ESP_BLE_MESH_CFG_CLIENT_TIMEOUT_EVT, &param);
+        dwell_end(start);
+    }
+    else if (copy.client == SIM_CLIENT_AGG)
+    {
+        esp_ble_mesh_agg_cb_param_t param = { .client.send = { .params = &copy.params } };
+        int64_t start = dwell_start();
+
+        copy.stack->agg_cb(ESP_BLE_MESH_AGG_CLIENT_SEND_TIMEOUT_EVT, &param);
+        dwell_end(start);
+    }
+    else
+    {
+        esp_ble_mesh_generic_client_cb_param_t param = { .params = &copy.params };
+        copy.stack->generic_cb(ESP_BLE_MESH_GENERIC_CLIENT_TIMEOUT_EVT, &param);
+    }
+}
+
+static void local_receive(void *arg)
+{
+    sim_reply_t *reply = arg;
+    esp_ble_mesh_client_common_param_t params = {};
+    bool matched = false;
+    bool get = false;
+
+    pthread_mutex_lock(&mesh_lock);
+    stats.replies++;
+    for (int i = 0; i < SIM_PENDING_MAX; i++)
+    {
+        sim_pending_t *entry = &pending[i];
+        if (entry->used && entry->params.model == reply->model && entry->params.ctx.addr == reply->src
+            && entry->status_op == reply->opcode)
+        {
+            params = entry->params;
+            get = entry->get;
+            entry->used = false;
+            entry->gen++;
+            matched = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    if (!matched)
+    {
+        params.opcode = reply->opcode;
+        params.model = reply->model;
+        params.ctx.addr = reply->src;
+        params.ctx.net_idx = reply->net_idx;
+    }
+    params.ctx.recv_op = reply->opcode;
+    params.ctx.recv_dst = own_addr();
+    params.ctx.recv_ttl = reply->recv_ttl;
+
+    if (reply->client == SIM_CLIENT_CONFIG)
+    {
+        esp_ble_mesh_cfg_client_cb_param_t param = { .params = &params, .status_cb = reply->cfg_status };
+        int64_t start = dwell_start();
+
+        reply->stack->cfg_cb(!matched ? ESP_BLE_MESH_CFG_CLIENT_PUBLISH_EVT
+                             : get ? ESP_BLE_MESH_CFG_CLIENT_GET_STATE_EVT : ESP_BLE_MESH_CFG_CLIENT_SET_STATE_EVT,
+                             &param);
+        dwell_end(start);
+    }
+    else if (reply->client == SIM_CLIENT_AGG)
+    {
+        esp_ble_mesh_agg_cb_param_t param = {
+            .client.recv = { .params = &params, .recv.agg_status = reply->agg_status },
+        };
+        int64_t start = dwell_start();
+
+        reply->stack->agg_cb(matched ? ESP_BLE_MESH_AGG_CLIENT_RECV_RSP_EVT : ESP_BLE_MESH_AGG_CLIENT_RECV_PUB_EVT,
+                             &param);
+        dwell_end(start);
+    }
+    else
+    {
+        esp_ble_mesh_generic_client_cb_param_t param = { .params = &params, .status_cb = reply->gen_status };
+        reply->stack->generic_cb(!matched ? ESP_BLE_MESH_GENERIC_CLIENT_PUBLISH_EVT
+                                 : get ? ESP_BLE_MESH_GENERIC_CLIENT_GET_STATE_EVT
+                                       : ESP_BLE_MESH_GENERIC_CLIENT_SET_STATE_EVT, &param);
+    }
+    free(reply);
+}
+
+// Sends a node's status back to us, mesh_lock held
+static void node_respond_locked(sim_node_t *node, sim_reply_t *reply, size_t len, bool to_group)
+{
+    uint8_t segments = segment_count(len);
+    int64_t now = sim_now();
+    int64_t start;
+
+    // Mesh Model specification 3.7.3.1: random response delay, longer for multicast
+    start = now + config.node_delay_us / 2 + (int64_t)(sim_random_unit() * config.node_delay_us)
+            + (to_group ? 20000 + (int64_t)(sim_random_unit() * 480000)
+                        : 20000 + (int64_t)(sim_random_unit() * 30000));
+    start = MAX(start, node->tx_free_us);
+    node->tx_free_us = start + segments * pdu_airtime_us(SIM_NODE_TRANSMIT);
+
+    // From the primary element unless the server of another one answers
+    if (!reply->src)
+    {
+        reply->src = node->unicast;
+    }
+    reply->net_idx = node->info.net_idx;
+    reply->recv_ttl = SIM_NODE_TTL - (node->hops - 1);
+    if (node->hops > SIM_NODE_TTL)
+    {
+        stats.out_of_reach++;
+        free(reply);
+        return;
+    }
+    if (!message_survives(segments, SIM_NODE_TRANSMIT, true))
+    {
+        stats.replies_lost++;
+        free(reply);
+        return;
+    }
+
+    sim_schedule(node->tx_free_us + jittered_latency_us(), local_receive, reply);
+}
+
+static sim_reply_t *reply_alloc(const sim_request_t *request)
+{
+    sim_reply_t *reply = calloc(1, sizeof(*reply));
+
+    if (!reply)
+    {
+        abort();
+    }
+    reply->stack = request->stack;
+    reply->model = request->params.model;
+    reply->client = request->client;
+    reply->opcode = status_opcode(request->params.opcode);
+    reply->buf.data = reply->data;
+    reply->buf.__buf = reply->data;
+    reply->buf.size = sizeof(reply->data);
+
+    return reply;
+}
+
+static void comp_data_build(sim_node_t *node, struct net_buf_simple *buf)
+{
+    net_buf_simple_add_le16(buf, 0x02E5);
+    net_buf_simple_add_le16(buf, 0x0000);
+    net_buf_simple_add_le16(buf, 0x0000);
+    net_buf_simple_add_le16(buf, CONFIG_BLE_MESH_CRPL);
+    net_buf_simple_add_le16(buf, ESP_BLE_MESH_FEATURE_RELAY | ESP_BLE_MESH_FEATURE_PROXY);
+
+    for (uint8_t elem = 0; elem < node->elem_num; elem++)
+    {
+        const uint16_t *models = elem ? secondary_models : primary_models;
+        size_t count = elem ? ARRAY_SIZE(secondary_models) : ARRAY_SIZE(primary_models);
+
+        net_buf_simple_add_le16(buf, 0x0000);
+        net_buf_simple_add_u8(buf, count + (!elem && node->agg));
+        net_buf_simple_add_u8(buf, 0);
+        for (size_t i = 0; i < count; i++)
+        {
+            net_buf_simple_add_le16(buf, models[i]);
+            if (models[i] == ESP_BLE_MESH_MODEL_ID_CONFIG_SRV && node->agg)
+            {
+                net_buf_simple_add_le16(buf, ESP_BLE_MESH_MODEL_ID_AGG_SRV);
+            }
+        }
+    }
+}
+
+// Period and count states of the heartbeat messages: 2^(log - 1), 0 for 0
+static int64_t hb_period_us(uint8_t log)
+{
+    return log ? (1000000LL << (log - 1)) : 0;
+}
+
+static uint8_t hb_log(uint32_t value)
+{
+    if (!value)
+    {
+        return 0;
+    }
+
+    return value >= 0xffff ? 0xff : 32 - __builtin_clz(value);
+}
+
+// Hops a message sent with the TTL travels: TTL 0 is not relayed, TTL 1 is not allowed
+static uint8_t ttl_reach(uint8_t ttl)
+{
+    return ttl < 2 ? 1 : ttl;
+}
+
+static void heartbeat_fire(void *arg)
+{
+    sim_node_t *node = &nodes[(uintptr_t)arg & 0xffffffff];
+    uint16_t gen = (uintptr_t)arg >> 32;
+    uint32_t from = node - nodes;
+    esp_ble_mesh_prov_cb_param_t param = {};
+    bool report = false;
+    uint8_t reach;
+
+    pthread_mutex_lock(&mesh_lock);
+    if (node->hb_gen != gen)
+    {
+        pthread_mutex_unlock(&mesh_lock);
+        return;
+    }
+    sim_schedule(sim_now() + hb_period_us(node->hb_period_log), heartbeat_fire, arg);
+    if (node->off || node->reset || !node->unicast)
+    {
+        pthread_mutex_unlock(&mesh_lock);
+        return;
+    }
+
+    stats.heartbeats++;
+    reach = ttl_reach(node->hb_ttl);
+    for (uint32_t i = 0; i < config.nodes; i++)
+    {
+        sim_node_t *peer = &nodes[i];
+        uint8_t hops = hops_between[from * config.nodes + i];
+
+        if (i == from || hops > reach || !peer->unicast || peer->info.net_idx != node->info.net_idx)
+        {
+            continue;
+        }
+        if (hops < reach)
+        {
+            stats.hb_relayed++;
+        }
+        if (peer->hb_sub_src == node->unicast && sim_now() < peer->hb_sub_end_us
+            && message_survives(1, SIM_NODE_TRANSMIT, false))
+        {
+            peer->hb_sub_count += peer->hb_sub_count < UINT16_MAX;
+            peer->hb_sub_min_hops = MIN(peer->hb_sub_min_hops, hops);
+            peer->hb_sub_max_hops = MAX(peer->hb_sub_max_hops, hops);
+        }
+    }
+
+    // An empty reject list lets every heartbeat through
+    if (prov.hb_recv && prov.hb_filter == ESP_BLE_MESH_PROVISIONER_HB_FILTER_REJECT_LIST
+        && node->hops <= reach && message_survives(1, SIM_NODE_TRANSMIT, false))
+    {
+        report = true;
+        param.provisioner_recv_heartbeat.hb_src = node->unicast;
+        param.provisioner_recv_heartbeat.hb_dst = node->hb_dst;
+        param.provisioner_recv_heartbeat.init_ttl = node->hb_ttl;
+        param.provisioner_recv_heartbeat.rx_ttl = node->hb_ttl ? node->hb_ttl - (node->hops - 1) : 0;
+        param.provisioner_recv_heartbeat.hops = node->hops;
+        param.provisioner_recv_heartbeat.feature = ESP_BLE_MESH_FEATURE_RELAY | ESP_BLE_MESH_FEATURE_PROXY;
+        param.provisioner_recv_heartbeat.rssi = node->hops == 1 ? node->rssi + (int8_t)(sim_random_unit() * 7) - 3
+                                                                : -60 - (int8_t)(sim_random_unit() * 30);
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    if (report)
+    {
+        prov_event_post(prov_stack, ESP_BLE_MESH_PROVISIONER_RECV_HEARTBEAT_MESSAGE_EVT, &param,
+                        sim_now() + jittered_latency_us());
+    }
+}
+
+// Restarts publication with the current state, mesh_lock held
+static void heartbeat_start_locked(sim_node_t *node)
+{
+    node->hb_gen++;
+    if (node->hb_dst && node->hb_period_log)
+    {
+        sim_schedule(sim_now() + hb_period_us(node->hb_period_log), heartbeat_fire,
+                     (void *)((uintptr_t)(node - nodes) | (uintptr_t)node->hb_gen << 32));
+    }
+}
+
+static void heartbeat_sub_status(const sim_node_t *node, esp_ble_mesh_cfg_hb_sub_status_cb_t *status)
+{
+    int64_t left_us = MAX(node->hb_sub_end_us - sim_now(), 0);
+
+    status->src = node->hb_sub_src;
+    status->dst = node->hb_sub_dst;
+    status->period = hb_log((left_us + 999999) / 1000000);
+    status->count = hb_log(node->hb_sub_count);
+    status->min_hops = node->hb_sub_min_hops;
+    status->max_hops = node->hb_sub_max_hops;
+}
+
+// Applies a Configuration Server message and fills in its status, false when the
+// simulated node does not implement the opcode
+static bool node_config_apply(sim_node_t *node, const sim_request_t *request, sim_reply_t *reply, size_t *extra)
+{
+    switch (request->params.opcode)
+    {
+        case ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET:
+            comp_data_build(node, &reply->buf);
+            reply->cfg_status.comp_data_status.page = 0;
+            reply->cfg_status.comp_data_status.composition_data = &reply->buf;
+            *extra = reply->buf.len;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD:
+        {
+            const esp_ble_mesh_cfg_app_key_add_t *add = &request->cfg_set.app_key_add;
+            esp_ble_mesh_cfg_appkey_status_cb_t *status = &reply->cfg_status.appkey_status;
+
+            status->net_idx = add->net_idx;
+            status->app_idx = add->app_idx;
+            if (add->net_idx != node->info.net_idx)
+            {
+                status->status = CFG_STATUS_INVALID_NETKEY;
+            }
+            else if (add->app_idx >= SIM_APP_KEYS_MAX)
+            {
+                status->status = CFG_STATUS_NO_RESOURCES;
+            }
+            else
+            {
+                node->app_keys |= 1 << add->app_idx;
+            }
+            break;
+        }
+        case ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND:
+        {
+            const esp_ble_mesh_cfg_model_app_bind_t *bind = &request->cfg_set.model_app_bind;
+            esp_ble_mesh_cfg_mod_app_status_cb_t *status = &reply->cfg_status.model_app_status;
+            int slot = model_slot(node, bind->element_addr - node->unicast, bind->model_id);
+
+            status->element_addr = bind->element_addr;
+            status->app_idx = bind->model_app_idx;
+            status->company_id = bind->company_id;
+            status->model_id = bind->model_id;
+            if (slot < 0 || bind->model_id == ESP_BLE_MESH_MODEL_ID_CONFIG_SRV)
+            {
+                status->status = CFG_STATUS_INVALID_MODEL;
+            }
+            else if (bind->model_app_idx >= SIM_APP_KEYS_MAX || !(node->app_keys & (1 << bind->model_app_idx)))
+            {
+                status->status = CFG_STATUS_INVALID_APPKEY;
+            }
+            else
+            {
+                node->bound |= 1u << slot;
+            }
+            break;
+        }
+        case ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD:
+        {
+            const esp_ble_mesh_cfg_model_sub_add_t *add = &request->cfg_set.model_sub_add;
+            esp_ble_mesh_cfg_model_sub_status_cb_t *status = &reply->cfg_status.model_sub_status;
+            int slot = model_slot(node, add->element_addr - node->unicast, add->model_id);
+
+            status->element_addr = add->element_addr;
+            status->sub_addr = add->sub_addr;
+            status->company_id = add->company_id;
+            status->model_id = add->model_id;
+            if (slot < 0 || add->model_id == ESP_BLE_MESH_MODEL_ID_CONFIG_SRV)
+            {
+                status->status = CFG_STATUS_INVALID_MODEL;
+            }
+            else if (!slot_subscribed(node, slot, add->sub_addr))
+            {
+                status->status = CFG_STATUS_NO_RESOURCES;
+                for (int i = 0; i < CONFIG_BLE_MESH_MODEL_GROUP_COUNT; i++)
+                {
+                    if (!node->subs[slot][i])
+                    {
+                        node->subs[slot][i] = add->sub_addr;
+                        status->status = CFG_STATUS_SUCCESS;
+                        break;
+                    }
+                }
+            }
+            break;
+        }
+        case ESP_BLE_MESH_MODEL_OP_HEARTBEAT_PUB_SET:
+        {
+            const esp_ble_mesh_cfg_heartbeat_pub_set_t *set = &request->cfg_set.heartbeat_pub_set;
+            esp_ble_mesh_cfg_hb_pub_status_cb_t *status = &reply->cfg_status.heartbeat_pub_status;
+
+            status->dst = set->dst;
+            status->count = set->count;
+            status->period = set->period;
+            status->ttl = set->ttl;
+            status->features = set->feature;
+            status->net_idx = set->net_idx;
+            if (set->net_idx != node->info.net_idx)
+            {
+                status->status = CFG_STATUS_INVALID_NETKEY;
+                break;
+            }
+            // The count is taken as endless, the robots are told to publish for good
+            node->hb_dst = set->count ? set->dst : ESP_BLE_MESH_ADDR_UNASSIGNED;
+            node->hb_period_log = set->period;
+            node->hb_ttl = set->ttl;
+            heartbeat_start_locked(node);
+            break;
+        }
+        case ESP_BLE_MESH_MODEL_OP_HEARTBEAT_SUB_SET:
+        {
+            const esp_ble_mesh_cfg_heartbeat_sub_set_t *set = &request->cfg_set.heartbeat_sub_set;
+            bool enable = set->src && set->dst && set->period;
+
+            node->hb_sub_src = enable ? set->src : ESP_BLE_MESH_ADDR_UNASSIGNED;
+            node->hb_sub_dst = enable ? set->dst : ESP_BLE_MESH_ADDR_UNASSIGNED;
+            node->hb_sub_end_us = enable ? sim_now() + hb_period_us(set->period) : 0;
+            node->hb_sub_count = 0;
+            node->hb_sub_min_hops = SIM_HB_MIN_HOPS_NONE;
+            node->hb_sub_max_hops = 0;
+            heartbeat_sub_status(node, &reply->cfg_status.heartbeat_sub_status);
+            break;
+        }
+        case ESP_BLE_MESH_MODEL_OP_HEARTBEAT_SUB_GET:
+            heartbeat_sub_status(node, &reply->cfg_status.heartbeat_sub_status);
+            break;
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+// Configuration Server, mesh_lock held
+static void node_config_receive(sim_node_t *node, sim_request_t *request)
+{
+    sim_reply_t *reply;
+    size_t extra = 0;
+
+    if (request->params.ctx.addr != node->unicast)
+    {
+        return;
+    }
+
+    reply = reply_alloc(request);
+    if (!node_config_apply(node, request, reply, &extra))
+    {
+        // Not implemented by the simulated node, the request times out
+        free(reply);
+        return;
+    }
+
+    node_respond_locked(node, reply, access_len(reply->opcode, extra), false);
+}
+
+static uint16_t get_le16(const uint8_t *buf)
+{
+    return buf[0] | buf[1] << 8;
+}
+
+// Decodes the parameters of an aggregated item into the set state the Configuration
+// Client would have passed, false for opcodes the simulated node does not aggregate
+static bool agg_item_decode(sim_request_t *item, uint32_t opcode, const uint8_t *params, size_t len)
+{
+    memset(&item->cfg_set, 0, sizeof(item->cfg_set));
+    item->params.opcode = opcode;
+
+    switch (opcode)
+    {
+        case ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD:
+            if (len != 19)
+            {
+                return false;
+            }
+            item->cfg_set.app_key_add.net_idx = params[0] | (params[1] & 0x0f) << 8;
+            item->cfg_set.app_key_add.app_idx = params[1] >> 4 | params[2] << 4;
+            memcpy(item->cfg_set.app_key_add.app_key, params + 3, 16);
+            return true;
+        case ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND:
+            if (len != 6)
+            {
+                return false;
+            }
+            item->cfg_set.model_app_bind.element_addr = get_le16(params);
+            item->cfg_set.model_app_bind.model_app_idx = get_le16(params + 2);
+            item->cfg_set.model_app_bind.model_id = get_le16(params + 4);
+            item->cfg_set.model_app_bind.company_id = ESP_BLE_MESH_CID_NVAL;
+            return true;
+        case ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD:
+            if (len != 6)
+            {
+                return false;
+            }
+            item->cfg_set.model_sub_add.element_addr = get_le16(params);
+            item->cfg_set.model_sub_add.sub_addr = get_le16(params + 2);
+            item->cfg_set.model_sub_add.model_id = get_le16(params + 4);
+            item->cfg_set.model_sub_add.company_id = ESP_BLE_MESH_CID_NVAL;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Appends the status of an aggregated item as a response item, returns its status code
+static uint8_t agg_status_encode(const sim_reply_t *item, struct net_buf_simple *buf)
+{
+    const esp_ble_mesh_cfg_client_common_cb_param_t *status = &item->cfg_status;
+    uint8_t code;
+
+    net_buf_simple_add_u8(buf, (access_len(item->opcode, 0)) << 1);
+    net_buf_simple_add_be16(buf, item->opcode);
+    switch (item->opcode)
+    {
+        case ESP_BLE_MESH_MODEL_OP_APP_KEY_STATUS:
+            code = status->appkey_status.status;
+            net_buf_simple_add_u8(buf, code);
+            net_buf_simple_add_u8(buf, status->appkey_status.net_idx);
+            net_buf_simple_add_u8(buf, (status->appkey_status.net_idx >> 8 & 0x0f) | (status->appkey_status.app_idx & 0x0f) << 4);
+            net_buf_simple_add_u8(buf, status->appkey_status.app_idx >> 4);
+            break;
+        case ESP_BLE_MESH_MODEL_OP_MODEL_APP_STATUS:
+            code = status->model_app_status.status;
+            net_buf_simple_add_u8(buf, code);
+            net_buf_simple_add_le16(buf, status->model_app_status.element_addr);
+            net_buf_simple_add_le16(buf, status->model_app_status.app_idx);
+            net_buf_simple_add_le16(buf, status->model_app_status.model_id);
+            break;
+        default:
+            code = status->model_sub_status.status;
+            net_buf_simple_add_u8(buf, code);
+            net_buf_simple_add_le16(buf, status->model_sub_status.element_addr);
+            net_buf_simple_add_le16(buf, status->model_sub_status.sub_addr);
+            net_buf_simple_add_le16(buf, status->model_sub_status.model_id);
+            break;
+    }
+
+    return code;
+}
+
+// Opcodes Aggregator Server on the primary element, mesh_lock held. The items go to the
+// Configuration Server in order, processing stops after the first that does not succeed.
+static void node_agg_receive(sim_node_t *node, sim_request_t *request)
+{
+    esp_ble_mesh_agg_status_t *status;
+    sim_reply_t *reply;
+    size_t pos = 0;
+
+    if (request->params.ctx.addr != node->unicast || !node->agg)
+    {
+        return;
+    }
+
+    reply = reply_alloc(request);
+    status = &reply->agg_status;
+    status->element_addr = request->agg_msg.agg_sequence.element_addr;
+    status->items = &reply->buf;
+    if (request->params.ctx.app_idx != ESP_BLE_MESH_KEY_DEV)
+    {
+        status->status = AGG_STATUS_WRONG_ACCESS_KEY;
+    }
+    else if (status->element_addr != node->unicast)
+    {
+        status->status = AGG_STATUS_INVALID_ADDRESS;
+    }
+
+    while (status->status == AGG_STATUS_SUCCESS && pos < request->value_len)
+    {
+        const uint8_t *data = request->value + pos;
+        sim_request_t item = *request;
+        sim_reply_t item_reply = {};
+        size_t len = data[0] >> 1;
+        size_t header = 1;
+        size_t oplen;
+        size_t extra = 0;
+        uint32_t opcode;
+
+        if (data[0] & 1)
+        {
+            len = (pos + 1 < request->value_len) ? (data[0] | data[1] << 8) >> 1 : 0;
+            header = 2;
+        }
+        if (!len || pos + header + len > request->value_len)
+        {
+            status->status = AGG_STATUS_NOT_UNDERSTOOD;
+            break;
+        }
+        // Room for the largest configuration status
+        if (reply->buf.len + 1 + access_len(ESP_BLE_MESH_MODEL_OP_MODEL_APP_STATUS, 0) > reply->buf.size)
+        {
+            break;
+        }
+
+        oplen = (data[header] & 0x80) ? ((data[header] & 0x40) ? 3 : 2) : 1;
+        if (len < oplen)
+        {
+            status->status = AGG_STATUS_NOT_UNDERSTOOD;
+            break;
+        }
+
+        data += header;
+        opcode = oplen == 1 ? data[0] : oplen == 2 ? data[0] << 8 | data[1] : data[0] << 16 | data[1] << 8 | data[2];
+        item_reply.buf.data = item_reply.data;
+        item_reply.buf.__buf = item_reply.data;
+        item_reply.buf.size = sizeof(item_reply.data);
+        item_reply.opcode = status_opcode(opcode);
+        if (!agg_item_decode(&item, opcode, data + oplen, len - oplen)
+            || !node_config_apply(node, &item, &item_reply, &extra))
+        {
+            status->status = AGG_STATUS_WRONG_OPCODE;
+            break;
+        }
+
+        pos += header + len;
+        if (agg_status_encode(&item_reply, &reply->buf) != CFG_STATUS_SUCCESS)
+        {
+            break;
+        }
+    }
+
+    // Items of a refused sequence are not answered
+    if (status->status != AGG_STATUS_SUCCESS)
+    {
+        net_buf_simple_reset(&reply->buf);
+    }
+
+    node_respond_locked(node, reply, access_len(reply->opcode, reply->buf.len), false);
+}
+
+// Returns true when the set is a retransmission of the node's last transaction
+static bool transaction_seen(sim_node_t *node, const sim_request_t *request, uint8_t tid)
+{
+    int64_t now = sim_now();
+
+    if (node->tid_us && node->tid_src == request->src && node->tid_dst == request->params.ctx.addr
+        && node->tid == tid && now - node->tid_us < SIM_TID_WINDOW_US)
+    {
+        return true;
+    }
+
+    node->tid_src = request->src;
+    node->tid_dst = request->params.ctx.addr;
+    node->tid = tid;
+    node->tid_us = now;
+
+    return false;
+}
+
+// Generic servers, mesh_lock held
+static void node_generic_receive(sim_node_t *node, sim_request_t *request)
+{
+    uint32_t opcode = request->params.opcode;
+    uint16_t dst = request->params.ctx.addr;
+    uint16_t model_id = server_model(opcode);
+    int elem = target_element(node, dst, model_id);
+    sim_reply_t *reply;
+    size_t extra = 0;
+
+    // Servers only act on messages encrypted with an AppKey bound to them
+    if (elem < 0 || !(node->bound & (1u << model_slot(node, elem, model_id)))
+        || request->params.ctx.app_idx >= SIM_APP_KEYS_MAX
+        || !(node->app_keys & (1 << request->params.ctx.app_idx)))
+    {
+        return;
+    }
+
+    switch (opcode)
+    {
+        case ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_SET_UNACK:
+            if (!transaction_seen(node, request, request->gen_set.onoff_set.tid))
+            {
+                node->onoff[elem] = request->gen_set.onoff_set.onoff;
+                node->sets++;
+            }
+            break;
+        case ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_SET_UNACK:
+            if (!transaction_seen(node, request, request->gen_set.level_set.tid))
+            {
+                node->level[elem] = request->gen_set.level_set.level;
+                node->sets++;
+            }
+            break;
+        case ESP_BLE_MESH_MODEL_OP_GEN_POWER_LEVEL_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_POWER_LEVEL_SET_UNACK:
+            if (!transaction_seen(node, request, request->gen_set.power_level_set.tid))
+            {
+                node->power = request->gen_set.power_level_set.power;
+                node->sets++;
+            }
+            break;
+        case ESP_BLE_MESH_MODEL_OP_GEN_DEF_TRANS_TIME_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_DEF_TRANS_TIME_SET_UNACK:
+            node->trans_time = request->gen_set.def_trans_time_set.trans_time;
+            node->sets++;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_SET_UNACK:
+            node->latitude = request->gen_set.loc_global_set.global_latitude;
+            node->longitude = request->gen_set.loc_global_set.global_longitude;
+            node->altitude = request->gen_set.loc_global_set.global_altitude;
+            node->sets++;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_SET_UNACK:
+            node->sets++;
+            break;
+        default:
+            break;
+    }
+
+    if (!status_opcode(opcode))
+    {
+        return;
+    }
+
+    reply = reply_alloc(request);
+    switch (reply->opcode)
+    {
+        case ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_STATUS:
+            reply->gen_status.onoff_status.present_onoff = node->onoff[elem];
+            break;
+        case ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_STATUS:
+            reply->gen_status.level_status.present_level = node->level[elem];
+            break;
+        case ESP_BLE_MESH_MODEL_OP_GEN_DEF_TRANS_TIME_STATUS:
+            reply->gen_status.def_trans_time_status.trans_time = node->trans_time;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_GEN_POWER_LEVEL_STATUS:
+            reply->gen_status.power_level_status.present_power = node->power;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_GEN_BATTERY_STATUS:
+            reply->gen_status.battery_status.battery_level = node->battery;
+            reply->gen_status.battery_status.time_to_discharge = 0xffffff;
+            reply->gen_status.battery_status.time_to_charge = 0xffffff;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_STATUS:
+            reply->gen_status.location_global_status.global_latitude = node->latitude;
+            reply->gen_status.location_global_status.global_longitude = node->longitude;
+            reply->gen_status.location_global_status.global_altitude = node->altitude;
+            break;
+        case ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_STATUS:
+            net_buf_simple_add_mem(&reply->buf, request->value, request->value_len);
+            reply->gen_status.user_property_status.property_id = opcode == ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_GET
+                ? request->gen_get.user_property_get.property_id
+                : request->gen_set.user_property_set.property_id;
+            reply->gen_status.user_property_status.user_access = 0x03;
+            reply->gen_status.user_property_status.property_value = &reply->buf;
+            extra = reply->buf.len;
+            break;
+        default:
+            break;
+    }
+
+    reply->src = node->unicast + elem;
+    node_respond_locked(node, reply, access_len(reply->opcode, extra), !ESP_BLE_MESH_ADDR_IS_UNICAST(dst));
+}
+
+static void node_receive(void *arg)
+{
+    sim_request_t *request = arg;
+
+    pthread_mutex_lock(&mesh_lock);
+    if (request->node->reset || request->node->off)
+    {
+        // Without keys the device cannot even decrypt it
+    }
+    else if (request->client == SIM_CLIENT_CONFIG)
+    {
+        node_config_receive(request->node, request);
+    }
+    else if (request->client == SIM_CLIENT_AGG)
+    {
+        node_agg_receive(request->node, request);
+    }
+    else
+    {
+        node_generic_receive(request->node, request);
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    free(request);
+}
+
+static void deliver_locked(const sim_request_t *request, sim_node_t *node, uint8_t segments,
+                           uint8_t net_transmit, int64_t on_air_us)
+{
+    sim_request_t *copy;
+
+    // Without the NetKey the node cannot even tell it was addressed
+    if (node->info.net_idx != request->params.ctx.net_idx)
+    {
+        return;
+    }
+
+    if (node->hops > ttl_reach(request->params.ctx.send_ttl))
+    {
+        stats.out_of_reach++;
+        return;
+    }
+
+    if (!message_survives(segments, net_transmit, ESP_BLE_MESH_ADDR_IS_UNICAST(request->params.ctx.addr)))
+    {
+        stats.lost++;
+        return;
+    }
+
+    copy = malloc(sizeof(*copy));
+    if (!copy)
+    {
+        abort();
+    }
+    *copy = *request;
+    copy->node = node;
+    stats.delivered++;
+    sim_schedule(on_air_us + jittered_latency_us(), node_receive, copy);
+}
+
+static sim_pending_t *pending_alloc_locked(void)
+{
+    for (int i = 0; i < SIM_PENDING_MAX; i++)
+    {
+        if (!pending[i].used)
+        {
+            pending[i].used = true;
+            return &pending[i];
+        }
+    }
+
+    return NULL;
+}
+
+static bool pending_busy_locked(const esp_ble_mesh_model_t *model, uint16_t addr)
+{
+    for (int i = 0; i < SIM_PENDING_MAX; i++)
+    {
+        if (pending[i].used && pending[i].params.model == model && pending[i].params.ctx.addr == addr)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Stack task side of a client send: queues the PDUs and tracks the reply
+static void client_send_fire(void *arg)
+{
+    sim_request_t *request = arg;
+    uint16_t dst = request->params.ctx.addr;
+    uint32_t status_op = status_opcode(request->params.opcode);
+    uint8_t net_transmit = stack_net_transmit(request->stack);
+    uint8_t segments = segment_count(access_len(request->params.opcode, request->value_len));
+    int64_t now = sim_now();
+    sim_pending_t *entry = NULL;
+    int err = 0;
+
+    pthread_mutex_lock(&mesh_lock);
+    if (status_op && pending_busy_locked(request->params.model, dst))
+    {
+        stats.busy++;
+        err = -EBUSY;
+    }
+    else if (adv_in_use + segments > config.adv_bufs)
+    {
+        stats.adv_full++;
+        err = -ENOBUFS;
+    }
+    else if (status_op && !(entry = pending_alloc_locked()))
+    {
+        err = -ENOMEM;
+    }
+
+    if (!err)
+    {
+        int64_t on_air_us;
+
+        adv_in_use += segments;
+        stats.adv_peak = MAX(stats.adv_peak, adv_in_use);
+        stats.pdus += segments;
+        bearer_free_us = MAX(bearer_free_us, now) + segments * pdu_airtime_us(net_transmit);
+        on_air_us = bearer_free_us;
+        sim_schedule(on_air_us, adv_release, (void *)(uintptr_t)segments);
+
+        // Every relay of the subnet the message reaches with a TTL of 2 or more floods it
+        // on, whether the destination lies behind it or not
+        for (uint32_t i = 0; i < config.nodes; i++)
+        {
+            if (nodes[i].unicast && nodes[i].info.net_idx == request->params.ctx.net_idx
+                && nodes[i].hops < request->params.ctx.send_ttl)
+            {
+                stats.relayed += segments;
+            }
+        }
+
+        if (entry)
+        {
+            int32_t timeout_ms = request->params.msg_timeout ? request->params.msg_timeout
+                                                             : CONFIG_BLE_MESH_CLIENT_MSG_TIMEOUT;
+            entry->client = request->client;
+            entry->get = request->get;
+            entry->stack = request->stack;
+            entry->params = request->params;
+            entry->status_op = status_op;
+            sim_schedule(on_air_us + (int64_t)timeout_ms * 1000, pending_timeout,
+                         (void *)(uintptr_t)((entry - pending) | (uint32_t)entry->gen << 16));
+        }
+
+        if (ESP_BLE_MESH_ADDR_IS_UNICAST(dst))
+        {
+            if (nodes_by_addr[dst])
+            {
+                deliver_locked(request, nodes_by_addr[dst], segments, net_transmit, on_air_us);
+            }
+        }
+        else if (request->client == SIM_CLIENT_GENERIC)
+        {
+            uint16_t model_id = server_model(request->params.opcode);
+            for (uint32_t i = 0; i < config.nodes; i++)
+            {
+                if (nodes[i].unicast && target_element(&nodes[i], dst, model_id) >= 0)
+                {
+                    deliver_locked(request, &nodes[i], segments, net_transmit, on_air_us);
+                }
+            }
+        }
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    if (err)
+    {
+        sim_error_event_t event = {
+            .stack = request->stack,
+            .client = request->client,
+            .get = request->get,
+            .error_code = err,
+            .params = request->params,
+        };
+        sim_error_event_t *copy = malloc(sizeof(*copy));
+        if (!copy)
+        {
+            abort();
+        }
+        *copy = event;
+        client_error_fire(copy);
+    }
+
+    free(request);
+}
+
+static esp_err_t client_send(sim_client_t client, bool get, esp_ble_mesh_client_common_param_t *params,
+                             const void *state, size_t state_len)
+{
+    sim_request_t *request;
+    sim_stack_t *stack;
+
+    if (!params || !params->model || !params->ctx.addr || (!get && !state))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&mesh_lock);
+    stack = stack_of_model(params->model);
+    pthread_mutex_unlock(&mesh_lock);
+    if (!stack)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    request = calloc(1, sizeof(*request));
+    if (!request)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    request->stack = stack;
+    request->client = client;
+    request->get = get;
+    request->params = *params;
+    request->src = own_addr();
+    if (state)
+    {
+        memcpy(&request->cfg_set, state, state_len);
+    }
+
+    if (client == SIM_CLIENT_GENERIC && !get && params->opcode != ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_GET
+        && (params->opcode == ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_SET
+            || params->opcode == ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_SET_UNACK))
+    {
+        struct net_buf_simple *value = request->gen_set.user_property_set.property_value;
+        if (value)
+        {
+            request->value_len = MIN(value->len, sizeof(request->value));
+            memcpy(request->value, value->data, request->value_len);
+        }
+        request->gen_set.user_property_set.property_value = NULL;
+    }
+    else if (client == SIM_CLIENT_AGG)
+    {
+        struct net_buf_simple *items = request->agg_msg.agg_sequence.items;
+
+        request->value_len = items->len;
+        memcpy(request->value, items->data, items->len);
+        request->agg_msg.agg_sequence.items = NULL;
+    }
+
+    sim_schedule(sim_now(), client_send_fire, request);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_mesh_config_client_get_state(esp_ble_mesh_client_common_param_t *params,
+                                               esp_ble_mesh_cfg_client_get_state_t *get_state)
+{
+    return client_send(SIM_CLIENT_CONFIG, true, params, get_state, sizeof(*get_state));
+}
+
+esp_err_t esp_ble_mesh_config_client_set_state(esp_ble_mesh_client_common_param_t *params,
+                                               esp_ble_mesh_cfg_client_set_state_t *set_state)
+{
+    return client_send(SIM_CLIENT_CONFIG, false, params, set_state, sizeof(*set_state));
+}
+
+esp_err_t esp_ble_mesh_generic_client_get_state(esp_ble_mesh_client_common_param_t *params,
+                                                esp_ble_mesh_generic_client_get_state_t *get_state)
+{
+    return client_send(SIM_CLIENT_GENERIC, true, params, get_state, sizeof(*get_state));
+}
+
+esp_err_t esp_ble_mesh_generic_client_set_state(esp_ble_mesh_client_common_param_t *params,
+                                                esp_ble_mesh_generic_client_set_state_t *set_state)
+{
+    return client_send(SIM_CLIENT_GENERIC, false, params, set_state, sizeof(*set_state));
+}
+
+esp_err_t esp_ble_mesh_agg_client_send(esp_ble_mesh_client_common_param_t *params, esp_ble_mesh_agg_client_msg_t *msg)
+{
+    if (!params || !msg || params->opcode != ESP_BLE_MESH_MODEL_OP_AGG_SEQUENCE || !msg->agg_sequence.items
+        || msg->agg_sequence.items->len + 2 > SIM_ACCESS_MAX - 2)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return client_send(SIM_CLIENT_AGG, false, params, msg, sizeof(*msg));
+}
+
+esp_err_t esp_ble_mesh_register_prov_callback(esp_ble_mesh_prov_cb_t callback)
+{
+    registering.prov_cb = callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_mesh_register_config_client_callback(esp_ble_mesh_cfg_client_cb_t callback)
+{
+    registering.cfg_cb = callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_mesh_register_config_server_callback(esp_ble_mesh_cfg_server_cb_t callback)
+{
+    registering.cfg_srv_cb = callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_mesh_register_generic_client_callback(esp_ble_mesh_generic_client_cb_t callback)
+{
+    registering.generic_cb = callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_mesh_register_agg_callback(esp_ble_mesh_agg_cb_t callback)
+{
+    registering.agg_cb = callback;
+    return ESP_OK;
+}
+
+// Links every model to its element and client models to their user data, as the
+// stack does while initializing the composition
+static void comp_bind(esp_ble_mesh_comp_t *comp)
+{
+    for (size_t e = 0; e < comp->element_count; e++)
+    {
+        esp_ble_mesh_elem_t *elem = &comp->elements[e];
+
+        for (size_t i = 0; i < elem->sig_model_count; i++)
+        {
+            esp_ble_mesh_model_t *model = &elem->sig_models[i];
+
+            model->element = elem;
+            model->element_idx = e;
+            model->model_idx = i;
+            for (size_t c = 0; c < ARRAY_SIZE(client_models); c++)
+            {
+                if (model->model_id == client_models[c] && model->user_data)
+                {
+                    ((esp_ble_mesh_client_t *)model->user_data)->model = model;
+                }
+            }
+        }
+    }
+}
+
+// lib/ runs provisioner and client in one process, each esp_ble_mesh_init() gets its
+// own stack with the callbacks registered just before it
+esp_err_t esp_ble_mesh_init(esp_ble_mesh_prov_t *prov_param, esp_ble_mesh_comp_t *comp)
+{
+    sim_stack_t *stack;
+    esp_ble_mesh_prov_cb_param_t param = {};
+
+    if (!prov_param || !comp || !comp->element_count)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&mesh_lock);
+    if (stack_count == SIM_STACKS_MAX)
+    {
+        pthread_mutex_unlock(&mesh_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    stack = &stacks[stack_count++];
+    *stack = registering;
+    stack->prov = prov_param;
+    stack->comp = comp;
+    comp_bind(comp);
+    memset(&registering, 0, sizeof(registering));
+    pthread_mutex_unlock(&mesh_lock);
+
+    prov_event_post(stack, ESP_BLE_MESH_PROV_REGISTER_COMP_EVT, &param, sim_now());
+
+    return ESP_OK;
+}
+
+static sim_stack_t *latest_stack(void)
+{
+    return stack_count ? &stacks[stack_count - 1] : NULL;
+}
+
+// The provisioner is the stack that made the first provisioner call
+static sim_stack_t *provisioner_stack(void)
+{
+    pthread_mutex_lock(&mesh_lock);
+    if (!prov_stack)
+    {
+        prov_stack = latest_stack();
+        if (prov_stack)
+        {
+            if (!prov.restored)
+            {
+                prov.next_addr = prov_stack->prov->prov_start_address;
+            }
+            for (size_t e = 0; e < prov_stack->comp->element_count; e++)
+            {
+                prov_stack->comp->elements[e].element_addr = own_addr() + e;
+            }
+        }
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    return prov_stack;
+}
+
+static void provisioner_comp(esp_ble_mesh_prov_cb_event_t event, int err_code)
+{
+    esp_ble_mesh_prov_cb_param_t param = {};
+
+    // Every *_comp member starts with err_code
+    param.provisioner_prov_enable_comp.err_code = err_code;
+    prov_event_post(provisioner_stack(), event, &param, sim_now());
+}
+
+esp_err_t esp_ble_mesh_node_prov_enable(esp_ble_mesh_prov_bearer_t bearers)
+{
+    esp_ble_mesh_prov_cb_param_t param = {};
+
+    pthread_mutex_lock(&mesh_lock);
+    node_stack = latest_stack();
+    pthread_mutex_unlock(&mesh_lock);
+    if (!node_stack)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    prov_event_post(node_stack, ESP_BLE_MESH_NODE_PROV_ENABLE_COMP_EVT, &param, sim_now());
+
+    // The node role shares the provisioner's device, which is a node of its own network
+    for (size_t e = 0; e < node_stack->comp->element_count; e++)
+    {
+        node_stack->comp->elements[e].element_addr = own_addr() + e;
+    }
+    param.node_prov_complete.net_idx = config.node_net_idx;
+    param.node_prov_complete.addr = own_addr();
+    prov_event_post(node_stack, ESP_BLE_MESH_NODE_PROV_COMPLETE_EVT, &param, sim_now());
+    node_provisioned = true;
+    node_configure(node_stack);
+
+    return ESP_OK;
+}
+
+// Nothing to turn off, the node never beacons; it only reports back on the stack's task
+esp_err_t esp_ble_mesh_node_prov_disable(esp_ble_mesh_prov_bearer_t bearers)
+{
+    esp_ble_mesh_prov_cb_param_t param = {};
+
+    pthread_mutex_lock(&mesh_lock);
+    node_stack = latest_stack();
+    pthread_mutex_unlock(&mesh_lock);
+    if (!node_stack)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    param.node_prov_disable_comp.err_code = node_provisioned ? -EALREADY : 0;
+    prov_event_post(node_stack, ESP_BLE_MESH_NODE_PROV_DISABLE_COMP_EVT, &param, sim_now());
+
+    return ESP_OK;
+}
+
+// Provisioning without a link, as the stack does at the end of one. The node role shares
+// the provisioner's device, so only its address is accepted; no configuration follows.
+// Internal to the stack, a call from any other task than its own is a bug.
+int bt_mesh_provision(const uint8_t net_key[16], uint16_t net_idx, uint8_t flags, uint32_t iv_index,
+                      uint16_t addr, const uint8_t dev_key[16])
+{
+    if (!sim_on_event_task())
+    {
+        fprintf(stderr, "bt_mesh_provision() called outside the stack's task\n");
+        abort();
+    }
+
+    pthread_mutex_lock(&mesh_lock);
+    node_stack = latest_stack();
+    pthread_mutex_unlock(&mesh_lock);
+    if (!node_stack || node_provisioned)
+    {
+        return -EALREADY;
+    }
+    if (addr != own_addr())
+    {
+        return -EINVAL;
+    }
+
+    for (size_t e = 0; e < node_stack->comp->element_count; e++)
+    {
+        node_stack->comp->elements[e].element_addr = addr + e;
+    }
+    node_provisioned = true;
+
+    return 0;
+}
+
+esp_err_t esp_ble_mesh_node_add_local_app_key(const uint8_t app_key[16], uint16_t net_idx, uint16_t app_idx)
+{
+    esp_ble_mesh_prov_cb_param_t param = {};
+
+    if (!node_stack || !node_provisioned)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    param.node_add_app_key_comp.net_idx = net_idx;
+    param.node_add_app_key_comp.app_idx = app_idx;
+    prov_event_post(node_stack, ESP_BLE_MESH_NODE_ADD_LOCAL_APP_KEY_COMP_EVT, &param, sim_now());
+
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_mesh_node_bind_app_key_to_local_model(uint16_t element_addr, uint16_t company_id,
+                                                        uint16_t model_id, uint16_t app_idx)
+{
+    esp_ble_mesh_prov_cb_param_t param = {};
+    esp_ble_mesh_model_t *model = NULL;
+
+    if (!node_stack || !node_provisioned)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    for (size_t e = 0; e < node_stack->comp->element_count && !model; e++)
+    {
+        esp_ble_mesh_elem_t *elem = &node_stack->comp->elements[e];
+
+        for (size_t i = 0; i < elem->sig_model_count && elem->element_addr == element_addr; i++)
+        {
+            if (elem->sig_models[i].model_id == model_id)
+            {
+                model = &elem->sig_models[i];
+                break;
+            }
+        }
+    }
+
+    param.node_bind_app_key_to_model_comp.element_addr = element_addr;
+    param.node_bind_app_key_to_model_comp.app_idx = app_idx;
+    param.node_bind_app_key_to_model_comp.company_id = company_id;
+    param.node_bind_app_key_to_model_comp.model_id = model_id;
+    if (model)
+    {
+        // The stack binds before it reports
+        model->keys[0] = app_idx;
+    }
+    else
+    {
+        param.node_bind_app_key_to_model_comp.err_code = -ENODEV;
+    }
+    prov_event_post(node_stack, ESP_BLE_MESH_NODE_BIND_APP_KEY_TO_MODEL_COMP_EVT, &param, sim_now());
+
+    return ESP_OK;
+}
+
+bool esp_ble_mesh_node_is_provisioned(void)
+{
+    return node_provisioned;
+}
+
+uint16_t esp_ble_mesh_get_primary_element_address(void)
+{
+    return own_addr();
+}
+
+esp_err_t esp_ble_mesh_provisioner_set_dev_uuid_match(const uint8_t *match_val, uint8_t match_len,
+                                                      uint8_t offset, bool prov_after_match)
+{
+    if (match_len > sizeof(prov.match) || offset + match_len > sizeof(prov.match) || (match_len && !match_val))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    provisioner_stack();
+    pthread_mutex_lock(&mesh_lock);
+    memcpy(prov.match, match_val, match_len);
+    prov.match_len = match_len;
+    prov.match_offset = offset;
+    prov.after_match = prov_after_match;
+    pthread_mutex_unlock(&mesh_lock);
+
+    provisioner_comp(ESP_BLE_MESH_PROVISIONER_SET_DEV_UUID_MATCH_COMP_EVT, 0);
+
+    return ESP_OK;
+}
+
+// Only the NetKey index is modeled, it applies to every link that completes afterwards
+esp_err_t esp_ble_mesh_provisioner_set_prov_data_info(esp_ble_mesh_prov_data_info_t *prov_data_info)
+{
+    int err = 0;
+
+    if (!prov_data_info)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    provisioner_stack();
+    pthread_mutex_lock(&mesh_lock);
+    if (prov_data_info->flag & PROV_DATA_NET_IDX_FLAG)
+    {
+        if (net_key_known_locked(prov_data_info->net_idx))
+        {
+            prov.net_idx = prov_data_info->net_idx;
+        }
+        else
+        {
+            err = -ENODEV;
+        }
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    provisioner_comp(ESP_BLE_MESH_PROVISIONER_SET_PROV_DATA_INFO_COMP_EVT, err);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_mesh_provisioner_prov_enable(esp_ble_mesh_prov_bearer_t bearers)
+{
+    provisioner_stack();
+    pthread_mutex_lock(&mesh_lock);
+    prov.enabled = true;
+    pthread_mutex_unlock(&mesh_lock);
+
+    provisioner_comp(ESP_BLE_MESH_PROVISIONER_PROV_ENABLE_COMP_EVT, 0);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_mesh_provisioner_prov_disable(esp_ble_mesh_prov_bearer_t bearers)
+{
+    pthread_mutex_lock(&mesh_lock);
+    prov.enabled = false;
+    pthread_mutex_unlock(&mesh_lock);
+
+    provisioner_comp(ESP_BLE_MESH_PROVISIONER_PROV_DISABLE_COMP_EVT, 0);
+
+    return ESP_OK;
+}
+
+static void prov_link_open_fire(void *arg)
+{
+    sim_node_t *node = arg;
+    esp_ble_mesh_prov_cb_param_t param = {};
+
+    param.provisioner_prov_link_open.bearer = node->link_bearer;
+    prov_event_post(prov_stack, ESP_BLE_MESH_PROVISIONER_PROV_LINK_OPEN_EVT, &param, sim_now());
+}
+
+// Whether the stack can give the node this range, its own old record aside
+static bool range_available_locked(const sim_node_t *node, uint16_t unicast)
+{
+    if (!ESP_BLE_MESH_ADDR_IS_UNICAST(unicast) || !ESP_BLE_MESH_ADDR_IS_UNICAST(unicast + node->elem_num - 1))
+    {
+        return false;
+    }
+
+    for (uint8_t e = 0; e < node->elem_num; e++)
+    {
+        if (nodes_by_addr[unicast + e] && nodes_by_addr[unicast + e] != node)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Drops the stack's record of a node, mesh_lock held
+static void node_forget_locked(sim_node_t *node)
+{
+    for (uint8_t e = 0; e < node->elem_num; e++)
+    {
+        nodes_by_addr[node->unicast + e] = NULL;
+    }
+    nodes_by_idx[node->node_idx] = NULL;
+    node->unicast = 0;
+    prov.node_count--;
+}
+
+static int node_idx_alloc_locked(void)
+{
+    for (int i = 0; i < CONFIG_BLE_MESH_MAX_PROV_NODES; i++)
+    {
+        if (!nodes_by_idx[i])
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void prov_done_fire(void *arg)
+{
+    sim_node_t *node = arg;
+    esp_ble_mesh_prov_cb_param_t complete = {};
+    esp_ble_mesh_prov_cb_param_t close = {};
+    uint16_t unicast;
+    bool failed;
+
+    pthread_mutex_lock(&mesh_lock);
+    if (node->link_bearer == ESP_BLE_MESH_PROV_GATT)
+    {
+        prov.gatt_links--;
+    }
+    else
+    {
+        prov.adv_links--;
+    }
+    node->linking = false;
+    unicast = node->assign_addr ? node->assign_addr : prov.next_addr;
+    node->assign_addr = 0;
+
+    // A PB-ADV link also dies when a whole transaction and its retransmissions are lost
+    failed = node->link_timeout
+             || (node->link_bearer == ESP_BLE_MESH_PROV_ADV && sim_random_unit() < config.loss * config.loss * config.loss)
+             || (!node->unicast && prov.node_count == CONFIG_BLE_MESH_MAX_PROV_NODES)
+             || !range_available_locked(node, unicast);
+    if (failed)
+    {
+        stats.prov_failed++;
+        stats.prov_timeouts += node->link_timeout;
+    }
+    else
+    {
+        // Like the real stack, a record under the same UUID is replaced
+        if (node->unicast)
+        {
+            node_forget_locked(node);
+        }
+        if (unicast == prov.next_addr)
+        {
+            prov.next_addr += node->elem_num;
+        }
+        node->unicast = unicast;
+        node->node_idx = node_idx_alloc_locked();
+        node->reset = false;
+        prov.node_count++;
+        prov.addr_high = MAX(prov.addr_high, unicast + node->elem_num - 1);
+        for (uint8_t e = 0; e < node->elem_num; e++)
+        {
+            nodes_by_addr[node->unicast + e] = node;
+        }
+        nodes_by_idx[node->node_idx] = node;
+        node->app_keys = 0;
+        node->bound = 0;
+        memset(node->subs, 0, sizeof(node->subs));
+        stats.provisioned++;
+
+        memcpy(node->info.addr, node->bd_addr, BD_ADDR_LEN);
+        memcpy(node->info.dev_uuid, node->uuid, 16);
+        node->info.unicast_addr = node->unicast;
+        node->info.element_num = node->elem_num;
+        node->info.net_idx = prov.net_idx;
+
+        complete.provisioner_prov_complete.node_idx = node->node_idx;
+        memcpy(complete.provisioner_prov_complete.device_uuid, node->uuid, 16);
+        complete.provisioner_prov_complete.unicast_addr = node->unicast;
+        complete.provisioner_prov_complete.element_num = node->elem_num;
+        complete.provisioner_prov_complete.netkey_idx = prov.net_idx;
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    if (!failed)
+    {
+        prov_event_fire(memcpy(malloc(sizeof(sim_prov_event_t)), &(sim_prov_event_t) {
+            .stack = prov_stack, .event = ESP_BLE_MESH_PROVISIONER_PROV_COMPLETE_EVT, .param = complete,
+        }, sizeof(sim_prov_event_t)));
+    }
+
+    close.provisioner_prov_link_close.bearer = node->link_bearer;
+    close.provisioner_prov_link_close.reason = failed ? 0x01 : 0x00;
+    prov_event_post(prov_stack, ESP_BLE_MESH_PROVISIONER_PROV_LINK_CLOSE_EVT, &close, sim_now());
+}
+
+// Opens a link to the node, returns the stack's error code, mesh_lock held
+static int prov_start_locked(sim_node_t *node, uint16_t assign_addr, esp_ble_mesh_prov_bearer_t bearer)
+{
+    bool gatt = bearer == ESP_BLE_MESH_PROV_GATT;
+    int64_t now = sim_now();
+    int64_t duration_us;
+    int edge_db;
+
+    if ((node->unicast && !node->reset) || node->linking)
+    {
+        return -EALREADY;
+    }
+    if (assign_addr && !range_available_locked(node, assign_addr))
+    {
+        return -EINVAL;
+    }
+    if (gatt ? prov.gatt_links >= CONFIG_BLE_MESH_PBG_SAME_TIME : prov.adv_links >= CONFIG_BLE_MESH_PBA_SAME_TIME)
+    {
+        return -EIO;
+    }
+
+    if (gatt)
+    {
+        prov.gatt_links++;
+    }
+    else
+    {
+        prov.adv_links++;
+    }
+    node->linking = true;
+    node->link_bearer = bearer;
+    node->assign_addr = assign_addr;
+
+    // Lost PB-ADV PDUs are retransmitted, stretching the procedure; the link layer
+    // hides losses from PB-GATT
+    duration_us = (int64_t)(config.prov_us * (0.8 + 0.4 * sim_random_unit()) / (gatt ? 1.0 : 1.0 - config.loss));
+
+    // At the edge of the room the link holds its slot until the transaction times out
+    edge_db = (gatt ? SIM_EDGE_RSSI_GATT : SIM_EDGE_RSSI_ADV) - node->rssi;
+    node->link_timeout = edge_db > 0 && sim_random_unit() < edge_db * SIM_EDGE_FAIL_PER_DB;
+    if (node->link_timeout)
+    {
+        duration_us = SIM_LINK_TIMEOUT_US;
+    }
+
+    sim_schedule(now + SIM_LINK_OPEN_US, prov_link_open_fire, node);
+    sim_schedule(now + SIM_LINK_OPEN_US + duration_us, prov_done_fire, node);
+
+    return 0;
+}
+
+static sim_node_t *node_by_uuid(const uint8_t uuid[16])
+{
+    // Devices carry their index in the low BD_ADDR bytes, see sim_mesh_init()
+    uint32_t index = (uint32_t)uuid[5] << 16 | uuid[6] << 8 | uuid[7];
+
+    if (index >= config.nodes + config.strangers || memcmp(nodes[index].uuid, uuid, 16))
+    {
+        return NULL;
+    }
+
+    return &nodes[index];
+}
+
+typedef struct {
+    uint8_t uuid[16];
+    esp_ble_mesh_dev_add_flag_t flags;
+} sim_add_dev_t;
+
+static void add_unprov_dev_fire(void *arg)
+{
+    sim_add_dev_t *add = arg;
+    sim_node_t *node;
+    int err = 0;
+
+    pthread_mutex_lock(&mesh_lock);
+    node = node_by_uuid(add->uuid);
+    if (!node)
+    {
+        err = -EINVAL;
+    }
+    else if (add->flags & ADD_DEV_START_PROV_NOW_FLAG)
+    {
+        err = prov_start_locked(node, 0, ESP_BLE_MESH_PROV_ADV);
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    provisioner_comp(ESP_BLE_MESH_PROVISIONER_ADD_UNPROV_DEV_COMP_EVT, err);
+    free(add);
+}
+
+esp_err_t esp_ble_mesh_provisioner_add_unprov_dev(esp_ble_mesh_unprov_dev_add_t *add_dev,
+                                                  esp_ble_mesh_dev_add_flag_t flags)
+{
+    sim_add_dev_t *add;
+
+    if (!add_dev)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    add = malloc(sizeof(*add));
+    if (!add)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(add->uuid, add_dev->uuid, 16);
+    add->flags = flags;
+    sim_schedule(sim_now(), add_unprov_dev_fire, add);
+
+    return ESP_OK;
+}
+
+typedef struct {
+    uint8_t uuid[16];
+    uint16_t unicast;
+    esp_ble_mesh_prov_bearer_t bearer;
+} sim_prov_dev_t;
+
+static void prov_device_with_addr_fire(void *arg)
+{
+    sim_prov_dev_t *dev = arg;
+    esp_ble_mesh_prov_cb_param_t param = {};
+    sim_node_t *node;
+
+    pthread_mutex_lock(&mesh_lock);
+    node = node_by_uuid(dev->uuid);
+    param.provisioner_prov_dev_with_addr_comp.err_code = node ? prov_start_locked(node, dev->unicast, dev->bearer) : -EINVAL;
+    pthread_mutex_unlock(&mesh_lock);
+
+    prov_event_post(prov_stack, ESP_BLE_MESH_PROVISIONER_PROV_DEV_WITH_ADDR_COMP_EVT, &param, sim_now());
+    free(dev);
+}
+
+esp_err_t esp_ble_mesh_provisioner_prov_device_with_addr(const uint8_t uuid[16], esp_ble_mesh_bd_addr_t addr,
+                                                         esp_ble_mesh_addr_type_t addr_type,
+                                                         esp_ble_mesh_prov_bearer_t bearer, uint16_t oob_info,
+                                                         uint16_t unicast_addr)
+{
+    sim_prov_dev_t *dev;
+
+    if (!uuid || !ESP_BLE_MESH_ADDR_IS_UNICAST(unicast_addr)
+        || (bearer != ESP_BLE_MESH_PROV_ADV && bearer != ESP_BLE_MESH_PROV_GATT))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    dev = malloc(sizeof(*dev));
+    if (!dev)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(dev->uuid, uuid, 16);
+    dev->unicast = unicast_addr;
+    dev->bearer = bearer;
+    sim_schedule(sim_now(), prov_device_with_addr_fire, dev);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_mesh_provisioner_delete_node_with_uuid(const uint8_t uuid[16])
+{
+    esp_ble_mesh_prov_cb_param_t param = {};
+    sim_node_t *node;
+
+    if (!uuid)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&mesh_lock);
+    node = node_by_uuid(uuid);
+    if (node && node->unicast)
+    {
+        node_forget_locked(node);
+    }
+    else
+    {
+        param.provisioner_delete_node_with_uuid_comp.err_code = -ENODEV;
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    memcpy(param.provisioner_delete_node_with_uuid_comp.uuid, uuid, 16);
+    prov_event_post(provisioner_stack(), ESP_BLE_MESH_PROVISIONER_DELETE_NODE_WITH_UUID_COMP_EVT, &param, sim_now());
+
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_mesh_provisioner_delete_node_with_addr(uint16_t unicast_addr)
+{
+    esp_ble_mesh_prov_cb_param_t param = {};
+    sim_node_t *node;
+
+    if (!ESP_BLE_MESH_ADDR_IS_UNICAST(unicast_addr))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&mesh_lock);
+    node = nodes_by_addr[unicast_addr];
+    if (node && node->unicast == unicast_addr)
+    {
+        node_forget_locked(node);
+    }
+    else
+    {
+        param.provisioner_delete_node_with_addr_comp.err_code = -ENODEV;
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    param.provisioner_delete_node_with_addr_comp.unicast_addr = unicast_addr;
+    prov_event_post(provisioner_stack(), ESP_BLE_MESH_PROVISIONER_DELETE_NODE_WITH_ADDR_COMP_EVT, &param, sim_now());
+
+    return ESP_OK;
+}
+
+typedef struct {
+    uint16_t index;
+    char name[SIM_NODE_NAME_LEN + 1];
+} sim_node_name_t;
+
+static void set_node_name_fire(void *arg)
+{
+    sim_node_name_t *set = arg;
+    esp_ble_mesh_prov_cb_param_t param = {};
+
+    pthread_mutex_lock(&mesh_lock);
+    if (set->index < CONFIG_BLE_MESH_MAX_PROV_NODES && nodes_by_idx[set->index])
+    {
+        memcpy(nodes_by_idx[set->index]->name, set->name, sizeof(set->name));
+    }
+    else
+    {
+        param.provisioner_set_node_name_comp.err_code = -EINVAL;
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    param.provisioner_set_node_name_comp.node_index = set->index;
+    prov_event_fire(memcpy(malloc(sizeof(sim_prov_event_t)), &(sim_prov_event_t) {
+        .stack = prov_stack, .event = ESP_BLE_MESH_PROVISIONER_SET_NODE_NAME_COMP_EVT, .param = param,
+    }, sizeof(sim_prov_event_t)));
+    free(set);
+}
+
+esp_err_t esp_ble_mesh_provisioner_set_node_name(uint16_t index, const char *name)
+{
+    sim_node_name_t *set;
+
+    if (!name)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    set = calloc(1, sizeof(*set));
+    if (!set)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    set->index = index;
+    strncpy(set->name, name, SIM_NODE_NAME_LEN);
+    sim_schedule(sim_now(), set_node_name_fire, set);
+
+    return ESP_OK;
+}
+
+esp_ble_mesh_node_t *esp_ble_mesh_provisioner_get_node_with_uuid(const uint8_t uuid[16])
+{
+    esp_ble_mesh_node_t *info = NULL;
+    sim_node_t *node;
+
+    pthread_mutex_lock(&mesh_lock);
+    node = uuid ? node_by_uuid(uuid) : NULL;
+    if (node && node->unicast)
+    {
+        info = &node->info;
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    return info;
+}
+
+uint16_t esp_ble_mesh_provisioner_get_prov_node_count(void)
+{
+    uint16_t count;
+
+    pthread_mutex_lock(&mesh_lock);
+    count = prov.node_count;
+    pthread_mutex_unlock(&mesh_lock);
+
+    return count;
+}
+
+// Like the stack's own table, indexed by node_idx with NULL for free entries
+const esp_ble_mesh_node_t **esp_ble_mesh_provisioner_get_node_table_entry(void)
+{
+    static const esp_ble_mesh_node_t *table[CONFIG_BLE_MESH_MAX_PROV_NODES];
+
+    pthread_mutex_lock(&mesh_lock);
+    for (int i = 0; i < CONFIG_BLE_MESH_MAX_PROV_NODES; i++)
+    {
+        table[i] = nodes_by_idx[i] ? &nodes_by_idx[i]->info : NULL;
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    return table;
+}
+
+const char *esp_ble_mesh_provisioner_get_node_name(uint16_t index)
+{
+    const char *name = NULL;
+
+    pthread_mutex_lock(&mesh_lock);
+    if (index < CONFIG_BLE_MESH_MAX_PROV_NODES && nodes_by_idx[index])
+    {
+        name = nodes_by_idx[index]->name;
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    return name;
+}
+
+esp_err_t esp_ble_mesh_provisioner_add_local_net_key(const uint8_t net_key[16], uint16_t net_idx)
+{
+    esp_ble_mesh_prov_cb_param_t param = {};
+    int err = 0;
+
+    if (net_idx >= 32)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // The primary subnet takes one of the slots
+    pthread_mutex_lock(&mesh_lock);
+    if (net_key_known_locked(net_idx))
+    {
+        err = -EEXIST;
+    }
+    else if (__builtin_popcount(prov.net_keys) + 1 >= CONFIG_BLE_MESH_PROVISIONER_SUBNET_COUNT)
+    {
+        err = -ENOMEM;
+    }
+    else
+    {
+        prov.net_keys |= 1u << net_idx;
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    param.provisioner_add_net_key_comp.err_code = err;
+    param.provisioner_add_net_key_comp.net_idx = net_idx;
+    prov_event_post(provisioner_stack(), ESP_BLE_MESH_PROVISIONER_ADD_LOCAL_NET_KEY_COMP_EVT, &param, sim_now());
+
+    return ESP_OK;
+}
+
+// A NULL key is generated, like the real stack does
+esp_err_t esp_ble_mesh_provisioner_add_local_app_key(const uint8_t app_key[16], uint16_t net_idx, uint16_t app_idx)
+{
+    esp_ble_mesh_prov_cb_param_t param = {};
+    int err = 0;
+
+    if (app_idx >= SIM_APP_KEYS_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&mesh_lock);
+    if (!net_key_known_locked(net_idx))
+    {
+        err = -ENODEV;
+    }
+    else if (prov.app_keys[app_idx].used)
+    {
+        err = -EEXIST;
+    }
+    else
+    {
+        prov.app_keys[app_idx].used = true;
+        prov.app_keys[app_idx].net_idx = net_idx;
+        for (int i = 0; i < 16; i++)
+        {
+            prov.app_keys[app_idx].key[i] = app_key ? app_key[i] : (uint8_t)(sim_random_unit() * 256);
+        }
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    param.provisioner_add_app_key_comp.err_code = err;
+    param.provisioner_add_app_key_comp.net_idx = net_idx;
+    param.provisioner_add_app_key_comp.app_idx = app_idx;
+    prov_event_post(provisioner_stack(), ESP_BLE_MESH_PROVISIONER_ADD_LOCAL_APP_KEY_COMP_EVT, &param, sim_now());
+
+    return ESP_OK;
+}
+
+const uint8_t *esp_ble_mesh_provisioner_get_local_app_key(uint16_t net_idx, uint16_t app_idx)
+{
+    const uint8_t *key = NULL;
+
+    pthread_mutex_lock(&mesh_lock);
+    if (app_idx < SIM_APP_KEYS_MAX && prov.app_keys[app_idx].used && prov.app_keys[app_idx].net_idx == net_idx)
+    {
+        key = prov.app_keys[app_idx].key;
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    return key;
+}
+
+esp_err_t esp_ble_mesh_provisioner_bind_app_key_to_local_model(uint16_t element_addr, uint16_t app_idx,
+                                                               uint16_t model_id, uint16_t company_id)
+{
+    provisioner_comp(ESP_BLE_MESH_PROVISIONER_BIND_APP_KEY_TO_MODEL_COMP_EVT, 0);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_mesh_provisioner_recv_heartbeat(bool enable)
+{
+    esp_ble_mesh_prov_cb_param_t param = {};
+
+    pthread_mutex_lock(&mesh_lock);
+    prov.hb_recv = enable;
+    pthread_mutex_unlock(&mesh_lock);
+
+    param.provisioner_enable_heartbeat_recv_comp.enable = enable;
+    prov_event_post(provisioner_stack(), ESP_BLE_MESH_PROVISIONER_ENABLE_HEARTBEAT_RECV_COMP_EVT, &param, sim_now());
+
+    return ESP_OK;
+}
+
+// Filter entries are not kept: an empty reject list passes every heartbeat, an empty
+// accept list none
+esp_err_t esp_ble_mesh_provisioner_set_heartbeat_filter_type(uint8_t type)
+{
+    esp_ble_mesh_prov_cb_param_t param = {};
+
+    if (type > ESP_BLE_MESH_PROVISIONER_HB_FILTER_ACCEPT_LIST)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&mesh_lock);
+    prov.hb_filter = type;
+    pthread_mutex_unlock(&mesh_lock);
+
+    param.provisioner_set_heartbeat_filter_type_comp.type = type;
+    prov_event_post(provisioner_stack(), ESP_BLE_MESH_PROVISIONER_SET_HEARTBEAT_FILTER_TYPE_COMP_EVT, &param,
+                    sim_now());
+
+    return ESP_OK;
+}
+
+static void beacon_fire(void *arg)
+{
+    sim_node_t *node = arg;
+    esp_ble_mesh_prov_cb_param_t param = {};
+    bool report = false;
+    bool matches;
+
+    pthread_mutex_lock(&mesh_lock);
+    if ((node->unicast && !node->reset) || node->off)
+    {
+        // Provisioned devices stop sending unprovisioned device beacons
+        pthread_mutex_unlock(&mesh_lock);
+        return;
+    }
+
+    matches = !memcmp(node->uuid + prov.match_offset, prov.match, prov.match_len);
+    if (prov.enabled && matches && !node->linking)
+    {
+        if (prov.after_match)
+        {
+            if (sim_random_unit() >= config.loss)
+            {
+                prov_start_locked(node, 0, ESP_BLE_MESH_PROV_ADV);
+            }
+        }
+        else
+        {
+            report = true;
+            memcpy(param.provisioner_recv_unprov_adv_pkt.dev_uuid, node->uuid, 16);
+            memcpy(param.provisioner_recv_unprov_adv_pkt.addr, node->bd_addr, BD_ADDR_LEN);
+        }
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    sim_schedule(sim_now() + CONFIG_BLE_MESH_UNPROVISIONED_BEACON_INTERVAL * 1000000LL
+                 + (int64_t)(sim_random_unit() * 100000), beacon_fire, node);
+
+    // The stack reports every copy it scans, each one is lost on its own
+    for (uint8_t i = 0; report && i < SIM_BEACON_REPORTS; i++)
+    {
+        if (sim_random_unit() < config.loss)
+        {
+            continue;
+        }
+        param.provisioner_recv_unprov_adv_pkt.bearer = i < SIM_BEACON_REPORTS - 1 ? ESP_BLE_MESH_PROV_ADV
+                                                                                  : ESP_BLE_MESH_PROV_GATT;
+        param.provisioner_recv_unprov_adv_pkt.rssi = node->rssi + (int8_t)(sim_random_unit() * 7) - 3;
+        pthread_mutex_lock(&mesh_lock);
+        stats.beacons++;
+        pthread_mutex_unlock(&mesh_lock);
+        prov_event_post(prov_stack, ESP_BLE_MESH_PROVISIONER_RECV_UNPROV_ADV_PKT_EVT, &param,
+                        sim_now() + i * SIM_BEACON_GAP_US);
+    }
+}
+
+// Each robot goes 0.5 to 1 range away from the provisioner or a robot placed before it
+// fewer than max_hops placements deep, the tree of placements bounds the hop counts
+static void place_robots(void)
+{
+    uint32_t *parents = calloc(config.nodes + 1, sizeof(*parents));
+    uint8_t *depth = calloc(config.nodes + 1, sizeof(*depth));
+    uint32_t parent_count = 1;
+
+    if (!parents || !depth)
+    {
+        abort();
+    }
+
+    // Index config.nodes stands for the provisioner
+    parents[0] = config.nodes;
+    for (uint32_t i = 0; i < config.nodes; i++)
+    {
+        uint32_t parent = parents[(uint32_t)(sim_random_unit() * parent_count)];
+        double angle = sim_random_unit() * 2 * M_PI;
+        double distance = SIM_RANGE * (0.5 + sim_random_unit() / 2);
+
+        nodes[i].x = (parent < config.nodes ? nodes[parent].x : 0) + distance * cos(angle);
+        nodes[i].y = (parent < config.nodes ? nodes[parent].y : 0) + distance * sin(angle);
+        depth[i] = depth[parent] + 1;
+        if (depth[i] < config.max_hops)
+        {
+            parents[parent_count++] = i;
+        }
+    }
+
+    free(parents);
+    free(depth);
+}
+
+// Robot index config.nodes is the provisioner at the origin
+static bool in_range(uint32_t a, uint32_t b)
+{
+    double ax = a < config.nodes ? nodes[a].x : 0;
+    double ay = a < config.nodes ? nodes[a].y : 0;
+    double bx = b < config.nodes ? nodes[b].x : 0;
+    double by = b < config.nodes ? nodes[b].y : 0;
+
+    return (ax - bx) * (ax - bx) + (ay - by) * (ay - by) <= SIM_RANGE * SIM_RANGE;
+}
+
+static bool powered(uint32_t i)
+{
+    return i == config.nodes || !nodes[i].off;
+}
+
+// Breadth first from every powered robot and the provisioner over the links between
+// powered robots, mesh_lock held
+static void hops_update_locked(void)
+{
+    uint32_t count = config.nodes + 1;
+    uint32_t *offsets = calloc(count + 1, sizeof(*offsets));
+    uint32_t *queue = calloc(count, sizeof(*queue));
+    uint8_t *dist = malloc(count);
+    uint32_t *adjacency;
+
+    if (!hops_between)
+    {
+        hops_between = malloc((size_t)config.nodes * config.nodes);
+    }
+    if (!offsets || !queue || !dist || !hops_between)
+    {
+        abort();
+    }
+
+    for (uint32_t a = 0; a < count; a++)
+    {
+        for (uint32_t b = a + 1; b < count; b++)
+        {
+            if (powered(a) && powered(b) && in_range(a, b))
+            {
+                offsets[a + 1]++;
+                offsets[b + 1]++;
+            }
+        }
+    }
+    for (uint32_t a = 0; a < count; a++)
+    {
+        offsets[a + 1] += offsets[a];
+    }
+    adjacency = malloc((offsets[count] + 1) * sizeof(*adjacency));
+    if (!adjacency)
+    {
+        abort();
+    }
+    // The queue serves as fill cursor first
+    for (uint32_t a = 0; a < count; a++)
+    {
+        queue[a] = offsets[a];
+    }
+    for (uint32_t a = 0; a < count; a++)
+    {
+        for (uint32_t b = a + 1; b < count; b++)
+        {
+            if (powered(a) && powered(b) && in_range(a, b))
+            {
+                adjacency[queue[a]++] = b;
+                adjacency[queue[b]++] = a;
+            }
+        }
+    }
+
+    for (uint32_t from = 0; from < count; from++)
+    {
+        uint32_t head = 0;
+        uint32_t tail = 0;
+
+        memset(dist, SIM_HOPS_NONE, count);
+        if (powered(from))
+        {
+            dist[from] = 0;
+            queue[tail++] = from;
+        }
+        while (head < tail)
+        {
+            uint32_t a = queue[head++];
+
+            // Robots beyond the reach of any TTL are as good as cut off
+            for (uint32_t e = offsets[a]; e < offsets[a + 1] && dist[a] < SIM_HOPS_NONE - 1; e++)
+            {
+                if (dist[adjacency[e]] == SIM_HOPS_NONE)
+                {
+                    dist[adjacency[e]] = dist[a] + 1;
+                    queue[tail++] = adjacency[e];
+                }
+            }
+        }
+
+        if (from == config.nodes)
+        {
+            for (uint32_t i = 0; i < config.nodes; i++)
+            {
+                nodes[i].hops = dist[i];
+            }
+        }
+        else
+        {
+            memcpy(&hops_between[(size_t)from * config.nodes], dist, config.nodes);
+        }
+    }
+
+    free(adjacency);
+    free(dist);
+    free(queue);
+    free(offsets);
+}
+
+void sim_mesh_init(const sim_mesh_config_t *cfg)
+{
+    config = *cfg;
+    config.elem_num = MAX(1, MIN(config.elem_num, SIM_ELEMS_MAX));
+
+    nodes = calloc(config.nodes + config.strangers, sizeof(*nodes));
+    if (!nodes)
+    {
+        abort();
+    }
+
+    // Strangers come after the robots of the fleet, only their index tells them apart
+    for (uint32_t i = 0; i < config.nodes + config.strangers; i++)
+    {
+        sim_node_t *node = &nodes[i];
+
+        // Same layout as ble_mesh_get_dev_uuid(): match prefix, then the BD_ADDR
+        node->bd_addr[0] = 0x24;
+        node->bd_addr[1] = 0x6f;
+        node->bd_addr[2] = 0x28;
+        node->bd_addr[3] = i >> 16;
+        node->bd_addr[4] = i >> 8;
+        node->bd_addr[5] = i;
+        node->uuid[0] = 0xdd;
+        node->uuid[1] = 0xdd;
+        memcpy(node->uuid + 2, node->bd_addr, BD_ADDR_LEN);
+        node->elem_num = config.elem_mixed ? 1 + i % config.elem_num : config.elem_num;
+        node->battery = 50 + i % 50;
+        node->rssi = -45 - (int8_t)(sim_random_unit() * 50);
+        node->hops = 1;
+        node->agg = sim_random_unit() < config.agg;
+
+        // Devices are switched on within the first beacon interval
+        sim_schedule((int64_t)(sim_random_unit() * CONFIG_BLE_MESH_UNPROVISIONED_BEACON_INTERVAL * 1000000LL),
+                     beacon_fire, node);
+    }
+
+    // A single hop puts every robot at the origin, in range of all others
+    if (config.max_hops > 1)
+    {
+        place_robots();
+    }
+    hops_update_locked();
+}
+
+void sim_mesh_get_stats(sim_mesh_stats_t *out)
+{
+    pthread_mutex_lock(&mesh_lock);
+    *out = stats;
+    pthread_mutex_unlock(&mesh_lock);
+}
+
+bool sim_mesh_get_uuid(uint32_t index, uint8_t uuid[16])
+{
+    if (index >= config.nodes + config.strangers)
+    {
+        return false;
+    }
+
+    memcpy(uuid, nodes[index].uuid, 16);
+    return true;
+}
+
+bool sim_mesh_reset_node(uint16_t unicast)
+{
+    sim_node_t *node = NULL;
+
+    pthread_mutex_lock(&mesh_lock);
+    if (ESP_BLE_MESH_ADDR_IS_UNICAST(unicast) && nodes_by_addr[unicast] && !nodes_by_addr[unicast]->reset)
+    {
+        node = nodes_by_addr[unicast];
+        node->reset = true;
+        node->app_keys = 0;
+        node->bound = 0;
+        memset(node->subs, 0, sizeof(node->subs));
+        node->hb_dst = ESP_BLE_MESH_ADDR_UNASSIGNED;
+        node->hb_sub_src = ESP_BLE_MESH_ADDR_UNASSIGNED;
+        node->hb_sub_end_us = 0;
+        heartbeat_start_locked(node);
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    // Back up and beaconing after a reboot
+    if (node)
+    {
+        sim_schedule(sim_now() + 1000000 + (int64_t)(sim_random_unit() * 1000000), beacon_fire, node);
+    }
+
+    return node;
+}
+
+bool sim_mesh_power_off(uint16_t unicast)
+{
+    bool done = false;
+
+    pthread_mutex_lock(&mesh_lock);
+    if (ESP_BLE_MESH_ADDR_IS_UNICAST(unicast) && nodes_by_addr[unicast] && !nodes_by_addr[unicast]->off)
+    {
+        nodes_by_addr[unicast]->off = true;
+        hops_update_locked();
+        done = true;
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    return done;
+}
+
+// Robot index of a unicast address, config.nodes for the provisioner, -1 for neither
+static int64_t robot_index_locked(uint16_t addr)
+{
+    if (addr == own_addr())
+    {
+        return config.nodes;
+    }
+    if (!ESP_BLE_MESH_ADDR_IS_UNICAST(addr) || !nodes_by_addr[addr] || nodes_by_addr[addr]->off
+        || nodes_by_addr[addr]->reset || nodes_by_addr[addr] - nodes >= config.nodes)
+    {
+        return -1;
+    }
+
+    return nodes_by_addr[addr] - nodes;
+}
+
+bool sim_mesh_linked(uint16_t a, uint16_t b)
+{
+    bool linked;
+    int64_t i;
+    int64_t j;
+
+    pthread_mutex_lock(&mesh_lock);
+    i = robot_index_locked(a);
+    j = robot_index_locked(b);
+    linked = i >= 0 && j >= 0 && i != j && in_range(i, j);
+    pthread_mutex_unlock(&mesh_lock);
+
+    return linked;
+}
+
+uint32_t sim_mesh_links(void)
+{
+    uint32_t links = 0;
+
+    pthread_mutex_lock(&mesh_lock);
+    for (uint32_t a = 0; a <= config.nodes; a++)
+    {
+        for (uint32_t b = a + 1; b <= config.nodes; b++)
+        {
+            bool on_a = a == config.nodes || (nodes[a].unicast && !nodes[a].reset && !nodes[a].off);
+            bool on_b = b == config.nodes || (nodes[b].unicast && !nodes[b].reset && !nodes[b].off);
+
+            links += on_a && on_b && in_range(a, b);
+        }
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    return links;
+}
+
+uint16_t sim_mesh_addr_high(void)
+{
+    uint16_t high;
+
+    pthread_mutex_lock(&mesh_lock);
+    high = prov.addr_high;
+    pthread_mutex_unlock(&mesh_lock);
+
+    return high;
+}
+
+size_t sim_mesh_get_nodes(uint16_t *addrs, size_t max)
+{
+    size_t count = 0;
+
+    pthread_mutex_lock(&mesh_lock);
+    for (uint32_t addr = 1; addr < ARRAY_SIZE(nodes_by_addr) && count < max; addr++)
+    {
+        const sim_node_t *node = nodes_by_addr[addr];
+
+        if (node && node->unicast == addr && node->app_keys && !node->off && !node->reset)
+        {
+            addrs[count++] = addr;
+        }
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    return count;
+}
+
+uint32_t sim_mesh_node_sets(uint16_t unicast)
+{
+    uint32_t sets = 0;
+
+    pthread_mutex_lock(&mesh_lock);
+    if (ESP_BLE_MESH_ADDR_IS_UNICAST(unicast) && nodes_by_addr[unicast])
+    {
+        sets = nodes_by_addr[unicast]->sets;
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    return sets;
+}
+
+bool sim_mesh_node_onoff(uint16_t unicast, uint8_t *onoff)
+{
+    sim_node_t *node = NULL;
+
+    pthread_mutex_lock(&mesh_lock);
+    if (ESP_BLE_MESH_ADDR_IS_UNICAST(unicast) && nodes_by_addr[unicast])
+    {
+        node = nodes_by_addr[unicast];
+        *onoff = node->onoff[unicast - node->unicast];
+    }
+    pthread_mutex_unlock(&mesh_lock);
+
+    return node != NULL;
+}
+
+typedef struct {
+    uint32_t magic;
+    uint32_t nodes;
+    uint32_t node_size;
+    uint8_t elem_num;
+    bool elem_mixed;
+    uint16_t next_addr;
+    uint16_t node_count;
+    uint16_t addr_high;
+} sim_state_header_t;
+
+bool sim_mesh_save(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    sim_state_header_t header = {
+        .magic = SIM_STATE_MAGIC,
+        .nodes = config.nodes,
+        .node_size = sizeof(sim_node_t),
+        .elem_num = config.elem_num,
+        .elem_mixed = config.elem_mixed,
+    };
+    bool ok;
+
+    if (!file)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&mesh_lock);
+    header.next_addr = prov.next_addr;
+    header.node_count = prov.node_count;
+    header.addr_high = prov.addr_high;
+    ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(nodes, sizeof(*nodes), config.nodes, file) == config.nodes;
+    pthread_mutex_unlock(&mesh_lock);
+
+    return fclose(file) == 0 && ok;
+}
+
+bool sim_mesh_load(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    sim_state_header_t header;
+    sim_node_t *loaded;
+    bool ok;
+
+    if (!file)
+    {
+        return false;
+    }
+
+    loaded = calloc(config.nodes, sizeof(*loaded));
+    ok = loaded && fread(&header, sizeof(header), 1, file) == 1 && header.magic == SIM_STATE_MAGIC
+         && header.nodes == config.nodes && header.node_size == sizeof(sim_node_t)
+         && header.elem_num == config.elem_num && header.elem_mixed == config.elem_mixed
+         && fread(loaded, sizeof(*loaded), config.nodes, file) == config.nodes;
+    fclose(file);
+
+    if (ok)
+    {
+        pthread_mutex_lock(&mesh_lock);
+        for (uint32_t i = 0; i < config.nodes; i++)
+        {
+            sim_node_t *node = &nodes[i];
+
+            *node = loaded[i];
+            node->linking = false;
+            node->tx_free_us = 0;
+            node->tid_us = 0;
+            node->hb_sub_end_us = 0;
+            heartbeat_start_locked(node);
+            if (node->unicast)
+            {
+                for (uint8_t e = 0; e < node->elem_num; e++)
+                {
+                    nodes_by_addr[node->unicast + e] = node;
+                }
+                nodes_by_idx[node->node_idx] = node;
+            }
+        }
+        prov.next_addr = header.next_addr;
+        prov.node_count = header.node_count;
+        prov.addr_high = header.addr_high;
+        prov.restored = true;
+        hops_update_locked();
+        pthread_mutex_unlock(&mesh_lock);
+    }
+    free(loaded);
+
+    return ok;
+}
@@ -0,0 +1,384 @@
+// NVS stand-in: blobs in memory, optionally loaded from and saved to a file so a
+// second run starts with the flash contents of the first
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+
+#include "nvs_flash.h"
+
+#define SIM_NVS_NAMESPACES_MAX  8
+
+typedef struct sim_nvs_entry {
+    char ns[NVS_NS_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    size_t len;
+    uint8_t *data;
+    struct sim_nvs_entry *next;
+} sim_nvs_entry_t;
+
+struct sim_nvs_iterator {
+    char ns[NVS_NS_NAME_MAX_SIZE];
+    sim_nvs_entry_t *entry;
+};
+
+static pthread_mutex_t nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_nvs_entry_t *entries;
+static char namespaces[SIM_NVS_NAMESPACES_MAX][NVS_NS_NAME_MAX_SIZE];
+static size_t namespace_count;
+
+// Looks up the entry, locked
+static sim_nvs_entry_t **entry_find(const char *ns, const char *key)
+{
+    sim_nvs_entry_t **pos = &entries;
+
+    while (*pos && (strcmp((*pos)->ns, ns) || strcmp((*pos)->key, key)))
+    {
+        pos = &(*pos)->next;
+    }
+
+    return pos;
+}
+
+static const char *handle_namespace(nvs_handle_t handle)
+{
+    return handle && handle <= namespace_count ? namespaces[handle - 1] : NULL;
+}
+
+static esp_err_t entry_set(const char *ns, const char *key, const void *value, size_t length)
+{
+    sim_nvs_entry_t **pos = entry_find(ns, key);
+    uint8_t *data = malloc(length ? length : 1);
+
+    if (!data)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(data, value, length);
+
+    if (!*pos)
+    {
+        *pos = calloc(1, sizeof(**pos));
+        if (!*pos)
+        {
+            free(data);
+            return ESP_ERR_NO_MEM;
+        }
+        strncpy((*pos)->ns, ns, NVS_NS_NAME_MAX_SIZE - 1);
+        strncpy((*pos)->key, key, NVS_KEY_NAME_MAX_SIZE - 1);
+    }
+    free((*pos)->data);
+    (*pos)->data = data;
+    (*pos)->len = length;
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    pthread_mutex_lock(&nvs_lock);
+    while (entries)
+    {
+        sim_nvs_entry_t *next = entries->next;
+        free(entries->data);
+        free(entries);
+        entries = next;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    esp_err_t err = ESP_OK;
+    size_t i;
+
+    if (!namespace_name || strlen(namespace_name) >= NVS_NS_NAME_MAX_SIZE || !out_handle)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    for (i = 0; i < namespace_count && strcmp(namespaces[i], namespace_name); i++)
+    {
+    }
+    if (i == namespace_count)
+    {
+        if (namespace_count == SIM_NVS_NAMESPACES_MAX)
+        {
+            err = ESP_ERR_NO_MEM;
+        }
+        else
+        {
+            strcpy(namespaces[namespace_count++], namespace_name);
+        }
+    }
+    *out_handle = i + 1;
+    pthread_mutex_unlock(&nvs_lock);
+
+    return err;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    const char *ns = handle_namespace(handle);
+    sim_nvs_entry_t *entry;
+    esp_err_t err = ESP_OK;
+
+    if (!ns)
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    entry = *entry_find(ns, key);
+    if (!entry)
+    {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    }
+    else if (!out_value)
+    {
+        *length = entry->len;
+    }
+    else if (*length < entry->len)
+    {
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    else
+    {
+        memcpy(out_value, entry->data, entry->len);
+        *length = entry->len;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+
+    return err;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    const char *ns = handle_namespace(handle);
+    esp_err_t err;
+
+    if (!ns)
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (!key || strlen(key) >= NVS_KEY_NAME_MAX_SIZE)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    err = entry_set(ns, key, value, length);
+    pthread_mutex_unlock(&nvs_lock);
+
+    return err;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    const char *ns = handle_namespace(handle);
+    sim_nvs_entry_t **pos;
+    sim_nvs_entry_t *entry;
+
+    if (!ns)
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    pos = entry_find(ns, key);
+    entry = *pos;
+    if (entry)
+    {
+        *pos = entry->next;
+        free(entry->data);
+        free(entry);
+    }
+    pthread_mutex_unlock(&nvs_lock);
+
+    return entry ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle)
+{
+    const char *ns = handle_namespace(handle);
+    sim_nvs_entry_t **pos = &entries;
+
+    if (!ns)
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    while (*pos)
+    {
+        sim_nvs_entry_t *entry = *pos;
+        if (!strcmp(entry->ns, ns))
+        {
+            *pos = entry->next;
+            free(entry->data);
+            free(entry);
+        }
+        else
+        {
+            pos = &entry->next;
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return handle_namespace(handle) ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+}
+
+// Moves the iterator to the first entry of its namespace at or after entry, locked
+static sim_nvs_entry_t *iterator_skip(const char *ns, sim_nvs_entry_t *entry)
+{
+    while (entry && strcmp(entry->ns, ns))
+    {
+        entry = entry->next;
+    }
+
+    return entry;
+}
+
+esp_err_t nvs_entry_find(const char *part_name, const char *namespace_name, nvs_type_t type,
+                         nvs_iterator_t *output_iterator)
+{
+    struct sim_nvs_iterator *it;
+
+    *output_iterator = NULL;
+    if (type != NVS_TYPE_BLOB && type != NVS_TYPE_ANY)
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    it = calloc(1, sizeof(*it));
+    if (!it)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    strncpy(it->ns, namespace_name, NVS_NS_NAME_MAX_SIZE - 1);
+
+    pthread_mutex_lock(&nvs_lock);
+    it->entry = iterator_skip(it->ns, entries);
+    pthread_mutex_unlock(&nvs_lock);
+
+    if (!it->entry)
+    {
+        free(it);
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *output_iterator = it;
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_entry_next(nvs_iterator_t *iterator)
+{
+    struct sim_nvs_iterator *it = *iterator;
+
+    pthread_mutex_lock(&nvs_lock);
+    it->entry = iterator_skip(it->ns, it->entry->next);
+    pthread_mutex_unlock(&nvs_lock);
+
+    if (!it->entry)
+    {
+        free(it);
+        *iterator = NULL;
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t nvs_entry_info(const nvs_iterator_t iterator, nvs_entry_info_t *out_info)
+{
+    memset(out_info, 0, sizeof(*out_info));
+    strcpy(out_info->namespace_name, iterator->entry->ns);
+    strcpy(out_info->key, iterator->entry->key);
+    out_info->type = NVS_TYPE_BLOB;
+
+    return ESP_OK;
+}
+
+void nvs_release_iterator(nvs_iterator_t iterator)
+{
+    free(iterator);
+}
+
+bool sim_nvs_load(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    char ns[NVS_NS_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint32_t len;
+    uint8_t *data;
+
+    if (!file)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    while (fread(ns, sizeof(ns), 1, file) == 1 && fread(key, sizeof(key), 1, file) == 1
+           && fread(&len, sizeof(len), 1, file) == 1)
+    {
+        data = malloc(len ? len : 1);
+        if (!data || fread(data, 1, len, file) != len)
+        {
+            free(data);
+            break;
+        }
+        ns[sizeof(ns) - 1] = '\0';
+        key[sizeof(key) - 1] = '\0';
+        entry_set(ns, key, data, len);
+        free(data);
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    fclose(file);
+
+    return true;
+}
+
+bool sim_nvs_save(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    bool ok = file != NULL;
+
+    if (!file)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    for (sim_nvs_entry_t *entry = entries; entry; entry = entry->next)
+    {
+        uint32_t len = entry->len;
+        ok &= fwrite(entry->ns, sizeof(entry->ns), 1, file) == 1;
+        ok &= fwrite(entry->key, sizeof(entry->key), 1, file) == 1;
+        ok &= fwrite(&len, sizeof(len), 1, file) == 1;
+        ok &= fwrite(entry->data, 1, len, file) == len;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    ok &= fclose(file) == 0;
+
+    return ok;
+}
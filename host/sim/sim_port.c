@@ -0,0 +1,167 @@
+// Small ESP-IDF and NimBLE pieces lib/ links against: logging, error names,
+// the console and a NimBLE host that syncs SIM_HOST_SYNC_MS after its task starts
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+
+#include "esp_ble_mesh_defs.h"
+#include "esp_console.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "freertos/semphr.h"
+#include "host/ble_hs.h"
+#include "host/util/util.h"
+#include "nimble/nimble_port.h"
+#include "nimble/nimble_port_freertos.h"
+
+// Controller bring-up until the host is in sync, an assumed figure in the range of a
+// few hundred ms real controllers take
+#define SIM_HOST_SYNC_MS 200
+
+esp_log_level_t sim_log_level = ESP_LOG_ERROR;
+
+struct ble_hs_cfg ble_hs_cfg;
+
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void sim_log(esp_log_level_t level, const char *tag, const char *fmt, ...)
+{
+    static const char letters[] = "-EWIDV";
+    va_list args;
+
+    pthread_mutex_lock(&log_lock);
+    fprintf(stderr, "%c (%.3f) %s: ", letters[level], sim_now() / 1e6, tag);
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+    pthread_mutex_unlock(&log_lock);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+        case ESP_OK:
+            return "ESP_OK";
+        case ESP_FAIL:
+            return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:
+            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:
+            return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:
+            return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:
+            return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:
+            return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED:
+            return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:
+            return "ESP_ERR_TIMEOUT";
+        default:
+            return "UNKNOWN ERROR";
+    }
+}
+
+const char *bt_hex(const void *buf, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    static __thread char str[129];
+    const uint8_t *bytes = buf;
+
+    len = MIN(len, (sizeof(str) - 1) / 2);
+    for (size_t i = 0; i < len; i++)
+    {
+        str[i * 2] = hex[bytes[i] >> 4];
+        str[i * 2 + 1] = hex[bytes[i] & 0xf];
+    }
+    str[len * 2] = '\0';
+
+    return str;
+}
+
+esp_err_t esp_console_cmd_register(const esp_console_cmd_t *cmd)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_console_new_repl_uart(const esp_console_dev_uart_config_t *dev, const esp_console_repl_config_t *cfg,
+                                    esp_console_repl_t **out)
+{
+    *out = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_console_register_help_command(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_console_start_repl(esp_console_repl_t *repl)
+{
+    return ESP_OK;
+}
+
+esp_err_t nimble_port_init(void)
+{
+    return ESP_OK;
+}
+
+// The host task reports sync once the controller is up and then idles like the real event loop
+void nimble_port_run(void)
+{
+    SemaphoreHandle_t never = xSemaphoreCreateBinary();
+
+    vTaskDelay(pdMS_TO_TICKS(SIM_HOST_SYNC_MS));
+    if (ble_hs_cfg.sync_cb)
+    {
+        ble_hs_cfg.sync_cb();
+    }
+    xSemaphoreTake(never, portMAX_DELAY);
+}
+
+void nimble_port_freertos_init(TaskFunction_t host_task_fn)
+{
+    xTaskCreate(host_task_fn, "nimble_host", 4096, NULL, 5, NULL);
+}
+
+void nimble_port_freertos_deinit(void)
+{
+}
+
+void ble_store_config_init(void)
+{
+}
+
+int ble_store_util_status_rr(struct ble_store_status_event *event, void *arg)
+{
+    return 0;
+}
+
+int ble_hs_util_ensure_addr(int prefer_random)
+{
+    return 0;
+}
+
+int ble_hs_id_infer_auto(int privacy, uint8_t *out_addr_type)
+{
+    *out_addr_type = 0;
+    return 0;
+}
+
+int ble_hs_id_copy_addr(uint8_t id_addr_type, uint8_t *out_id_addr, int *out_is_nrpa)
+{
+    static const uint8_t addr[6] = {0x24, 0x6f, 0x28, 0x00, 0x00, 0x01};
+
+    memcpy(out_id_addr, addr, sizeof(addr));
+    if (out_is_nrpa)
+    {
+        *out_is_nrpa = 0;
+    }
+    return 0;
+}
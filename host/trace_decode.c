@@ -0,0 +1,149 @@
+// Converts a ble_mesh_trace_export() dump to Chrome trace event JSON, which
+// chrome://tracing and ui.perfetto.dev open directly
+//
+// Usage: trace_decode <dump> [out.json]
+//
+// The dump is either binary or a captured console log holding the hex line of
+// "mesh_trace dump"
+
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define TRACE_EVENT_DESC(id, name, kind) [id] = {name, kind},
+static const struct {
+    const char *name;
+    int kind;
+} events[TRACE_EVENT_COUNT] = {
+    TRACE_EVENTS(TRACE_EVENT_DESC)
+};
+#undef TRACE_EVENT_DESC
+
+// A console capture becomes the binary dump its hex line encodes, other files are read as they are
+static FILE *open_dump(const char *path)
+{
+    static const char magic_hex[] = "445a5452";     // TRACE_EXPORT_MAGIC, little endian
+    FILE *file = fopen(path, "rb");
+    char *text = NULL;
+    size_t size = 0;
+    size_t len;
+    char *hex;
+
+    if (!file)
+    {
+        return NULL;
+    }
+
+    FILE *buf = open_memstream(&text, &size);
+    char chunk[4096];
+    while (buf && (len = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    {
+        fwrite(chunk, 1, len, buf);
+    }
+    fclose(file);
+    if (!buf || fputc('\0', buf) == EOF || fclose(buf))
+    {
+        return NULL;
+    }
+
+    hex = size > 4 && memcmp(text, "DZTR", 4) ? strstr(text, magic_hex) : NULL;
+    if (!hex)
+    {
+        return fmemopen(text, size - 1, "rb");
+    }
+
+    len = 0;
+    while (isxdigit((unsigned char)hex[2 * len]) && isxdigit((unsigned char)hex[2 * len + 1]))
+    {
+        char byte[3] = {hex[2 * len], hex[2 * len + 1], '\0'};
+        text[len++] = (char)strtoul(byte, NULL, 16);
+    }
+
+    return fmemopen(text, len, "rb");
+}
+
+int main(int argc, char **argv)
+{
+    ble_mesh_trace_export_header_t header;
+    ble_mesh_trace_record_t record;
+    FILE *in;
+    FILE *out = stdout;
+    uint64_t wraps = 0;
+    uint32_t last_ts = 0;
+    size_t count = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <dump> [out.json]\n", argv[0]);
+        return 2;
+    }
+
+    in = open_dump(argv[1]);
+    if (!in)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != TRACE_EXPORT_MAGIC
+        || header.version != TRACE_EXPORT_VERSION || header.record_size != sizeof(record))
+    {
+        fprintf(stderr, "%s: not a version %d trace dump\n", argv[1], TRACE_EXPORT_VERSION);
+        return 1;
+    }
+
+    if (argc > 2)
+    {
+        out = fopen(argv[2], "w");
+        if (!out)
+        {
+            perror(argv[2]);
+            return 1;
+        }
+    }
+
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"lost\":%u},\"traceEvents\":[\n", header.lost);
+
+    while (fread(&record, sizeof(record), 1, in) == 1)
+    {
+        const char *name = record.event < TRACE_EVENT_COUNT ? events[record.event].name : "unknown";
+        uint64_t ts;
+
+        // Records of both cores interleave slightly, only a large step back is a wrap
+        if (record.ts_us < last_ts && last_ts - record.ts_us > UINT32_MAX / 2)
+        {
+            wraps++;
+        }
+        last_ts = record.ts_us;
+        ts = (wraps << 32) + record.ts_us;
+
+        fprintf(out, "%s{\"name\":\"%s\",\"pid\":1,\"tid\":%u,", count ? ",\n" : "", name, record.core);
+        if (record.event < TRACE_EVENT_COUNT && events[record.event].kind == TRACE_SPAN && record.arg1 <= ts)
+        {
+            fprintf(out, "\"ph\":\"X\",\"ts\":%llu,\"dur\":%u,", (unsigned long long)(ts - record.arg1), record.arg1);
+        }
+        else
+        {
+            fprintf(out, "\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu,", (unsigned long long)ts);
+        }
+        fprintf(out, "\"args\":{\"addr\":\"0x%04x\",\"arg0\":\"0x%08x\",\"arg1\":%u}}",
+                record.addr, record.arg0, record.arg1);
+        count++;
+    }
+
+    fprintf(out, "\n]}\n");
+    fprintf(stderr, "%zu records, %u lost on the device\n", count, header.lost);
+
+    if (out != stdout)
+    {
+        fclose(out);
+    }
+    fclose(in);
+
+    return 0;
+}
@@ -0,0 +1,214 @@
+#include "addr_alloc.h"
+
+#include <string.h>
+#include <sys/param.h>
+
+#define ADDR_UNICAST_MAX    0x7fff
+#define WORD_BITS           32
+#define WORD_FULL           UINT32_MAX
+
+// A bit per address of the window, set while a node or reservation holds it
+static uint32_t used[(ADDR_ALLOC_WINDOW + WORD_BITS - 1) / WORD_BITS];
+static uint16_t window_start;
+static uint16_t window_len;
+
+// Window offsets of released ranges per element count, most recent last
+static uint16_t free_list[ADDR_ALLOC_LIST_ELEMS][ADDR_ALLOC_LIST_MAX];
+static uint8_t free_count[ADDR_ALLOC_LIST_ELEMS];
+
+// Every offset below is used, first fit scans start here
+static uint16_t first_free;
+
+static bool bit_test(uint16_t offset)
+{
+    return used[offset / WORD_BITS] & 1u << offset % WORD_BITS;
+}
+
+static void bits_update(uint16_t offset, uint8_t count, bool set)
+{
+    for (uint16_t i = offset; i < offset + count; i++)
+    {
+        if (set)
+        {
+            used[i / WORD_BITS] |= 1u << i % WORD_BITS;
+        }
+        else
+        {
+            used[i / WORD_BITS] &= ~(1u << i % WORD_BITS);
+        }
+    }
+
+    if (!set)
+    {
+        first_free = MIN(first_free, offset);
+        return;
+    }
+    while (first_free < window_len && bit_test(first_free))
+    {
+        first_free++;
+    }
+}
+
+static bool range_free(uint16_t offset, uint8_t count)
+{
+    if (offset + count > window_len)
+    {
+        return false;
+    }
+
+    for (uint16_t i = offset; i < offset + count; i++)
+    {
+        if (bit_test(i))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool window_offset(uint16_t unicast, uint8_t elem_num, uint16_t *offset)
+{
+    if (!elem_num || unicast < window_start || unicast - window_start + elem_num > window_len)
+    {
+        return false;
+    }
+
+    *offset = unicast - window_start;
+    return true;
+}
+
+void ble_mesh_addr_init(uint16_t start)
+{
+    memset(used, 0, sizeof(used));
+    memset(free_count, 0, sizeof(free_count));
+    first_free = 0;
+
+    window_start = start;
+    window_len = 0;
+    if (start && start <= ADDR_UNICAST_MAX)
+    {
+        window_len = MIN(ADDR_ALLOC_WINDOW, ADDR_UNICAST_MAX + 1 - start);
+    }
+}
+
+uint16_t ble_mesh_addr_alloc(uint8_t elem_num)
+{
+    uint32_t offset;
+
+    if (!elem_num)
+    {
+        return 0;
+    }
+
+    // The range of a removed node of the same size fits without a scan
+    if (elem_num <= ADDR_ALLOC_LIST_ELEMS)
+    {
+        uint8_t *count = &free_count[elem_num - 1];
+
+        while (*count)
+        {
+            offset = free_list[elem_num - 1][--*count];
+
+            // Part of it may have gone to a first fit allocation since
+            if (range_free(offset, elem_num))
+            {
+                bits_update(offset, elem_num, true);
+                return window_start + offset;
+            }
+        }
+    }
+
+    // Lowest gap first keeps the used addresses dense
+    offset = first_free;
+    while (offset + elem_num <= window_len)
+    {
+        uint8_t run = 0;
+
+        if (offset % WORD_BITS == 0 && used[offset / WORD_BITS] == WORD_FULL)
+        {
+            offset += WORD_BITS;
+            continue;
+        }
+
+        while (run < elem_num && !bit_test(offset + run))
+        {
+            run++;
+        }
+        if (run == elem_num)
+        {
+            bits_update(offset, elem_num, true);
+            return window_start + offset;
+        }
+        offset += run + 1;
+    }
+
+    return 0;
+}
+
+esp_err_t ble_mesh_addr_claim(uint16_t unicast, uint8_t elem_num)
+{
+    uint16_t offset;
+
+    if (!window_offset(unicast, elem_num, &offset))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!range_free(offset, elem_num))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    bits_update(offset, elem_num, true);
+    return ESP_OK;
+}
+
+void ble_mesh_addr_free(uint16_t unicast, uint8_t elem_num)
+{
+    uint16_t offset;
+
+    if (!window_offset(unicast, elem_num, &offset))
+    {
+        return;
+    }
+
+    bits_update(offset, elem_num, false);
+    if (elem_num > ADDR_ALLOC_LIST_ELEMS)
+    {
+        return;
+    }
+
+    // A full list drops its oldest entry, the scan still finds that range
+    if (free_count[elem_num - 1] == ADDR_ALLOC_LIST_MAX)
+    {
+        memmove(&free_list[elem_num - 1][0], &free_list[elem_num - 1][1],
+                (ADDR_ALLOC_LIST_MAX - 1) * sizeof(free_list[0][0]));
+        free_count[elem_num - 1]--;
+    }
+    free_list[elem_num - 1][free_count[elem_num - 1]++] = offset;
+}
+
+bool ble_mesh_addr_is_free(uint16_t unicast, uint8_t elem_num)
+{
+    uint16_t offset;
+
+    return window_offset(unicast, elem_num, &offset) && range_free(offset, elem_num);
+}
+
+uint16_t ble_mesh_addr_high(void)
+{
+    for (int32_t offset = window_len - 1; offset >= 0; offset--)
+    {
+        if (offset % WORD_BITS == WORD_BITS - 1 && !used[offset / WORD_BITS])
+        {
+            offset -= WORD_BITS - 1;
+            continue;
+        }
+        if (bit_test(offset))
+        {
+            return window_start + offset;
+        }
+    }
+
+    return 0;
+}
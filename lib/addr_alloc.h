@@ -0,0 +1,42 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_ADDR_ALLOC_H
+#define DEZIBOT_BLUETOOTH_MESH_ADDR_ALLOC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "node_registry.h"
+
+// Unicast addresses handed out to nodes, from the provisioner's start address on
+#ifndef ADDR_ALLOC_START
+#define ADDR_ALLOC_START        0x0005
+#endif
+#ifndef ADDR_ALLOC_WINDOW
+#define ADDR_ALLOC_WINDOW       (NODE_REGISTRY_MAX_NODES * NODE_REGISTRY_ELEMS_MAX)
+#endif
+
+// Element counts with a free list of released ranges, larger nodes are placed by scanning
+#define ADDR_ALLOC_LIST_ELEMS   4
+#define ADDR_ALLOC_LIST_MAX     16
+
+// Forgets every range, the window starts at start and is clipped to the unicast space
+void ble_mesh_addr_init(uint16_t start);
+
+// Reserves elem_num consecutive addresses: a range of the same size released before
+// if there is one, the lowest gap that fits otherwise. 0 when the window is full.
+uint16_t ble_mesh_addr_alloc(uint8_t elem_num);
+
+// Marks a known range as used, e.g. of nodes restored from flash. ESP_ERR_INVALID_STATE
+// when part of it is taken already, ESP_ERR_INVALID_ARG when it is outside the window.
+esp_err_t ble_mesh_addr_claim(uint16_t unicast, uint8_t elem_num);
+
+// Returns a range to the allocator, addresses outside the window are ignored
+void ble_mesh_addr_free(uint16_t unicast, uint8_t elem_num);
+
+// Whether none of the range is in use, false for addresses outside the window
+bool ble_mesh_addr_is_free(uint16_t unicast, uint8_t elem_num);
+
+// Highest address in use, 0 while none is
+uint16_t ble_mesh_addr_high(void);
+
+#endif //DEZIBOT_BLUETOOTH_MESH_ADDR_ALLOC_H
@@ -0,0 +1,379 @@
+#include "admission.h"
+
+#include <string.h>
+#include <sys/param.h>
+
+#define ADMISSION_SLOTS     (ADMISSION_ADV_SLOTS + ADMISSION_GATT_SLOTS)
+
+typedef enum {
+    ENTRY_FREE,
+    ENTRY_QUEUED,
+    ENTRY_LINKING,
+} entry_state_t;
+
+typedef struct {
+    ble_mesh_admission_candidate_t candidate;
+    entry_state_t state;
+    uint8_t  failures[2];   // per bearer, PB-ADV first
+    int64_t  queued_us;     // first heard, waiting time counts from here
+    int64_t  seen_us;       // last heard
+    int64_t  hold_us;       // not picked before
+} entry_t;
+
+// The first ADMISSION_ADV_SLOTS slots are PB-ADV links, the others PB-GATT
+typedef struct {
+    bool     busy;
+    bool     answered;      // the stack accepted the request
+    bool     done;          // provisioning complete, waiting for the link to close
+    uint8_t  uuid[16];
+    int64_t  start_us;
+} slot_t;
+
+static entry_t entries[ADMISSION_QUEUE_MAX];
+static slot_t slots[ADMISSION_SLOTS];
+
+// Slots whose request the stack has not answered yet, oldest first
+static uint8_t unanswered[ADMISSION_SLOTS];
+static uint8_t unanswered_head;
+static uint8_t unanswered_count;
+
+static ble_mesh_admission_stats_t stats;
+
+static esp_ble_mesh_prov_bearer_t slot_bearer(uint8_t slot)
+{
+    return slot < ADMISSION_ADV_SLOTS ? ESP_BLE_MESH_PROV_ADV : ESP_BLE_MESH_PROV_GATT;
+}
+
+static ble_mesh_admission_link_stats_t *link_stats(esp_ble_mesh_prov_bearer_t bearer)
+{
+    return bearer == ESP_BLE_MESH_PROV_GATT ? &stats.gatt : &stats.adv;
+}
+
+static entry_t *entry_find(const uint8_t uuid[16])
+{
+    for (size_t i = 0; i < ADMISSION_QUEUE_MAX; i++)
+    {
+        if (entries[i].state != ENTRY_FREE && !memcmp(entries[i].candidate.uuid, uuid, 16))
+        {
+            return &entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int32_t entry_score(const entry_t *entry, esp_ble_mesh_prov_bearer_t bearer, int64_t now_us)
+{
+    int32_t score = entry->candidate.rssi;
+
+    if (bearer == ESP_BLE_MESH_PROV_GATT)
+    {
+        score += ADMISSION_GATT_BONUS_DB;
+    }
+    score += (now_us - entry->queued_us) / (ADMISSION_AGING_MS * 1000LL);
+    score -= entry->failures[bearer == ESP_BLE_MESH_PROV_GATT] * ADMISSION_FAIL_PENALTY_DB;
+
+    return score;
+}
+
+// Frees a slot, a device whose link did not complete waits for its next turn. It was
+// silent while linking, so it gets a full stale period to beacon again.
+static void slot_release(uint8_t slot, bool failed, int64_t now_us)
+{
+    entry_t *entry = entry_find(slots[slot].uuid);
+    uint8_t b = slot_bearer(slot) == ESP_BLE_MESH_PROV_GATT;
+
+    if (entry && entry->state == ENTRY_LINKING)
+    {
+        entry->state = ENTRY_QUEUED;
+        entry->seen_us = now_us;
+        if (failed)
+        {
+            entry->failures[b] = MIN(entry->failures[b] + 1, UINT8_MAX);
+        }
+    }
+    memset(&slots[slot], 0, sizeof(slots[slot]));
+}
+
+static void unanswered_remove(uint8_t slot)
+{
+    for (uint8_t i = 0; i < unanswered_count; i++)
+    {
+        uint8_t pos = (unanswered_head + i) % ADMISSION_SLOTS;
+
+        if (unanswered[pos] != slot)
+        {
+            continue;
+        }
+        for (; i + 1 < unanswered_count; i++)
+        {
+            unanswered[(unanswered_head + i) % ADMISSION_SLOTS] = unanswered[(unanswered_head + i + 1) % ADMISSION_SLOTS];
+        }
+        unanswered_count--;
+        return;
+    }
+}
+
+static void expire(int64_t now_us)
+{
+    for (uint8_t i = 0; i < ADMISSION_SLOTS; i++)
+    {
+        if (slots[i].busy && now_us - slots[i].start_us > ADMISSION_LINK_MS * 1000LL)
+        {
+            link_stats(slot_bearer(i))->failed++;
+            unanswered_remove(i);
+            slot_release(i, true, now_us);
+        }
+    }
+
+    for (size_t i = 0; i < ADMISSION_QUEUE_MAX; i++)
+    {
+        if (entries[i].state == ENTRY_QUEUED && now_us - entries[i].seen_us > ADMISSION_STALE_MS * 1000LL)
+        {
+            entries[i].state = ENTRY_FREE;
+        }
+    }
+}
+
+void ble_mesh_admission_init(void)
+{
+    memset(entries, 0, sizeof(entries));
+    memset(slots, 0, sizeof(slots));
+    memset(&stats, 0, sizeof(stats));
+    unanswered_head = 0;
+    unanswered_count = 0;
+}
+
+void ble_mesh_admission_offer(const ble_mesh_admission_candidate_t *candidate, int64_t now_us)
+{
+    entry_t *entry = entry_find(candidate->uuid);
+    entry_t *victim = NULL;
+
+    if (entry)
+    {
+        entry->candidate.bearers |= candidate->bearers;
+        entry->candidate.rssi = (3 * entry->candidate.rssi + candidate->rssi) / 4;
+        memcpy(entry->candidate.addr, candidate->addr, BD_ADDR_LEN);
+        entry->candidate.addr_type = candidate->addr_type;
+        entry->seen_us = now_us;
+        return;
+    }
+
+    for (size_t i = 0; i < ADMISSION_QUEUE_MAX; i++)
+    {
+        if (entries[i].state == ENTRY_FREE)
+        {
+            entry = &entries[i];
+            break;
+        }
+        if (entries[i].state == ENTRY_QUEUED
+            && (!victim || entry_score(&entries[i], ESP_BLE_MESH_PROV_ADV, now_us)
+                           < entry_score(victim, ESP_BLE_MESH_PROV_ADV, now_us)))
+        {
+            victim = &entries[i];
+        }
+    }
+
+    // A full queue keeps the stronger devices, the dropped one comes back with its next beacon
+    if (!entry)
+    {
+        stats.dropped++;
+        if (!victim || entry_score(victim, ESP_BLE_MESH_PROV_ADV, now_us) >= candidate->rssi)
+        {
+            return;
+        }
+        entry = victim;
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    entry->candidate = *candidate;
+    entry->state = ENTRY_QUEUED;
+    entry->queued_us = now_us;
+    entry->seen_us = now_us;
+}
+
+bool ble_mesh_admission_pick(int64_t now_us, ble_mesh_admission_accept_t accept,
+                             ble_mesh_admission_candidate_t *candidate, esp_ble_mesh_prov_bearer_t *bearer)
+{
+    esp_ble_mesh_prov_bearer_t free_bearers = 0;
+    const entry_t *best = NULL;
+    int32_t best_score = INT32_MIN;
+
+    expire(now_us);
+
+    for (uint8_t i = 0; i < ADMISSION_SLOTS; i++)
+    {
+        if (!slots[i].busy)
+        {
+            free_bearers |= slot_bearer(i);
+        }
+    }
+    if (!free_bearers)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < ADMISSION_QUEUE_MAX; i++)
+    {
+        const entry_t *entry = &entries[i];
+
+        if (entry->state != ENTRY_QUEUED || entry->hold_us > now_us
+            || (accept && !accept(entry->candidate.uuid)))
+        {
+            continue;
+        }
+        for (esp_ble_mesh_prov_bearer_t b = ESP_BLE_MESH_PROV_ADV; b <= ESP_BLE_MESH_PROV_GATT; b <<= 1)
+        {
+            int32_t score;
+
+            if (!(entry->candidate.bearers & free_bearers & b))
+            {
+                continue;
+            }
+            score = entry_score(entry, b, now_us);
+            if (score > best_score)
+            {
+                best = entry;
+                best_score = score;
+                *bearer = b;
+            }
+        }
+    }
+
+    if (!best)
+    {
+        return false;
+    }
+
+    *candidate = best->candidate;
+    return true;
+}
+
+void ble_mesh_admission_start(const uint8_t uuid[16], esp_ble_mesh_prov_bearer_t bearer, int64_t now_us)
+{
+    entry_t *entry = entry_find(uuid);
+
+    for (uint8_t i = 0; i < ADMISSION_SLOTS; i++)
+    {
+        if (slots[i].busy || slot_bearer(i) != bearer)
+        {
+            continue;
+        }
+
+        slots[i].busy = true;
+        memcpy(slots[i].uuid, uuid, 16);
+        slots[i].start_us = now_us;
+        unanswered[(unanswered_head + unanswered_count++) % ADMISSION_SLOTS] = i;
+
+        if (entry)
+        {
+            entry->state = ENTRY_LINKING;
+            stats.wait_max_ms = MAX(stats.wait_max_ms, (now_us - entry->queued_us) / 1000);
+        }
+        return;
+    }
+}
+
+void ble_mesh_admission_drop(const uint8_t uuid[16])
+{
+    entry_t *entry = entry_find(uuid);
+
+    if (entry && entry->state == ENTRY_QUEUED)
+    {
+        entry->state = ENTRY_FREE;
+    }
+}
+
+void ble_mesh_admission_answer(int err_code, int64_t now_us)
+{
+    uint8_t slot;
+
+    if (!unanswered_count)
+    {
+        return;
+    }
+
+    slot = unanswered[unanswered_head];
+    unanswered_head = (unanswered_head + 1) % ADMISSION_SLOTS;
+    unanswered_count--;
+
+    if (err_code)
+    {
+        entry_t *entry = entry_find(slots[slot].uuid);
+
+        // The stack may still hold a link to the device whose slot was taken back, asked
+        // again right away it would refuse again at once
+        if (entry)
+        {
+            entry->hold_us = now_us + ADMISSION_HOLD_MS * 1000LL;
+        }
+        link_stats(slot_bearer(slot))->refused++;
+        slot_release(slot, false, now_us);
+        return;
+    }
+
+    link_stats(slot_bearer(slot))->started++;
+    slots[slot].answered = true;
+    slots[slot].start_us = now_us;
+}
+
+void ble_mesh_admission_complete(const uint8_t uuid[16])
+{
+    entry_t *entry = entry_find(uuid);
+
+    if (entry)
+    {
+        entry->state = ENTRY_FREE;
+    }
+
+    for (uint8_t i = 0; i < ADMISSION_SLOTS; i++)
+    {
+        if (slots[i].busy && !memcmp(slots[i].uuid, uuid, 16))
+        {
+            slots[i].done = true;
+            return;
+        }
+    }
+}
+
+void ble_mesh_admission_link_close(esp_ble_mesh_prov_bearer_t bearer, int64_t now_us)
+{
+    int16_t oldest = -1;
+
+    for (uint8_t i = 0; i < ADMISSION_SLOTS; i++)
+    {
+        if (!slots[i].busy || !slots[i].answered || slot_bearer(i) != bearer)
+        {
+            continue;
+        }
+        if (slots[i].done)
+        {
+            link_stats(bearer)->completed++;
+            slot_release(i, false, now_us);
+            return;
+        }
+        if (oldest < 0 || slots[i].start_us < slots[oldest].start_us)
+        {
+            oldest = i;
+        }
+    }
+
+    // The close event does not tell the device, the link open longest is the likely one
+    if (oldest >= 0)
+    {
+        link_stats(bearer)->failed++;
+        slot_release(oldest, true, now_us);
+    }
+}
+
+void ble_mesh_admission_get_stats(ble_mesh_admission_stats_t *out)
+{
+    *out = stats;
+    out->queued = 0;
+    out->linking = 0;
+    for (size_t i = 0; i < ADMISSION_QUEUE_MAX; i++)
+    {
+        out->queued += entries[i].state == ENTRY_QUEUED;
+        out->linking += entries[i].state == ENTRY_LINKING;
+    }
+}
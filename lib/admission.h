@@ -0,0 +1,93 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_ADMISSION_H
+#define DEZIBOT_BLUETOOTH_MESH_ADMISSION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_ble_mesh_defs.h"
+#include "sdkconfig.h"
+
+// Devices waiting for a provisioning link, the weakest one is dropped when full
+#ifndef ADMISSION_QUEUE_MAX
+#define ADMISSION_QUEUE_MAX         16
+#endif
+
+#define ADMISSION_ADV_SLOTS         CONFIG_BLE_MESH_PBA_SAME_TIME
+#define ADMISSION_GATT_SLOTS        CONFIG_BLE_MESH_PBG_SAME_TIME
+
+// Ranking in dB: RSSI, plus a bonus for the connection based bearer, plus one dB per
+// AGING_MS waited so every device gets a slot eventually, minus a penalty per link that
+// failed on the bearer, which moves devices at the edge to the other one
+#define ADMISSION_GATT_BONUS_DB     6
+#define ADMISSION_AGING_MS          500
+#define ADMISSION_FAIL_PENALTY_DB   6
+
+// Devices not heard for three beacon intervals left or were provisioned by someone else
+#define ADMISSION_STALE_MS          (3 * CONFIG_BLE_MESH_UNPROVISIONED_BEACON_INTERVAL * 1000)
+
+// A slot whose link the stack never reported closed is taken back after this
+#define ADMISSION_LINK_MS           60000
+
+// A device the stack refused to link is not asked for again before its next beacon
+#define ADMISSION_HOLD_MS           (CONFIG_BLE_MESH_UNPROVISIONED_BEACON_INTERVAL * 1000)
+
+typedef struct {
+    uint8_t  uuid[16];
+    uint8_t  addr[BD_ADDR_LEN];
+    esp_ble_mesh_addr_type_t addr_type;
+    uint16_t oob_info;
+    esp_ble_mesh_prov_bearer_t bearers;     // bearers the device was heard on
+    int8_t   rssi;
+} ble_mesh_admission_candidate_t;
+
+typedef struct {
+    uint32_t started;       // links the stack accepted
+    uint32_t refused;       // requests the stack answered with an error
+    uint32_t completed;
+    uint32_t failed;        // closed without provisioning complete, or never closed
+} ble_mesh_admission_link_stats_t;
+
+typedef struct {
+    ble_mesh_admission_link_stats_t adv;
+    ble_mesh_admission_link_stats_t gatt;
+    uint16_t queued;
+    uint16_t linking;
+    uint32_t dropped;       // candidates pushed out of a full queue
+    uint32_t wait_max_ms;   // longest a started device waited for its slot
+} ble_mesh_admission_stats_t;
+
+// Whether the device may take a slot now, devices it turns away stay queued
+typedef bool (*ble_mesh_admission_accept_t)(const uint8_t uuid[16]);
+
+void ble_mesh_admission_init(void);
+
+// Queues a device heard beaconing or refreshes its entry, RSSI is smoothed over reports
+void ble_mesh_admission_offer(const ble_mesh_admission_candidate_t *candidate, int64_t now_us);
+
+// Best queued device accept takes, any with accept NULL, and bearer for a free slot. False
+// when no slot or no device is left. The device stays queued until ble_mesh_admission_start() or _drop().
+bool ble_mesh_admission_pick(int64_t now_us, ble_mesh_admission_accept_t accept,
+                             ble_mesh_admission_candidate_t *candidate, esp_ble_mesh_prov_bearer_t *bearer);
+
+// The stack was asked to provision the device over bearer, its answer is expected
+// through ble_mesh_admission_answer() in request order
+void ble_mesh_admission_start(const uint8_t uuid[16], esp_ble_mesh_prov_bearer_t bearer, int64_t now_us);
+
+// Forgets a queued device, it comes back with its next beacon
+void ble_mesh_admission_drop(const uint8_t uuid[16]);
+
+// Answer of the stack to the oldest request still unanswered. On an error the slot
+// is free again and the device is back in the queue, held back for ADMISSION_HOLD_MS.
+void ble_mesh_admission_answer(int err_code, int64_t now_us);
+
+// Provisioning of the device completed, its slot is freed when the link closes
+void ble_mesh_admission_complete(const uint8_t uuid[16]);
+
+// The stack closed a link on the bearer. Links closing without a completed device
+// count as failed, the device waiting longest on that bearer is queued again.
+void ble_mesh_admission_link_close(esp_ble_mesh_prov_bearer_t bearer, int64_t now_us);
+
+void ble_mesh_admission_get_stats(ble_mesh_admission_stats_t *stats);
+
+#endif //DEZIBOT_BLUETOOTH_MESH_ADMISSION_H
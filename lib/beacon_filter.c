@@ -0,0 +1,253 @@
+#include "beacon_filter.h"
+
+#include <string.h>
+
+// Open addressing tables kept at most half full, entries hold index + 1
+#define ALLOW_INDEX_SIZE    (BEACON_FILTER_ALLOW_MAX * 2)
+#define SEEN_INDEX_SIZE     (BEACON_FILTER_SEEN_MAX * 2)
+#define INDEX_EMPTY         0
+#define SEEN_NONE           UINT16_MAX
+
+typedef struct {
+    uint8_t  uuid[16];
+    int64_t  hold_us[2];    // per bearer, PB-ADV first: repeats before this are dropped
+    uint16_t prev;          // towards the most recently admitted entry
+    uint16_t next;
+} seen_entry_t;
+
+static uint8_t allow_uuids[BEACON_FILTER_ALLOW_MAX][16];
+static uint16_t allow_index[ALLOW_INDEX_SIZE];
+static uint16_t allow_count;
+
+static seen_entry_t seen[BEACON_FILTER_SEEN_MAX];
+static uint16_t seen_index[SEEN_INDEX_SIZE];
+static uint16_t seen_count;
+static uint16_t seen_head;  // most recently admitted
+static uint16_t seen_tail;  // next to be reused
+
+static ble_mesh_filter_stats_t stats;
+
+static uint32_t uuid_hash(const uint8_t uuid[16])
+{
+    // FNV-1a, the device UUID only varies in the BD_ADDR bytes
+    uint32_t hash = 2166136261u;
+
+    for (int i = 0; i < 16; i++)
+    {
+        hash ^= uuid[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static uint32_t allow_probe(const uint8_t uuid[16])
+{
+    uint32_t pos = uuid_hash(uuid) % ALLOW_INDEX_SIZE;
+
+    while (allow_index[pos] != INDEX_EMPTY && memcmp(allow_uuids[allow_index[pos] - 1], uuid, 16))
+    {
+        pos = (pos + 1) % ALLOW_INDEX_SIZE;
+    }
+
+    return pos;
+}
+
+static uint32_t seen_probe(const uint8_t uuid[16])
+{
+    uint32_t pos = uuid_hash(uuid) % SEEN_INDEX_SIZE;
+
+    while (seen_index[pos] != INDEX_EMPTY && memcmp(seen[seen_index[pos] - 1].uuid, uuid, 16))
+    {
+        pos = (pos + 1) % SEEN_INDEX_SIZE;
+    }
+
+    return pos;
+}
+
+static void seen_index_delete(uint32_t pos)
+{
+    // Backward shift deletion, as in the node registry
+    uint32_t next = pos;
+
+    seen_index[pos] = INDEX_EMPTY;
+
+    for (;;)
+    {
+        next = (next + 1) % SEEN_INDEX_SIZE;
+        if (seen_index[next] == INDEX_EMPTY)
+        {
+            return;
+        }
+
+        uint32_t home = uuid_hash(seen[seen_index[next] - 1].uuid) % SEEN_INDEX_SIZE;
+        bool movable = (pos <= next) ? (home <= pos || home > next) : (home <= pos && home > next);
+        if (movable)
+        {
+            seen_index[pos] = seen_index[next];
+            seen_index[next] = INDEX_EMPTY;
+            pos = next;
+        }
+    }
+}
+
+static void seen_unlink(uint16_t entry)
+{
+    if (seen[entry].prev != SEEN_NONE)
+    {
+        seen[seen[entry].prev].next = seen[entry].next;
+    }
+    else
+    {
+        seen_head = seen[entry].next;
+    }
+
+    if (seen[entry].next != SEEN_NONE)
+    {
+        seen[seen[entry].next].prev = seen[entry].prev;
+    }
+    else
+    {
+        seen_tail = seen[entry].prev;
+    }
+}
+
+static void seen_push_head(uint16_t entry)
+{
+    seen[entry].prev = SEEN_NONE;
+    seen[entry].next = seen_head;
+    if (seen_head != SEEN_NONE)
+    {
+        seen[seen_head].prev = entry;
+    }
+    seen_head = entry;
+    if (seen_tail == SEEN_NONE)
+    {
+        seen_tail = entry;
+    }
+}
+
+static void seen_push_tail(uint16_t entry)
+{
+    seen[entry].next = SEEN_NONE;
+    seen[entry].prev = seen_tail;
+    if (seen_tail != SEEN_NONE)
+    {
+        seen[seen_tail].next = entry;
+    }
+    seen_tail = entry;
+    if (seen_head == SEEN_NONE)
+    {
+        seen_head = entry;
+    }
+}
+
+void ble_mesh_filter_init(void)
+{
+    memset(seen_index, 0, sizeof(seen_index));
+    memset(&stats, 0, sizeof(stats));
+    seen_count = 0;
+    seen_head = SEEN_NONE;
+    seen_tail = SEEN_NONE;
+}
+
+esp_err_t ble_mesh_filter_allow(const uint8_t uuid[16])
+{
+    uint32_t pos;
+
+    if (!uuid)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pos = allow_probe(uuid);
+    if (allow_index[pos] != INDEX_EMPTY)
+    {
+        return ESP_OK;
+    }
+    if (allow_count == BEACON_FILTER_ALLOW_MAX)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    memcpy(allow_uuids[allow_count], uuid, 16);
+    allow_index[pos] = ++allow_count;
+
+    return ESP_OK;
+}
+
+bool ble_mesh_filter_allowed(const uint8_t uuid[16])
+{
+    return !allow_count || allow_index[allow_probe(uuid)] != INDEX_EMPTY;
+}
+
+bool ble_mesh_filter_admit(const uint8_t uuid[16], esp_ble_mesh_prov_bearer_t bearer, int64_t now_us)
+{
+    uint8_t b = bearer == ESP_BLE_MESH_PROV_GATT;
+    uint32_t pos;
+    uint16_t entry;
+
+    stats.received++;
+    if (!ble_mesh_filter_allowed(uuid))
+    {
+        stats.foreign++;
+        return false;
+    }
+
+    pos = seen_probe(uuid);
+    if (seen_index[pos] != INDEX_EMPTY)
+    {
+        entry = seen_index[pos] - 1;
+        if (now_us < seen[entry].hold_us[b])
+        {
+            stats.repeated++;
+            return false;
+        }
+        seen_unlink(entry);
+    }
+    else
+    {
+        if (seen_count < BEACON_FILTER_SEEN_MAX)
+        {
+            entry = seen_count++;
+        }
+        else
+        {
+            // A device evicted before its hold time ran out only gets one beacon too many through
+            entry = seen_tail;
+            seen_unlink(entry);
+            seen_index_delete(seen_probe(seen[entry].uuid));
+            pos = seen_probe(uuid);
+        }
+        memcpy(seen[entry].uuid, uuid, 16);
+        memset(seen[entry].hold_us, 0, sizeof(seen[entry].hold_us));
+        seen_index[pos] = entry + 1;
+    }
+
+    seen[entry].hold_us[b] = now_us + BEACON_FILTER_HOLD_MS * 1000LL;
+    seen_push_head(entry);
+    stats.admitted++;
+
+    return true;
+}
+
+void ble_mesh_filter_forget(const uint8_t uuid[16])
+{
+    uint32_t pos = seen_probe(uuid);
+    uint16_t entry;
+
+    if (seen_index[pos] == INDEX_EMPTY)
+    {
+        return;
+    }
+
+    entry = seen_index[pos] - 1;
+    memset(seen[entry].hold_us, 0, sizeof(seen[entry].hold_us));
+    seen_unlink(entry);
+    seen_push_tail(entry);
+}
+
+void ble_mesh_filter_get_stats(ble_mesh_filter_stats_t *out)
+{
+    *out = stats;
+}
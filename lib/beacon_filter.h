@@ -0,0 +1,49 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_BEACON_FILTER_H
+#define DEZIBOT_BLUETOOTH_MESH_BEACON_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_ble_mesh_defs.h"
+#include "node_registry.h"
+
+// Devices that may be provisioned, an empty allowlist admits every fleet UUID
+#ifndef BEACON_FILTER_ALLOW_MAX
+#define BEACON_FILTER_ALLOW_MAX NODE_REGISTRY_MAX_NODES
+#endif
+
+// Devices remembered at once, the least recently admitted one is dropped first
+#ifndef BEACON_FILTER_SEEN_MAX
+#define BEACON_FILTER_SEEN_MAX  32
+#endif
+
+// Repeats of an admitted beacon are dropped for this long. Below the beacon interval,
+// so a device still beaconing is passed on once per interval and bearer.
+#define BEACON_FILTER_HOLD_MS   (CONFIG_BLE_MESH_UNPROVISIONED_BEACON_INTERVAL * 1000 * 3 / 4)
+
+typedef struct {
+    uint32_t received;
+    uint32_t admitted;
+    uint32_t repeated;      // dropped, admitted less than BEACON_FILTER_HOLD_MS ago
+    uint32_t foreign;       // dropped, not on the allowlist
+} ble_mesh_filter_stats_t;
+
+// Empties the cache of seen devices, the allowlist is kept
+void ble_mesh_filter_init(void);
+
+// Puts a device on the allowlist. ESP_ERR_NO_MEM when it is full.
+esp_err_t ble_mesh_filter_allow(const uint8_t uuid[16]);
+
+// O(1) expected, true for every UUID while the allowlist is empty
+bool ble_mesh_filter_allowed(const uint8_t uuid[16]);
+
+// Decides whether a beacon of the device on the bearer goes further and remembers that it did
+bool ble_mesh_filter_admit(const uint8_t uuid[16], esp_ble_mesh_prov_bearer_t bearer, int64_t now_us);
+
+// The next beacon of the device is admitted regardless of the hold time
+void ble_mesh_filter_forget(const uint8_t uuid[16]);
+
+void ble_mesh_filter_get_stats(ble_mesh_filter_stats_t *stats);
+
+#endif //DEZIBOT_BLUETOOTH_MESH_BEACON_FILTER_H
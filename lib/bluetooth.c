@@ -1,26 +1,32 @@
 #include "bluetooth.h"
+#include "boot_profile.h"
+#include "lifecycle.h"
 
 #define TAG "BLUETOOTH"
 
-static SemaphoreHandle_t mesh_sem;
 static uint8_t own_addr_type;
 void ble_store_config_init(void);
 static uint8_t addr_val[6] = {0};
 
 void ble_mesh_get_dev_uuid(uint8_t *dev_uuid)
 {
+    const uint8_t match[] = BLE_MESH_UUID_MATCH;
+
     if (dev_uuid == NULL)
     {
         ESP_LOGE(TAG, "%s, Invalid device uuid", __func__);
         return;
     }
 
-    memcpy(dev_uuid + 2, addr_val, BD_ADDR_LEN);
+    memcpy(dev_uuid, match, sizeof(match));
+    memcpy(dev_uuid + sizeof(match), addr_val, BD_ADDR_LEN);
 }
 
 static void mesh_on_reset(int reason)
 {
     ESP_LOGI(TAG, "Resetting state - reason=%d", reason);
+    // The host syncs again once the controller is back
+    ble_mesh_lifecycle_clear(LIFECYCLE_STACK_UP);
 }
 
 static void mesh_on_sync(void)
@@ -38,7 +44,8 @@ static void mesh_on_sync(void)
 
     error = ble_hs_id_copy_addr(own_addr_type, addr_val, NULL);
 
-    xSemaphoreGive(mesh_sem);
+    ble_mesh_boot_end(BOOT_HOST_SYNC);
+    ble_mesh_lifecycle_set(LIFECYCLE_STACK_UP);
 }
 
 void mesh_host_task(void *param)
@@ -49,16 +56,16 @@ void mesh_host_task(void *param)
     nimble_port_freertos_deinit();
 }
 
-esp_err_t bluetooth_init(void)
+esp_err_t bluetooth_start(void)
 {
     esp_err_t error;
 
-    mesh_sem = xSemaphoreCreateBinary();
-    if (mesh_sem == NULL) {
-        ESP_LOGE(TAG, "Failed to create mesh semaphore");
-        return ESP_FAIL;
+    error = ble_mesh_lifecycle_init();
+    if (error != ESP_OK) {
+        return error;
     }
 
+    ble_mesh_boot_begin(BOOT_NIMBLE);
     error = nimble_port_init();
     if (error != ESP_OK) {
         ESP_LOGE(TAG, "Failed to init nimble %d ", error);
@@ -70,10 +77,34 @@ esp_err_t bluetooth_init(void)
     ble_hs_cfg.store_status_cb = ble_store_util_status_rr;
 
     ble_store_config_init();
+    ble_mesh_boot_end(BOOT_NIMBLE);
 
+    ble_mesh_boot_begin(BOOT_HOST_SYNC);
     nimble_port_freertos_init(mesh_host_task);
 
-    xSemaphoreTake(mesh_sem, portMAX_DELAY);
-
     return ESP_OK;
+}
+
+esp_err_t bluetooth_wait_sync(void)
+{
+    // The device UUID is derived from the address copied on sync
+    esp_err_t error = ble_mesh_lifecycle_wait(LIFECYCLE_STACK_UP, BLUETOOTH_SYNC_TIMEOUT_MS);
+
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "NimBLE host did not sync within %d ms", BLUETOOTH_SYNC_TIMEOUT_MS);
+    }
+
+    return error;
+}
+
+esp_err_t bluetooth_init(void)
+{
+    esp_err_t error;
+
+    error = bluetooth_start();
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    return bluetooth_wait_sync();
 }
\ No newline at end of file
@@ -3,8 +3,23 @@
 
 #include "common.h"
 
+// First bytes of every robot's device UUID, the provisioner only reports devices carrying them
+#define BLE_MESH_UUID_MATCH     {0xdd, 0xdd}
+
+// bluetooth_init() gives up on the NimBLE host after this long
+#define BLUETOOTH_SYNC_TIMEOUT_MS 5000
+
+// Fills dev_uuid with BLE_MESH_UUID_MATCH followed by the BD_ADDR
 void ble_mesh_get_dev_uuid(uint8_t *dev_uuid);
 
+// Starts the NimBLE host without waiting for it to sync with the controller, which
+// takes most of the boot; anything not using the stack can be initialized meanwhile
+esp_err_t bluetooth_start(void);
+
+// Waits for the host started before to sync, ESP_ERR_TIMEOUT if it does not
+esp_err_t bluetooth_wait_sync(void);
+
+// bluetooth_start() and bluetooth_wait_sync()
 esp_err_t bluetooth_init(void);
 
 #endif //DEZIBOT_BLUETOOTH_MESH_MESH_INIT_H
\ No newline at end of file
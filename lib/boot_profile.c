@@ -0,0 +1,81 @@
+#include "boot_profile.h"
+#include "common.h"
+
+#define TAG "BOOT"
+
+static const char *const phase_names[BOOT_PHASE_COUNT] = {
+    [BOOT_NVS] = "nvs",
+    [BOOT_NIMBLE] = "nimble",
+    [BOOT_HOST_SYNC] = "host_sync",
+    [BOOT_CLIENT] = "client",
+    [BOOT_CLIENT_MESH] = "client_mesh",
+    [BOOT_PROVISIONER] = "provisioner",
+    [BOOT_PROVISIONER_MESH] = "provisioner_mesh",
+    [BOOT_READY] = "ready",
+};
+
+static portMUX_TYPE boot_lock = portMUX_INITIALIZER_UNLOCKED;
+static ble_mesh_boot_span_t spans[BOOT_PHASE_COUNT];
+
+void ble_mesh_boot_begin(ble_mesh_boot_phase_t phase)
+{
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&boot_lock);
+    spans[phase].begin_us = now;
+    spans[phase].end_us = 0;
+    taskEXIT_CRITICAL(&boot_lock);
+}
+
+void ble_mesh_boot_end(ble_mesh_boot_phase_t phase)
+{
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&boot_lock);
+    // Phases begin at boot at the latest, an end without a begin counts from there.
+    // Only the first end counts, the host for one syncs again after every reset.
+    if (!spans[phase].end_us)
+    {
+        spans[phase].end_us = MAX(now, 1);
+    }
+    taskEXIT_CRITICAL(&boot_lock);
+}
+
+void ble_mesh_boot_get(ble_mesh_boot_span_t out[BOOT_PHASE_COUNT])
+{
+    taskENTER_CRITICAL(&boot_lock);
+    memcpy(out, spans, sizeof(spans));
+    taskEXIT_CRITICAL(&boot_lock);
+}
+
+void ble_mesh_boot_report(void)
+{
+    ble_mesh_boot_span_t copy[BOOT_PHASE_COUNT];
+    char line[256];
+    size_t used = 0;
+    int64_t last_us = 0;
+
+    ble_mesh_boot_get(copy);
+
+    // Phases as start+duration, those still running as start+
+    for (int i = 0; i < BOOT_PHASE_COUNT && used < sizeof(line); i++)
+    {
+        if (!copy[i].end_us && !copy[i].begin_us)
+        {
+            continue;
+        }
+        if (copy[i].end_us)
+        {
+            used += snprintf(line + used, sizeof(line) - used, " %s %" PRId64 "+%" PRId64, phase_names[i],
+                             copy[i].begin_us / 1000, (copy[i].end_us - copy[i].begin_us) / 1000);
+            last_us = MAX(last_us, copy[i].end_us);
+        }
+        else
+        {
+            used += snprintf(line + used, sizeof(line) - used, " %s %" PRId64 "+", phase_names[i],
+                             copy[i].begin_us / 1000);
+        }
+    }
+
+    ESP_LOGI(TAG, "%" PRId64 " ms, phases in ms since boot:%s", last_us / 1000, used ? line : " none");
+}
@@ -0,0 +1,33 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_BOOT_PROFILE_H
+#define DEZIBOT_BLUETOOTH_MESH_BOOT_PROFILE_H
+
+#include <stdint.h>
+
+typedef enum {
+    BOOT_NVS,               // NVS flash init, erase included
+    BOOT_NIMBLE,            // NimBLE port and host configuration
+    BOOT_HOST_SYNC,         // host task started to synced with the controller
+    BOOT_CLIENT,            // ble_mesh_client_init()
+    BOOT_CLIENT_MESH,       // its mesh stack init and provisioning enable
+    BOOT_PROVISIONER,       // ble_mesh_provisioner_init()
+    BOOT_PROVISIONER_MESH,  // its mesh stack init, restore and provisioning enable
+    BOOT_READY,             // end of initialization until the node can send
+    BOOT_PHASE_COUNT,
+} ble_mesh_boot_phase_t;
+
+typedef struct {
+    int64_t begin_us;       // esp_timer time, since boot
+    int64_t end_us;         // 0 while the phase runs
+} ble_mesh_boot_span_t;
+
+// Recorders, safe from any task. Ending a phase twice keeps the first end, beginning it
+// again measures it again.
+void ble_mesh_boot_begin(ble_mesh_boot_phase_t phase);
+void ble_mesh_boot_end(ble_mesh_boot_phase_t phase);
+
+void ble_mesh_boot_get(ble_mesh_boot_span_t spans[BOOT_PHASE_COUNT]);
+
+// Logs one line with the start and duration of every phase that ran, in ms since boot
+void ble_mesh_boot_report(void);
+
+#endif //DEZIBOT_BLUETOOTH_MESH_BOOT_PROFILE_H
@@ -1,14 +1,235 @@
 #include "client.h"
 #include "bluetooth.h"
+#include "boot_profile.h"
 #include "common.h"
+#include "lifecycle.h"
+#include "metrics.h"
+#include "node_registry.h"
+#include "peer_dir.h"
+#include "provisioner.h"
+#include "self_prov.h"
+#include "trace.h"
+#include "ttl_cache.h"
+#include "tx_queue.h"
+
+#include "esp_ble_mesh_local_data_operation_api.h"
+
+#include <stdatomic.h>
 
 #define TAG "BLE_MESH_CLIENT"
 #define APP_KEY_IDX 0x0000
+// Default route for messages to whichever team the node's own AppKey belongs to
+#define CLIENT_TEAM_OWN UINT8_MAX
+
+#define TX_TASK_STACK 4096
+#define TX_TASK_PRIO 5
+// ADV buffers left to the stack's own traffic: segment acks, beacons, heartbeats and a
+// local provisioner's configuration. Our messages may occupy the rest of the pool.
+#define TX_ADV_RESERVE (CONFIG_BLE_MESH_ADV_BUF_COUNT / 4)
+#define TX_ADV_BUDGET (CONFIG_BLE_MESH_ADV_BUF_COUNT - TX_ADV_RESERVE)
+#define TX_RETRY_MAX 3
+#define TX_RETRY_DELAY_MS 20
+// Messages handed to the stack that a send failure it reports later is matched against
+#define TX_SENT_MAX 16
+
+// Pending unacknowledged sets that newer values of the same destination replace
+#define COALESCE_SLOTS 16
+// Destinations with their own minimum send interval
+#define COALESCE_INTERVALS 8
+// Destinations with their own team, besides the local provisioner's nodes
+#define CLIENT_ROUTES_MAX 8
+
+// (model, destination) pairs with their own TID sequence
+#define TID_ENTRIES 32
+// Messages waiting for a retransmission with the same TID
+#define REPEAT_SLOTS 8
+// Servers treat a repeated TID from the same source within this window as the same transaction
+#define TID_WINDOW_MS 6000
+
+// Acknowledged requests that may be outstanding at the same time
+#define ACK_PENDING_MAX 16
+
+// Unicast retry rounds for members that did not confirm a group send
+#define GROUP_RETRY_ROUNDS 2
+
+// Remote addresses whose last reported state is kept, one per node the registry can hold
+#ifndef STATE_CACHE_SIZE
+#define STATE_CACHE_SIZE NODE_REGISTRY_MAX_NODES
+#endif
+
+// Entries an address may occupy, the least recently updated one of its set is evicted.
+// A table indexed by the address alone would need an entry for every address of the
+// provisioner's window, several per node; hashing into fewer entries lets them collide.
+#ifndef STATE_CACHE_WAYS
+#define STATE_CACHE_WAYS 4
+#endif
+
+#define STATE_CACHE_SETS ((STATE_CACHE_SIZE + STATE_CACHE_WAYS - 1) / STATE_CACHE_WAYS)
+
+// Indexes into client_models
+enum {
+    CLIENT_MODEL_CFG_SRV,
+    CLIENT_MODEL_CFG_CLI,
+    CLIENT_MODEL_ONOFF,
+    CLIENT_MODEL_LEVEL,
+    CLIENT_MODEL_DEF_TRANS_TIME,
+    CLIENT_MODEL_POWER_LEVEL,
+    CLIENT_MODEL_BATTERY,
+    CLIENT_MODEL_LOCATION,
+    CLIENT_MODEL_PROPERTY,
+};
 
 static uint8_t dev_uuid[16];
-static bool is_provisioned = false;
 static uint16_t node_addr = 0;
 
+static TaskHandle_t tx_task;
+static SemaphoreHandle_t tx_space;
+static int64_t tx_airtime_us;
+static int64_t bearer_free_us;
+// ADV buffers our messages may occupy, follows what the stack reports about its pool
+static uint32_t adv_budget = TX_ADV_BUDGET;
+static uint32_t adv_handed;
+static int64_t adv_shrunk_us;
+static portMUX_TYPE tx_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint64_t tx_latency_sum_us;
+static ble_mesh_client_tx_stats_t tx_stats;
+static atomic_uint tx_enqueued;
+static atomic_uint tx_dropped_full;
+static atomic_uint tx_depth_max;
+static atomic_uint tx_coalesced;
+static atomic_uint tx_unsupported;
+
+typedef enum {
+    TX_FIRST,       // new message, gets its TID
+    TX_REPEAT,      // extra copy with the TID already used
+    TX_RESEND,      // again, the stack failed to send it
+} tx_kind_t;
+
+// The stack only takes a send over in its own task, and reports a failure there
+// through the client callback. That callback hands it to the sender, which owns the
+// messages it handed over and resends them from here.
+typedef struct {
+    bool used;
+    bool resend;        // failed, due again at due_us
+    int64_t due_us;
+    ble_mesh_tx_msg_t msg;
+} tx_sent_t;
+
+typedef struct {
+    uint16_t addr;
+    uint32_t opcode;
+    int err;
+} tx_failure_t;
+
+static QueueHandle_t tx_failures;
+// Owned by the sender task
+static tx_sent_t tx_sent[TX_SENT_MAX];
+static uint8_t tx_sent_next;
+
+typedef struct {
+    bool used;
+    bool pending;       // a token for this slot is queued or deferred
+    bool deferred;      // held back by the destination's minimum interval
+    uint8_t model;
+    uint32_t opcode;
+    uint16_t addr;
+    int64_t last_sent_us;
+    int64_t due_us;
+    ble_mesh_tx_msg_t msg;
+} coalesce_slot_t;
+
+typedef struct {
+    uint16_t addr;
+    uint8_t model;
+    uint8_t tid;
+} tid_entry_t;
+
+typedef struct {
+    bool active;
+    uint8_t remaining;
+    int64_t due_us;
+    ble_mesh_tx_msg_t msg;
+} tx_repeat_t;
+
+// Owned by the sender task
+static tid_entry_t tids[TID_ENTRIES];
+static uint8_t tid_victim;
+static tx_repeat_t repeats[REPEAT_SLOTS];
+
+// Retransmission count in the upper, interval in ms in the lower 16 bits
+static atomic_uint retransmit_cfg;
+
+typedef struct {
+    bool used;
+    bool completed;
+    uint16_t gen;
+    ble_mesh_client_result_cb_t cb;
+    void *arg;
+    SemaphoreHandle_t done;
+    int64_t sent_us;
+    ble_mesh_client_result_t result;
+} ack_request_t;
+
+static portMUX_TYPE ack_lock = portMUX_INITIALIZER_UNLOCKED;
+static ack_request_t ack_requests[ACK_PENDING_MAX];
+
+enum {
+    STATE_ONOFF,
+    STATE_LEVEL,
+    STATE_BATTERY,
+    STATE_LOCATION,
+    STATE_FIELD_COUNT,
+    STATE_NONE = STATE_FIELD_COUNT,
+};
+
+typedef struct {
+    uint16_t addr;
+    uint8_t onoff;
+    int16_t level;
+    esp_ble_mesh_gen_battery_status_cb_t battery;
+    esp_ble_mesh_gen_loc_global_status_cb_t location;
+    int64_t updated_us[STATE_FIELD_COUNT];     // 0 while the field was never reported
+    int64_t touched_us;                         // last update of any field, for eviction
+} state_entry_t;
+
+static portMUX_TYPE state_lock = portMUX_INITIALIZER_UNLOCKED;
+static state_entry_t state_cache[STATE_CACHE_SETS][STATE_CACHE_WAYS];
+static ble_mesh_client_cache_stats_t state_stats;
+
+// Acknowledged group send in progress, its statuses arrive as publications
+// because their source is a member and not the group address we sent to
+typedef struct {
+    bool active;
+    uint16_t group_addr;
+    uint8_t value;
+    ble_mesh_client_group_result_t *result;
+    SemaphoreHandle_t done;
+} group_session_t;
+
+static SemaphoreHandle_t group_mutex;
+static portMUX_TYPE group_lock = portMUX_INITIALIZER_UNLOCKED;
+static group_session_t group_session;
+
+static portMUX_TYPE coalesce_lock = portMUX_INITIALIZER_UNLOCKED;
+static coalesce_slot_t coalesce_slots[COALESCE_SLOTS];
+static uint32_t default_interval_ms;
+static struct {
+    uint16_t addr;
+    uint32_t interval_ms;
+} min_intervals[COALESCE_INTERVALS];
+
+static portMUX_TYPE route_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t default_team = CLIENT_TEAM_OWN;
+// The AppKey the node was configured with and the NetKey it is bound to, a robot of
+// team t gets AppKey t and knows no other
+static bool node_key_known;
+static uint16_t node_net_idx = ESP_BLE_MESH_KEY_PRIMARY;
+static uint16_t node_app_idx = APP_KEY_IDX;
+static struct {
+    uint16_t addr;
+    uint8_t team;
+} team_routes[CLIENT_ROUTES_MAX];
+
 static esp_ble_mesh_cfg_srv_t config_server = {
     .net_transmit = ESP_BLE_MESH_TRANSMIT(2, 20),
     .relay = ESP_BLE_MESH_RELAY_DISABLED,
@@ -16,7 +237,7 @@ static esp_ble_mesh_cfg_srv_t config_server = {
     .beacon = ESP_BLE_MESH_BEACON_ENABLED,
     .gatt_proxy = ESP_BLE_MESH_GATT_PROXY_ENABLED,
     .friend_state = ESP_BLE_MESH_FRIEND_NOT_SUPPORTED,
-    .default_ttl = 7
+    .default_ttl = TTL_CACHE_DEFAULT
 };
 
 static esp_ble_mesh_client_t onoff_client;
@@ -55,6 +276,88 @@ static esp_ble_mesh_prov_t prov = {
     .uuid = dev_uuid,
 };
 
+// Whether the node's AppKey is bound to the OnOff Client, or with all to every sending
+// model. The stack keeps the bindings in the models and restores them with the settings.
+static bool client_models_bound(bool all)
+{
+    uint16_t app_idx = node_app_idx;
+    int last = all ? ARRAY_SIZE(client_models) - 1 : CLIENT_MODEL_ONOFF;
+
+    for (int i = CLIENT_MODEL_ONOFF; i <= last; i++) {
+        bool bound = false;
+
+        for (int k = 0; k < ARRAY_SIZE(client_models[i].keys); k++) {
+            bound |= client_models[i].keys[k] == app_idx;
+        }
+        if (!bound) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Models bound only needs the OnOff Client, the one an operator binds and the robot
+// sends with. Sends through another client model fail until it is bound as well.
+static void lifecycle_update_bindings(void)
+{
+    if (client_models_bound(false)) {
+        ble_mesh_lifecycle_set(LIFECYCLE_MODELS_BOUND);
+    } else {
+        ble_mesh_lifecycle_clear(LIFECYCLE_MODELS_BOUND);
+    }
+}
+
+// Without a provisioner nobody configures the node, it binds the AppKey to its
+// sending models itself once the key is in
+static void self_prov_bind_models(void)
+{
+    for (int i = CLIENT_MODEL_ONOFF; i < ARRAY_SIZE(client_models); i++) {
+        esp_err_t err = esp_ble_mesh_node_bind_app_key_to_local_model(node_addr, ESP_BLE_MESH_CID_NVAL,
+                                                                      client_models[i].model_id, node_app_idx);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to bind AppKey to model 0x%04x (err %d)", client_models[i].model_id, err);
+        }
+    }
+}
+
+// The first AppKey the node gets is its own, it sends with it and its NetKey unless
+// routed elsewhere. Further keys, e.g. another team's on a gateway, leave it alone.
+static void node_key_set(uint16_t net_idx, uint16_t app_idx)
+{
+    taskENTER_CRITICAL(&route_lock);
+    if (!node_key_known) {
+        node_key_known = true;
+        node_net_idx = net_idx;
+        node_app_idx = app_idx;
+    }
+    taskEXIT_CRITICAL(&route_lock);
+}
+
+static void node_key_clear(void)
+{
+    taskENTER_CRITICAL(&route_lock);
+    node_key_known = false;
+    node_net_idx = ESP_BLE_MESH_KEY_PRIMARY;
+    node_app_idx = APP_KEY_IDX;
+    taskEXIT_CRITICAL(&route_lock);
+}
+
+// A node restored from flash gets no configuration events, the key bound to its
+// models is its own. The stack does not tell which NetKey that AppKey is bound to,
+// the team layout does.
+static void node_key_restore(void)
+{
+    for (int k = 0; k < ARRAY_SIZE(client_models[CLIENT_MODEL_ONOFF].keys); k++) {
+        uint16_t app_idx = client_models[CLIENT_MODEL_ONOFF].keys[k];
+
+        if (app_idx != ESP_BLE_MESH_KEY_UNUSED) {
+            node_key_set(BLE_MESH_TEAM_NET_IDX(BLE_MESH_APP_IDX_TEAM(app_idx)), app_idx);
+            return;
+        }
+    }
+}
+
 static void mesh_prov_cb(esp_ble_mesh_prov_cb_event_t event,
                          esp_ble_mesh_prov_cb_param_t *param)
 {
@@ -65,6 +368,9 @@ static void mesh_prov_cb(esp_ble_mesh_prov_cb_event_t event,
         case ESP_BLE_MESH_NODE_PROV_ENABLE_COMP_EVT:
             ESP_LOGI(TAG, "Node ready for provisioning - should be visible in nRF Mesh app");
             break;
+        case ESP_BLE_MESH_NODE_PROV_DISABLE_COMP_EVT:
+            ble_mesh_self_prov_prov_disabled();
+            break;
         case ESP_BLE_MESH_NODE_PROV_LINK_OPEN_EVT:
             ESP_LOGI(TAG, "Provisioning link opened");
             break;
@@ -74,14 +380,40 @@ static void mesh_prov_cb(esp_ble_mesh_prov_cb_event_t event,
         case ESP_BLE_MESH_NODE_PROV_COMPLETE_EVT:
             ESP_LOGI(TAG, "Provisioning completed: addr=0x%04x", param->node_prov_complete.addr);
             node_addr = param->node_prov_complete.addr;
-            is_provisioned = true;
+            ble_mesh_lifecycle_set(LIFECYCLE_PROVISIONED);
             ESP_LOGI(TAG, "Device is now provisioned at address 0x%04x", node_addr);
             ESP_LOGI(TAG, "GATT Proxy should start advertising automatically");
             ESP_LOGW(TAG, "IMPORTANT: Reconnect to the device in nRF Mesh app, then bind the AppKey");
             ESP_LOGW(TAG, "Steps: Tap 'Connect' on node -> Elements -> Element 0 -> Generic OnOff Client -> Bind Key");
+            ESP_LOGW(TAG, "Bind the other Generic clients the same way to send through them as well");
+            break;
+        case ESP_BLE_MESH_NODE_ADD_LOCAL_APP_KEY_COMP_EVT:
+            if (param->node_add_app_key_comp.err_code && param->node_add_app_key_comp.err_code != -EEXIST) {
+                ESP_LOGE(TAG, "Failed to add local AppKey 0x%04x (err %d)", param->node_add_app_key_comp.app_idx,
+                         param->node_add_app_key_comp.err_code);
+                break;
+            }
+            ESP_LOGI(TAG, "Local AppKey 0x%04x added", param->node_add_app_key_comp.app_idx);
+            node_key_set(param->node_add_app_key_comp.net_idx, param->node_add_app_key_comp.app_idx);
+            ble_mesh_lifecycle_set(LIFECYCLE_APPKEY_BOUND);
+            self_prov_bind_models();
+            break;
+        case ESP_BLE_MESH_NODE_BIND_APP_KEY_TO_MODEL_COMP_EVT:
+            if (param->node_bind_app_key_to_model_comp.err_code) {
+                ESP_LOGE(TAG, "Failed to bind AppKey to model 0x%04x (err %d)",
+                         param->node_bind_app_key_to_model_comp.model_id,
+                         param->node_bind_app_key_to_model_comp.err_code);
+            }
+            lifecycle_update_bindings();
+            break;
+        case ESP_BLE_MESH_NODE_PROV_RESET_EVT:
+            ESP_LOGW(TAG, "Node reset, keys and bindings are gone");
+            node_addr = 0;
+            node_key_clear();
+            ble_mesh_lifecycle_clear(LIFECYCLE_PROVISIONED | LIFECYCLE_APPKEY_BOUND | LIFECYCLE_MODELS_BOUND);
             break;
         case ESP_BLE_MESH_PROXY_CLIENT_RECV_ADV_PKT_EVT:
-            ESP_LOGI(TAG, "Proxy client received advertising packet");
+            TRACE_VERBOSE(TRACE_PROXY_ADV, 0, param->proxy_client_recv_adv_pkt.net_idx, 0);
             break;
         case ESP_BLE_MESH_PROXY_CLIENT_CONNECTED_EVT:
             ESP_LOGI(TAG, "Proxy client connected");
@@ -95,6 +427,37 @@ static void mesh_prov_cb(esp_ble_mesh_prov_cb_event_t event,
     }
 }
 
+static void mesh_config_server_cb(esp_ble_mesh_cfg_server_cb_event_t event,
+                                  esp_ble_mesh_cfg_server_cb_param_t *param)
+{
+    if (event != ESP_BLE_MESH_CFG_SERVER_STATE_CHANGE_EVT) {
+        return;
+    }
+
+    switch (param->ctx.recv_op) {
+        case ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD:
+            node_key_set(param->value.state_change.appkey_add.net_idx, param->value.state_change.appkey_add.app_idx);
+            if (param->value.state_change.appkey_add.app_idx == node_app_idx) {
+                ESP_LOGI(TAG, "AppKey 0x%04x added on NetKey 0x%04x", node_app_idx, node_net_idx);
+                ble_mesh_lifecycle_set(LIFECYCLE_APPKEY_BOUND);
+            }
+            break;
+        case ESP_BLE_MESH_MODEL_OP_APP_KEY_DELETE:
+            if (node_key_known && param->value.state_change.appkey_delete.app_idx == node_app_idx) {
+                ESP_LOGW(TAG, "AppKey 0x%04x deleted", node_app_idx);
+                node_key_clear();
+                ble_mesh_lifecycle_clear(LIFECYCLE_APPKEY_BOUND | LIFECYCLE_MODELS_BOUND);
+            }
+            break;
+        case ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND:
+        case ESP_BLE_MESH_MODEL_OP_MODEL_APP_UNBIND:
+            lifecycle_update_bindings();
+            break;
+        default:
+            break;
+    }
+}
+
 static void mesh_config_client_cb(esp_ble_mesh_cfg_client_cb_event_t event,
                                    esp_ble_mesh_cfg_client_cb_param_t *param)
 {
@@ -125,290 +488,1769 @@ static void mesh_config_client_cb(esp_ble_mesh_cfg_client_cb_event_t event,
     }
 }
 
-static void mesh_generic_client_cb(esp_ble_mesh_generic_client_cb_event_t event,
-                                   esp_ble_mesh_generic_client_cb_param_t *param)
+static ack_request_t *ack_lookup(ble_mesh_client_handle_t handle)
 {
-    switch (event) {
-        case ESP_BLE_MESH_GENERIC_CLIENT_GET_STATE_EVT:
-            ESP_LOGI(TAG, "Generic client get state event");
-            break;
-        case ESP_BLE_MESH_GENERIC_CLIENT_SET_STATE_EVT:
-            ESP_LOGI(TAG, "Generic client set state event");
-            break;
-        case ESP_BLE_MESH_GENERIC_CLIENT_PUBLISH_EVT:
-            ESP_LOGI(TAG, "Generic client publish event");
-            break;
-        case ESP_BLE_MESH_GENERIC_CLIENT_TIMEOUT_EVT:
-            ESP_LOGI(TAG, "Generic client timeout event");
-            break;
-        default:
-            break;
+    uint32_t idx = (handle & 0xff) - 1;
+    ack_request_t *request = NULL;
+
+    if (idx >= ACK_PENDING_MAX) {
+        return NULL;
+    }
+
+    taskENTER_CRITICAL(&ack_lock);
+    if (ack_requests[idx].used && ack_requests[idx].gen == (handle >> 8)) {
+        request = &ack_requests[idx];
     }
+    taskEXIT_CRITICAL(&ack_lock);
+
+    return request;
 }
 
-void ble_mesh_client_send(uint8_t val, uint16_t addr)
+static void ack_release(ack_request_t *request)
 {
-    esp_ble_mesh_generic_client_set_state_t set_state = {0};
-    esp_ble_mesh_client_common_param_t common = {0};
-    esp_err_t err;
-    
-    if (!is_provisioned) {
-        ESP_LOGW(TAG, "Device not provisioned yet, cannot send messages");
-        return;
+    taskENTER_CRITICAL(&ack_lock);
+    request->used = false;
+    request->completed = false;
+    taskEXIT_CRITICAL(&ack_lock);
+}
+
+// The request a queued message was sent for, if it is still waiting for it. ack_lock held.
+static ack_request_t *ack_of_msg_locked(const ble_mesh_tx_msg_t *msg)
+{
+    ack_request_t *request = &ack_requests[msg->request - 1];
+
+    if (!request->used || request->completed || request->gen != msg->request_gen) {
+        return NULL;
     }
-    
-    common.opcode = ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_SET_UNACK;
-    common.model = &client_models[2];  // Generic OnOff Client
-    common.ctx.net_idx = 0x0000;
-    common.ctx.app_idx = 0x0000;
-    common.ctx.addr = addr;
-    common.ctx.send_ttl = 3;
-    common.msg_timeout = 0;
-    
-    set_state.onoff_set.op_en = false;
-    set_state.onoff_set.onoff = val;
-    set_state.onoff_set.tid = 0;
-    
-    err = esp_ble_mesh_generic_client_set_state(&common, &set_state);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to send onoff set (err %d)", err);
-    } else {
-        ESP_LOGI(TAG, "Sent onoff %d to addr 0x%04x", val, addr);
+
+    return request;
+}
+
+// Stamps the send time of the message's request. False when the request was
+// cancelled or completed meanwhile, its slot may already belong to another one.
+static bool ack_mark_sent(const ble_mesh_tx_msg_t *msg, int64_t sent_us)
+{
+    ack_request_t *request;
+
+    taskENTER_CRITICAL(&ack_lock);
+    request = ack_of_msg_locked(msg);
+    if (request) {
+        request->sent_us = sent_us;
     }
+    taskEXIT_CRITICAL(&ack_lock);
+
+    return request != NULL;
 }
 
-void ble_mesh_client_send_level(int16_t level, uint16_t addr)
+// Hands the result to the callback or the waiter of a request already marked completed
+static void ack_finish(ack_request_t *request, esp_err_t err, const esp_ble_mesh_gen_client_status_cb_t *status)
 {
-    esp_ble_mesh_generic_client_set_state_t set_state = {0};
-    esp_ble_mesh_client_common_param_t common = {0};
-    esp_err_t err;
-    
-    if (!is_provisioned) {
-        ESP_LOGW(TAG, "Device not provisioned yet, cannot send messages");
-        return;
+    // Transmit failures are counted by the sender
+    if (request->sent_us) {
+        ble_mesh_metrics_result(request->result.opcode,
+                                err == ESP_OK ? METRICS_OK : err == ESP_ERR_TIMEOUT ? METRICS_TIMEOUT : METRICS_FAIL,
+                                esp_timer_get_time() - request->sent_us);
     }
-    
-    common.opcode = ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_SET_UNACK;
-    common.model = &client_models[3];  // Generic Level Client
-    common.ctx.net_idx = 0x0000;
-    common.ctx.app_idx = 0x0000;
-    common.ctx.addr = addr;
-    common.ctx.send_ttl = 3;
-    common.msg_timeout = 0;
-    
-    set_state.level_set.op_en = false;
-    set_state.level_set.level = level;
-    set_state.level_set.tid = 0;
-    
-    err = esp_ble_mesh_generic_client_set_state(&common, &set_state);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to send level set (err %d)", err);
+
+    request->result.err = err;
+    if (status) {
+        request->result.status = *status;
+    }
+
+    if (request->cb) {
+        request->cb(&request->result, request->arg);
+        ack_release(request);
     } else {
-        ESP_LOGI(TAG, "Sent level %d to addr 0x%04x", level, addr);
+        xSemaphoreGive(request->done);
     }
 }
 
-void ble_mesh_client_send_default_transition_time(uint8_t transition_time, uint16_t addr)
+// Completes the request outstanding for (addr, opcode), if any
+static void ack_complete(uint16_t addr, uint32_t opcode, esp_err_t err,
+                         const esp_ble_mesh_gen_client_status_cb_t *status)
 {
-    esp_ble_mesh_generic_client_set_state_t set_state = {0};
-    esp_ble_mesh_client_common_param_t common = {0};
-    esp_err_t err;
-    
-    if (!is_provisioned) {
-        ESP_LOGW(TAG, "Device not provisioned yet, cannot send messages");
-        return;
+    ack_request_t *request = NULL;
+
+    taskENTER_CRITICAL(&ack_lock);
+    for (int i = 0; i < ACK_PENDING_MAX; i++) {
+        if (ack_requests[i].used && !ack_requests[i].completed &&
+            ack_requests[i].result.addr == addr && ack_requests[i].result.opcode == opcode) {
+            request = &ack_requests[i];
+            request->completed = true;
+            break;
+        }
     }
-    
-    common.opcode = ESP_BLE_MESH_MODEL_OP_GEN_DEF_TRANS_TIME_SET_UNACK;
-    common.model = &client_models[4];  // Generic Default Transition Time Client
-    common.ctx.net_idx = 0x0000;
-    common.ctx.app_idx = 0x0000;
-    common.ctx.addr = addr;
-    common.ctx.send_ttl = 3;
-    common.msg_timeout = 0;
-    
-    set_state.def_trans_time_set.trans_time = transition_time;
-    
-    err = esp_ble_mesh_generic_client_set_state(&common, &set_state);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to send default transition time set (err %d)", err);
-    } else {
-        ESP_LOGI(TAG, "Sent default transition time %d to addr 0x%04x", transition_time, addr);
+    taskEXIT_CRITICAL(&ack_lock);
+
+    if (request) {
+        ack_finish(request, err, status);
     }
 }
 
-void ble_mesh_client_send_power_level(uint16_t power, uint16_t addr)
+// Fails the request of a message the stack never took
+static void ack_fail(const ble_mesh_tx_msg_t *msg, esp_err_t err)
 {
-    esp_ble_mesh_generic_client_set_state_t set_state = {0};
-    esp_ble_mesh_client_common_param_t common = {0};
-    esp_err_t err;
-    
-    if (!is_provisioned) {
-        ESP_LOGW(TAG, "Device not provisioned yet, cannot send messages");
-        return;
+    ack_request_t *request;
+
+    taskENTER_CRITICAL(&ack_lock);
+    request = ack_of_msg_locked(msg);
+    if (request) {
+        request->completed = true;
+        request->sent_us = 0;
     }
-    
-    common.opcode = ESP_BLE_MESH_MODEL_OP_GEN_POWER_LEVEL_SET_UNACK;
-    common.model = &client_models[5];  // Generic Power Level Client
-    common.ctx.net_idx = 0x0000;
-    common.ctx.app_idx = 0x0000;
-    common.ctx.addr = addr;
-    common.ctx.send_ttl = 3;
-    common.msg_timeout = 0;
-    
-    set_state.power_level_set.op_en = false;
-    set_state.power_level_set.power = power;
-    set_state.power_level_set.tid = 0;
-    
-    err = esp_ble_mesh_generic_client_set_state(&common, &set_state);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to send power level set (err %d)", err);
-    } else {
-        ESP_LOGI(TAG, "Sent power level %d to addr 0x%04x", power, addr);
+    taskEXIT_CRITICAL(&ack_lock);
+
+    if (request) {
+        ack_finish(request, err, NULL);
     }
 }
 
-void ble_mesh_client_send_battery(uint8_t battery_level, uint16_t addr)
+static int state_field(uint32_t opcode)
 {
-    esp_ble_mesh_generic_client_get_state_t get_state = {0};
-    esp_ble_mesh_client_common_param_t common = {0};
-    esp_err_t err;
-    
-    if (!is_provisioned) {
-        ESP_LOGW(TAG, "Device not provisioned yet, cannot send messages");
-        return;
+    // Requests for GET/SET events, status opcodes for publications
+    switch (opcode) {
+        case ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_GET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_STATUS:
+            return STATE_ONOFF;
+        case ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_GET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_STATUS:
+            return STATE_LEVEL;
+        case ESP_BLE_MESH_MODEL_OP_GEN_BATTERY_GET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_BATTERY_STATUS:
+            return STATE_BATTERY;
+        case ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_GET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_SET:
+        case ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_STATUS:
+            return STATE_LOCATION;
+        default:
+            return STATE_NONE;
     }
-    
-    // Battery model is typically read-only, so we send a GET request
-    common.opcode = ESP_BLE_MESH_MODEL_OP_GEN_BATTERY_GET;
-    common.model = &client_models[6];  // Generic Battery Client
-    common.ctx.net_idx = 0x0000;
-    common.ctx.app_idx = 0x0000;
-    common.ctx.addr = addr;
-    common.ctx.send_ttl = 3;
-    common.msg_timeout = 0;
-    
-    err = esp_ble_mesh_generic_client_get_state(&common, &get_state);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to send battery get (err %d)", err);
-    } else {
-        ESP_LOGI(TAG, "Sent battery get to addr 0x%04x", addr);
+}
+
+static int state_field_of_model(uint8_t model)
+{
+    switch (model) {
+        case CLIENT_MODEL_ONOFF:
+            return STATE_ONOFF;
+        case CLIENT_MODEL_LEVEL:
+            return STATE_LEVEL;
+        case CLIENT_MODEL_LOCATION:
+            return STATE_LOCATION;
+        default:
+            return STATE_NONE;
     }
 }
 
-void ble_mesh_client_send_location(uint32_t latitude, uint32_t longitude, int16_t altitude, uint16_t addr)
+static state_entry_t *state_find_locked(uint16_t addr)
 {
-    esp_ble_mesh_generic_client_set_state_t set_state = {0};
-    esp_ble_mesh_client_common_param_t common = {0};
-    esp_err_t err;
-    
-    if (!is_provisioned) {
-        ESP_LOGW(TAG, "Device not provisioned yet, cannot send messages");
-        return;
+    state_entry_t *set = state_cache[addr % STATE_CACHE_SETS];
+
+    for (int i = 0; i < STATE_CACHE_WAYS; i++) {
+        if (set[i].addr == addr) {
+            return &set[i];
+        }
     }
-    
-    common.opcode = ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_SET_UNACK;
-    common.model = &client_models[7];  // Generic Location Client
-    common.ctx.net_idx = 0x0000;
-    common.ctx.app_idx = 0x0000;
-    common.ctx.addr = addr;
-    common.ctx.send_ttl = 3;
-    common.msg_timeout = 0;
-    
-    set_state.loc_global_set.global_latitude = latitude;
-    set_state.loc_global_set.global_longitude = longitude;
-    set_state.loc_global_set.global_altitude = altitude;
-    
-    err = esp_ble_mesh_generic_client_set_state(&common, &set_state);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to send location global set (err %d)", err);
-    } else {
-        ESP_LOGI(TAG, "Sent location (lat=%lu, lon=%lu, alt=%d) to addr 0x%04x", 
-                 latitude, longitude, altitude, addr);
+    return NULL;
+}
+
+// Entry for addr, taking a free or the least recently updated one of its set
+static state_entry_t *state_claim_locked(uint16_t addr)
+{
+    state_entry_t *set = state_cache[addr % STATE_CACHE_SETS];
+    state_entry_t *victim = &set[0];
+
+    for (int i = 0; i < STATE_CACHE_WAYS; i++) {
+        if (set[i].addr == addr) {
+            return &set[i];
+        }
+        if (victim->addr != ESP_BLE_MESH_ADDR_UNASSIGNED &&
+            (set[i].addr == ESP_BLE_MESH_ADDR_UNASSIGNED || set[i].touched_us < victim->touched_us)) {
+            victim = &set[i];
+        }
+    }
+
+    if (victim->addr != ESP_BLE_MESH_ADDR_UNASSIGNED) {
+        state_stats.evictions++;
     }
+    memset(victim, 0, sizeof(*victim));
+    victim->addr = addr;
+    return victim;
 }
 
-void ble_mesh_client_send_property(uint16_t property_id, uint8_t *property_value, 
-                                    uint16_t property_value_len, uint16_t addr)
+static void state_update(uint16_t addr, uint32_t opcode, const esp_ble_mesh_gen_client_status_cb_t *status)
 {
-    esp_ble_mesh_generic_client_set_state_t set_state = {0};
-    esp_ble_mesh_client_common_param_t common = {0};
-    esp_err_t err;
-    
-    if (!is_provisioned) {
-        ESP_LOGW(TAG, "Device not provisioned yet, cannot send messages");
+    int field = state_field(opcode);
+    state_entry_t *entry;
+
+    if (field == STATE_NONE || !ESP_BLE_MESH_ADDR_IS_UNICAST(addr)) {
         return;
     }
-    
-    if (property_value_len > 379) {  // Max property value length
-        ESP_LOGE(TAG, "Property value too long (max 379 bytes)");
+
+    taskENTER_CRITICAL(&state_lock);
+    entry = state_claim_locked(addr);
+
+    switch (field) {
+        case STATE_ONOFF:
+            entry->onoff = status->onoff_status.present_onoff;
+            break;
+        case STATE_LEVEL:
+            entry->level = status->level_status.present_level;
+            break;
+        case STATE_BATTERY:
+            entry->battery = status->battery_status;
+            break;
+        case STATE_LOCATION:
+            entry->location = status->location_global_status;
+            break;
+    }
+    entry->updated_us[field] = esp_timer_get_time();
+    entry->touched_us = entry->updated_us[field];
+    state_stats.updates++;
+    taskEXIT_CRITICAL(&state_lock);
+}
+
+// A set we sent makes the cached value stale until the node reports again
+static void state_invalidate(uint16_t addr, uint8_t model)
+{
+    int field = state_field_of_model(model);
+    state_entry_t *entry;
+
+    if (field == STATE_NONE || !ESP_BLE_MESH_ADDR_IS_UNICAST(addr)) {
         return;
     }
-    
-    common.opcode = ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_SET_UNACK;
-    common.model = &client_models[8];  // Generic Property Client
-    common.ctx.net_idx = 0x0000;
-    common.ctx.app_idx = 0x0000;
-    common.ctx.addr = addr;
-    common.ctx.send_ttl = 3;
-    common.msg_timeout = 0;
-    
-    set_state.user_property_set.property_id = property_id;
-    set_state.user_property_set.property_value = property_value;
 
-    err = esp_ble_mesh_generic_client_set_state(&common, &set_state);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to send user property set (err %d)", err);
-    } else {
-        ESP_LOGI(TAG, "Sent user property 0x%04x (len=%d) to addr 0x%04x", 
-                 property_id, property_value_len, addr);
+    taskENTER_CRITICAL(&state_lock);
+    entry = state_find_locked(addr);
+    if (entry) {
+        entry->updated_us[field] = 0;
     }
+    taskEXIT_CRITICAL(&state_lock);
 }
 
-esp_err_t ble_mesh_client_init(void)
+static esp_err_t state_read(uint16_t addr, int field, uint32_t max_age_ms, void *value)
 {
-    ESP_LOGI(TAG, "Initializing...");
-    esp_err_t err;
-    
-    ble_mesh_get_dev_uuid(dev_uuid);
-    ESP_LOGI(TAG, "Device UUID: %02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
-             dev_uuid[0], dev_uuid[1], dev_uuid[2], dev_uuid[3],
-             dev_uuid[4], dev_uuid[5], dev_uuid[6], dev_uuid[7],
-             dev_uuid[8], dev_uuid[9], dev_uuid[10], dev_uuid[11],
-             dev_uuid[12], dev_uuid[13], dev_uuid[14], dev_uuid[15]);
-    
-    err = esp_ble_mesh_register_prov_callback(mesh_prov_cb);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to register prov callback (err %d)", err);
-        return err;
-    }
-    
-    err = esp_ble_mesh_register_config_client_callback(mesh_config_client_cb);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to register config client callback (err %d)", err);
-        return err;
+    state_entry_t *entry;
+    int64_t now = esp_timer_get_time();
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+
+    if (!value) {
+        return ESP_ERR_INVALID_ARG;
     }
-    
-    err = esp_ble_mesh_register_generic_client_callback(mesh_generic_client_cb);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to register generic client callback (err %d)", err);
-        return err;
+
+    taskENTER_CRITICAL(&state_lock);
+    entry = state_find_locked(addr);
+    if (entry && entry->updated_us[field] &&
+        now - entry->updated_us[field] <= (int64_t)max_age_ms * 1000) {
+        switch (field) {
+            case STATE_ONOFF:
+                *(uint8_t *)value = entry->onoff;
+                break;
+            case STATE_LEVEL:
+                *(int16_t *)value = entry->level;
+                break;
+            case STATE_BATTERY:
+                *(esp_ble_mesh_gen_battery_status_cb_t *)value = entry->battery;
+                break;
+            case STATE_LOCATION:
+                *(esp_ble_mesh_gen_loc_global_status_cb_t *)value = entry->location;
+                break;
+        }
+        err = ESP_OK;
+        state_stats.hits++;
+    } else {
+        state_stats.misses++;
     }
-    
-    err = esp_ble_mesh_init(&prov, &composition);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "BLE Mesh init failed (err %d)", err);
-        return err;
+    taskEXIT_CRITICAL(&state_lock);
+
+    return err;
+}
+
+static int group_member_index(const ble_mesh_client_group_result_t *result, uint16_t addr)
+{
+    int lo = 0;
+    int hi = result->member_count;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (result->members[mid] < addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
     }
-    
-    err = esp_ble_mesh_node_prov_enable((esp_ble_mesh_prov_bearer_t)(ESP_BLE_MESH_PROV_ADV | ESP_BLE_MESH_PROV_GATT));
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to enable node provisioning (err %d)", err);
-        return err;
+
+    return (lo < result->member_count && result->members[lo] == addr) ? lo : -1;
+}
+
+static bool group_confirmed(const ble_mesh_client_group_result_t *result, int idx)
+{
+    return result->responded[idx / 32] & (1u << (idx % 32));
+}
+
+// Marks a member whose status reports the value of the group send
+static void group_collect(uint16_t addr, uint32_t opcode, const esp_ble_mesh_gen_client_status_cb_t *status)
+{
+    bool done = false;
+
+    if (opcode != ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_STATUS) {
+        return;
+    }
+
+    taskENTER_CRITICAL(&group_lock);
+    if (group_session.active) {
+        ble_mesh_client_group_result_t *result = group_session.result;
+        int idx = group_member_index(result, addr);
+        bool applied = status->onoff_status.present_onoff == group_session.value ||
+                       (status->onoff_status.op_en && status->onoff_status.target_onoff == group_session.value);
+
+        if (idx >= 0 && applied && !group_confirmed(result, idx)) {
+            result->responded[idx / 32] |= 1u << (idx % 32);
+            result->responded_count++;
+            done = result->responded_count == result->member_count;
+        }
+    }
+    taskEXIT_CRITICAL(&group_lock);
+
+    if (done) {
+        xSemaphoreGive(group_session.done);
+    }
+}
+
+// Stack task side of a failed send, the sender resends the message
+static void client_tx_report_failure(uint16_t addr, uint32_t opcode, int err)
+{
+    tx_failure_t failure = {.addr = addr, .opcode = opcode, .err = err};
+
+    if (xQueueSend(tx_failures, &failure, 0) != pdTRUE) {
+        ack_complete(addr, opcode, ESP_FAIL, NULL);
+        return;
+    }
+    xTaskNotifyGive(tx_task);
+}
+
+// Server model handling the message on the receiving element
+static uint16_t client_server_model(uint8_t model, bool get)
+{
+    switch (model) {
+        case CLIENT_MODEL_ONOFF:
+            return ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_SRV;
+        case CLIENT_MODEL_LEVEL:
+            return ESP_BLE_MESH_MODEL_ID_GEN_LEVEL_SRV;
+        case CLIENT_MODEL_DEF_TRANS_TIME:
+            return ESP_BLE_MESH_MODEL_ID_GEN_DEF_TRANS_TIME_SRV;
+        case CLIENT_MODEL_POWER_LEVEL:
+            return ESP_BLE_MESH_MODEL_ID_GEN_POWER_LEVEL_SRV;
+        case CLIENT_MODEL_BATTERY:
+            return ESP_BLE_MESH_MODEL_ID_GEN_BATTERY_SRV;
+        case CLIENT_MODEL_LOCATION:
+            // Location states are written through the setup server
+            return get ? ESP_BLE_MESH_MODEL_ID_GEN_LOCATION_SRV : ESP_BLE_MESH_MODEL_ID_GEN_LOCATION_SETUP_SRV;
+        case CLIENT_MODEL_PROPERTY:
+            return ESP_BLE_MESH_MODEL_ID_GEN_USER_PROP_SRV;
+        default:
+            return ESP_BLE_MESH_MODEL_ID_CONFIG_SRV;
+    }
+}
+
+static void mesh_generic_client_cb(esp_ble_mesh_generic_client_cb_event_t event,
+                                   esp_ble_mesh_generic_client_cb_param_t *param)
+{
+    uint16_t addr = param->params->ctx.addr;
+    uint16_t net_idx = param->params->ctx.net_idx;
+    uint32_t opcode = param->params->opcode;
+    uint8_t model = param->params->model - client_models;
+
+    switch (event) {
+        case ESP_BLE_MESH_GENERIC_CLIENT_GET_STATE_EVT:
+        case ESP_BLE_MESH_GENERIC_CLIENT_SET_STATE_EVT:
+            TRACE_MSG(TRACE_RX_STATUS, addr, opcode, param->error_code);
+            if (param->error_code) {
+                client_tx_report_failure(addr, opcode, param->error_code);
+                break;
+            }
+            ble_mesh_ttl_learn_rx(addr, param->params->ctx.recv_ttl);
+            ble_mesh_peer_heard(addr, net_idx,
+                                client_server_model(model, event == ESP_BLE_MESH_GENERIC_CLIENT_GET_STATE_EVT));
+            state_update(addr, opcode, &param->status_cb);
+            ack_complete(addr, opcode, ESP_OK, &param->status_cb);
+            break;
+        case ESP_BLE_MESH_GENERIC_CLIENT_PUBLISH_EVT:
+            TRACE_MSG(TRACE_RX_PUBLISH, addr, opcode, 0);
+            ble_mesh_peer_heard(addr, net_idx, client_server_model(model, true));
+            state_update(addr, opcode, &param->status_cb);
+            group_collect(addr, opcode, &param->status_cb);
+            break;
+        case ESP_BLE_MESH_GENERIC_CLIENT_TIMEOUT_EVT:
+            TRACE_MSG(TRACE_RX_TIMEOUT, addr, opcode, 0);
+            // The path may have grown, the next message goes out with the default TTL again
+            ble_mesh_ttl_forget(addr);
+            // Only the Location states are read and written through different servers
+            ble_mesh_peer_timeout(addr, client_server_model(model, opcode == ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_GET));
+            ack_complete(addr, opcode, ESP_ERR_TIMEOUT, NULL);
+            break;
+        default:
+            break;
+    }
+}
+
+static esp_err_t client_transmit(ble_mesh_tx_msg_t *msg)
+{
+    esp_ble_mesh_client_common_param_t common = {0};
+    NET_BUF_SIMPLE_DEFINE(value, TX_QUEUE_VALUE_MAX);
+
+    common.opcode = msg->opcode;
+    common.model = &client_models[msg->model];
+    common.ctx.net_idx = msg->net_idx;
+    common.ctx.app_idx = msg->app_idx;
+    common.ctx.addr = msg->addr;
+    // Chosen per transmission, retries and repeats follow what was learned meanwhile
+    msg->ttl = ble_mesh_ttl_get(msg->addr);
+    common.ctx.send_ttl = msg->ttl;
+    common.msg_timeout = 0;
+
+    if (msg->get) {
+        return esp_ble_mesh_generic_client_get_state(&common, &msg->get_state);
+    }
+
+    if (msg->model == CLIENT_MODEL_PROPERTY) {
+        net_buf_simple_add_mem(&value, msg->value, msg->value_len);
+        msg->set.user_property_set.property_value = &value;
+    }
+
+    return esp_ble_mesh_generic_client_set_state(&common, &msg->set);
+}
+
+// Network PDUs the message occupies, access payloads above 11 octets are segmented
+static uint32_t client_pdu_count(const ble_mesh_tx_msg_t *msg)
+{
+    uint32_t len = 2 + msg->value_len + 4;
+
+    if (msg->model != CLIENT_MODEL_PROPERTY || len <= 15) {
+        return 1;
+    }
+
+    return (len + 11) / 12;
+}
+
+// Blocks while the airtime already handed to the stack exceeds the ADV buffer budget
+static void client_tx_pace(uint32_t pdus)
+{
+    int64_t limit_us = (int64_t)adv_budget * tx_airtime_us;
+    int64_t backlog_us = bearer_free_us - esp_timer_get_time();
+    int64_t excess_us = backlog_us + (int64_t)pdus * tx_airtime_us - limit_us;
+
+    if (excess_us > 0) {
+        vTaskDelay(pdMS_TO_TICKS(excess_us / 1000) + 1);
+    }
+}
+
+static uint8_t *client_msg_tid(ble_mesh_tx_msg_t *msg)
+{
+    if (msg->get) {
+        return NULL;
+    }
+
+    switch (msg->model) {
+        case CLIENT_MODEL_ONOFF:
+            return &msg->set.onoff_set.tid;
+        case CLIENT_MODEL_LEVEL:
+            return &msg->set.level_set.tid;
+        case CLIENT_MODEL_POWER_LEVEL:
+            return &msg->set.power_level_set.tid;
+        default:
+            return NULL;
+    }
+}
+
+// Starts a new transaction: the next TID of the message's (model, destination) sequence
+static void client_assign_tid(ble_mesh_tx_msg_t *msg, uint8_t *tid)
+{
+    tid_entry_t *entry = NULL;
+
+    for (int i = 0; i < TID_ENTRIES; i++) {
+        if (tids[i].addr == msg->addr && tids[i].model == msg->model) {
+            entry = &tids[i];
+            break;
+        }
+    }
+
+    if (!entry) {
+        // Random start so a rebooted client does not repeat the server's last TID
+        entry = &tids[tid_victim];
+        tid_victim = (tid_victim + 1) % TID_ENTRIES;
+        entry->addr = msg->addr;
+        entry->model = msg->model;
+        entry->tid = esp_random();
+    }
+
+    *tid = ++entry->tid;
+}
+
+static void repeat_schedule(const ble_mesh_tx_msg_t *msg)
+{
+    uint32_t cfg = atomic_load(&retransmit_cfg);
+    uint8_t count = cfg >> 16;
+    uint16_t interval_ms = cfg & 0xffff;
+    tx_repeat_t *free_slot = NULL;
+
+    // A new transaction for the destination supersedes repeats of the previous one
+    for (int i = 0; i < REPEAT_SLOTS; i++) {
+        if (repeats[i].active && repeats[i].msg.addr == msg->addr && repeats[i].msg.model == msg->model) {
+            repeats[i].active = false;
+        }
+        if (!repeats[i].active && !free_slot) {
+            free_slot = &repeats[i];
+        }
+    }
+
+    if (count == 0 || !free_slot) {
+        return;
+    }
+
+    free_slot->active = true;
+    free_slot->remaining = count;
+    free_slot->due_us = esp_timer_get_time() + (int64_t)interval_ms * 1000;
+    free_slot->msg = *msg;
+}
+
+static bool repeat_take_due(ble_mesh_tx_msg_t *msg, int64_t *next_due_us)
+{
+    uint16_t interval_ms = atomic_load(&retransmit_cfg) & 0xffff;
+    int64_t now = esp_timer_get_time();
+    bool found = false;
+
+    for (int i = 0; i < REPEAT_SLOTS; i++) {
+        tx_repeat_t *repeat = &repeats[i];
+
+        if (!repeat->active) {
+            continue;
+        }
+        if (!found && repeat->due_us <= now) {
+            *msg = repeat->msg;
+            repeat->due_us = now + (int64_t)interval_ms * 1000;
+            repeat->active = --repeat->remaining > 0;
+            found = true;
+        }
+        if (repeat->active) {
+            *next_due_us = MIN(*next_due_us, repeat->due_us);
+        }
+    }
+
+    return found;
+}
+
+static void client_tx_drop(const ble_mesh_tx_msg_t *msg, esp_err_t err)
+{
+    ESP_LOGE(TAG, "Dropping opcode 0x%04" PRIx32 " to addr 0x%04x (err %d)", msg->opcode, msg->addr, err);
+    TRACE_MSG(TRACE_TX_DROP, msg->addr, msg->opcode, err);
+    taskENTER_CRITICAL(&tx_stats_lock);
+    tx_stats.dropped_error++;
+    taskEXIT_CRITICAL(&tx_stats_lock);
+    ble_mesh_metrics_result(msg->opcode, METRICS_FAIL, 0);
+    if (msg->request) {
+        ack_fail(msg, ESP_FAIL);
+    }
+}
+
+static void tx_sent_record(const ble_mesh_tx_msg_t *msg)
+{
+    tx_sent_t *entry = &tx_sent[tx_sent_next];
+
+    // Entries due for a resend are kept, unless every entry is
+    for (int i = 0; i < TX_SENT_MAX && entry->resend; i++) {
+        tx_sent_next = (tx_sent_next + 1) % TX_SENT_MAX;
+        entry = &tx_sent[tx_sent_next];
+    }
+    tx_sent_next = (tx_sent_next + 1) % TX_SENT_MAX;
+
+    entry->used = true;
+    entry->resend = false;
+    entry->msg = *msg;
+}
+
+// The newest message to (addr, opcode) the stack took over, the one a failure is for
+static tx_sent_t *tx_sent_find(uint16_t addr, uint32_t opcode)
+{
+    for (int i = 1; i <= TX_SENT_MAX; i++) {
+        tx_sent_t *entry = &tx_sent[(tx_sent_next + TX_SENT_MAX - i) % TX_SENT_MAX];
+
+        if (entry->used && !entry->resend && entry->msg.addr == addr && entry->msg.opcode == opcode) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+// The stack's pool was full, other traffic holds more of it than the budget left over.
+// One cut per backlog: the refusals of messages handed over before it are the same news.
+static void client_adv_refused(int64_t now)
+{
+    if (now < adv_shrunk_us) {
+        return;
+    }
+    adv_budget = MAX(adv_budget / 2, 1);
+    adv_handed = 0;
+    adv_shrunk_us = bearer_free_us;
+    ESP_LOGD(TAG, "ADV buffers exhausted, pacing to %" PRIu32 " in flight", adv_budget);
+}
+
+// Every budget's worth of PDUs the stack took without refusing wins one buffer back
+static void client_adv_accepted(uint32_t pdus)
+{
+    adv_handed += pdus;
+    if (adv_budget < TX_ADV_BUDGET && adv_handed >= adv_budget) {
+        adv_handed -= adv_budget;
+        adv_budget++;
+    }
+}
+
+static void client_tx_failed(const tx_failure_t *failure)
+{
+    tx_sent_t *entry = tx_sent_find(failure->addr, failure->opcode);
+    int64_t now = esp_timer_get_time();
+
+    if (!entry) {
+        // Too long ago to resend, a request still waiting for it fails
+        ack_complete(failure->addr, failure->opcode, ESP_FAIL, NULL);
+        return;
+    }
+
+    // It never went on air
+    uint32_t pdus = client_pdu_count(&entry->msg);
+    bearer_free_us = MAX(bearer_free_us - (int64_t)pdus * tx_airtime_us, now);
+    if (failure->err == -ENOBUFS) {
+        client_adv_refused(now);
+    }
+
+    if (entry->msg.attempts >= TX_RETRY_MAX) {
+        entry->used = false;
+        client_tx_drop(&entry->msg, failure->err);
+        return;
+    }
+    entry->msg.attempts++;
+    entry->resend = true;
+    entry->due_us = now + TX_RETRY_DELAY_MS * 1000;
+    if (failure->err == -ENOBUFS) {
+        // Not before our own backlog has freed the buffers it needs
+        entry->due_us = MAX(entry->due_us, bearer_free_us + (int64_t)pdus * tx_airtime_us);
+    }
+}
+
+static bool resend_take_due(ble_mesh_tx_msg_t *msg, int64_t *next_due_us)
+{
+    int64_t now = esp_timer_get_time();
+    bool found = false;
+
+    for (int i = 0; i < TX_SENT_MAX; i++) {
+        tx_sent_t *entry = &tx_sent[i];
+
+        if (!entry->resend) {
+            continue;
+        }
+        if (!found && entry->due_us <= now) {
+            *msg = entry->msg;
+            entry->used = false;
+            entry->resend = false;
+            found = true;
+            continue;
+        }
+        *next_due_us = MIN(*next_due_us, entry->due_us);
+    }
+
+    return found;
+}
+
+static void client_tx_send(ble_mesh_tx_msg_t *msg, tx_kind_t kind)
+{
+    uint32_t pdus = client_pdu_count(msg);
+    uint8_t *tid = client_msg_tid(msg);
+    esp_err_t err;
+
+    client_tx_pace(pdus);
+
+    if (tid && kind == TX_FIRST) {
+        client_assign_tid(msg, tid);
+    }
+
+    // Before handing it over, the status may arrive before client_transmit returns.
+    // Nobody waits for a cancelled request, and its status would be taken for the
+    // next request to the same destination.
+    if (msg->request && !ack_mark_sent(msg, esp_timer_get_time())) {
+        TRACE_MSG(TRACE_TX_DROP, msg->addr, msg->opcode, ESP_ERR_INVALID_STATE);
+        return;
+    }
+
+    // Only a full queue to the stack's task fails here, the send itself fails later
+    for (int attempt = 0;; attempt++) {
+        err = client_transmit(msg);
+        if (err == ESP_OK || attempt == TX_RETRY_MAX) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(TX_RETRY_DELAY_MS));
+    }
+
+    if (err != ESP_OK) {
+        client_tx_drop(msg, err);
+        return;
+    }
+    tx_sent_record(msg);
+
+    // The stack drains its ADV queue one PDU at a time, so the message is
+    // on air once everything handed over before it has been transmitted
+    int64_t now = esp_timer_get_time();
+    bearer_free_us = MAX(bearer_free_us, now) + (int64_t)pdus * tx_airtime_us;
+    client_adv_accepted(pdus);
+    ble_mesh_metrics_sent(msg->opcode);
+    ble_mesh_metrics_gauge(METRICS_GAUGE_ADV_CREDITS, (bearer_free_us - now + tx_airtime_us - 1) / tx_airtime_us);
+
+    if (kind == TX_REPEAT) {
+        taskENTER_CRITICAL(&tx_stats_lock);
+        tx_stats.retransmitted++;
+        taskEXIT_CRITICAL(&tx_stats_lock);
+        return;
+    }
+    if (kind == TX_RESEND) {
+        taskENTER_CRITICAL(&tx_stats_lock);
+        tx_stats.resent++;
+        taskEXIT_CRITICAL(&tx_stats_lock);
+        return;
+    }
+
+    // Acknowledged requests go out once, neither the stack nor we resend them. A lost
+    // request or status completes it with ESP_ERR_TIMEOUT.
+    if (tid && !msg->ack) {
+        repeat_schedule(msg);
+    }
+
+    uint32_t latency_us = bearer_free_us - msg->enqueue_us;
+    taskENTER_CRITICAL(&tx_stats_lock);
+    tx_latency_sum_us += latency_us;
+    tx_stats.latency_max_us = MAX(tx_stats.latency_max_us, latency_us);
+    tx_stats.sent++;
+    taskEXIT_CRITICAL(&tx_stats_lock);
+
+    TRACE_MSG(TRACE_TX_SEND, msg->addr, msg->opcode, latency_us);
+}
+
+static uint32_t coalesce_interval_us(uint16_t addr)
+{
+    for (int i = 0; i < COALESCE_INTERVALS; i++) {
+        if (min_intervals[i].addr == addr) {
+            return min_intervals[i].interval_ms * 1000;
+        }
+    }
+
+    return default_interval_ms * 1000;
+}
+
+// Resolves a queued coalescing token into the newest value of its slot.
+// Returns false when the destination's minimum interval defers the send.
+static bool coalesce_resolve(ble_mesh_tx_msg_t *msg)
+{
+    coalesce_slot_t *slot = &coalesce_slots[msg->slot - 1];
+    int64_t now = esp_timer_get_time();
+    bool ready;
+
+    taskENTER_CRITICAL(&coalesce_lock);
+    int64_t due_us = slot->last_sent_us + coalesce_interval_us(slot->addr);
+    ready = slot->last_sent_us == 0 || due_us <= now;
+    if (ready) {
+        *msg = slot->msg;
+        slot->pending = false;
+        slot->last_sent_us = now;
+    } else {
+        slot->deferred = true;
+        slot->due_us = due_us;
+    }
+    taskEXIT_CRITICAL(&coalesce_lock);
+
+    return ready;
+}
+
+// Takes the newest value of a deferred slot whose interval has elapsed
+static bool coalesce_take_due(ble_mesh_tx_msg_t *msg, int64_t *next_due_us)
+{
+    int64_t now = esp_timer_get_time();
+    bool found = false;
+
+    *next_due_us = INT64_MAX;
+
+    taskENTER_CRITICAL(&coalesce_lock);
+    for (int i = 0; i < COALESCE_SLOTS; i++) {
+        coalesce_slot_t *slot = &coalesce_slots[i];
+
+        if (!slot->deferred) {
+            continue;
+        }
+        if (!found && slot->due_us <= now) {
+            *msg = slot->msg;
+            slot->pending = false;
+            slot->deferred = false;
+            slot->last_sent_us = now;
+            found = true;
+        } else {
+            *next_due_us = MIN(*next_due_us, slot->due_us);
+        }
+    }
+    taskEXIT_CRITICAL(&coalesce_lock);
+
+    return found;
+}
+
+static void client_tx_task(void *arg)
+{
+    ble_mesh_tx_msg_t msg;
+    int64_t next_due_us;
+    TickType_t wait;
+
+    for (;;) {
+        tx_failure_t failure;
+
+        while (xQueueReceive(tx_failures, &failure, 0) == pdTRUE) {
+            client_tx_failed(&failure);
+        }
+
+        if (coalesce_take_due(&msg, &next_due_us)) {
+            client_tx_send(&msg, TX_FIRST);
+            continue;
+        }
+
+        if (resend_take_due(&msg, &next_due_us)) {
+            client_tx_send(&msg, TX_RESEND);
+            continue;
+        }
+
+        if (repeat_take_due(&msg, &next_due_us)) {
+            client_tx_send(&msg, TX_REPEAT);
+            continue;
+        }
+
+        if (tx_queue_pop(&msg)) {
+            xSemaphoreGive(tx_space);
+            if (!msg.slot || coalesce_resolve(&msg)) {
+                client_tx_send(&msg, TX_FIRST);
+            }
+            continue;
+        }
+
+        wait = portMAX_DELAY;
+        if (next_due_us != INT64_MAX) {
+            wait = pdMS_TO_TICKS(MAX(next_due_us - esp_timer_get_time(), 0) / 1000) + 1;
+        }
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+static bool coalesce_supported(const ble_mesh_tx_msg_t *msg)
+{
+    return !msg->get && !msg->ack && msg->model != CLIENT_MODEL_PROPERTY;
+}
+
+// Stores the message in its (model, opcode, addr) slot. Returns true when an
+// unsent older value was replaced, so no new token has to be queued.
+static bool coalesce_store(ble_mesh_tx_msg_t *msg)
+{
+    coalesce_slot_t *slot = NULL;
+    coalesce_slot_t *victim = NULL;
+    bool merged = false;
+
+    taskENTER_CRITICAL(&coalesce_lock);
+    for (int i = 0; i < COALESCE_SLOTS; i++) {
+        coalesce_slot_t *candidate = &coalesce_slots[i];
+
+        if (candidate->used && candidate->model == msg->model &&
+            candidate->opcode == msg->opcode && candidate->addr == msg->addr) {
+            slot = candidate;
+            break;
+        }
+        if (!candidate->pending && (!victim || candidate->last_sent_us < victim->last_sent_us)) {
+            victim = candidate;
+        }
+    }
+
+    if (!slot && victim) {
+        slot = victim;
+        slot->used = true;
+        slot->model = msg->model;
+        slot->opcode = msg->opcode;
+        slot->addr = msg->addr;
+        slot->last_sent_us = 0;
+    }
+
+    if (slot) {
+        merged = slot->pending;
+        slot->msg = *msg;
+        slot->pending = true;
+        msg->slot = slot - coalesce_slots + 1;
+    }
+    taskEXIT_CRITICAL(&coalesce_lock);
+
+    return merged;
+}
+
+static void coalesce_release(const ble_mesh_tx_msg_t *msg)
+{
+    taskENTER_CRITICAL(&coalesce_lock);
+    coalesce_slots[msg->slot - 1].pending = false;
+    taskEXIT_CRITICAL(&coalesce_lock);
+}
+
+// The composition data of a provisioner on this device, or what the client learned
+static esp_err_t client_has_model(const ble_mesh_tx_msg_t *msg)
+{
+    uint16_t model_id = client_server_model(msg->model, msg->get);
+    esp_err_t err = ble_mesh_provisioner_has_model(msg->addr, model_id);
+
+    if (err == ESP_OK || err == ESP_ERR_NOT_SUPPORTED) {
+        return err;
+    }
+
+    return ble_mesh_peer_has_model(msg->addr, model_id);
+}
+
+static uint8_t client_team(uint16_t addr)
+{
+    uint8_t team;
+
+    // A provisioner on this device knows which subnet each of its nodes was provisioned
+    // into, a client on a robot of its own what subnet a node answered on
+    if (ESP_BLE_MESH_ADDR_IS_UNICAST(addr) &&
+        (ble_mesh_provisioner_get_team(addr, &team) == ESP_OK || ble_mesh_peer_get_team(addr, &team) == ESP_OK)) {
+        return team;
+    }
+
+    taskENTER_CRITICAL(&route_lock);
+    team = default_team;
+    for (int i = 0; i < CLIENT_ROUTES_MAX; i++) {
+        if (team_routes[i].addr == addr) {
+            team = team_routes[i].team;
+            break;
+        }
+    }
+    if (team == CLIENT_TEAM_OWN) {
+        team = BLE_MESH_NET_IDX_TEAM(node_net_idx);
+    }
+    taskEXIT_CRITICAL(&route_lock);
+
+    return team;
+}
+
+static esp_err_t client_enqueue(ble_mesh_tx_msg_t *msg)
+{
+    uint8_t team;
+
+    uint32_t depth;
+
+    if (!ble_mesh_lifecycle_is(LIFECYCLE_PROVISIONED)) {
+        ESP_LOGW(TAG, "Device not provisioned yet, cannot send messages");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Elements lacking the server would drop the message unanswered, those not known to
+    // lack it are sent to regardless
+    if (ESP_BLE_MESH_ADDR_IS_UNICAST(msg->addr) && client_has_model(msg) == ESP_ERR_NOT_SUPPORTED) {
+        ESP_LOGW(TAG, "0x%04x has no server for opcode 0x%04" PRIx32, msg->addr, msg->opcode);
+        atomic_fetch_add(&tx_unsupported, 1);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    // Only the team's nodes relay and decrypt it
+    team = client_team(msg->addr);
+    msg->net_idx = BLE_MESH_TEAM_NET_IDX(team);
+    msg->app_idx = BLE_MESH_TEAM_APP_IDX(team);
+    taskENTER_CRITICAL(&route_lock);
+    if (node_key_known && msg->net_idx == node_net_idx) {
+        // The node's own subnet goes with the AppKey it was actually given
+        msg->app_idx = node_app_idx;
+    }
+    taskEXIT_CRITICAL(&route_lock);
+    msg->enqueue_us = esp_timer_get_time();
+    msg->attempts = 0;
+
+    if (!msg->get) {
+        state_invalidate(msg->addr, msg->model);
+    }
+
+    if (coalesce_supported(msg) && coalesce_store(msg)) {
+        atomic_fetch_add(&tx_coalesced, 1);
+        return ESP_OK;
+    }
+
+    if (!tx_queue_push(msg)) {
+        if (msg->slot) {
+            coalesce_release(msg);
+        }
+        atomic_fetch_add(&tx_dropped_full, 1);
+        return ESP_ERR_NO_MEM;
+    }
+
+    atomic_fetch_add(&tx_enqueued, 1);
+
+    depth = tx_queue_depth();
+    TRACE_MSG(TRACE_TX_ENQUEUE, msg->addr, msg->opcode, depth);
+    ble_mesh_metrics_gauge(METRICS_GAUGE_TX_QUEUE, depth);
+    uint32_t depth_max = atomic_load(&tx_depth_max);
+    while (depth > depth_max && !atomic_compare_exchange_weak(&tx_depth_max, &depth_max, depth)) {
+    }
+
+    xTaskNotifyGive(tx_task);
+
+    return ESP_OK;
+}
+
+static esp_err_t client_enqueue_acked(ble_mesh_tx_msg_t *msg, ble_mesh_client_result_cb_t cb, void *arg,
+                                      ble_mesh_client_handle_t *handle)
+{
+    ack_request_t *request = NULL;
+    uint32_t pending = 1;
+    esp_err_t err;
+
+    if (!cb && !handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // The stack allows a single outstanding request per destination and opcode
+    taskENTER_CRITICAL(&ack_lock);
+    for (int i = 0; i < ACK_PENDING_MAX; i++) {
+        if (ack_requests[i].used && ack_requests[i].result.addr == msg->addr &&
+            ack_requests[i].result.opcode == msg->opcode) {
+            taskEXIT_CRITICAL(&ack_lock);
+            return ESP_ERR_INVALID_STATE;
+        }
+        if (!ack_requests[i].used && !request) {
+            request = &ack_requests[i];
+        } else if (ack_requests[i].used) {
+            pending++;
+        }
+    }
+    if (request) {
+        request->used = true;
+        request->completed = false;
+        request->gen++;
+        msg->request_gen = request->gen;
+    }
+    taskEXIT_CRITICAL(&ack_lock);
+
+    if (!request) {
+        return ESP_ERR_NO_MEM;
+    }
+    ble_mesh_metrics_gauge(METRICS_GAUGE_ACK_PENDING, pending);
+
+    // Drop a completion left over from a cancelled wait
+    xSemaphoreTake(request->done, 0);
+
+    memset(&request->result, 0, sizeof(request->result));
+    request->result.addr = msg->addr;
+    request->result.opcode = msg->opcode;
+    request->cb = cb;
+    request->arg = arg;
+    request->sent_us = 0;
+
+    msg->request = request - ack_requests + 1;
+
+    err = client_enqueue(msg);
+    if (err != ESP_OK) {
+        ack_release(request);
+        return err;
+    }
+
+    if (handle) {
+        *handle = ((uint32_t)request->gen << 8) | msg->request;
+    }
+
+    return ESP_OK;
+}
+
+static void client_msg_onoff(ble_mesh_tx_msg_t *msg, uint8_t val, uint16_t addr, bool acked)
+{
+    msg->opcode = acked ? ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_SET : ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_SET_UNACK;
+    msg->ack = acked;
+    msg->model = CLIENT_MODEL_ONOFF;
+    msg->addr = addr;
+    msg->set.onoff_set.op_en = false;
+    msg->set.onoff_set.onoff = val;
+}
+
+static void client_msg_level(ble_mesh_tx_msg_t *msg, int16_t level, uint16_t addr, bool acked)
+{
+    msg->opcode = acked ? ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_SET : ESP_BLE_MESH_MODEL_OP_GEN_LEVEL_SET_UNACK;
+    msg->ack = acked;
+    msg->model = CLIENT_MODEL_LEVEL;
+    msg->addr = addr;
+    msg->set.level_set.op_en = false;
+    msg->set.level_set.level = level;
+}
+
+static void client_msg_default_transition_time(ble_mesh_tx_msg_t *msg, uint8_t transition_time,
+                                               uint16_t addr, bool acked)
+{
+    msg->opcode = acked ? ESP_BLE_MESH_MODEL_OP_GEN_DEF_TRANS_TIME_SET : ESP_BLE_MESH_MODEL_OP_GEN_DEF_TRANS_TIME_SET_UNACK;
+    msg->ack = acked;
+    msg->model = CLIENT_MODEL_DEF_TRANS_TIME;
+    msg->addr = addr;
+    msg->set.def_trans_time_set.trans_time = transition_time;
+}
+
+static void client_msg_power_level(ble_mesh_tx_msg_t *msg, uint16_t power, uint16_t addr, bool acked)
+{
+    msg->opcode = acked ? ESP_BLE_MESH_MODEL_OP_GEN_POWER_LEVEL_SET : ESP_BLE_MESH_MODEL_OP_GEN_POWER_LEVEL_SET_UNACK;
+    msg->ack = acked;
+    msg->model = CLIENT_MODEL_POWER_LEVEL;
+    msg->addr = addr;
+    msg->set.power_level_set.op_en = false;
+    msg->set.power_level_set.power = power;
+}
+
+static void client_msg_battery(ble_mesh_tx_msg_t *msg, uint16_t addr)
+{
+    // Battery model is typically read-only, so we send a GET request
+    msg->opcode = ESP_BLE_MESH_MODEL_OP_GEN_BATTERY_GET;
+    msg->model = CLIENT_MODEL_BATTERY;
+    msg->addr = addr;
+    msg->get = true;
+}
+
+static void client_msg_location(ble_mesh_tx_msg_t *msg, uint32_t latitude, uint32_t longitude,
+                                int16_t altitude, uint16_t addr, bool acked)
+{
+    msg->opcode = acked ? ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_SET : ESP_BLE_MESH_MODEL_OP_GEN_LOC_GLOBAL_SET_UNACK;
+    msg->ack = acked;
+    msg->model = CLIENT_MODEL_LOCATION;
+    msg->addr = addr;
+    msg->set.loc_global_set.global_latitude = latitude;
+    msg->set.loc_global_set.global_longitude = longitude;
+    msg->set.loc_global_set.global_altitude = altitude;
+}
+
+static esp_err_t client_msg_property(ble_mesh_tx_msg_t *msg, uint16_t property_id, uint8_t *property_value,
+                                     uint16_t property_value_len, uint16_t addr, bool acked)
+{
+    if (property_value_len > TX_QUEUE_VALUE_MAX) {
+        ESP_LOGE(TAG, "Property value too long (max %d bytes)", TX_QUEUE_VALUE_MAX);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    msg->opcode = acked ? ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_SET : ESP_BLE_MESH_MODEL_OP_GEN_USER_PROPERTY_SET_UNACK;
+    msg->ack = acked;
+    msg->model = CLIENT_MODEL_PROPERTY;
+    msg->addr = addr;
+    msg->set.user_property_set.property_id = property_id;
+    msg->value_len = property_value_len;
+    memcpy(msg->value, property_value, property_value_len);
+
+    return ESP_OK;
+}
+
+esp_err_t ble_mesh_client_send(uint8_t val, uint16_t addr)
+{
+    ble_mesh_tx_msg_t msg = {0};
+
+    client_msg_onoff(&msg, val, addr, false);
+
+    return client_enqueue(&msg);
+}
+
+esp_err_t ble_mesh_client_send_level(int16_t level, uint16_t addr)
+{
+    ble_mesh_tx_msg_t msg = {0};
+
+    client_msg_level(&msg, level, addr, false);
+
+    return client_enqueue(&msg);
+}
+
+esp_err_t ble_mesh_client_send_default_transition_time(uint8_t transition_time, uint16_t addr)
+{
+    ble_mesh_tx_msg_t msg = {0};
+
+    client_msg_default_transition_time(&msg, transition_time, addr, false);
+
+    return client_enqueue(&msg);
+}
+
+esp_err_t ble_mesh_client_send_power_level(uint16_t power, uint16_t addr)
+{
+    ble_mesh_tx_msg_t msg = {0};
+
+    client_msg_power_level(&msg, power, addr, false);
+
+    return client_enqueue(&msg);
+}
+
+esp_err_t ble_mesh_client_send_battery(uint8_t battery_level, uint16_t addr)
+{
+    ble_mesh_tx_msg_t msg = {0};
+
+    client_msg_battery(&msg, addr);
+
+    return client_enqueue(&msg);
+}
+
+esp_err_t ble_mesh_client_send_location(uint32_t latitude, uint32_t longitude, int16_t altitude, uint16_t addr)
+{
+    ble_mesh_tx_msg_t msg = {0};
+
+    client_msg_location(&msg, latitude, longitude, altitude, addr, false);
+
+    return client_enqueue(&msg);
+}
+
+esp_err_t ble_mesh_client_send_property(uint16_t property_id, uint8_t *property_value,
+                                        uint16_t property_value_len, uint16_t addr)
+{
+    ble_mesh_tx_msg_t msg = {0};
+    esp_err_t err;
+
+    err = client_msg_property(&msg, property_id, property_value, property_value_len, addr, false);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    return client_enqueue(&msg);
+}
+
+esp_err_t ble_mesh_client_send_group(uint8_t val, uint16_t group_addr)
+{
+    ble_mesh_tx_msg_t msg = {0};
+
+    if (!ESP_BLE_MESH_ADDR_IS_GROUP(group_addr)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    client_msg_onoff(&msg, val, group_addr, false);
+
+    return client_enqueue(&msg);
+}
+
+esp_err_t ble_mesh_client_send_level_group(int16_t level, uint16_t group_addr)
+{
+    ble_mesh_tx_msg_t msg = {0};
+
+    if (!ESP_BLE_MESH_ADDR_IS_GROUP(group_addr)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    client_msg_level(&msg, level, group_addr, false);
+
+    return client_enqueue(&msg);
+}
+
+esp_err_t ble_mesh_client_send_acked(uint8_t val, uint16_t addr, ble_mesh_client_result_cb_t cb, void *arg,
+                                     ble_mesh_client_handle_t *handle)
+{
+    ble_mesh_tx_msg_t msg = {0};
+
+    client_msg_onoff(&msg, val, addr, true);
+
+    return client_enqueue_acked(&msg, cb, arg, handle);
+}
+
+esp_err_t ble_mesh_client_send_level_acked(int16_t level, uint16_t addr, ble_mesh_client_result_cb_t cb, void *arg,
+                                           ble_mesh_client_handle_t *handle)
+{
+    ble_mesh_tx_msg_t msg = {0};
+
+    client_msg_level(&msg, level, addr, true);
+
+    return client_enqueue_acked(&msg, cb, arg, handle);
+}
+
+esp_err_t ble_mesh_client_send_default_transition_time_acked(uint8_t transition_time, uint16_t addr,
+                                                             ble_mesh_client_result_cb_t cb, void *arg,
+                                                             ble_mesh_client_handle_t *handle)
+{
+    ble_mesh_tx_msg_t msg = {0};
+
+    client_msg_default_transition_time(&msg, transition_time, addr, true);
+
+    return client_enqueue_acked(&msg, cb, arg, handle);
+}
+
+esp_err_t ble_mesh_client_send_power_level_acked(uint16_t power, uint16_t addr, ble_mesh_client_result_cb_t cb,
+                                                 void *arg, ble_mesh_client_handle_t *handle)
+{
+    ble_mesh_tx_msg_t msg = {0};
+
+    client_msg_power_level(&msg, power, addr, true);
+
+    return client_enqueue_acked(&msg, cb, arg, handle);
+}
+
+esp_err_t ble_mesh_client_send_battery_acked(uint16_t addr, ble_mesh_client_result_cb_t cb, void *arg,
+                                             ble_mesh_client_handle_t *handle)
+{
+    ble_mesh_tx_msg_t msg = {0};
+
+    client_msg_battery(&msg, addr);
+
+    return client_enqueue_acked(&msg, cb, arg, handle);
+}
+
+esp_err_t ble_mesh_client_send_location_acked(uint32_t latitude, uint32_t longitude, int16_t altitude,
+                                              uint16_t addr, ble_mesh_client_result_cb_t cb, void *arg,
+                                              ble_mesh_client_handle_t *handle)
+{
+    ble_mesh_tx_msg_t msg = {0};
+
+    client_msg_location(&msg, latitude, longitude, altitude, addr, true);
+
+    return client_enqueue_acked(&msg, cb, arg, handle);
+}
+
+esp_err_t ble_mesh_client_send_property_acked(uint16_t property_id, uint8_t *property_value,
+                                              uint16_t property_value_len, uint16_t addr,
+                                              ble_mesh_client_result_cb_t cb, void *arg,
+                                              ble_mesh_client_handle_t *handle)
+{
+    ble_mesh_tx_msg_t msg = {0};
+    esp_err_t err;
+
+    err = client_msg_property(&msg, property_id, property_value, property_value_len, addr, true);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    return client_enqueue_acked(&msg, cb, arg, handle);
+}
+
+esp_err_t ble_mesh_client_wait(ble_mesh_client_handle_t handle, uint32_t timeout_ms, ble_mesh_client_result_t *result)
+{
+    ack_request_t *request = ack_lookup(handle);
+
+    if (!request || request->cb) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (xSemaphoreTake(request->done, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    if (result) {
+        *result = request->result;
+    }
+    ack_release(request);
+
+    return ESP_OK;
+}
+
+void ble_mesh_client_cancel(ble_mesh_client_handle_t handle)
+{
+    ack_request_t *request = ack_lookup(handle);
+
+    if (request) {
+        ack_release(request);
+    }
+}
+
+// Unicast retries to the members that are still missing, at most ACK_PENDING_MAX at a time
+static void group_retry(uint8_t val, ble_mesh_client_group_result_t *result, uint32_t timeout_ms)
+{
+    ble_mesh_client_handle_t handles[ACK_PENDING_MAX];
+    int indexes[ACK_PENDING_MAX];
+    int next = 0;
+
+    while (next < result->member_count) {
+        int batch = 0;
+
+        for (; next < result->member_count && batch < ACK_PENDING_MAX; next++) {
+            if (group_confirmed(result, next)) {
+                continue;
+            }
+            if (ble_mesh_client_send_acked(val, result->members[next], NULL, NULL, &handles[batch]) == ESP_OK) {
+                indexes[batch++] = next;
+                result->retried++;
+            }
+        }
+
+        for (int i = 0; i < batch; i++) {
+            ble_mesh_client_result_t reply;
+            int idx = indexes[i];
+
+            if (ble_mesh_client_wait(handles[i], timeout_ms, &reply) != ESP_OK) {
+                ble_mesh_client_cancel(handles[i]);
+                continue;
+            }
+            if (reply.err != ESP_OK || reply.status.onoff_status.present_onoff != val) {
+                continue;
+            }
+
+            taskENTER_CRITICAL(&group_lock);
+            if (!group_confirmed(result, idx)) {
+                result->responded[idx / 32] |= 1u << (idx % 32);
+                result->responded_count++;
+            }
+            taskEXIT_CRITICAL(&group_lock);
+        }
+    }
+}
+
+esp_err_t ble_mesh_client_send_group_acked(uint8_t val, uint16_t group_addr, const uint16_t *members,
+                                           size_t member_count, uint32_t timeout_ms,
+                                           ble_mesh_client_group_result_t *result)
+{
+    ble_mesh_tx_msg_t msg = {0};
+    esp_err_t err;
+
+    if (!ESP_BLE_MESH_ADDR_IS_GROUP(group_addr) || !result || member_count > BLE_MESH_CLIENT_GROUP_MEMBERS_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(result, 0, sizeof(*result));
+    if (members) {
+        // Kept sorted so statuses are matched by binary search
+        for (size_t i = 0; i < member_count; i++) {
+            size_t j = i;
+            for (; j > 0 && result->members[j - 1] > members[i]; j--) {
+                result->members[j] = result->members[j - 1];
+            }
+            result->members[j] = members[i];
+        }
+        result->member_count = member_count;
+    } else {
+        uint8_t team = client_team(group_addr);
+
+        result->member_count = ble_mesh_provisioner_get_team_members(team, result->members,
+                                                                     BLE_MESH_CLIENT_GROUP_MEMBERS_MAX);
+        if (!result->member_count) {
+            // No provisioner on this device, the OnOff Servers heard lately
+            result->member_count = ble_mesh_peer_get_members(team, ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_SRV,
+                                                             result->members, BLE_MESH_CLIENT_GROUP_MEMBERS_MAX);
+        }
+    }
+
+    if (!result->member_count) {
+        ESP_LOGW(TAG, "%s: no members expected for group 0x%04x", __func__, group_addr);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    client_msg_onoff(&msg, val, group_addr, true);
+
+    xSemaphoreTake(group_mutex, portMAX_DELAY);
+    xSemaphoreTake(group_session.done, 0);
+
+    taskENTER_CRITICAL(&group_lock);
+    group_session.active = true;
+    group_session.group_addr = group_addr;
+    group_session.value = val;
+    group_session.result = result;
+    taskEXIT_CRITICAL(&group_lock);
+
+    err = client_enqueue(&msg);
+    if (err == ESP_OK) {
+        xSemaphoreTake(group_session.done, pdMS_TO_TICKS(timeout_ms));
+    }
+
+    taskENTER_CRITICAL(&group_lock);
+    group_session.active = false;
+    result->group_responses = result->responded_count;
+    taskEXIT_CRITICAL(&group_lock);
+
+    xSemaphoreGive(group_mutex);
+
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    for (int round = 0; round < GROUP_RETRY_ROUNDS && result->responded_count < result->member_count; round++) {
+        group_retry(val, result, timeout_ms);
+    }
+
+    return result->responded_count == result->member_count ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+void ble_mesh_client_set_min_interval(uint16_t addr, uint32_t interval_ms)
+{
+    int free_idx = -1;
+
+    taskENTER_CRITICAL(&coalesce_lock);
+    if (addr == ESP_BLE_MESH_ADDR_UNASSIGNED) {
+        default_interval_ms = interval_ms;
+        taskEXIT_CRITICAL(&coalesce_lock);
+        return;
+    }
+
+    for (int i = 0; i < COALESCE_INTERVALS; i++) {
+        if (min_intervals[i].addr == addr) {
+            free_idx = i;
+            break;
+        }
+        if (free_idx < 0 && min_intervals[i].addr == ESP_BLE_MESH_ADDR_UNASSIGNED) {
+            free_idx = i;
+        }
+    }
+
+    if (free_idx >= 0) {
+        min_intervals[free_idx].addr = addr;
+        min_intervals[free_idx].interval_ms = interval_ms;
+    }
+    taskEXIT_CRITICAL(&coalesce_lock);
+
+    if (free_idx < 0) {
+        ESP_LOGW(TAG, "No room for a minimum interval of addr 0x%04x", addr);
+    }
+}
+
+esp_err_t ble_mesh_client_set_team(uint16_t addr, uint8_t team)
+{
+    int free_idx = -1;
+
+    if (team >= BLE_MESH_TEAMS_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    taskENTER_CRITICAL(&route_lock);
+    if (addr == ESP_BLE_MESH_ADDR_UNASSIGNED) {
+        default_team = team;
+        taskEXIT_CRITICAL(&route_lock);
+        return ESP_OK;
+    }
+
+    for (int i = 0; i < CLIENT_ROUTES_MAX; i++) {
+        if (team_routes[i].addr == addr) {
+            free_idx = i;
+            break;
+        }
+        if (free_idx < 0 && team_routes[i].addr == ESP_BLE_MESH_ADDR_UNASSIGNED) {
+            free_idx = i;
+        }
+    }
+
+    if (free_idx >= 0) {
+        team_routes[free_idx].addr = addr;
+        team_routes[free_idx].team = team;
+    }
+    taskEXIT_CRITICAL(&route_lock);
+
+    if (free_idx < 0) {
+        ESP_LOGW(TAG, "No room for a team of addr 0x%04x", addr);
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t ble_mesh_client_set_retransmit(uint8_t count, uint16_t interval_ms)
+{
+    if ((uint32_t)count * interval_ms >= TID_WINDOW_MS || (count && !interval_ms)) {
+        ESP_LOGE(TAG, "Retransmissions must fit the %d ms transaction window", TID_WINDOW_MS);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    atomic_store(&retransmit_cfg, ((uint32_t)count << 16) | interval_ms);
+
+    return ESP_OK;
+}
+
+void ble_mesh_client_get_tx_stats(ble_mesh_client_tx_stats_t *stats)
+{
+    uint64_t latency_sum_us;
+
+    taskENTER_CRITICAL(&tx_stats_lock);
+    *stats = tx_stats;
+    latency_sum_us = tx_latency_sum_us;
+    taskEXIT_CRITICAL(&tx_stats_lock);
+    stats->depth = tx_queue_depth();
+    stats->depth_max = atomic_load(&tx_depth_max);
+    stats->enqueued = atomic_load(&tx_enqueued);
+    stats->dropped_full = atomic_load(&tx_dropped_full);
+    stats->coalesced = atomic_load(&tx_coalesced);
+    stats->unsupported = atomic_load(&tx_unsupported);
+    stats->airtime_saved_ms = (uint64_t)stats->coalesced * tx_airtime_us / 1000;
+    stats->latency_avg_us = stats->sent ? latency_sum_us / stats->sent : 0;
+}
+
+esp_err_t ble_mesh_client_wait_queue(uint32_t timeout_ms)
+{
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+
+    if (!tx_space) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Woken whenever the sender takes a message, another waiter may have taken the room
+    while (tx_queue_depth() >= TX_QUEUE_LEN) {
+        int64_t left_us = deadline_us - esp_timer_get_time();
+
+        if (left_us <= 0 || xSemaphoreTake(tx_space, pdMS_TO_TICKS(left_us / 1000) + 1) != pdTRUE) {
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t ble_mesh_client_get_cached_onoff(uint16_t addr, uint32_t max_age_ms, uint8_t *onoff)
+{
+    return state_read(addr, STATE_ONOFF, max_age_ms, onoff);
+}
+
+esp_err_t ble_mesh_client_get_cached_level(uint16_t addr, uint32_t max_age_ms, int16_t *level)
+{
+    return state_read(addr, STATE_LEVEL, max_age_ms, level);
+}
+
+esp_err_t ble_mesh_client_get_cached_battery(uint16_t addr, uint32_t max_age_ms,
+                                             esp_ble_mesh_gen_battery_status_cb_t *battery)
+{
+    return state_read(addr, STATE_BATTERY, max_age_ms, battery);
+}
+
+esp_err_t ble_mesh_client_get_cached_location(uint16_t addr, uint32_t max_age_ms,
+                                              esp_ble_mesh_gen_loc_global_status_cb_t *location)
+{
+    return state_read(addr, STATE_LOCATION, max_age_ms, location);
+}
+
+void ble_mesh_client_get_cache_stats(ble_mesh_client_cache_stats_t *stats)
+{
+    taskENTER_CRITICAL(&state_lock);
+    *stats = state_stats;
+    taskEXIT_CRITICAL(&state_lock);
+}
+
+esp_err_t ble_mesh_client_init(void)
+{
+    ESP_LOGI(TAG, "Initializing...");
+    ble_mesh_credentials_t creds;
+    bool self_prov;
+    esp_err_t err;
+
+    ble_mesh_boot_begin(BOOT_CLIENT);
+    err = ble_mesh_lifecycle_init();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    tx_queue_init();
+
+    group_mutex = xSemaphoreCreateMutex();
+    group_session.done = xSemaphoreCreateBinary();
+    if (!group_mutex || !group_session.done) {
+        ESP_LOGE(TAG, "Failed to create group send semaphores");
+        return ESP_ERR_NO_MEM;
+    }
+
+    tx_failures = xQueueCreate(TX_SENT_MAX, sizeof(tx_failure_t));
+    tx_space = xSemaphoreCreateBinary();
+    if (!tx_failures || !tx_space) {
+        ESP_LOGE(TAG, "Failed to create send failure queue or space signal");
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (int i = 0; i < ACK_PENDING_MAX; i++) {
+        ack_requests[i].done = xSemaphoreCreateBinary();
+        if (!ack_requests[i].done) {
+            ESP_LOGE(TAG, "Failed to create request semaphore");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    tx_airtime_us = (ESP_BLE_MESH_GET_TRANSMIT_COUNT(config_server.net_transmit) + 1) *
+                    (ESP_BLE_MESH_GET_TRANSMIT_INTERVAL(config_server.net_transmit) + 10) * 1000;
+
+    if (xTaskCreate(client_tx_task, "mesh_tx", TX_TASK_STACK, NULL, TX_TASK_PRIO, &tx_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create sender task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    err = esp_ble_mesh_register_prov_callback(mesh_prov_cb);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register prov callback (err %d)", err);
+        return err;
+    }
+    
+    err = esp_ble_mesh_register_config_client_callback(mesh_config_client_cb);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register config client callback (err %d)", err);
+        return err;
     }
     
+    err = esp_ble_mesh_register_config_server_callback(mesh_config_server_cb);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register config server callback (err %d)", err);
+        return err;
+    }
+
+    err = esp_ble_mesh_register_generic_client_callback(mesh_generic_client_cb);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register generic client callback (err %d)", err);
+        return err;
+    }
+
+    // Credentials for the next boot can be stored even while waiting for a provisioner
+    ble_mesh_self_prov_register_console();
+
+    // Everything above runs while the host syncs, the UUID needs its address
+    err = bluetooth_wait_sync();
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    ble_mesh_boot_begin(BOOT_CLIENT_MESH);
+    ble_mesh_get_dev_uuid(dev_uuid);
+    ESP_LOGI(TAG, "Device UUID: %02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+             dev_uuid[0], dev_uuid[1], dev_uuid[2], dev_uuid[3],
+             dev_uuid[4], dev_uuid[5], dev_uuid[6], dev_uuid[7],
+             dev_uuid[8], dev_uuid[9], dev_uuid[10], dev_uuid[11],
+             dev_uuid[12], dev_uuid[13], dev_uuid[14], dev_uuid[15]);
+
+    // Loaded first, nothing may come between the stack init and self-provisioning
+    self_prov = ble_mesh_self_prov_enabled() && ble_mesh_self_prov_load(&creds) == ESP_OK;
+
+    err = esp_ble_mesh_init(&prov, &composition);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "BLE Mesh init failed (err %d)", err);
+        return err;
+    }
+
+    // A node restored from flash gets no provisioning or configuration events
+    if (esp_ble_mesh_node_is_provisioned()) {
+        node_addr = esp_ble_mesh_get_primary_element_address();
+        ble_mesh_lifecycle_set(LIFECYCLE_PROVISIONED);
+        node_key_restore();
+        lifecycle_update_bindings();
+        if (ble_mesh_lifecycle_is(LIFECYCLE_MODELS_BOUND)) {
+            ble_mesh_lifecycle_set(LIFECYCLE_APPKEY_BOUND);
+        }
+        ESP_LOGI(TAG, "Restored as 0x%04x", node_addr);
+        // Provisioned by a provisioner, which configures it as well
+        self_prov = self_prov && node_addr == creds.addr;
+    } else if (self_prov) {
+        err = ble_mesh_self_prov_provision(&creds);
+        if (err != ESP_OK) {
+            self_prov = false;
+        } else {
+            node_addr = creds.addr;
+            ble_mesh_lifecycle_set(LIFECYCLE_PROVISIONED);
+        }
+    }
+
+    // A self-provisioned node configures itself, again if a reboot came between
+    if (self_prov && !client_models_bound(true)) {
+        err = esp_ble_mesh_node_add_local_app_key(creds.app_key, creds.net_idx, creds.app_idx);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to add local AppKey (err %d)", err);
+            return err;
+        }
+    }
+    memset(&creds, 0, sizeof(creds));
+
+    if (!self_prov) {
+        err = esp_ble_mesh_node_prov_enable((esp_ble_mesh_prov_bearer_t)(ESP_BLE_MESH_PROV_ADV | ESP_BLE_MESH_PROV_GATT));
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to enable node provisioning (err %d)", err);
+            return err;
+        }
+    }
+    ble_mesh_boot_end(BOOT_CLIENT_MESH);
+    ble_mesh_boot_end(BOOT_CLIENT);
+
     ESP_LOGI(TAG, "BLE Mesh Client initialized successfully");
-    ESP_LOGI(TAG, "Device should now be visible for provisioning via GATT and ADV");
+    if (!self_prov) {
+        ESP_LOGI(TAG, "Device should now be visible for provisioning via GATT and ADV");
+    }
     
     return ESP_OK;
 }
@@ -2,29 +2,168 @@
 #define DEZIBOT_BLUETOOTH_MESH_CLIENT_H
 
 #include "common.h"
+#include "team.h"
+
+typedef struct {
+    uint32_t depth;
+    uint32_t depth_max;
+    uint32_t enqueued;
+    uint32_t sent;
+    uint32_t dropped_full;      // rejected because the queue was full
+    uint32_t dropped_error;     // given up after the stack kept refusing or failing them
+    uint32_t unsupported;       // rejected because the destination lacks the server model
+    uint32_t latency_avg_us;    // enqueue until the last PDU is expected on air
+    uint32_t latency_max_us;
+    uint32_t coalesced;         // sets replaced by a newer value before going on air
+    uint32_t airtime_saved_ms;
+    uint32_t retransmitted;     // extra copies sent with an already used TID
+    uint32_t resent;            // sent again after the stack reported it failed to send them
+} ble_mesh_client_tx_stats_t;
+
+typedef struct {
+    uint32_t hits;          // reads answered from the cache
+    uint32_t misses;        // reads of unknown or stale fields
+    uint32_t updates;       // fields filled from status replies and publications
+    uint32_t evictions;     // nodes displaced by another address of the same full set
+} ble_mesh_client_cache_stats_t;
+
+// Largest member set of an acknowledged group send
+#ifndef BLE_MESH_CLIENT_GROUP_MEMBERS_MAX
+#define BLE_MESH_CLIENT_GROUP_MEMBERS_MAX CONFIG_BLE_MESH_MAX_PROV_NODES
+#endif
+
+typedef struct {
+    uint16_t members[BLE_MESH_CLIENT_GROUP_MEMBERS_MAX];    // ascending unicast addresses
+    uint16_t member_count;
+    uint16_t responded_count;   // members that confirmed the value
+    uint16_t group_responses;   // of those, confirmed by the single group message
+    uint16_t retried;           // unicast retries sent to missing members
+    uint32_t responded[(BLE_MESH_CLIENT_GROUP_MEMBERS_MAX + 31) / 32];     // bit i for members[i]
+} ble_mesh_client_group_result_t;
+
+// Identifies an outstanding acknowledged request, 0 is never a valid handle
+typedef uint32_t ble_mesh_client_handle_t;
+
+typedef struct {
+    esp_err_t err;          // ESP_OK once the status arrived, ESP_ERR_TIMEOUT or the send error
+    uint16_t addr;
+    uint32_t opcode;        // opcode of the request
+    esp_ble_mesh_gen_client_status_cb_t status;     // decoded status, valid when err is ESP_OK
+} ble_mesh_client_result_t;
+
+// Runs on the mesh stack's task when the status or the stack's timeout arrives, from
+// the generic client callback, or on the client's sender task when the stack refused
+// the send. Must not block, the stack handles no other event meanwhile.
+typedef void (*ble_mesh_client_result_cb_t)(const ble_mesh_client_result_t *result, void *arg);
 
 esp_err_t ble_mesh_client_init(void);
 
+// All send functions only enqueue the message for the sender task and never block.
+// They return ESP_ERR_NO_MEM when the queue is full, ESP_ERR_NOT_SUPPORTED when the
+// local provisioner knows the destination element lacks the server model.
+
 // Generic OnOff Client
-void ble_mesh_client_send(uint8_t val, uint16_t addr);
+esp_err_t ble_mesh_client_send(uint8_t val, uint16_t addr);
 
 // Generic Level Client
-void ble_mesh_client_send_level(int16_t level, uint16_t addr);
+esp_err_t ble_mesh_client_send_level(int16_t level, uint16_t addr);
 
 // Generic Default Transition Time Client
-void ble_mesh_client_send_default_transition_time(uint8_t transition_time, uint16_t addr);
+esp_err_t ble_mesh_client_send_default_transition_time(uint8_t transition_time, uint16_t addr);
 
 // Generic Power Level Client
-void ble_mesh_client_send_power_level(uint16_t power, uint16_t addr);
+esp_err_t ble_mesh_client_send_power_level(uint16_t power, uint16_t addr);
 
 // Generic Battery Client
-void ble_mesh_client_send_battery(uint8_t battery_level, uint16_t addr);
+esp_err_t ble_mesh_client_send_battery(uint8_t battery_level, uint16_t addr);
 
 // Generic Location Client
-void ble_mesh_client_send_location(uint32_t latitude, uint32_t longitude, int16_t altitude, uint16_t addr);
+esp_err_t ble_mesh_client_send_location(uint32_t latitude, uint32_t longitude, int16_t altitude, uint16_t addr);
 
 // Generic Property Client
-void ble_mesh_client_send_property(uint16_t property_id, uint8_t *property_value, 
-                                    uint16_t property_value_len, uint16_t addr);
+esp_err_t ble_mesh_client_send_property(uint16_t property_id, uint8_t *property_value,
+                                        uint16_t property_value_len, uint16_t addr);
+
+// One PDU to a group address the provisioner subscribed the team's servers to
+// (ble_mesh_provisioner_add_group), instead of one message per member
+esp_err_t ble_mesh_client_send_group(uint8_t val, uint16_t group_addr);
+esp_err_t ble_mesh_client_send_level_group(int16_t level, uint16_t group_addr);
+
+// Acknowledged On/Off set to a group. Collects the members' statuses for up to timeout_ms,
+// then retries by unicast only to the members that did not confirm the value. members
+// may be NULL to expect every operational node of the group's team in the local
+// provisioner's registry, or without a provisioner on this device every OnOff Server of
+// the team heard within PEER_DIR_EXPIRE_MS.
+// Blocks; returns ESP_ERR_TIMEOUT when members are still missing after the retries.
+esp_err_t ble_mesh_client_send_group_acked(uint8_t val, uint16_t group_addr, const uint16_t *members,
+                                           size_t member_count, uint32_t timeout_ms,
+                                           ble_mesh_client_group_result_t *result);
+
+// Acknowledged variants. The request completes through cb, or when cb is NULL through
+// ble_mesh_client_wait() on the returned handle. Requests to different destinations
+// are in flight concurrently; a second request with the same destination and opcode
+// is rejected with ESP_ERR_INVALID_STATE until the first completes.
+// A request is sent once: neither the stack nor the client resends it, a lost request
+// or status completes it with ESP_ERR_TIMEOUT and resending is up to the caller. A
+// request cancelled while still queued is not sent at all.
+esp_err_t ble_mesh_client_send_acked(uint8_t val, uint16_t addr, ble_mesh_client_result_cb_t cb, void *arg,
+                                     ble_mesh_client_handle_t *handle);
+esp_err_t ble_mesh_client_send_level_acked(int16_t level, uint16_t addr, ble_mesh_client_result_cb_t cb, void *arg,
+                                           ble_mesh_client_handle_t *handle);
+esp_err_t ble_mesh_client_send_default_transition_time_acked(uint8_t transition_time, uint16_t addr,
+                                                             ble_mesh_client_result_cb_t cb, void *arg,
+                                                             ble_mesh_client_handle_t *handle);
+esp_err_t ble_mesh_client_send_power_level_acked(uint16_t power, uint16_t addr, ble_mesh_client_result_cb_t cb,
+                                                 void *arg, ble_mesh_client_handle_t *handle);
+esp_err_t ble_mesh_client_send_battery_acked(uint16_t addr, ble_mesh_client_result_cb_t cb, void *arg,
+                                             ble_mesh_client_handle_t *handle);
+esp_err_t ble_mesh_client_send_location_acked(uint32_t latitude, uint32_t longitude, int16_t altitude,
+                                              uint16_t addr, ble_mesh_client_result_cb_t cb, void *arg,
+                                              ble_mesh_client_handle_t *handle);
+esp_err_t ble_mesh_client_send_property_acked(uint16_t property_id, uint8_t *property_value,
+                                              uint16_t property_value_len, uint16_t addr,
+                                              ble_mesh_client_result_cb_t cb, void *arg,
+                                              ble_mesh_client_handle_t *handle);
+
+// Blocks until the request completes and releases its handle. Returns ESP_ERR_TIMEOUT
+// if it did not complete in time; the handle then stays valid for another wait.
+esp_err_t ble_mesh_client_wait(ble_mesh_client_handle_t handle, uint32_t timeout_ms, ble_mesh_client_result_t *result);
+
+// Releases a handle that will not be waited for
+void ble_mesh_client_cancel(ble_mesh_client_handle_t handle);
+
+// Last state reported by a node through a status reply or a publication. Returns
+// ESP_ERR_NOT_FOUND when the field is unknown or older than max_age_ms; the caller
+// then issues a GET. Sets sent through this client invalidate the cached field.
+esp_err_t ble_mesh_client_get_cached_onoff(uint16_t addr, uint32_t max_age_ms, uint8_t *onoff);
+esp_err_t ble_mesh_client_get_cached_level(uint16_t addr, uint32_t max_age_ms, int16_t *level);
+esp_err_t ble_mesh_client_get_cached_battery(uint16_t addr, uint32_t max_age_ms,
+                                             esp_ble_mesh_gen_battery_status_cb_t *battery);
+esp_err_t ble_mesh_client_get_cached_location(uint16_t addr, uint32_t max_age_ms,
+                                              esp_ble_mesh_gen_loc_global_status_cb_t *location);
+void ble_mesh_client_get_cache_stats(ble_mesh_client_cache_stats_t *stats);
+
+// Unacknowledged sets for the same model, opcode and destination are merged while
+// queued, only the newest value is sent and at most once per interval.
+// ESP_BLE_MESH_ADDR_UNASSIGNED sets the default for all destinations.
+void ble_mesh_client_set_min_interval(uint16_t addr, uint32_t interval_ms);
+
+// Messages go out on the subnet and with the AppKey of the destination's team. Nodes of
+// the local provisioner go to the team they were provisioned into, other addresses and
+// groups to the team set here. ESP_BLE_MESH_ADDR_UNASSIGNED sets the default for them,
+// initially the node's own team: the subnet of the first AppKey it was given. Every
+// other team's AppKey must be bound to the client models too.
+esp_err_t ble_mesh_client_set_team(uint16_t addr, uint8_t team);
+
+// Every set carrying a TID gets a fresh TID per (model, destination) and is then
+// repeated count more times with the same TID, interval_ms apart. Repeats stop
+// early once a newer value for the destination is sent. count 0 disables it.
+esp_err_t ble_mesh_client_set_retransmit(uint8_t count, uint16_t interval_ms);
+
+void ble_mesh_client_get_tx_stats(ble_mesh_client_tx_stats_t *stats);
+
+// Blocks until the send queue has room again, for a send refused with ESP_ERR_NO_MEM.
+// Returns ESP_ERR_TIMEOUT when it is still full after timeout_ms.
+esp_err_t ble_mesh_client_wait_queue(uint32_t timeout_ms);
 
 #endif //DEZIBOT_BLUETOOTH_MESH_CLIENT_H
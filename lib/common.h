@@ -5,16 +5,23 @@
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/param.h>
 
 // ESP APIs
 #include "esp_err.h"
 #include "sdkconfig.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
+#include "esp_timer.h"
+#include "esp_random.h"
 
 // FreeRTOS APIs
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
 
 // NimBLE APIs
 #include "nimble/nimble_port.h"
@@ -0,0 +1,110 @@
+#include "comp_data.h"
+#include "common.h"
+
+#define TAG                 "COMP_DATA"
+
+// cid, pid, vid, crpl, features
+#define COMP_HEADER_LEN     10
+// loc, NumS, NumV
+#define COMP_ELEM_HEADER_LEN 4
+
+static uint16_t get_le16(const uint8_t *buf)
+{
+    return buf[0] | buf[1] << 8;
+}
+
+esp_err_t ble_mesh_comp_data_parse(const uint8_t *data, size_t len, ble_mesh_comp_data_t *comp)
+{
+    const uint8_t *end = data + len;
+    const uint8_t *pos = data;
+
+    if (!data || !comp)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(comp, 0, sizeof(*comp));
+    if (len < COMP_HEADER_LEN)
+    {
+        ESP_LOGE(TAG, "%s: truncated header (%u bytes)", __func__, (unsigned)len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    comp->cid = get_le16(pos);
+    comp->pid = get_le16(pos + 2);
+    comp->vid = get_le16(pos + 4);
+    comp->crpl = get_le16(pos + 6);
+    comp->features = get_le16(pos + 8);
+    pos += COMP_HEADER_LEN;
+
+    while (pos < end)
+    {
+        ble_mesh_comp_data_elem_t *elem;
+        size_t models_len;
+
+        if (comp->elem_count == COMP_DATA_ELEMS_MAX)
+        {
+            ESP_LOGE(TAG, "%s: more than %d elements", __func__, COMP_DATA_ELEMS_MAX);
+            return ESP_ERR_NO_MEM;
+        }
+        if (end - pos < COMP_ELEM_HEADER_LEN)
+        {
+            ESP_LOGE(TAG, "%s: truncated element %u", __func__, comp->elem_count);
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        elem = &comp->elems[comp->elem_count];
+        elem->loc = get_le16(pos);
+        elem->sig_count = pos[2];
+        elem->vnd_count = pos[3];
+        elem->first = comp->model_count;
+        pos += COMP_ELEM_HEADER_LEN;
+
+        models_len = 2 * elem->sig_count + 4 * elem->vnd_count;
+        if ((size_t)(end - pos) < models_len)
+        {
+            ESP_LOGE(TAG, "%s: truncated model list of element %u", __func__, comp->elem_count);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        if (comp->model_count + elem->sig_count + elem->vnd_count > COMP_DATA_MODELS_MAX)
+        {
+            ESP_LOGE(TAG, "%s: more than %d models", __func__, COMP_DATA_MODELS_MAX);
+            return ESP_ERR_NO_MEM;
+        }
+
+        for (uint8_t i = 0; i < elem->sig_count; i++, pos += 2)
+        {
+            comp->models[comp->model_count++] = (uint32_t)ESP_BLE_MESH_CID_NVAL << 16 | get_le16(pos);
+        }
+        for (uint8_t i = 0; i < elem->vnd_count; i++, pos += 4)
+        {
+            comp->models[comp->model_count++] = (uint32_t)get_le16(pos) << 16 | get_le16(pos + 2);
+        }
+
+        comp->elem_count++;
+    }
+
+    return ESP_OK;
+}
+
+bool ble_mesh_comp_data_has_model(const ble_mesh_comp_data_t *comp, uint8_t elem, uint16_t company_id, uint16_t model_id)
+{
+    const ble_mesh_comp_data_elem_t *entry;
+    uint32_t key = (uint32_t)company_id << 16 | model_id;
+
+    if (!comp || elem >= comp->elem_count)
+    {
+        return false;
+    }
+
+    entry = &comp->elems[elem];
+    for (uint8_t i = entry->first; i < entry->first + entry->sig_count + entry->vnd_count; i++)
+    {
+        if (comp->models[i] == key)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,40 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_COMP_DATA_H
+#define DEZIBOT_BLUETOOTH_MESH_COMP_DATA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Elements and models of one node that are indexed, larger compositions are rejected
+#define COMP_DATA_ELEMS_MAX     8
+#define COMP_DATA_MODELS_MAX    32
+
+typedef struct {
+    uint16_t loc;
+    uint8_t  sig_count;
+    uint8_t  vnd_count;
+    uint8_t  first;         // index of the element's first model in models[]
+} ble_mesh_comp_data_elem_t;
+
+// Composition data page 0
+typedef struct {
+    uint16_t cid;
+    uint16_t pid;
+    uint16_t vid;
+    uint16_t crpl;
+    uint16_t features;
+    uint8_t  elem_count;
+    uint8_t  model_count;
+    ble_mesh_comp_data_elem_t elems[COMP_DATA_ELEMS_MAX];
+    uint32_t models[COMP_DATA_MODELS_MAX];  // company id << 16 | model id, ESP_BLE_MESH_CID_NVAL for SIG models
+} ble_mesh_comp_data_t;
+
+// Parses page 0 as returned by Config Composition Data Status, without the page number
+esp_err_t ble_mesh_comp_data_parse(const uint8_t *data, size_t len, ble_mesh_comp_data_t *comp);
+
+// Pass ESP_BLE_MESH_CID_NVAL as company_id for SIG models
+bool ble_mesh_comp_data_has_model(const ble_mesh_comp_data_t *comp, uint8_t elem, uint16_t company_id, uint16_t model_id);
+
+#endif //DEZIBOT_BLUETOOTH_MESH_COMP_DATA_H
@@ -0,0 +1,331 @@
+#include "dispatcher.h"
+
+#define TAG "DISPATCH"
+
+_Static_assert(DISPATCH_POOL_SIZE <= UINT8_MAX, "pool indexes are uint8_t");
+_Static_assert(DISPATCH_POOL_RESERVE < DISPATCH_POOL_SIZE, "lossy events need objects too");
+
+typedef struct {
+    ble_mesh_dispatch_handler_t handler;
+    bool lossy;
+} dispatch_slot_t;
+
+// Handler per stack event, indexed by the event id
+static dispatch_slot_t prov_slots[ESP_BLE_MESH_PROV_EVT_MAX];
+static dispatch_slot_t cfg_slots[ESP_BLE_MESH_CFG_CLIENT_EVT_MAX];
+#if CONFIG_BLE_MESH_AGG_CLI
+static dispatch_slot_t agg_slots[ESP_BLE_MESH_AGG_EVT_MAX];
+#endif
+
+static ble_mesh_dispatch_event_t pool[DISPATCH_POOL_SIZE];
+
+// Free objects are a stack of pool indexes and posted ones a ring of them in arrival
+// order. A critical section and a notification cost the stack's task less than a
+// queue operation.
+static portMUX_TYPE pool_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t free_slots[DISPATCH_POOL_SIZE];
+static uint8_t free_count;
+static uint8_t pending[DISPATCH_POOL_SIZE];
+static uint8_t pending_head;
+static uint8_t pending_count;
+static uint8_t pool_peak;
+
+static TaskHandle_t worker;
+
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static ble_mesh_dispatch_stats_t stats;
+static uint64_t dwell_sum_us;
+
+static const dispatch_slot_t *slot_get(ble_mesh_dispatch_source_t source, int event)
+{
+    switch (source)
+    {
+        case DISPATCH_PROV:
+            return event >= 0 && event < ESP_BLE_MESH_PROV_EVT_MAX ? &prov_slots[event] : NULL;
+        case DISPATCH_CFG_CLIENT:
+            return event >= 0 && event < ESP_BLE_MESH_CFG_CLIENT_EVT_MAX ? &cfg_slots[event] : NULL;
+#if CONFIG_BLE_MESH_AGG_CLI
+        case DISPATCH_AGG:
+            return event >= 0 && event < ESP_BLE_MESH_AGG_EVT_MAX ? &agg_slots[event] : NULL;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+static ble_mesh_dispatch_event_t *pool_take(bool lossy)
+{
+    ble_mesh_dispatch_event_t *event = NULL;
+
+    taskENTER_CRITICAL(&pool_lock);
+    if (free_count > (lossy ? DISPATCH_POOL_RESERVE : 0))
+    {
+        event = &pool[free_slots[--free_count]];
+        pool_peak = MAX(pool_peak, DISPATCH_POOL_SIZE - free_count);
+    }
+    taskEXIT_CRITICAL(&pool_lock);
+
+    return event;
+}
+
+static void pool_give(ble_mesh_dispatch_event_t *event)
+{
+    taskENTER_CRITICAL(&pool_lock);
+    free_slots[free_count++] = event - pool;
+    taskEXIT_CRITICAL(&pool_lock);
+}
+
+static ble_mesh_dispatch_event_t *pending_pop(void)
+{
+    ble_mesh_dispatch_event_t *event = NULL;
+
+    taskENTER_CRITICAL(&pool_lock);
+    if (pending_count)
+    {
+        event = &pool[pending[pending_head]];
+        pending_head = (pending_head + 1) % DISPATCH_POOL_SIZE;
+        pending_count--;
+    }
+    taskEXIT_CRITICAL(&pool_lock);
+
+    return event;
+}
+
+// An object for an event with a handler, NULL for the others and when none is free.
+// Runs in the stack's task, which must never be blocked here.
+static ble_mesh_dispatch_event_t *event_take(ble_mesh_dispatch_source_t source, int event)
+{
+    const dispatch_slot_t *slot = slot_get(source, event);
+    ble_mesh_dispatch_event_t *copy;
+
+    if (!slot || !slot->handler)
+    {
+        return NULL;
+    }
+
+    copy = pool_take(slot->lossy);
+    if (!copy)
+    {
+        taskENTER_CRITICAL(&stats_lock);
+        if (slot->lossy)
+        {
+            stats.dropped++;
+        }
+        else
+        {
+            stats.lost++;
+        }
+        taskEXIT_CRITICAL(&stats_lock);
+        return NULL;
+    }
+
+    copy->source = source;
+    copy->event = event;
+    return copy;
+}
+
+static void event_post(ble_mesh_dispatch_event_t *copy, int64_t start_us)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t dwell = now - start_us;
+
+    copy->posted_us = now;
+    taskENTER_CRITICAL(&pool_lock);
+    pending[(pending_head + pending_count++) % DISPATCH_POOL_SIZE] = copy - pool;
+    taskEXIT_CRITICAL(&pool_lock);
+    xTaskNotifyGive(worker);
+
+    taskENTER_CRITICAL(&stats_lock);
+    stats.posted++;
+    dwell_sum_us += dwell;
+    stats.dwell_max_us = MAX(stats.dwell_max_us, dwell);
+    taskEXIT_CRITICAL(&stats_lock);
+}
+
+// Copies a buffer into the event and points *buf at the copy
+static void buf_copy(ble_mesh_dispatch_event_t *copy, struct net_buf_simple **buf)
+{
+    size_t len;
+
+    if (!*buf)
+    {
+        return;
+    }
+
+    len = MIN((*buf)->len, DISPATCH_DATA_MAX);
+    if (len < (*buf)->len)
+    {
+        taskENTER_CRITICAL(&stats_lock);
+        stats.truncated++;
+        taskEXIT_CRITICAL(&stats_lock);
+    }
+    memcpy(copy->data, (*buf)->data, len);
+    copy->buf.data = copy->data;
+    copy->buf.__buf = copy->data;
+    copy->buf.len = len;
+    copy->buf.size = DISPATCH_DATA_MAX;
+    *buf = &copy->buf;
+}
+
+static void params_copy(ble_mesh_dispatch_event_t *copy, esp_ble_mesh_client_common_param_t **params)
+{
+    if (*params)
+    {
+        copy->params = **params;
+        *params = &copy->params;
+    }
+}
+
+static void prov_cb(esp_ble_mesh_prov_cb_event_t event, esp_ble_mesh_prov_cb_param_t *param)
+{
+    int64_t start = esp_timer_get_time();
+    ble_mesh_dispatch_event_t *copy = event_take(DISPATCH_PROV, event);
+
+    if (!copy)
+    {
+        return;
+    }
+
+    copy->param.prov = *param;
+    event_post(copy, start);
+}
+
+static void cfg_client_cb(esp_ble_mesh_cfg_client_cb_event_t event, esp_ble_mesh_cfg_client_cb_param_t *param)
+{
+    int64_t start = esp_timer_get_time();
+    ble_mesh_dispatch_event_t *copy = event_take(DISPATCH_CFG_CLIENT, event);
+    uint32_t opcode;
+
+    if (!copy)
+    {
+        return;
+    }
+
+    copy->param.cfg = *param;
+    params_copy(copy, &copy->param.cfg.params);
+    opcode = copy->param.cfg.params ? copy->param.cfg.params->opcode : 0;
+    if (event != ESP_BLE_MESH_CFG_CLIENT_TIMEOUT_EVT && !param->error_code
+        && (opcode == ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET || opcode == ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_STATUS))
+    {
+        buf_copy(copy, &copy->param.cfg.status_cb.comp_data_status.composition_data);
+    }
+    event_post(copy, start);
+}
+
+#if CONFIG_BLE_MESH_AGG_CLI
+static void agg_cb(esp_ble_mesh_agg_cb_event_t event, esp_ble_mesh_agg_cb_param_t *param)
+{
+    int64_t start = esp_timer_get_time();
+    ble_mesh_dispatch_event_t *copy = event_take(DISPATCH_AGG, event);
+
+    if (!copy)
+    {
+        return;
+    }
+
+    copy->param.agg = *param;
+    switch (event)
+    {
+        case ESP_BLE_MESH_AGG_CLIENT_SEND_COMP_EVT:
+        case ESP_BLE_MESH_AGG_CLIENT_SEND_TIMEOUT_EVT:
+            params_copy(copy, &copy->param.agg.client.send.params);
+            break;
+        case ESP_BLE_MESH_AGG_CLIENT_RECV_RSP_EVT:
+        case ESP_BLE_MESH_AGG_CLIENT_RECV_PUB_EVT:
+            params_copy(copy, &copy->param.agg.client.recv.params);
+            buf_copy(copy, &copy->param.agg.client.recv.recv.agg_status.items);
+            break;
+        default:
+            break;
+    }
+    event_post(copy, start);
+}
+#endif
+
+static void dispatch_task(void *arg)
+{
+    ble_mesh_dispatch_event_t *event;
+
+    for (;;)
+    {
+        int64_t start;
+        uint32_t took;
+
+        event = pending_pop();
+        if (!event)
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        start = esp_timer_get_time();
+        slot_get(event->source, event->event)->handler(event);
+        took = esp_timer_get_time() - start;
+
+        taskENTER_CRITICAL(&stats_lock);
+        stats.handled++;
+        stats.wait_max_us = MAX(stats.wait_max_us, (uint32_t)(start - event->posted_us));
+        stats.handler_max_us = MAX(stats.handler_max_us, took);
+        taskEXIT_CRITICAL(&stats_lock);
+
+        pool_give(event);
+    }
+}
+
+esp_err_t ble_mesh_dispatch_init(const ble_mesh_dispatch_entry_t *table, size_t count)
+{
+    esp_err_t error;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        dispatch_slot_t *slot = (dispatch_slot_t *)slot_get(table[i].source, table[i].event);
+
+        if (!slot)
+        {
+            ESP_LOGE(TAG, "%s: event %d of source %d out of range", __func__, table[i].event, table[i].source);
+            return ESP_ERR_INVALID_ARG;
+        }
+        slot->handler = table[i].handler;
+        slot->lossy = table[i].lossy;
+    }
+
+    for (free_count = 0; free_count < DISPATCH_POOL_SIZE; free_count++)
+    {
+        free_slots[free_count] = DISPATCH_POOL_SIZE - 1 - free_count;
+    }
+
+    if (xTaskCreate(dispatch_task, "mesh_dispatch", DISPATCH_TASK_STACK, NULL, DISPATCH_TASK_PRIO, &worker) != pdPASS)
+    {
+        ESP_LOGE(TAG, "%s: failed to create worker task", __func__);
+        return ESP_ERR_NO_MEM;
+    }
+
+    error = esp_ble_mesh_register_prov_callback(prov_cb);
+    if (error == ESP_OK)
+    {
+        error = esp_ble_mesh_register_config_client_callback(cfg_client_cb);
+    }
+#if CONFIG_BLE_MESH_AGG_CLI
+    if (error == ESP_OK)
+    {
+        error = esp_ble_mesh_register_agg_callback(agg_cb);
+    }
+#endif
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: failed to register callbacks (err %d)", __func__, error);
+    }
+
+    return error;
+}
+
+void ble_mesh_dispatch_get_stats(ble_mesh_dispatch_stats_t *out)
+{
+    taskENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    out->dwell_avg_us = stats.posted ? dwell_sum_us / stats.posted : 0;
+    taskEXIT_CRITICAL(&stats_lock);
+    taskENTER_CRITICAL(&pool_lock);
+    out->pool_peak = pool_peak;
+    taskEXIT_CRITICAL(&pool_lock);
+}
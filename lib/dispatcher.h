@@ -0,0 +1,85 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_DISPATCHER_H
+#define DEZIBOT_BLUETOOTH_MESH_DISPATCHER_H
+
+#include "common.h"
+
+#if CONFIG_BLE_MESH_AGG_CLI
+#include "esp_ble_mesh_agg_model_api.h"
+#endif
+
+// Event objects shared by all stack callbacks
+#ifndef DISPATCH_POOL_SIZE
+#define DISPATCH_POOL_SIZE      32
+#endif
+
+// Objects left to events that must not be lost, lossy ones are dropped before. The
+// callbacks never wait for an object, so this covers the worst burst of them: a
+// result per configuration request in flight, link open, complete and close of every
+// provisioning link, and the completions of the stack calls their handlers make.
+#ifndef DISPATCH_POOL_RESERVE
+#define DISPATCH_POOL_RESERVE   16
+#endif
+
+// Buffer contents copied along, an access payload at most
+#define DISPATCH_DATA_MAX       384
+
+#define DISPATCH_TASK_STACK     4096
+#define DISPATCH_TASK_PRIO      5
+
+typedef enum {
+    DISPATCH_PROV,          // esp_ble_mesh_prov_cb_event_t
+    DISPATCH_CFG_CLIENT,    // esp_ble_mesh_cfg_client_cb_event_t
+    DISPATCH_AGG,           // esp_ble_mesh_agg_cb_event_t
+    DISPATCH_SOURCE_COUNT,
+} ble_mesh_dispatch_source_t;
+
+// A callback's parameters copied out of the stack. Pointers in them lead into the
+// event itself: the client's common parameters, the composition data of a
+// Composition Data Status and the items of an Opcodes Aggregator Status. Other
+// buffers are not copied and must not be used by handlers.
+typedef struct {
+    ble_mesh_dispatch_source_t source;
+    int      event;
+    int64_t  posted_us;
+    union {
+        esp_ble_mesh_prov_cb_param_t prov;
+        esp_ble_mesh_cfg_client_cb_param_t cfg;
+#if CONFIG_BLE_MESH_AGG_CLI
+        esp_ble_mesh_agg_cb_param_t agg;
+#endif
+    } param;
+    esp_ble_mesh_client_common_param_t params;
+    struct net_buf_simple buf;
+    uint8_t  data[DISPATCH_DATA_MAX];
+} ble_mesh_dispatch_event_t;
+
+typedef void (*ble_mesh_dispatch_handler_t)(const ble_mesh_dispatch_event_t *event);
+
+typedef struct {
+    ble_mesh_dispatch_source_t source;
+    int      event;
+    ble_mesh_dispatch_handler_t handler;
+    bool     lossy;         // repeated by the sender anyway, kept out of the reserve
+} ble_mesh_dispatch_entry_t;
+
+typedef struct {
+    uint32_t posted;
+    uint32_t handled;
+    uint32_t dropped;       // lossy events without a free object
+    uint32_t lost;          // events that must not be lost, dropped anyway: the reserve is too small
+    uint32_t truncated;     // buffers longer than DISPATCH_DATA_MAX
+    uint8_t  pool_peak;     // objects in use at once
+    uint32_t dwell_avg_us;  // in the stack's callback, copying included
+    uint32_t dwell_max_us;
+    uint32_t wait_max_us;   // posted to handler start
+    uint32_t handler_max_us;
+} ble_mesh_dispatch_stats_t;
+
+// Registers the stack callbacks and starts the worker task. Events of the table are
+// copied and handed to their handler on the worker in the order they arrived, all
+// others are ignored. Call before esp_ble_mesh_init().
+esp_err_t ble_mesh_dispatch_init(const ble_mesh_dispatch_entry_t *table, size_t count);
+
+void ble_mesh_dispatch_get_stats(ble_mesh_dispatch_stats_t *stats);
+
+#endif //DEZIBOT_BLUETOOTH_MESH_DISPATCHER_H
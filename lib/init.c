@@ -2,25 +2,71 @@
 
 #include "common.h"
 #include "bluetooth.h"
+#include "boot_profile.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include "esp_console.h"
 
 #define TAG "INIT"
 
+// The REPL reads the console UART on a task of its own. The mesh inits register the
+// commands of what they start, the metrics and the trace are shared by all of them.
+static esp_err_t console_start(void)
+{
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    esp_console_dev_uart_config_t uart_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    esp_console_repl_t *repl = NULL;
+    esp_err_t error;
+
+    repl_config.prompt = "mesh>";
+    error = esp_console_new_repl_uart(&uart_config, &repl_config, &repl);
+    if (error == ESP_OK)
+    {
+        error = esp_console_register_help_command();
+    }
+    if (error == ESP_OK)
+    {
+        error = ble_mesh_metrics_register_console();
+    }
+    if (error == ESP_OK)
+    {
+        error = ble_mesh_trace_register_console();
+    }
+    if (error == ESP_OK)
+    {
+        error = esp_console_start_repl(repl);
+    }
+
+    return error;
+}
+
 esp_err_t pre_init(void)
 {
     esp_err_t error;
 
+    ble_mesh_boot_begin(BOOT_NVS);
     error = nvs_flash_init();
-    if (error == ESP_ERR_NVS_NO_FREE_PAGES)
+    if (error == ESP_ERR_NVS_NO_FREE_PAGES || error == ESP_ERR_NVS_NEW_VERSION_FOUND)
     {
         ESP_ERROR_CHECK(nvs_flash_erase());
         error = nvs_flash_init();
     }
     ESP_ERROR_CHECK(error);
+    ble_mesh_boot_end(BOOT_NVS);
+
+    // Diagnostics only, the node runs without them
+    error = console_start();
+    if (error)
+    {
+        ESP_LOGE(TAG, "console_start failed (err %d)", error);
+    }
 
-    error = bluetooth_init();
+    // The mesh inits wait for the host to sync, everything before them overlaps with it
+    error = bluetooth_start();
     if (error)
     {
-        ESP_LOGE(TAG, "esp32_bluetooth_init failed (err %d)", error);
+        ESP_LOGE(TAG, "bluetooth_start failed (err %d)", error);
         return error;
     }
 
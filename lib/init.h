@@ -3,6 +3,8 @@
 
 #include "common.h"
 
+// Initializes NVS, starts the console REPL and the NimBLE host, call once before the
+// mesh inits
 esp_err_t pre_init(void);
 
 #endif //DEZIBOT_BLUETOOTH_MESH_INIT_H
\ No newline at end of file
@@ -0,0 +1,215 @@
+#include "lifecycle.h"
+
+#define TAG "LIFECYCLE"
+
+typedef struct {
+    ble_mesh_lifecycle_cb_t cb;
+    void *arg;
+} lifecycle_subscriber_t;
+
+static const char *const bit_names[] = {
+    "stack_up",
+    "provisioned",
+    "appkey_bound",
+    "models_bound",
+};
+
+static EventGroupHandle_t group;
+
+// Serializes changes so that subscribers see the transitions in the order the bits changed
+static SemaphoreHandle_t change_mutex;
+
+static portMUX_TYPE subscriber_lock = portMUX_INITIALIZER_UNLOCKED;
+static lifecycle_subscriber_t subscribers[LIFECYCLE_SUBSCRIBERS_MAX];
+
+static void notify(EventBits_t set, EventBits_t cleared)
+{
+    lifecycle_subscriber_t copy[LIFECYCLE_SUBSCRIBERS_MAX];
+
+    if (!set && !cleared)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL(&subscriber_lock);
+    memcpy(copy, subscribers, sizeof(copy));
+    taskEXIT_CRITICAL(&subscriber_lock);
+
+    for (int i = 0; i < LIFECYCLE_SUBSCRIBERS_MAX; i++)
+    {
+        if (copy[i].cb)
+        {
+            copy[i].cb(set, cleared, copy[i].arg);
+        }
+    }
+}
+
+static void change(EventBits_t set, EventBits_t clear)
+{
+    EventBits_t before;
+
+    if (!group)
+    {
+        ESP_LOGE(TAG, "%s: not initialized", __func__);
+        return;
+    }
+
+    xSemaphoreTake(change_mutex, portMAX_DELAY);
+    before = xEventGroupGetBits(group);
+    if (clear & before)
+    {
+        xEventGroupClearBits(group, clear);
+    }
+    // Subscribers hear of a state before the tasks waiting for it run
+    notify(set & ~before, clear & before);
+    if (set & ~before)
+    {
+        xEventGroupSetBits(group, set);
+    }
+    xSemaphoreGive(change_mutex);
+}
+
+esp_err_t ble_mesh_lifecycle_init(void)
+{
+    if (group)
+    {
+        return ESP_OK;
+    }
+
+    change_mutex = xSemaphoreCreateMutex();
+    group = xEventGroupCreate();
+    if (!change_mutex || !group)
+    {
+        ESP_LOGE(TAG, "%s: failed to create the event group", __func__);
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+void ble_mesh_lifecycle_set(EventBits_t bits)
+{
+    change(bits, 0);
+}
+
+void ble_mesh_lifecycle_clear(EventBits_t bits)
+{
+    change(0, bits);
+}
+
+EventBits_t ble_mesh_lifecycle_get(void)
+{
+    return group ? xEventGroupGetBits(group) & LIFECYCLE_READY : 0;
+}
+
+bool ble_mesh_lifecycle_is(EventBits_t bits)
+{
+    return (ble_mesh_lifecycle_get() & bits) == bits;
+}
+
+esp_err_t ble_mesh_lifecycle_wait(EventBits_t bits, uint32_t timeout_ms)
+{
+    TickType_t wait = timeout_ms == LIFECYCLE_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+
+    if (!group)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if ((xEventGroupWaitBits(group, bits, pdFALSE, pdTRUE, wait) & bits) != bits)
+    {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t ble_mesh_lifecycle_subscribe(ble_mesh_lifecycle_cb_t cb, void *arg)
+{
+    EventBits_t bits;
+    int slot = -1;
+
+    if (!cb)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!group)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Holding the change mutex, no transition falls between the first call and the subscription
+    xSemaphoreTake(change_mutex, portMAX_DELAY);
+    taskENTER_CRITICAL(&subscriber_lock);
+    for (int i = 0; i < LIFECYCLE_SUBSCRIBERS_MAX; i++)
+    {
+        if (!subscribers[i].cb)
+        {
+            subscribers[i].cb = cb;
+            subscribers[i].arg = arg;
+            slot = i;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&subscriber_lock);
+
+    if (slot < 0)
+    {
+        xSemaphoreGive(change_mutex);
+        ESP_LOGE(TAG, "%s: no subscriber slot left", __func__);
+        return ESP_ERR_NO_MEM;
+    }
+
+    bits = ble_mesh_lifecycle_get();
+    if (bits)
+    {
+        cb(bits, 0, arg);
+    }
+    xSemaphoreGive(change_mutex);
+
+    return ESP_OK;
+}
+
+esp_err_t ble_mesh_lifecycle_unsubscribe(ble_mesh_lifecycle_cb_t cb, void *arg)
+{
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+
+    taskENTER_CRITICAL(&subscriber_lock);
+    for (int i = 0; i < LIFECYCLE_SUBSCRIBERS_MAX; i++)
+    {
+        if (subscribers[i].cb == cb && subscribers[i].arg == arg)
+        {
+            subscribers[i].cb = NULL;
+            err = ESP_OK;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&subscriber_lock);
+
+    return err;
+}
+
+const char *ble_mesh_lifecycle_str(EventBits_t bits, char *buf, size_t len)
+{
+    size_t used = 0;
+
+    if (!len)
+    {
+        return buf;
+    }
+
+    buf[0] = '\0';
+    for (size_t i = 0; i < ARRAY_SIZE(bit_names) && used < len; i++)
+    {
+        if (bits & (1 << i))
+        {
+            used += snprintf(buf + used, len - used, "%s%s", used ? " " : "", bit_names[i]);
+        }
+    }
+    if (!used)
+    {
+        snprintf(buf, len, "none");
+    }
+
+    return buf;
+}
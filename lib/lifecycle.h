@@ -0,0 +1,51 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_LIFECYCLE_H
+#define DEZIBOT_BLUETOOTH_MESH_LIFECYCLE_H
+
+#include "common.h"
+#include "freertos/event_groups.h"
+
+// States of the local node, each a bit of the lifecycle event group
+#define LIFECYCLE_STACK_UP      (1 << 0)   // NimBLE host synced with the controller
+#define LIFECYCLE_PROVISIONED   (1 << 1)   // node has a unicast address and the NetKey
+#define LIFECYCLE_APPKEY_BOUND  (1 << 2)   // the client's AppKey was added
+#define LIFECYCLE_MODELS_BOUND  (1 << 3)   // the Generic OnOff Client has the AppKey bound
+
+// Everything needed before the client can send
+#define LIFECYCLE_READY         (LIFECYCLE_STACK_UP | LIFECYCLE_PROVISIONED | LIFECYCLE_APPKEY_BOUND | LIFECYCLE_MODELS_BOUND)
+
+#define LIFECYCLE_WAIT_FOREVER  UINT32_MAX
+
+// Transition callbacks that can be subscribed at the same time
+#ifndef LIFECYCLE_SUBSCRIBERS_MAX
+#define LIFECYCLE_SUBSCRIBERS_MAX 4
+#endif
+
+// Called with the bits that were set and cleared by one change, in the task that made
+// it and before tasks waiting for the bits set run. Must not block and must not change
+// the lifecycle itself.
+typedef void (*ble_mesh_lifecycle_cb_t)(EventBits_t set, EventBits_t cleared, void *arg);
+
+// Creates the event group, later calls return right away
+esp_err_t ble_mesh_lifecycle_init(void);
+
+void ble_mesh_lifecycle_set(EventBits_t bits);
+
+void ble_mesh_lifecycle_clear(EventBits_t bits);
+
+EventBits_t ble_mesh_lifecycle_get(void);
+
+// Whether all of bits are set
+bool ble_mesh_lifecycle_is(EventBits_t bits);
+
+// Blocks until all of bits are set, ESP_ERR_TIMEOUT if they were not within timeout_ms
+esp_err_t ble_mesh_lifecycle_wait(EventBits_t bits, uint32_t timeout_ms);
+
+// cb is first called with the bits already set, then on every transition
+esp_err_t ble_mesh_lifecycle_subscribe(ble_mesh_lifecycle_cb_t cb, void *arg);
+
+esp_err_t ble_mesh_lifecycle_unsubscribe(ble_mesh_lifecycle_cb_t cb, void *arg);
+
+// Names of the bits set, separated by spaces, "none" without any
+const char *ble_mesh_lifecycle_str(EventBits_t bits, char *buf, size_t len);
+
+#endif //DEZIBOT_BLUETOOTH_MESH_LIFECYCLE_H
@@ -0,0 +1,282 @@
+#include "metrics.h"
+#include "common.h"
+
+#include "esp_console.h"
+
+#define TAG "METRICS"
+
+#define METRICS_OPCODE_OTHER    0xffffffff
+
+typedef struct {
+    uint32_t opcode;
+    uint32_t sent;
+    uint32_t ok;
+    uint32_t fail;
+    uint32_t timeout;
+    uint32_t hist[METRICS_HIST_BUCKETS];
+} opcode_metrics_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t sum_ms;
+    uint32_t max_ms;
+    uint32_t hist[METRICS_HIST_BUCKETS];
+} stage_metrics_t;
+
+_Static_assert(sizeof(opcode_metrics_t) == (5 + METRICS_HIST_BUCKETS) * sizeof(uint32_t), "blob layout");
+_Static_assert(sizeof(stage_metrics_t) == (3 + METRICS_HIST_BUCKETS) * sizeof(uint32_t), "blob layout");
+
+static portMUX_TYPE metrics_lock = portMUX_INITIALIZER_UNLOCKED;
+static opcode_metrics_t opcodes[METRICS_OPCODES];
+static uint8_t opcode_count;
+static stage_metrics_t stages[METRICS_STAGE_COUNT];
+static uint32_t gauges[METRICS_GAUGE_COUNT];
+
+static const char *const stage_names[METRICS_STAGE_COUNT] = {
+    [METRICS_STAGE_PROVISION] = "provision",
+    [METRICS_STAGE_COMP_DATA] = "comp_data",
+    [METRICS_STAGE_APP_KEY] = "app_key",
+    [METRICS_STAGE_MODEL_BIND] = "model_bind",
+    [METRICS_STAGE_MODEL_SUB] = "model_sub",
+    [METRICS_STAGE_AGGREGATE] = "aggregate",
+    [METRICS_STAGE_OPERATIONAL] = "operational",
+};
+
+static const char *const gauge_names[METRICS_GAUGE_COUNT] = {
+    [METRICS_GAUGE_ADV_CREDITS] = "adv_credits",
+    [METRICS_GAUGE_TX_QUEUE] = "tx_queue",
+    [METRICS_GAUGE_ACK_PENDING] = "ack_pending",
+    [METRICS_GAUGE_CFG_IN_FLIGHT] = "cfg_in_flight",
+};
+
+static uint32_t hist_bucket(int64_t us)
+{
+    uint32_t ms = us > 0 ? MIN(us / 1000, UINT32_MAX) : 0;
+    uint32_t bucket = ms ? 32 - __builtin_clz(ms) : 0;
+
+    return MIN(bucket, METRICS_HIST_BUCKETS - 1);
+}
+
+// Upper bound in ms of the bucket holding the given percentile, metrics_lock held
+static uint32_t hist_percentile(const uint32_t *hist, uint32_t total, uint32_t percent)
+{
+    uint32_t target = (total * percent + 99) / 100;
+    uint32_t seen = 0;
+
+    for (uint32_t i = 0; i < METRICS_HIST_BUCKETS; i++)
+    {
+        seen += hist[i];
+        if (seen >= target && seen)
+        {
+            return 1u << i;
+        }
+    }
+
+    return 0;
+}
+
+// Entry of the opcode, metrics_lock held
+static opcode_metrics_t *opcode_entry(uint32_t opcode)
+{
+    for (uint8_t i = 0; i < opcode_count; i++)
+    {
+        if (opcodes[i].opcode == opcode)
+        {
+            return &opcodes[i];
+        }
+    }
+
+    if (opcode_count < METRICS_OPCODES - 1)
+    {
+        opcodes[opcode_count].opcode = opcode;
+        return &opcodes[opcode_count++];
+    }
+
+    opcodes[METRICS_OPCODES - 1].opcode = METRICS_OPCODE_OTHER;
+    return &opcodes[METRICS_OPCODES - 1];
+}
+
+void ble_mesh_metrics_sent(uint32_t opcode)
+{
+    taskENTER_CRITICAL(&metrics_lock);
+    opcode_entry(opcode)->sent++;
+    taskEXIT_CRITICAL(&metrics_lock);
+}
+
+void ble_mesh_metrics_result(uint32_t opcode, ble_mesh_metrics_outcome_t outcome, int64_t latency_us)
+{
+    taskENTER_CRITICAL(&metrics_lock);
+    opcode_metrics_t *entry = opcode_entry(opcode);
+    switch (outcome)
+    {
+        case METRICS_OK:
+            entry->ok++;
+            entry->hist[hist_bucket(latency_us)]++;
+            break;
+        case METRICS_FAIL:
+            entry->fail++;
+            break;
+        case METRICS_TIMEOUT:
+            entry->timeout++;
+            break;
+    }
+    taskEXIT_CRITICAL(&metrics_lock);
+}
+
+void ble_mesh_metrics_stage(ble_mesh_metrics_stage_t stage, int64_t duration_us)
+{
+    uint32_t ms = duration_us > 0 ? duration_us / 1000 : 0;
+
+    taskENTER_CRITICAL(&metrics_lock);
+    stages[stage].count++;
+    stages[stage].sum_ms += ms;
+    stages[stage].max_ms = MAX(stages[stage].max_ms, ms);
+    stages[stage].hist[hist_bucket(duration_us)]++;
+    taskEXIT_CRITICAL(&metrics_lock);
+}
+
+void ble_mesh_metrics_gauge(ble_mesh_metrics_gauge_t gauge, uint32_t value)
+{
+    // Racy read first so the common case of no new maximum stays lock free
+    if (value <= gauges[gauge])
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL(&metrics_lock);
+    gauges[gauge] = MAX(gauges[gauge], value);
+    taskEXIT_CRITICAL(&metrics_lock);
+}
+
+void ble_mesh_metrics_reset(void)
+{
+    taskENTER_CRITICAL(&metrics_lock);
+    memset(opcodes, 0, sizeof(opcodes));
+    opcode_count = 0;
+    memset(stages, 0, sizeof(stages));
+    memset(gauges, 0, sizeof(gauges));
+    taskEXIT_CRITICAL(&metrics_lock);
+}
+
+void ble_mesh_metrics_dump(void)
+{
+    static opcode_metrics_t opcode_copy[METRICS_OPCODES];
+    static stage_metrics_t stage_copy[METRICS_STAGE_COUNT];
+    uint32_t gauge_copy[METRICS_GAUGE_COUNT];
+    uint8_t count;
+
+    // Printing with interrupts disabled is not an option, work on a copy
+    taskENTER_CRITICAL(&metrics_lock);
+    memcpy(opcode_copy, opcodes, sizeof(opcodes));
+    memcpy(stage_copy, stages, sizeof(stages));
+    memcpy(gauge_copy, gauges, sizeof(gauges));
+    count = opcodes[METRICS_OPCODES - 1].opcode ? METRICS_OPCODES : opcode_count;
+    taskEXIT_CRITICAL(&metrics_lock);
+
+    printf("%-10s %8s %8s %8s %8s %8s %8s\n", "opcode", "sent", "ok", "fail", "timeout", "p50 ms", "p90 ms");
+    for (uint8_t i = 0; i < count; i++)
+    {
+        opcode_metrics_t *entry = &opcode_copy[i];
+        if (!entry->opcode)
+        {
+            continue;
+        }
+        printf("0x%08" PRIx32 " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 "\n",
+               entry->opcode, entry->sent, entry->ok, entry->fail, entry->timeout,
+               hist_percentile(entry->hist, entry->ok, 50), hist_percentile(entry->hist, entry->ok, 90));
+    }
+
+    printf("%-12s %8s %8s %8s %8s\n", "stage", "count", "avg ms", "p90 ms", "max ms");
+    for (int i = 0; i < METRICS_STAGE_COUNT; i++)
+    {
+        stage_metrics_t *stage = &stage_copy[i];
+        printf("%-12s %8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 "\n", stage_names[i], stage->count,
+               stage->count ? stage->sum_ms / stage->count : 0, hist_percentile(stage->hist, stage->count, 90),
+               stage->max_ms);
+    }
+
+    for (int i = 0; i < METRICS_GAUGE_COUNT; i++)
+    {
+        printf("%-14s max %" PRIu32 "\n", gauge_names[i], gauge_copy[i]);
+    }
+}
+
+size_t ble_mesh_metrics_blob(uint8_t *buf, size_t len)
+{
+    uint32_t *words = (uint32_t *)buf;
+    size_t n = 0;
+
+    if (!buf || len < METRICS_BLOB_SIZE || ((uintptr_t)buf & 3))
+    {
+        return 0;
+    }
+
+    words[n++] = METRICS_BLOB_MAGIC;
+    words[n++] = METRICS_BLOB_VERSION;
+    words[n++] = METRICS_OPCODES;
+    words[n++] = METRICS_STAGE_COUNT;
+    words[n++] = METRICS_GAUGE_COUNT;
+    words[n++] = METRICS_HIST_BUCKETS;
+
+    // Every record is whole uint32 words, the structs have no padding
+    taskENTER_CRITICAL(&metrics_lock);
+    memcpy(&words[n], opcodes, sizeof(opcodes));
+    n += sizeof(opcodes) / (sizeof(uint32_t));
+    memcpy(&words[n], stages, sizeof(stages));
+    n += sizeof(stages) / (sizeof(uint32_t));
+    memcpy(&words[n], gauges, sizeof(gauges));
+    n += sizeof(gauges) / sizeof(uint32_t);
+    taskEXIT_CRITICAL(&metrics_lock);
+
+    return n * sizeof(uint32_t);
+}
+
+static int metrics_console_cmd(int argc, char **argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "reset"))
+    {
+        ble_mesh_metrics_reset();
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "blob"))
+    {
+        static uint32_t blob[METRICS_BLOB_WORDS];
+        size_t len = ble_mesh_metrics_blob((uint8_t *)blob, sizeof(blob));
+
+        for (size_t i = 0; i < len; i++)
+        {
+            printf("%02x", ((uint8_t *)blob)[i]);
+        }
+        printf("\n");
+        return 0;
+    }
+
+    if (argc > 1)
+    {
+        printf("usage: %s [blob|reset]\n", argv[0]);
+        return 1;
+    }
+
+    ble_mesh_metrics_dump();
+    return 0;
+}
+
+esp_err_t ble_mesh_metrics_register_console(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "mesh_metrics",
+        .help = "Mesh send/status counters, latency histograms, stage durations and high-water marks. "
+                "'blob' prints the binary snapshot as hex, 'reset' clears all metrics.",
+        .hint = "[blob|reset]",
+        .func = metrics_console_cmd,
+    };
+    esp_err_t error = esp_console_cmd_register(&cmd);
+
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: failed to register command (err %d)", __func__, error);
+    }
+
+    return error;
+}
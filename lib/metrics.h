@@ -0,0 +1,72 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_METRICS_H
+#define DEZIBOT_BLUETOOTH_MESH_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Distinct opcodes tracked, further opcodes are counted in the last entry
+#define METRICS_OPCODES         24
+
+// Bucket 0 holds latencies below 1 ms, bucket i those in [2^(i-1), 2^i) ms,
+// the last one everything above
+#define METRICS_HIST_BUCKETS    16
+
+#define METRICS_BLOB_MAGIC      0x544d5a44  // "DZMT"
+#define METRICS_BLOB_VERSION    2
+
+typedef enum {
+    METRICS_OK,
+    METRICS_FAIL,       // rejected by the node or the stack
+    METRICS_TIMEOUT,    // no status before the stack gave up
+} ble_mesh_metrics_outcome_t;
+
+typedef enum {
+    METRICS_STAGE_PROVISION,    // provisioning link open to complete
+    METRICS_STAGE_COMP_DATA,    // each configuration step, including its retries
+    METRICS_STAGE_APP_KEY,
+    METRICS_STAGE_MODEL_BIND,
+    METRICS_STAGE_MODEL_SUB,
+    METRICS_STAGE_AGGREGATE,    // all Opcodes Aggregator sequences of a node
+    METRICS_STAGE_OPERATIONAL,  // provisioning complete to fully configured
+    METRICS_STAGE_COUNT,
+} ble_mesh_metrics_stage_t;
+
+// High-water marks of our own buffers; the stack's ADV and net_buf pools are not
+// exposed through its API, so the ADV credits the sender hands out stand in for them
+typedef enum {
+    METRICS_GAUGE_ADV_CREDITS,  // ADV buffers occupied by our own messages
+    METRICS_GAUGE_TX_QUEUE,
+    METRICS_GAUGE_ACK_PENDING,
+    METRICS_GAUGE_CFG_IN_FLIGHT,
+    METRICS_GAUGE_COUNT,
+} ble_mesh_metrics_gauge_t;
+
+// Blob layout, every field a little endian uint32:
+//   magic, version, METRICS_OPCODES, METRICS_STAGE_COUNT, METRICS_GAUGE_COUNT, METRICS_HIST_BUCKETS
+//   per opcode: opcode, sent, ok, fail, timeout, histogram[METRICS_HIST_BUCKETS]
+//   per stage:  count, sum_ms, max_ms, histogram[METRICS_HIST_BUCKETS]
+//   per gauge:  high-water mark
+#define METRICS_BLOB_WORDS (6 + METRICS_OPCODES * (5 + METRICS_HIST_BUCKETS) \
+                            + METRICS_STAGE_COUNT * (3 + METRICS_HIST_BUCKETS) + METRICS_GAUGE_COUNT)
+#define METRICS_BLOB_SIZE  (METRICS_BLOB_WORDS * sizeof(uint32_t))
+
+// Recorders, cheap and safe from any task including the mesh stack's callbacks
+void ble_mesh_metrics_sent(uint32_t opcode);
+void ble_mesh_metrics_result(uint32_t opcode, ble_mesh_metrics_outcome_t outcome, int64_t latency_us);
+void ble_mesh_metrics_stage(ble_mesh_metrics_stage_t stage, int64_t duration_us);
+void ble_mesh_metrics_gauge(ble_mesh_metrics_gauge_t gauge, uint32_t value);
+
+void ble_mesh_metrics_reset(void);
+
+// Prints a human readable snapshot to stdout
+void ble_mesh_metrics_dump(void);
+
+// Writes the snapshot to buf, returns its size or 0 if len is below METRICS_BLOB_SIZE
+size_t ble_mesh_metrics_blob(uint8_t *buf, size_t len);
+
+// Registers the "mesh_metrics [blob|reset]" console command
+esp_err_t ble_mesh_metrics_register_console(void);
+
+#endif //DEZIBOT_BLUETOOTH_MESH_METRICS_H
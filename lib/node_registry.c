@@ -0,0 +1,275 @@
+#include "node_registry.h"
+
+#include <string.h>
+
+#define ADDR_UNASSIGNED     0x0000
+#define ADDR_IS_UNICAST(a)  ((a) != ADDR_UNASSIGNED && (a) < 0x8000)
+
+// Open addressing table kept at most half full, entries hold slot index + 1
+#define UUID_INDEX_SIZE     (NODE_REGISTRY_MAX_NODES * 2)
+#define UUID_INDEX_EMPTY    0
+
+static esp_ble_mesh_node_info_t nodes[NODE_REGISTRY_MAX_NODES];
+
+static uint16_t uuid_index[UUID_INDEX_SIZE];
+
+// Slot indexes of used nodes, sorted by unicast address
+static uint16_t addr_index[NODE_REGISTRY_MAX_NODES];
+static uint16_t addr_count;
+
+static uint16_t free_slots[NODE_REGISTRY_MAX_NODES];
+static uint16_t free_count;
+
+static uint32_t uuid_hash(const uint8_t uuid[16])
+{
+    // FNV-1a, the device UUID only varies in the BD_ADDR bytes
+    uint32_t hash = 2166136261u;
+
+    for (int i = 0; i < 16; i++)
+    {
+        hash ^= uuid[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static uint32_t uuid_index_probe(const uint8_t uuid[16])
+{
+    uint32_t pos = uuid_hash(uuid) % UUID_INDEX_SIZE;
+
+    while (uuid_index[pos] != UUID_INDEX_EMPTY)
+    {
+        if (!memcmp(nodes[uuid_index[pos] - 1].uuid, uuid, 16))
+        {
+            break;
+        }
+        pos = (pos + 1) % UUID_INDEX_SIZE;
+    }
+
+    return pos;
+}
+
+static void uuid_index_delete(uint32_t pos)
+{
+    // Backward shift deletion keeps probe chains intact without tombstones
+    uint32_t next = pos;
+
+    uuid_index[pos] = UUID_INDEX_EMPTY;
+
+    for (;;)
+    {
+        next = (next + 1) % UUID_INDEX_SIZE;
+        if (uuid_index[next] == UUID_INDEX_EMPTY)
+        {
+            return;
+        }
+
+        uint32_t home = uuid_hash(nodes[uuid_index[next] - 1].uuid) % UUID_INDEX_SIZE;
+        bool movable = (pos <= next) ? (home <= pos || home > next) : (home <= pos && home > next);
+        if (movable)
+        {
+            uuid_index[pos] = uuid_index[next];
+            uuid_index[next] = UUID_INDEX_EMPTY;
+            pos = next;
+        }
+    }
+}
+
+// First position in addr_index whose node starts above addr
+static uint16_t addr_index_upper_bound(uint16_t addr)
+{
+    uint16_t lo = 0;
+    uint16_t hi = addr_count;
+
+    while (lo < hi)
+    {
+        uint16_t mid = lo + (hi - lo) / 2;
+        if (nodes[addr_index[mid]].unicast <= addr)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static void addr_index_insert(uint16_t slot)
+{
+    uint16_t pos = addr_index_upper_bound(nodes[slot].unicast);
+
+    memmove(&addr_index[pos + 1], &addr_index[pos], (addr_count - pos) * sizeof(addr_index[0]));
+    addr_index[pos] = slot;
+    addr_count++;
+}
+
+static void addr_index_delete(uint16_t slot)
+{
+    uint16_t pos = addr_index_upper_bound(nodes[slot].unicast);
+
+    while (pos > 0 && addr_index[pos - 1] != slot)
+    {
+        pos--;
+    }
+    if (pos == 0)
+    {
+        return;
+    }
+
+    pos--;
+    memmove(&addr_index[pos], &addr_index[pos + 1], (addr_count - pos - 1) * sizeof(addr_index[0]));
+    addr_count--;
+}
+
+static void release_slot(uint16_t slot)
+{
+    uuid_index_delete(uuid_index_probe(nodes[slot].uuid));
+    addr_index_delete(slot);
+    memset(&nodes[slot], 0, sizeof(nodes[slot]));
+    free_slots[free_count++] = slot;
+}
+
+static void evict_overlapping(uint16_t unicast, uint8_t elem_num, uint16_t keep)
+{
+    uint16_t pos = addr_index_upper_bound(unicast + elem_num - 1);
+
+    while (pos > 0)
+    {
+        uint16_t slot = addr_index[pos - 1];
+        if (nodes[slot].unicast + nodes[slot].elem_num <= unicast)
+        {
+            break;
+        }
+        if (slot != keep)
+        {
+            release_slot(slot);
+        }
+        pos--;
+    }
+}
+
+void ble_mesh_registry_init(void)
+{
+    memset(nodes, 0, sizeof(nodes));
+    memset(uuid_index, 0, sizeof(uuid_index));
+    addr_count = 0;
+
+    for (free_count = 0; free_count < NODE_REGISTRY_MAX_NODES; free_count++)
+    {
+        free_slots[free_count] = NODE_REGISTRY_MAX_NODES - 1 - free_count;
+    }
+}
+
+esp_ble_mesh_node_info_t *ble_mesh_registry_store(const uint8_t uuid[16], uint16_t unicast, uint8_t elem_num)
+{
+    uint32_t pos;
+    uint16_t slot;
+
+    if (!uuid || !ADDR_IS_UNICAST(unicast) || elem_num == 0 || !ADDR_IS_UNICAST(unicast + elem_num - 1))
+    {
+        return NULL;
+    }
+
+    pos = uuid_index_probe(uuid);
+    if (uuid_index[pos] != UUID_INDEX_EMPTY)
+    {
+        slot = uuid_index[pos] - 1;
+        addr_index_delete(slot);
+        evict_overlapping(unicast, elem_num, slot);
+    }
+    else
+    {
+        evict_overlapping(unicast, elem_num, NODE_REGISTRY_MAX_NODES);
+        if (free_count == 0)
+        {
+            return NULL;
+        }
+
+        // Evictions may have moved entries, probe again for a free position
+        pos = uuid_index_probe(uuid);
+        slot = free_slots[--free_count];
+        memcpy(nodes[slot].uuid, uuid, 16);
+        uuid_index[pos] = slot + 1;
+    }
+
+    nodes[slot].unicast = unicast;
+    nodes[slot].elem_num = elem_num;
+    addr_index_insert(slot);
+
+    return &nodes[slot];
+}
+
+esp_ble_mesh_node_info_t *ble_mesh_registry_find_uuid(const uint8_t uuid[16])
+{
+    uint32_t pos;
+
+    if (!uuid)
+    {
+        return NULL;
+    }
+
+    pos = uuid_index_probe(uuid);
+    if (uuid_index[pos] == UUID_INDEX_EMPTY)
+    {
+        return NULL;
+    }
+
+    return &nodes[uuid_index[pos] - 1];
+}
+
+esp_ble_mesh_node_info_t *ble_mesh_registry_find_addr(uint16_t addr)
+{
+    esp_ble_mesh_node_info_t *node;
+    uint16_t pos;
+
+    if (!ADDR_IS_UNICAST(addr))
+    {
+        return NULL;
+    }
+
+    pos = addr_index_upper_bound(addr);
+    if (pos == 0)
+    {
+        return NULL;
+    }
+
+    node = &nodes[addr_index[pos - 1]];
+    if (addr >= node->unicast + node->elem_num)
+    {
+        return NULL;
+    }
+
+    return node;
+}
+
+esp_err_t ble_mesh_registry_remove(esp_ble_mesh_node_info_t *node)
+{
+    if (!node || node < nodes || node >= nodes + NODE_REGISTRY_MAX_NODES
+        || node->unicast == ADDR_UNASSIGNED)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    release_slot(node - nodes);
+
+    return ESP_OK;
+}
+
+size_t ble_mesh_registry_count(void)
+{
+    return addr_count;
+}
+
+esp_ble_mesh_node_info_t *ble_mesh_registry_at(size_t index)
+{
+    if (index >= addr_count)
+    {
+        return NULL;
+    }
+
+    return &nodes[addr_index[index]];
+}
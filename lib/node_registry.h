@@ -0,0 +1,82 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_NODE_REGISTRY_H
+#define DEZIBOT_BLUETOOTH_MESH_NODE_REGISTRY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+// Number of node slots; may be raised above the stack limit for host builds
+#ifndef NODE_REGISTRY_MAX_NODES
+#define NODE_REGISTRY_MAX_NODES CONFIG_BLE_MESH_MAX_PROV_NODES
+#endif
+
+// Composition data page 0 kept per node, larger pages are not cached
+#define NODE_REGISTRY_COMP_MAX  64
+
+// Elements per node whose server models are indexed
+#define NODE_REGISTRY_ELEMS_MAX 4
+
+typedef struct {
+    uint8_t  uuid[16];
+    uint16_t unicast;
+    uint8_t  elem_num;
+    uint8_t  team;          // index of its subnet and AppKey, from its provisioning
+
+    // Configuration pipeline state, owned by the provisioner
+    uint8_t  cfg_state;
+    uint8_t  cfg_retries;
+    uint8_t  cfg_sub_idx;   // next group subscription to add
+    uint8_t  cfg_bind_idx;  // next model to bind, element * bind models + model
+    uint8_t  cfg_agg_idx;   // items of the aggregated chain confirmed so far
+    uint8_t  cfg_round_trips;   // configuration requests since provisioning, retries included
+    bool     cfg_aggregated;    // configured through the Opcodes Aggregator
+    bool     cfg_in_flight;
+    int64_t  cfg_next_us;
+    int64_t  cfg_sent_us;   // last request of the current step handed to the stack
+    int64_t  cfg_step_us;   // current step started, retries included
+    int64_t  prov_time_us;
+    int64_t  ready_time_us;
+
+    // Heartbeat publication and neighbor probes after configuration, owned by the provisioner
+    uint8_t  topo_step;
+    uint8_t  topo_retries;
+    bool     topo_in_flight;
+    int64_t  topo_next_us;
+
+    // Confirmed configuration, persisted by node_store
+    uint16_t cfg_groups[CONFIG_BLE_MESH_MODEL_GROUP_COUNT];     // subscriptions acknowledged by the node
+    uint8_t  comp_len;      // 0 while unknown
+    uint8_t  comp[NODE_REGISTRY_COMP_MAX];
+
+    // Server models per element, a bit per entry of the provisioner's bind list.
+    // Derived from comp, all zero while the composition data is unknown.
+    uint16_t models[NODE_REGISTRY_ELEMS_MAX];
+    bool     agg_srv;       // Opcodes Aggregator Server on the primary element
+    bool     store_dirty;
+} esp_ble_mesh_node_info_t;
+
+// Clears all slots and indexes
+void ble_mesh_registry_init(void);
+
+// Inserts a node or updates the node already registered with the same UUID.
+// Stale entries whose address range overlaps the new range are evicted.
+esp_ble_mesh_node_info_t *ble_mesh_registry_store(const uint8_t uuid[16], uint16_t unicast, uint8_t elem_num);
+
+// O(1) expected lookup through the UUID hash index
+esp_ble_mesh_node_info_t *ble_mesh_registry_find_uuid(const uint8_t uuid[16]);
+
+// O(log n) lookup of the node owning an element address
+esp_ble_mesh_node_info_t *ble_mesh_registry_find_addr(uint16_t addr);
+
+// Frees the slot of a registered node and drops it from both indexes
+esp_err_t ble_mesh_registry_remove(esp_ble_mesh_node_info_t *node);
+
+size_t ble_mesh_registry_count(void);
+
+// Returns the index-th node in ascending unicast order, or NULL past the end
+esp_ble_mesh_node_info_t *ble_mesh_registry_at(size_t index);
+
+#endif //DEZIBOT_BLUETOOTH_MESH_NODE_REGISTRY_H
@@ -0,0 +1,316 @@
+#include "node_store.h"
+#include "team.h"
+
+#include "nvs.h"
+
+#define TAG                 "NODE_STORE"
+
+#define STORE_NAMESPACE     "mesh_prov"
+#define STORE_META_KEY      "meta"
+#define STORE_NODE_PREFIX   'n'
+
+// Records that fail validation are erased once the iteration is done
+#define STORE_STALE_MAX     16
+
+// Little endian records, variable length through the composition data:
+//   meta: version, net_idx, app_idx, app_key[16]
+//   node: version, cfg_state, elem_num, comp_len, unicast, uuid[16], ttop_ms,
+//         cfg_groups[CONFIG_BLE_MESH_MODEL_GROUP_COUNT], comp[comp_len]
+#define META_LEN            (1 + 2 + 2 + 16)
+#define NODE_HEADER_LEN     (4 + 2 + 16 + 4 + 2 * CONFIG_BLE_MESH_MODEL_GROUP_COUNT)
+#define NODE_RECORD_MAX     (NODE_HEADER_LEN + NODE_REGISTRY_COMP_MAX)
+
+#define TTOP_NOT_READY      UINT32_MAX
+
+static nvs_handle_t store_handle;
+static bool store_opened;
+
+static void put_le16(uint8_t *buf, uint16_t val)
+{
+    buf[0] = val;
+    buf[1] = val >> 8;
+}
+
+static uint16_t get_le16(const uint8_t *buf)
+{
+    return buf[0] | buf[1] << 8;
+}
+
+static void put_le32(uint8_t *buf, uint32_t val)
+{
+    put_le16(buf, val);
+    put_le16(buf + 2, val >> 16);
+}
+
+static uint32_t get_le32(const uint8_t *buf)
+{
+    return get_le16(buf) | (uint32_t)get_le16(buf + 2) << 16;
+}
+
+// The UUID of a robot carries its BD_ADDR in bytes 2..7, see ble_mesh_get_dev_uuid()
+static void node_key(const uint8_t uuid[16], char key[NVS_KEY_NAME_MAX_SIZE])
+{
+    snprintf(key, NVS_KEY_NAME_MAX_SIZE, "%c%02x%02x%02x%02x%02x%02x", STORE_NODE_PREFIX,
+             uuid[2], uuid[3], uuid[4], uuid[5], uuid[6], uuid[7]);
+}
+
+static size_t node_encode(const esp_ble_mesh_node_info_t *node, uint8_t *buf)
+{
+    uint8_t *pos = buf;
+    uint32_t ttop_ms = node->ready_time_us ? (node->ready_time_us - node->prov_time_us) / 1000 : TTOP_NOT_READY;
+
+    *pos++ = NODE_STORE_VERSION;
+    *pos++ = node->cfg_state;
+    *pos++ = node->elem_num;
+    *pos++ = node->comp_len;
+    put_le16(pos, node->unicast);
+    pos += 2;
+    memcpy(pos, node->uuid, 16);
+    pos += 16;
+    put_le32(pos, ttop_ms);
+    pos += 4;
+    for (int i = 0; i < CONFIG_BLE_MESH_MODEL_GROUP_COUNT; i++)
+    {
+        put_le16(pos, node->cfg_groups[i]);
+        pos += 2;
+    }
+    memcpy(pos, node->comp, node->comp_len);
+    pos += node->comp_len;
+
+    return pos - buf;
+}
+
+// Checks a record against the stack's own node database and loads it into the registry
+static bool node_decode(const uint8_t *buf, size_t len, int64_t now, ble_mesh_store_migrate_cb_t migrate)
+{
+    const esp_ble_mesh_node_t *known;
+    esp_ble_mesh_node_info_t *node;
+    uint16_t unicast;
+    uint32_t ttop_ms;
+
+    if (len < NODE_HEADER_LEN || buf[0] < NODE_STORE_VERSION_MIN || buf[0] > NODE_STORE_VERSION
+        || buf[3] > NODE_REGISTRY_COMP_MAX
+        || len != NODE_HEADER_LEN + buf[3])
+    {
+        return false;
+    }
+
+    unicast = get_le16(buf + 4);
+    known = esp_ble_mesh_provisioner_get_node_with_uuid(buf + 6);
+    if (!known || known->unicast_addr != unicast || known->element_num != buf[2])
+    {
+        return false;
+    }
+
+    node = ble_mesh_registry_store(buf + 6, unicast, buf[2]);
+    if (!node)
+    {
+        return false;
+    }
+
+    // The subnet is the stack's to keep, it is part of the node's provisioning
+    node->team = BLE_MESH_NET_IDX_TEAM(known->net_idx);
+    node->cfg_state = buf[1];
+    node->comp_len = buf[3];
+    for (int i = 0; i < CONFIG_BLE_MESH_MODEL_GROUP_COUNT; i++)
+    {
+        node->cfg_groups[i] = get_le16(buf + 26 + 2 * i);
+    }
+    memcpy(node->comp, buf + NODE_HEADER_LEN, node->comp_len);
+
+    // Operational nodes keep the time they originally needed, a ready time of 0
+    // would read as not operational
+    ttop_ms = get_le32(buf + 22);
+    node->prov_time_us = now;
+    if (ttop_ms != TTOP_NOT_READY)
+    {
+        node->ready_time_us = MAX(now, 1);
+        node->prov_time_us = now - (int64_t)ttop_ms * 1000;
+    }
+    node->cfg_step_us = now;
+
+    if (buf[0] != NODE_STORE_VERSION && (!migrate || !migrate(node, buf[0])))
+    {
+        ble_mesh_registry_remove(node);
+        return false;
+    }
+
+    return true;
+}
+
+esp_err_t ble_mesh_store_open(uint16_t net_idx, uint16_t app_idx, const uint8_t app_key[16])
+{
+    uint8_t meta[META_LEN];
+    uint8_t stored[META_LEN];
+    size_t len = sizeof(stored);
+    esp_err_t error;
+
+    error = nvs_open(STORE_NAMESPACE, NVS_READWRITE, &store_handle);
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: open namespace failed (err %d)", __func__, error);
+        return error;
+    }
+    store_opened = true;
+
+    meta[0] = NODE_STORE_VERSION;
+    put_le16(meta + 1, net_idx);
+    put_le16(meta + 3, app_idx);
+    memcpy(meta + 5, app_key, 16);
+
+    // Records of older versions stay for migration, the meta record is brought up to date
+    error = nvs_get_blob(store_handle, STORE_META_KEY, stored, &len);
+    if (error == ESP_OK && len == sizeof(stored) && stored[0] >= NODE_STORE_VERSION_MIN
+        && stored[0] <= NODE_STORE_VERSION && !memcmp(meta + 1, stored + 1, sizeof(meta) - 1))
+    {
+        if (stored[0] == NODE_STORE_VERSION)
+        {
+            return ESP_OK;
+        }
+
+        ESP_LOGI(TAG, "%s: migrating node records from version %u", __func__, stored[0]);
+        error = nvs_set_blob(store_handle, STORE_META_KEY, meta, sizeof(meta));
+        if (error == ESP_OK)
+        {
+            error = nvs_commit(store_handle);
+        }
+        if (error != ESP_OK)
+        {
+            ESP_LOGE(TAG, "%s: write meta record failed (err %d)", __func__, error);
+        }
+        return error;
+    }
+
+    if (error == ESP_OK)
+    {
+        ESP_LOGW(TAG, "%s: format or AppKey changed, dropping stored nodes", __func__);
+    }
+
+    error = nvs_erase_all(store_handle);
+    if (error == ESP_OK)
+    {
+        error = nvs_set_blob(store_handle, STORE_META_KEY, meta, sizeof(meta));
+    }
+    if (error == ESP_OK)
+    {
+        error = nvs_commit(store_handle);
+    }
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: write meta record failed (err %d)", __func__, error);
+    }
+
+    return error;
+}
+
+esp_err_t ble_mesh_store_restore(ble_mesh_store_migrate_cb_t migrate, size_t *restored)
+{
+    char stale[STORE_STALE_MAX][NVS_KEY_NAME_MAX_SIZE];
+    size_t stale_count = 0;
+    uint8_t record[NODE_RECORD_MAX];
+    nvs_iterator_t it = NULL;
+    int64_t now = esp_timer_get_time();
+    esp_err_t error;
+
+    *restored = 0;
+    if (!store_opened)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    error = nvs_entry_find(NVS_DEFAULT_PART_NAME, STORE_NAMESPACE, NVS_TYPE_BLOB, &it);
+    while (error == ESP_OK)
+    {
+        nvs_entry_info_t info;
+        size_t len = sizeof(record);
+
+        nvs_entry_info(it, &info);
+        if (info.key[0] == STORE_NODE_PREFIX)
+        {
+            if (nvs_get_blob(store_handle, info.key, record, &len) == ESP_OK && node_decode(record, len, now, migrate))
+            {
+                (*restored)++;
+            }
+            else if (stale_count < STORE_STALE_MAX)
+            {
+                memcpy(stale[stale_count++], info.key, NVS_KEY_NAME_MAX_SIZE);
+            }
+        }
+        error = nvs_entry_next(&it);
+    }
+    nvs_release_iterator(it);
+
+    if (error != ESP_ERR_NVS_NOT_FOUND)
+    {
+        ESP_LOGE(TAG, "%s: iterate namespace failed (err %d)", __func__, error);
+        return error;
+    }
+
+    for (size_t i = 0; i < stale_count; i++)
+    {
+        nvs_erase_key(store_handle, stale[i]);
+    }
+    if (stale_count)
+    {
+        ESP_LOGW(TAG, "%s: erased %u stale node records", __func__, (unsigned)stale_count);
+        nvs_commit(store_handle);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t ble_mesh_store_node(const esp_ble_mesh_node_info_t *node)
+{
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint8_t record[NODE_RECORD_MAX];
+    size_t len;
+    esp_err_t error;
+
+    if (!store_opened)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    node_key(node->uuid, key);
+    len = node_encode(node, record);
+
+    error = nvs_set_blob(store_handle, key, record, len);
+    if (error == ESP_OK)
+    {
+        error = nvs_commit(store_handle);
+    }
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: node 0x%04x write failed (err %d)", __func__, node->unicast, error);
+    }
+
+    return error;
+}
+
+esp_err_t ble_mesh_store_erase_node(const esp_ble_mesh_node_info_t *node)
+{
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    esp_err_t error;
+
+    if (!store_opened)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    node_key(node->uuid, key);
+    error = nvs_erase_key(store_handle, key);
+    if (error == ESP_ERR_NVS_NOT_FOUND)
+    {
+        return ESP_OK;
+    }
+    if (error == ESP_OK)
+    {
+        error = nvs_commit(store_handle);
+    }
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: node 0x%04x erase failed (err %d)", __func__, node->unicast, error);
+    }
+
+    return error;
+}
@@ -0,0 +1,31 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_NODE_STORE_H
+#define DEZIBOT_BLUETOOTH_MESH_NODE_STORE_H
+
+#include "common.h"
+#include "node_registry.h"
+
+// Bump when the record layout or meaning changes. Records from NODE_STORE_VERSION_MIN
+// on are handed to the migration callback, older ones are dropped.
+#define NODE_STORE_VERSION      3
+#define NODE_STORE_VERSION_MIN  1
+
+// Brings a node loaded from a record of an older version up to date, false drops it
+typedef bool (*ble_mesh_store_migrate_cb_t)(esp_ble_mesh_node_info_t *node, uint8_t version);
+
+// Opens the provisioner's NVS namespace. All records are dropped when the stored
+// format version is too old or the AppKey differs; the provisioner then configures the nodes the
+// stack still knows again, from composition data on.
+esp_err_t ble_mesh_store_open(uint16_t net_idx, uint16_t app_idx, const uint8_t app_key[16]);
+
+// Loads every record into the registry in one pass over the namespace. Records of
+// nodes the mesh stack no longer knows at the same address are erased, as are those
+// migrate refuses.
+esp_err_t ble_mesh_store_restore(ble_mesh_store_migrate_cb_t migrate, size_t *restored);
+
+// Writes the record of one node, keyed by the BD_ADDR part of its UUID
+esp_err_t ble_mesh_store_node(const esp_ble_mesh_node_info_t *node);
+
+// Erases the record of a node removed from the mesh, ESP_OK when there was none
+esp_err_t ble_mesh_store_erase_node(const esp_ble_mesh_node_info_t *node);
+
+#endif //DEZIBOT_BLUETOOTH_MESH_NODE_STORE_H
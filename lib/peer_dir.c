@@ -0,0 +1,216 @@
+#include "peer_dir.h"
+#include "team.h"
+
+typedef struct {
+    uint16_t addr;          // unassigned when free
+    uint16_t net_idx;       // subnet last heard on
+    uint16_t heard;         // servers that answered, a bit per peer_models entry
+    uint16_t silent;        // servers taken to be missing since silent_us
+    uint32_t timeouts;      // unanswered requests in a row, two bits per server
+    int64_t  heard_us;
+    int64_t  silent_us;
+} peer_entry_t;
+
+// The servers a client talks to, the bit order of heard, silent and timeouts
+static const uint16_t peer_models[] = {
+    ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_LEVEL_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_DEF_TRANS_TIME_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_POWER_LEVEL_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_POWER_LEVEL_SETUP_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_BATTERY_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_LOCATION_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_LOCATION_SETUP_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_USER_PROP_SRV,
+};
+
+_Static_assert(ARRAY_SIZE(peer_models) <= 16, "heard and silent are 16 bits wide");
+_Static_assert(PEER_DIR_SILENT_MAX <= 3, "timeouts are counted in two bits");
+
+static portMUX_TYPE peer_lock = portMUX_INITIALIZER_UNLOCKED;
+static peer_entry_t entries[PEER_DIR_SIZE];
+static ble_mesh_peer_stats_t stats;
+
+static int peer_model_bit(uint16_t model_id)
+{
+    for (int i = 0; i < ARRAY_SIZE(peer_models); i++)
+    {
+        if (peer_models[i] == model_id)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// The entry of addr, with verdicts older than PEER_DIR_SILENT_HOLD_MS dropped; NULL if
+// another address holds the slot. peer_lock held.
+static peer_entry_t *peer_find(uint16_t addr, int64_t now)
+{
+    peer_entry_t *entry = &entries[addr % PEER_DIR_SIZE];
+
+    if (!ESP_BLE_MESH_ADDR_IS_UNICAST(addr) || entry->addr != addr)
+    {
+        return NULL;
+    }
+    if (entry->silent && now - entry->silent_us > PEER_DIR_SILENT_HOLD_MS * 1000LL)
+    {
+        entry->silent = 0;
+    }
+
+    return entry;
+}
+
+void ble_mesh_peer_heard(uint16_t src, uint16_t net_idx, uint16_t model_id)
+{
+    int64_t now = esp_timer_get_time();
+    int bit = peer_model_bit(model_id);
+    peer_entry_t *entry = &entries[src % PEER_DIR_SIZE];
+
+    if (!ESP_BLE_MESH_ADDR_IS_UNICAST(src) || bit < 0)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL(&peer_lock);
+    if (entry->addr != src)
+    {
+        if (entry->addr != ESP_BLE_MESH_ADDR_UNASSIGNED)
+        {
+            stats.evicted++;
+        }
+        memset(entry, 0, sizeof(*entry));
+        entry->addr = src;
+    }
+    entry->net_idx = net_idx;
+    entry->heard |= 1u << bit;
+    entry->silent &= ~(1u << bit);
+    entry->timeouts &= ~(3u << (bit * 2));
+    entry->heard_us = now;
+    stats.learned++;
+    taskEXIT_CRITICAL(&peer_lock);
+}
+
+void ble_mesh_peer_timeout(uint16_t dst, uint16_t model_id)
+{
+    int64_t now = esp_timer_get_time();
+    int bit = peer_model_bit(model_id);
+    peer_entry_t *entry;
+
+    if (bit < 0)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL(&peer_lock);
+    entry = peer_find(dst, now);
+    // Nothing to learn from an element never heard, it may be gone altogether
+    if (entry && !(entry->heard & 1u << bit) && !(entry->silent & 1u << bit))
+    {
+        uint32_t count = (entry->timeouts >> (bit * 2) & 3) + 1;
+
+        entry->timeouts &= ~(3u << (bit * 2));
+        if (count >= PEER_DIR_SILENT_MAX)
+        {
+            entry->silent |= 1u << bit;
+            entry->silent_us = now;
+            stats.silent++;
+        }
+        else
+        {
+            entry->timeouts |= count << (bit * 2);
+        }
+    }
+    taskEXIT_CRITICAL(&peer_lock);
+}
+
+esp_err_t ble_mesh_peer_has_model(uint16_t addr, uint16_t model_id)
+{
+    int64_t now = esp_timer_get_time();
+    int bit = peer_model_bit(model_id);
+    esp_err_t error = ESP_ERR_NOT_FOUND;
+    peer_entry_t *entry;
+
+    if (bit < 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    taskENTER_CRITICAL(&peer_lock);
+    entry = peer_find(addr, now);
+    if (entry && entry->heard & 1u << bit)
+    {
+        error = ESP_OK;
+    }
+    else if (entry && entry->silent & 1u << bit)
+    {
+        error = ESP_ERR_NOT_SUPPORTED;
+    }
+    taskEXIT_CRITICAL(&peer_lock);
+
+    return error;
+}
+
+esp_err_t ble_mesh_peer_get_team(uint16_t addr, uint8_t *team)
+{
+    int64_t now = esp_timer_get_time();
+    peer_entry_t *entry;
+
+    if (!team)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    taskENTER_CRITICAL(&peer_lock);
+    entry = peer_find(addr, now);
+    if (entry)
+    {
+        *team = BLE_MESH_NET_IDX_TEAM(entry->net_idx);
+    }
+    taskEXIT_CRITICAL(&peer_lock);
+
+    return entry ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+size_t ble_mesh_peer_get_members(uint8_t team, uint16_t model_id, uint16_t *addrs, size_t max)
+{
+    int64_t now = esp_timer_get_time();
+    int bit = peer_model_bit(model_id);
+    size_t count = 0;
+
+    if (bit < 0)
+    {
+        return 0;
+    }
+
+    taskENTER_CRITICAL(&peer_lock);
+    for (size_t i = 0; i < PEER_DIR_SIZE && count < max; i++)
+    {
+        const peer_entry_t *entry = &entries[i];
+        size_t j = count;
+
+        if (entry->addr == ESP_BLE_MESH_ADDR_UNASSIGNED || !(entry->heard & 1u << bit)
+            || BLE_MESH_NET_IDX_TEAM(entry->net_idx) != team || now - entry->heard_us > PEER_DIR_EXPIRE_MS * 1000LL)
+        {
+            continue;
+        }
+        // Slots follow the address modulo the table size, keep them sorted
+        for (; j > 0 && addrs[j - 1] > entry->addr; j--)
+        {
+            addrs[j] = addrs[j - 1];
+        }
+        addrs[j] = entry->addr;
+        count++;
+    }
+    taskEXIT_CRITICAL(&peer_lock);
+
+    return count;
+}
+
+void ble_mesh_peer_get_stats(ble_mesh_peer_stats_t *out)
+{
+    taskENTER_CRITICAL(&peer_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&peer_lock);
+}
@@ -0,0 +1,50 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_PEER_DIR_H
+#define DEZIBOT_BLUETOOTH_MESH_PEER_DIR_H
+
+#include "common.h"
+
+// What a node learns about the other elements from the statuses and publications it
+// hears. Only a provisioner has their composition data and subnets, a client running
+// on a robot of its own has to go by this.
+
+// Elements remembered, direct mapped by unicast address
+#ifndef PEER_DIR_SIZE
+#define PEER_DIR_SIZE           128
+#endif
+
+// Acknowledged requests to a server model that have to time out in a row, while the
+// element answers another model, before it is taken to lack that server
+#define PEER_DIR_SILENT_MAX     3
+
+// A server taken to be missing is asked again after this long, a loss streak may have
+// been mistaken for it
+#define PEER_DIR_SILENT_HOLD_MS 300000
+
+// Elements not heard from for this long no longer count as members of their team
+#define PEER_DIR_EXPIRE_MS      300000
+
+typedef struct {
+    uint32_t learned;       // statuses and publications that updated an entry
+    uint32_t silent;        // servers taken to be missing
+    uint32_t evicted;       // entries replaced by another address mapping to their slot
+} ble_mesh_peer_stats_t;
+
+// Records a status or publication of src's model_id server, received on net_idx
+void ble_mesh_peer_heard(uint16_t src, uint16_t net_idx, uint16_t model_id);
+
+// Records that an acknowledged request to dst's model_id server went unanswered
+void ble_mesh_peer_timeout(uint16_t dst, uint16_t model_id);
+
+// ESP_OK when the server answered, ESP_ERR_NOT_SUPPORTED when it is taken to be missing,
+// ESP_ERR_NOT_FOUND when nothing is known about it
+esp_err_t ble_mesh_peer_has_model(uint16_t addr, uint16_t model_id);
+
+// Team of the subnet addr was last heard on, ESP_ERR_NOT_FOUND if it was not
+esp_err_t ble_mesh_peer_get_team(uint16_t addr, uint8_t *team);
+
+// Elements of the team whose model_id server was heard lately, in ascending order
+size_t ble_mesh_peer_get_members(uint8_t team, uint16_t model_id, uint16_t *addrs, size_t max);
+
+void ble_mesh_peer_get_stats(ble_mesh_peer_stats_t *stats);
+
+#endif //DEZIBOT_BLUETOOTH_MESH_PEER_DIR_H
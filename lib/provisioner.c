@@ -1,5 +1,24 @@
 #include "provisioner.h"
+#include "addr_alloc.h"
+#include "admission.h"
+#include "beacon_filter.h"
+#include "bluetooth.h"
+#include "boot_profile.h"
 #include "common.h"
+#include "comp_data.h"
+#include "dispatcher.h"
+#include "metrics.h"
+#include "node_store.h"
+#include "team.h"
+#include "topology.h"
+#include "trace.h"
+#include "ttl_cache.h"
+
+#include "esp_console.h"
+
+#if CONFIG_BLE_MESH_AGG_CLI
+#include "esp_ble_mesh_agg_model_api.h"
+#endif
 
 #define TAG                 "PROVISIONER"
 
@@ -7,22 +26,140 @@
 
 #define PROV_OWN_ADDR       0x0001
 
-#define MSG_SEND_TTL        3
 #define MSG_TIMEOUT         0
 #define MSG_ROLE            ROLE_PROVISIONER
 
 #define COMP_DATA_PAGE_0    0x00
 
-#define APP_KEY_IDX         0x0000
 #define APP_KEY_OCTET       0x12
 
+// Devices with a team other than the default one
+#define TEAM_ASSIGN_MAX     NODE_REGISTRY_MAX_NODES
+
+// Configuration requests in flight across the whole fleet
+#define CFG_WINDOW          4
+#define CFG_RETRY_MAX       5
+#define CFG_BACKOFF_MIN_MS  250
+#define CFG_BACKOFF_MAX_MS  8000
+
+// Heartbeat configuration requests of operational nodes in flight, they share the
+// window with configuration steps. Failed ones are retried with backoff, without giving up.
+#define TOPO_WINDOW         2
+#define TOPO_RETRY_MS       2000
+#define TOPO_RETRY_MAX_MS   (4 * TOPOLOGY_HB_PERIOD_MS)
+
+// Items per Opcodes Aggregator Sequence, bounded so that the sequence and its status
+// stay around ten segments each
+#define AGG_ITEMS_MAX       128
+
+// Address ranges of devices whose provisioning has not completed, a few per link the
+// stack runs at once. One is held this long after the device last asked for it.
+#define PROV_RESERVED_MAX   (2 * (CONFIG_BLE_MESH_PBA_SAME_TIME + CONFIG_BLE_MESH_PBG_SAME_TIME))
+#define PROV_RESERVE_MS     60000
+// A range is grown this far for a device whose links keep failing behind a taken address
+#define PROV_RESERVE_ELEMS_MAX  16
+
+// Confirmed configuration is written to flash this long after the last change
+#define STORE_DELAY_MS      1000
+
+// Group addresses every node's Generic OnOff Server subscribes to, bounded by the
+// subscription list size of the server models
+#define PROV_GROUPS_MAX     CONFIG_BLE_MESH_MODEL_GROUP_COUNT
+
+// Server models the AppKey is bound to on every element whose composition data
+// lists them, in this order. Their index is the bit in esp_ble_mesh_node_info_t.models.
+static const uint16_t bind_models[] = {
+    ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_LEVEL_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_DEF_TRANS_TIME_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_POWER_LEVEL_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_POWER_LEVEL_SETUP_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_BATTERY_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_LOCATION_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_LOCATION_SETUP_SRV,
+    ESP_BLE_MESH_MODEL_ID_GEN_USER_PROP_SRV,
+};
+
+#define BIND_MODELS         (sizeof(bind_models) / sizeof(bind_models[0]))
+#define BIND_ONOFF          0
+#define BIND_TARGETS        (NODE_REGISTRY_ELEMS_MAX * BIND_MODELS)
+
+typedef enum {
+    NODE_CFG_COMP_DATA_GET,
+    NODE_CFG_AGGREGATE,         // the three steps below in Opcodes Aggregator sequences
+    NODE_CFG_APP_KEY_ADD,
+    NODE_CFG_MODEL_APP_BIND,
+    NODE_CFG_MODEL_SUB_ADD,
+    NODE_CFG_DONE,
+    NODE_CFG_FAILED,
+} node_cfg_state_t;
+
+// Heartbeat steps an operational node cycles through
+typedef enum {
+    TOPO_PUB_SET,               // heartbeats to all nodes, skipped while they arrive
+    TOPO_SUB_SET,               // listen to the next peer for TOPOLOGY_PROBE_MS
+    TOPO_SUB_GET,               // whether that peer was heard directly, then the next one
+} topo_step_t;
+
+// One message of the aggregated chain
+typedef struct {
+    uint32_t opcode;
+    uint8_t  len;           // 0 for a group the node already confirmed
+    uint8_t  params[19];
+    uint16_t group;
+} agg_item_t;
+
+typedef struct {
+    uint8_t  uuid[16];
+    uint16_t unicast;       // 0 for a free entry
+    uint8_t  elem_num;
+    int64_t  time_us;
+} prov_reservation_t;
+
+typedef struct {
+    uint8_t  uuid[16];
+    uint8_t  team;
+} team_assign_t;
+
 static uint8_t dev_uuid[16];
 
-static esp_ble_mesh_node_info_t nodes[CONFIG_BLE_MESH_MAX_PROV_NODES] = {};
+// Keys of every team by team number. Team 0 has the primary subnet and the fixed AppKey,
+// the others a NetKey and AppKey the stack generated.
+static esp_ble_mesh_prov_key_t team_keys[BLE_MESH_TEAMS_MAX];
+// Teams whose keys the stack holds, a bit each
+static uint32_t team_ready;
+// Subnet of new devices, one setting for all links of the stack, and whether only its
+// devices are admitted
+static uint8_t prov_team;
+static bool prov_team_only;
 
-static esp_ble_mesh_prov_key_t prov_key = {};
+static team_assign_t team_assign[TEAM_ASSIGN_MAX];
+static size_t team_assign_count;
 
 static esp_ble_mesh_client_t config_client;
+#if CONFIG_BLE_MESH_AGG_CLI
+static esp_ble_mesh_client_t agg_client;
+#endif
+
+static SemaphoreHandle_t cfg_lock;
+static esp_timer_handle_t cfg_timer;
+static uint8_t cfg_in_flight;
+static uint32_t cfg_retries_total;
+static uint8_t topo_in_flight;
+
+static int64_t link_open_us;
+
+static esp_timer_handle_t store_timer;
+static bool store_pending;
+static int64_t init_time_us;
+static uint16_t restored_count;
+
+static uint16_t prov_groups[PROV_GROUPS_MAX];
+static uint8_t prov_group_count;
+
+static prov_reservation_t prov_reserved[PROV_RESERVED_MAX];
+// Element count assumed for a new device, that of the last provisioned node
+static uint8_t prov_elem_hint = 1;
 
 static esp_ble_mesh_cfg_srv_t config_server = {
     .net_transmit = ESP_BLE_MESH_TRANSMIT(2, 20),
@@ -31,12 +168,15 @@ static esp_ble_mesh_cfg_srv_t config_server = {
     .beacon = ESP_BLE_MESH_BEACON_ENABLED,
     .gatt_proxy = ESP_BLE_MESH_GATT_PROXY_ENABLED,
     .friend_state = ESP_BLE_MESH_FRIEND_NOT_SUPPORTED,
-    .default_ttl = 7
+    .default_ttl = TTL_CACHE_DEFAULT
 };
 
 static esp_ble_mesh_model_t root_models[] = {
     ESP_BLE_MESH_MODEL_CFG_SRV(&config_server),
     ESP_BLE_MESH_MODEL_CFG_CLI(&config_client),
+#if CONFIG_BLE_MESH_AGG_CLI
+    ESP_BLE_MESH_MODEL_AGG_CLI(&agg_client),
+#endif
 };
 
 static esp_ble_mesh_elem_t elements[] = {
@@ -52,7 +192,7 @@ static esp_ble_mesh_comp_t composition = {
 static esp_ble_mesh_prov_t provision = {
     .prov_uuid           = dev_uuid,
     .prov_unicast_addr   = PROV_OWN_ADDR,
-    .prov_start_address  = 0x0005,
+    .prov_start_address  = ADDR_ALLOC_START,
     .prov_attention      = 0x00,
     .prov_algorithm      = 0x00,
     .prov_pub_key_oob    = 0x00,
@@ -69,47 +209,171 @@ static esp_err_t ble_mesh_store_node_info(const uint8_t uuid[16], uint16_t unica
         return ESP_ERR_INVALID_ARG;
     }
 
-    for (int i = 0; i < ARRAY_SIZE(nodes); i++)
+    if (ble_mesh_registry_find_uuid(uuid))
     {
-        if (!memcmp(nodes[i].uuid, uuid, 16))
-        {
-            ESP_LOGW(TAG, "%s: reprovisioned device 0x%04x", __func__, unicast);
-            nodes[i].unicast = unicast;
-            nodes[i].elem_num = elem_num;
-            return ESP_OK;
-        }
+        ESP_LOGW(TAG, "%s: reprovisioned device 0x%04x", __func__, unicast);
+    }
+
+    if (!ble_mesh_registry_store(uuid, unicast, elem_num))
+    {
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+static esp_ble_mesh_node_info_t *ble_mesh_get_node_info(uint16_t unicast)
+{
+    return ble_mesh_registry_find_addr(unicast);
+}
+
+// Address range for a device about to be provisioned, cfg_lock held. A reflashed
+// device the registry still knows gets its previous range back, 0 when the window
+// or the reservations are full.
+static uint16_t prov_reserve_addr(const uint8_t uuid[16], uint8_t *elem_num)
+{
+    esp_ble_mesh_node_info_t *node = ble_mesh_registry_find_uuid(uuid);
+    prov_reservation_t *entry = NULL;
+    uint8_t elem_hint = prov_elem_hint;
+    int64_t now = esp_timer_get_time();
+
+    if (node)
+    {
+        *elem_num = node->elem_num;
+        return node->unicast;
     }
 
-    for (int i = 0; i < ARRAY_SIZE(nodes); i++)
+    for (size_t i = 0; i < PROV_RESERVED_MAX; i++)
     {
-        if (nodes[i].unicast == ESP_BLE_MESH_ADDR_UNASSIGNED)
+        prov_reservation_t *reserved = &prov_reserved[i];
+
+        if (reserved->unicast && !memcmp(reserved->uuid, uuid, 16))
         {
-            memcpy(nodes[i].uuid, uuid, 16);
-            nodes[i].unicast = unicast;
-            nodes[i].elem_num = elem_num;
-            return ESP_OK;
+            // Asking again means its last link failed. Behind a taken address the stack
+            // refuses a node larger than the range, try one twice the size elsewhere.
+            if (!ble_mesh_addr_is_free(reserved->unicast + reserved->elem_num, 1))
+            {
+                elem_hint = MAX(elem_hint, MIN(2 * reserved->elem_num, PROV_RESERVE_ELEMS_MAX));
+            }
+            if (reserved->elem_num >= elem_hint)
+            {
+                reserved->time_us = now;
+                *elem_num = reserved->elem_num;
+                return reserved->unicast;
+            }
         }
+
+        // Devices that stopped asking lost their link or went away; a range taken
+        // before the element count was known may be too short for the node
+        if (reserved->unicast && (now - reserved->time_us > PROV_RESERVE_MS * 1000LL
+            || !memcmp(reserved->uuid, uuid, 16)))
+        {
+            ble_mesh_addr_free(reserved->unicast, reserved->elem_num);
+            reserved->unicast = 0;
+        }
+        if (!reserved->unicast && !entry)
+        {
+            entry = reserved;
+        }
+    }
+
+    if (!entry)
+    {
+        return 0;
     }
 
-    return ESP_FAIL;
+    entry->unicast = ble_mesh_addr_alloc(elem_hint);
+    if (!entry->unicast)
+    {
+        ESP_LOGW(TAG, "%s: no unicast range of %d elements left", __func__, elem_hint);
+        return 0;
+    }
+    memcpy(entry->uuid, uuid, 16);
+    entry->elem_num = elem_hint;
+    entry->time_us = now;
+    *elem_num = entry->elem_num;
+
+    return entry->unicast;
 }
 
-static esp_ble_mesh_node_info_t *ble_mesh_get_node_info(uint16_t unicast)
+// Drops everything kept for a node the stack no longer knows: its share of the
+// configuration windows, its record, topology entry and address range. cfg_lock held.
+static void node_drop(esp_ble_mesh_node_info_t *node)
+{
+    if (node->cfg_in_flight)
+    {
+        cfg_in_flight--;
+    }
+    if (node->topo_in_flight)
+    {
+        topo_in_flight--;
+    }
+    ble_mesh_store_erase_node(node);
+    ble_mesh_topology_forget(node->unicast);
+    ble_mesh_addr_free(node->unicast, node->elem_num);
+    ble_mesh_filter_forget(node->uuid);
+    ble_mesh_registry_remove(node);
+}
+
+// Moves a provisioned device from its reservation or previous range to the range the
+// stack assigned, cfg_lock held
+static void prov_commit_addr(const uint8_t uuid[16], uint16_t unicast, uint8_t elem_num)
 {
-    if (!ESP_BLE_MESH_ADDR_IS_UNICAST(unicast))
+    esp_ble_mesh_node_info_t *node = ble_mesh_registry_find_uuid(uuid);
+
+    // A node with more elements than assumed overlaps the next reservation, that
+    // device gets a new range when it asks again
+    for (size_t i = 0; i < PROV_RESERVED_MAX; i++)
+    {
+        prov_reservation_t *reserved = &prov_reserved[i];
+
+        if (reserved->unicast && (!memcmp(reserved->uuid, uuid, 16)
+            || (reserved->unicast < unicast + elem_num && unicast < reserved->unicast + reserved->elem_num)))
+        {
+            ble_mesh_addr_free(reserved->unicast, reserved->elem_num);
+            reserved->unicast = 0;
+        }
+    }
+    if (node)
+    {
+        ble_mesh_addr_free(node->unicast, node->elem_num);
+    }
+
+    // The stack reassigned the range of nodes overlapping it, they are gone
+    for (uint16_t addr = unicast; addr < unicast + elem_num; addr++)
+    {
+        esp_ble_mesh_node_info_t *stale = ble_mesh_registry_find_addr(addr);
+        if (stale && stale != node)
+        {
+            ESP_LOGW(TAG, "%s: node 0x%04x overlaps 0x%04x+%d, dropped", __func__, stale->unicast, unicast, elem_num);
+            node_drop(stale);
+        }
+    }
+
+    if (ble_mesh_addr_claim(unicast, elem_num) == ESP_ERR_INVALID_STATE)
     {
-        return NULL;
+        ESP_LOGW(TAG, "%s: range 0x%04x+%d is reserved for another device", __func__, unicast, elem_num);
     }
+    prov_elem_hint = elem_num;
+}
+
+static const esp_ble_mesh_prov_key_t *team_key(const esp_ble_mesh_node_info_t *node)
+{
+    return &team_keys[node->team < BLE_MESH_TEAMS_MAX ? node->team : BLE_MESH_TEAM_DEFAULT];
+}
 
-    for (int i = 0; i < ARRAY_SIZE(nodes); i++)
+// Team the device joins at its next provisioning, cfg_lock held when it exists
+static uint8_t team_of_uuid(const uint8_t uuid[16])
+{
+    for (size_t i = 0; i < team_assign_count; i++)
     {
-        if (nodes[i].unicast <= unicast && nodes[i].unicast + nodes[i].elem_num > unicast)
+        if (!memcmp(team_assign[i].uuid, uuid, 16))
         {
-            return &nodes[i];
+            return team_assign[i].team;
         }
     }
 
-    return NULL;
+    return BLE_MESH_TEAM_DEFAULT;
 }
 
 static esp_err_t ble_mesh_set_msg_common(
@@ -125,365 +389,2258 @@ static esp_err_t ble_mesh_set_msg_common(
 
     common->opcode = opcode;
     common->model = model;
-    common->ctx.net_idx = prov_key.net_idx;
-    common->ctx.app_idx = prov_key.app_idx;
+    common->ctx.net_idx = team_key(node)->net_idx;
+    common->ctx.app_idx = team_key(node)->app_idx;
     common->ctx.addr = node->unicast;
-    common->ctx.send_ttl = MSG_SEND_TTL;
+    common->ctx.send_ttl = ble_mesh_ttl_get(node->unicast);
     common->msg_timeout = MSG_TIMEOUT;
 
     return ESP_OK;
 }
 
-static esp_err_t prov_complete(
-    int node_idx,
-    const esp_ble_mesh_octet16_t uuid,
-    uint16_t unicast,
-    uint8_t elem_num,
-    uint16_t net_idx)
+// Schedules a write of the node's record, cfg_lock held
+static void store_mark_dirty(esp_ble_mesh_node_info_t *node)
 {
-    esp_ble_mesh_client_common_param_t common = {};
-    esp_ble_mesh_cfg_client_get_state_t get_state = {};
-    esp_ble_mesh_node_info_t *node = NULL;
-    char name[11] = {0};
-    esp_err_t error;
+    node->store_dirty = true;
+    if (!store_pending && store_timer)
+    {
+        store_pending = true;
+        esp_timer_start_once(store_timer, STORE_DELAY_MS * 1000);
+    }
+}
 
-    ESP_LOGI(TAG, "node index: 0x%x, unicast address: 0x%02x, element num: %d, "
-                  "netkey index: 0x%02x", node_idx, unicast, elem_num, net_idx);
-    ESP_LOGI(TAG, "device uuid: %s", bt_hex(uuid, 16));
+// Writes the records of nodes whose confirmed configuration changed
+static void store_timer_cb(void *arg)
+{
+    esp_ble_mesh_node_info_t *dirty = NULL;
+    size_t count = 0;
 
-    sprintf(name, "%s%d", "NODE-", node_idx);
-    error = esp_ble_mesh_provisioner_set_node_name(node_idx, name);
-    if (error)
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    store_pending = false;
+    if (ble_mesh_registry_count() == 0)
     {
-        ESP_LOGE(TAG, "%s: Set node name failed", __func__);
-        return ESP_FAIL;
+        xSemaphoreGive(cfg_lock);
+        return;
     }
 
-    error = ble_mesh_store_node_info(uuid, unicast, elem_num);
-    if (error)
+    dirty = malloc(ble_mesh_registry_count() * sizeof(*dirty));
+    for (size_t i = 0; dirty && i < ble_mesh_registry_count(); i++)
     {
-        ESP_LOGE(TAG, "%s: Store node info failed", __func__);
-        return ESP_FAIL;
+        esp_ble_mesh_node_info_t *node = ble_mesh_registry_at(i);
+
+        if (node->store_dirty)
+        {
+            node->store_dirty = false;
+            dirty[count++] = *node;
+        }
     }
+    xSemaphoreGive(cfg_lock);
 
-    node = ble_mesh_get_node_info(unicast);
-    if (!node)
+    if (!dirty)
     {
-        ESP_LOGE(TAG, "%s: Get node info failed", __func__);
-        return ESP_FAIL;
+        ESP_LOGE(TAG, "%s: no memory, records stay dirty", __func__);
+        return;
     }
 
-    ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET);
-    get_state.comp_data_get.page = COMP_DATA_PAGE_0;
-    error = esp_ble_mesh_config_client_get_state(&common, &get_state);
-    if (error)
+    // Flash writes happen outside the lock, status callbacks are not held up by them
+    for (size_t i = 0; i < count; i++)
     {
-        ESP_LOGE(TAG, "%s: Send config comp data get failed", __func__);
-        return ESP_FAIL;
-    }
+        if (ble_mesh_store_node(&dirty[i]) == ESP_OK)
+        {
+            continue;
+        }
 
-    return ESP_OK;
+        // Written again with the next batch, unless the node left the registry meanwhile
+        ESP_LOGW(TAG, "%s: record of 0x%04x not written, retrying", __func__, dirty[i].unicast);
+        xSemaphoreTake(cfg_lock, portMAX_DELAY);
+        esp_ble_mesh_node_info_t *node = ble_mesh_registry_find_uuid(dirty[i].uuid);
+        if (node && node->unicast == dirty[i].unicast)
+        {
+            store_mark_dirty(node);
+        }
+        xSemaphoreGive(cfg_lock);
+    }
+    free(dirty);
 }
 
-static void prov_link_open(esp_ble_mesh_prov_bearer_t bearer)
+static void put_le16(uint8_t *buf, uint16_t val)
 {
-    ESP_LOGI(TAG, "%s link open", bearer == ESP_BLE_MESH_PROV_ADV ? "PB-ADV" : "PB-GATT");
+    buf[0] = val;
+    buf[1] = val >> 8;
 }
 
-static void prov_link_close(esp_ble_mesh_prov_bearer_t bearer, uint8_t reason)
+static bool cfg_has_group(const esp_ble_mesh_node_info_t *node, uint16_t group_addr)
 {
-    ESP_LOGI(TAG, "%s link close, reason 0x%02x", bearer == ESP_BLE_MESH_PROV_ADV ? "PB-ADV" : "PB-GATT", reason);
+    for (int i = 0; i < CONFIG_BLE_MESH_MODEL_GROUP_COUNT; i++)
+    {
+        if (node->cfg_groups[i] == group_addr)
+        {
+            return true;
+        }
+    }
+
+    return false;
 }
 
-static void recv_unprov_adv_pkt(
-    uint8_t dev_uuid_param[16],
-    uint8_t addr[BD_ADDR_LEN],
-    esp_ble_mesh_addr_type_t addr_type,
-    uint16_t oob_info, uint8_t adv_type_param,
-    esp_ble_mesh_prov_bearer_t bearer)
+static void cfg_confirm_group(esp_ble_mesh_node_info_t *node, uint16_t group_addr)
 {
-    esp_ble_mesh_unprov_dev_add_t add_dev = {};
-    esp_err_t error;
-
-    ESP_LOGI(TAG, "address: %s, address type: %d, adv type: %d", bt_hex(addr, BD_ADDR_LEN), addr_type, adv_type_param);
-    ESP_LOGI(TAG, "device uuid: %s", bt_hex(dev_uuid_param, 16));
-    ESP_LOGI(TAG, "oob info: %d, bearer: %s", oob_info, (bearer & ESP_BLE_MESH_PROV_ADV) ? "PB-ADV" : "PB-GATT");
-
-    memcpy(add_dev.addr, addr, BD_ADDR_LEN);
-    add_dev.addr_type = addr_type;
-    memcpy(add_dev.uuid, dev_uuid_param, 16);
-    add_dev.oob_info = oob_info;
-    add_dev.bearer = bearer;
-
-    error = esp_ble_mesh_provisioner_add_unprov_dev(&add_dev,
-        (ADD_DEV_RM_AFTER_PROV_FLAG | ADD_DEV_START_PROV_NOW_FLAG | ADD_DEV_FLUSHABLE_DEV_FLAG));
-    if (error)
+    for (int i = 0; i < CONFIG_BLE_MESH_MODEL_GROUP_COUNT && !cfg_has_group(node, group_addr); i++)
     {
-        ESP_LOGE(TAG, "%s: Add unprovisioned device into queue failed", __func__);
+        if (node->cfg_groups[i] == ESP_BLE_MESH_ADDR_UNASSIGNED)
+        {
+            node->cfg_groups[i] = group_addr;
+        }
     }
 }
 
-static void ble_mesh_provisioning_cb(esp_ble_mesh_prov_cb_event_t event, esp_ble_mesh_prov_cb_param_t *param)
+static int bind_model_bit(uint16_t model_id)
 {
-    switch (event)
+    for (int i = 0; i < BIND_MODELS; i++)
     {
-        case ESP_BLE_MESH_PROVISIONER_PROV_ENABLE_COMP_EVT:
-            ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_PROV_ENABLE_COMP_EVT, err_code %d",
-                param->provisioner_prov_enable_comp.err_code);
-            break;
-        case ESP_BLE_MESH_PROVISIONER_PROV_DISABLE_COMP_EVT:
-            ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_PROV_DISABLE_COMP_EVT, err_code %d",
-                param->provisioner_prov_disable_comp.err_code);
-            break;
-        case ESP_BLE_MESH_PROVISIONER_RECV_UNPROV_ADV_PKT_EVT:
-            ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_RECV_UNPROV_ADV_PKT_EVT");
-            recv_unprov_adv_pkt(param->provisioner_recv_unprov_adv_pkt.dev_uuid, param->provisioner_recv_unprov_adv_pkt.addr,
-                                param->provisioner_recv_unprov_adv_pkt.addr_type, param->provisioner_recv_unprov_adv_pkt.oob_info,
-                                param->provisioner_recv_unprov_adv_pkt.adv_type, param->provisioner_recv_unprov_adv_pkt.bearer);
-            break;
-        case ESP_BLE_MESH_PROVISIONER_PROV_LINK_OPEN_EVT:
-            prov_link_open(param->provisioner_prov_link_open.bearer);
-            break;
-        case ESP_BLE_MESH_PROVISIONER_PROV_LINK_CLOSE_EVT:
-            prov_link_close(param->provisioner_prov_link_close.bearer, param->provisioner_prov_link_close.reason);
-            break;
-        case ESP_BLE_MESH_PROVISIONER_PROV_COMPLETE_EVT:
-            prov_complete(param->provisioner_prov_complete.node_idx, param->provisioner_prov_complete.device_uuid,
-                          param->provisioner_prov_complete.unicast_addr, param->provisioner_prov_complete.element_num,
-                          param->provisioner_prov_complete.netkey_idx);
-            break;
-        case ESP_BLE_MESH_PROVISIONER_ADD_UNPROV_DEV_COMP_EVT:
-            ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_ADD_UNPROV_DEV_COMP_EVT, err_code %d",
-                param->provisioner_add_unprov_dev_comp.err_code);
-            break;
-        case ESP_BLE_MESH_PROVISIONER_SET_DEV_UUID_MATCH_COMP_EVT:
-            ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_SET_DEV_UUID_MATCH_COMP_EVT, err_code %d",
-                param->provisioner_set_dev_uuid_match_comp.err_code);
-            break;
-        case ESP_BLE_MESH_PROVISIONER_SET_NODE_NAME_COMP_EVT:
-        {
-            ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_SET_NODE_NAME_COMP_EVT, err_code %d",
-                param->provisioner_set_node_name_comp.err_code);
-
-            if (param->provisioner_set_node_name_comp.err_code == ESP_OK)
-            {
-                const char *name = NULL;
-                name = esp_ble_mesh_provisioner_get_node_name(param->provisioner_set_node_name_comp.node_index);
-                if (!name)
-                {
-                    ESP_LOGE(TAG, "Get node name failed");
-                    return;
-                }
-                ESP_LOGI(TAG, "Node %d name is: %s", param->provisioner_set_node_name_comp.node_index, name);
-            }
-            break;
-        }
-        case ESP_BLE_MESH_PROVISIONER_ADD_LOCAL_APP_KEY_COMP_EVT:
+        if (bind_models[i] == model_id)
         {
-            ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_ADD_LOCAL_APP_KEY_COMP_EVT, err_code %d",
-                param->provisioner_add_app_key_comp.err_code);
-
-            if (param->provisioner_add_app_key_comp.err_code == ESP_OK)
-            {
-                esp_err_t err = 0;
-                prov_key.app_idx = param->provisioner_add_app_key_comp.app_idx;
-                err = esp_ble_mesh_provisioner_bind_app_key_to_local_model(PROV_OWN_ADDR, prov_key.app_idx,
-                        ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_CLI, ESP_BLE_MESH_CID_NVAL);
-                if (err != ESP_OK)
-                {
-                    ESP_LOGE(TAG, "Provisioner bind local model appkey failed");
-                    return;
-                }
-            }
-            break;
+            return i;
         }
-        case ESP_BLE_MESH_PROVISIONER_BIND_APP_KEY_TO_MODEL_COMP_EVT:
-            ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_BIND_APP_KEY_TO_MODEL_COMP_EVT, err_code %d",
-                param->provisioner_bind_app_key_to_model_comp.err_code);
-            break;
-        default:
-            break;
     }
+
+    return -1;
 }
 
-static void ble_mesh_config_client_cb(
-    esp_ble_mesh_cfg_client_cb_event_t event,
-    esp_ble_mesh_cfg_client_cb_param_t *param)
+// Rebuilds the node's model index from its composition data, cfg_lock held
+static void cfg_index_models(esp_ble_mesh_node_info_t *node)
 {
-    esp_ble_mesh_client_common_param_t common = {};
-    esp_ble_mesh_node_info_t *node = NULL;
-    uint32_t opcode;
-    uint16_t addr;
-    esp_err_t error;
+    ble_mesh_comp_data_t comp;
+    uint8_t elem_count;
 
-    opcode = param->params->opcode;
-    addr = param->params->ctx.addr;
-
-    ESP_LOGI(TAG, "%s, error_code = 0x%02x, event = 0x%02x, addr: 0x%04x, opcode: 0x%04" PRIx32,
-             __func__, param->error_code, event, param->params->ctx.addr, opcode);
-
-    if (param->error_code)
+    memset(node->models, 0, sizeof(node->models));
+    node->agg_srv = false;
+    if (!node->comp_len)
     {
-        ESP_LOGE(TAG, "Send config client message failed, opcode 0x%04" PRIx32, opcode);
         return;
     }
 
-    node = ble_mesh_get_node_info(addr);
-    if (!node)
+    if (ble_mesh_comp_data_parse(node->comp, node->comp_len, &comp) != ESP_OK)
     {
-        ESP_LOGE(TAG, "%s: Get node info failed", __func__);
+        ESP_LOGW(TAG, "node 0x%04x: composition data unusable, treated as unknown", node->unicast);
+        node->comp_len = 0;
         return;
     }
 
-    switch (event)
+    node->agg_srv = ble_mesh_comp_data_has_model(&comp, 0, ESP_BLE_MESH_CID_NVAL, ESP_BLE_MESH_MODEL_ID_AGG_SRV);
+    elem_count = MIN(MIN(comp.elem_count, node->elem_num), NODE_REGISTRY_ELEMS_MAX);
+    for (uint8_t elem = 0; elem < elem_count; elem++)
     {
-        case ESP_BLE_MESH_CFG_CLIENT_GET_STATE_EVT:
-            switch (opcode)
-            {
-                case ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET:
-                {
-                    ESP_LOGI(TAG, "composition data %s", bt_hex(param->status_cb.comp_data_status.composition_data->data,
-                             param->status_cb.comp_data_status.composition_data->len));
-                    esp_ble_mesh_cfg_client_set_state_t set_state = {};
-                    ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD);
-                    set_state.app_key_add.net_idx = prov_key.net_idx;
-                    set_state.app_key_add.app_idx = prov_key.app_idx;
-                    memcpy(set_state.app_key_add.app_key, prov_key.app_key, 16);
-                    error = esp_ble_mesh_config_client_set_state(&common, &set_state);
-                    if (error)
-                    {
-                        ESP_LOGE(TAG, "%s: Config AppKey Add failed", __func__);
-                        return;
-                    }
-                    break;
-                }
-                default:
-                    break;
-            }
-            break;
-        case ESP_BLE_MESH_CFG_CLIENT_SET_STATE_EVT:
-            switch (opcode)
-            {
-                case ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD:
-                {
-                    esp_ble_mesh_cfg_client_set_state_t set_state = {};
-                    ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND);
-                    set_state.model_app_bind.element_addr = node->unicast;
-                    set_state.model_app_bind.model_app_idx = prov_key.app_idx;
-                    set_state.model_app_bind.model_id = ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_SRV;
-                    set_state.model_app_bind.company_id = ESP_BLE_MESH_CID_NVAL;
-                    error = esp_ble_mesh_config_client_set_state(&common, &set_state);
-                    if (error)
-                    {
-                        ESP_LOGE(TAG, "%s: Config Model App Bind failed", __func__);
-                        return;
-                    }
-                    break;
-                }
-                /*
-                case ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND:
-                {
-                    esp_ble_mesh_generic_client_get_state_t get_state = {};
-                    ble_mesh_set_msg_common(&common, node, onoff_client.model, ESP_BLE_MESH_MODEL_OP_GEN_ONOFF_GET);
-                    error = esp_ble_mesh_generic_client_get_state(&common, &get_state);
-                    if (error)
-                    {
-                        ESP_LOGE(TAG, "%s: Generic OnOff Get failed", __func__);
-                        return;
-                    }
-                    break;
-                }
-                */
-                default:
-                    break;
-            }
-            break;
-        case ESP_BLE_MESH_CFG_CLIENT_PUBLISH_EVT:
-            switch (opcode)
-            {
-                case ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_STATUS:
-                    ESP_LOG_BUFFER_HEX("composition data %s", param->status_cb.comp_data_status.composition_data->data,
-                                       param->status_cb.comp_data_status.composition_data->len);
-                    break;
-                case ESP_BLE_MESH_MODEL_OP_APP_KEY_STATUS:
-                    break;
-                default:
-                    break;
-            }
-            break;
-        case ESP_BLE_MESH_CFG_CLIENT_TIMEOUT_EVT:
-            switch (opcode)
+        for (int i = 0; i < BIND_MODELS; i++)
+        {
+            if (ble_mesh_comp_data_has_model(&comp, elem, ESP_BLE_MESH_CID_NVAL, bind_models[i]))
             {
-                case ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET:
-                {
-                    esp_ble_mesh_cfg_client_get_state_t get_state = {};
-                    ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET);
-                    get_state.comp_data_get.page = COMP_DATA_PAGE_0;
-                    error = esp_ble_mesh_config_client_get_state(&common, &get_state);
-                    if (error) {
-                        ESP_LOGE(TAG, "%s: Config Composition Data Get failed", __func__);
-                        return;
-                    }
-                    break;
-                }
-                case ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD:
-                {
-                    esp_ble_mesh_cfg_client_set_state_t set_state = {};
-                    ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD);
-                    set_state.app_key_add.net_idx = prov_key.net_idx;
-                    set_state.app_key_add.app_idx = prov_key.app_idx;
-                    memcpy(set_state.app_key_add.app_key, prov_key.app_key, 16);
-                    error = esp_ble_mesh_config_client_set_state(&common, &set_state);
-                    if (error) {
-                        ESP_LOGE(TAG, "%s: Config AppKey Add failed", __func__);
-                        return;
-                    }
-                    break;
-                }
-                case ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND: {
-                    esp_ble_mesh_cfg_client_set_state_t set_state = {};
-                    ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND);
-                    set_state.model_app_bind.element_addr = node->unicast;
-                    set_state.model_app_bind.model_app_idx = prov_key.app_idx;
-                    set_state.model_app_bind.model_id = ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_SRV;
-                    set_state.model_app_bind.company_id = ESP_BLE_MESH_CID_NVAL;
-                    error = esp_ble_mesh_config_client_set_state(&common, &set_state);
-                    if (error)
-                    {
-                        ESP_LOGE(TAG, "%s: Config Model App Bind failed", __func__);
-                        return;
-                    }
-                    break;
-                }
-                default:
-                    break;
+                node->models[elem] |= 1 << i;
             }
-            break;
-        default:
-            ESP_LOGE(TAG, "Not a config client status message event");
-            break;
+        }
     }
 }
 
-static esp_err_t ble_mesh_init(void)
+// Moves the bind cursor to the node's first model at or after target, false past the last
+static bool cfg_next_bind(esp_ble_mesh_node_info_t *node, uint8_t target)
 {
-    uint8_t match[2] = {0xdd, 0xdd};
-    esp_err_t error = ESP_OK;
-
-    prov_key.net_idx = ESP_BLE_MESH_KEY_PRIMARY;
-    prov_key.app_idx = APP_KEY_IDX;
-    memset(prov_key.app_key, APP_KEY_OCTET, sizeof(prov_key.app_key));
+    for (; target < BIND_TARGETS; target++)
+    {
+        if (node->models[target / BIND_MODELS] & 1 << target % BIND_MODELS)
+        {
+            node->cfg_bind_idx = target;
+            return true;
+        }
+    }
 
-    esp_ble_mesh_register_prov_callback(ble_mesh_provisioning_cb);
-    esp_ble_mesh_register_config_client_callback(ble_mesh_config_client_cb);
+    return false;
+}
 
-    error = esp_ble_mesh_init(&provision, &composition);
+// Starts the bind batch. Without composition data only the OnOff Server of the
+// primary element is bound, a node without any known server model skips the step.
+static void cfg_start_bind(esp_ble_mesh_node_info_t *node)
+{
+    node->cfg_bind_idx = 0;
+    if (node->comp_len && !cfg_next_bind(node, 0))
+    {
+        node->cfg_state = NODE_CFG_MODEL_SUB_ADD;
+    }
+}
+
+// The groups are subscribed by the primary OnOff Server
+static bool cfg_subscribes(const esp_ble_mesh_node_info_t *node)
+{
+    return !node->comp_len || node->models[0] & 1 << BIND_ONOFF;
+}
+
+// Models the bind batch of cfg_start_bind() covers
+static uint8_t cfg_bind_count(const esp_ble_mesh_node_info_t *node)
+{
+    uint8_t count = 0;
+
+    if (!node->comp_len)
+    {
+        return 1;
+    }
+
+    for (uint8_t target = 0; target < BIND_TARGETS; target++)
+    {
+        count += !!(node->models[target / BIND_MODELS] & 1 << target % BIND_MODELS);
+    }
+
+    return count;
+}
+
+// The n-th target of the bind batch, element * bind models + model
+static uint8_t cfg_bind_target(const esp_ble_mesh_node_info_t *node, uint8_t n)
+{
+    for (uint8_t target = 0; node->comp_len && target < BIND_TARGETS; target++)
+    {
+        if (node->models[target / BIND_MODELS] & 1 << target % BIND_MODELS && !n--)
+        {
+            return target;
+        }
+    }
+
+    return 0;
+}
+
+// Starts the aggregated chain on nodes with an Opcodes Aggregator Server, the others
+// go through the chain of single messages
+static void cfg_start_agg(esp_ble_mesh_node_info_t *node)
+{
+    node->cfg_agg_idx = 0;
+#if CONFIG_BLE_MESH_AGG_CLI
+    if (node->agg_srv)
+    {
+        return;
+    }
+#endif
+    node->cfg_state = NODE_CFG_APP_KEY_ADD;
+}
+
+// Item k of the aggregated chain: the AppKey, every model of the bind batch, then a
+// subscription per configured group. Returns false past the last item.
+static bool agg_item(const esp_ble_mesh_node_info_t *node, uint8_t k, agg_item_t *item)
+{
+    const esp_ble_mesh_prov_key_t *key = team_key(node);
+    uint8_t binds = cfg_bind_count(node);
+    uint8_t target;
+
+    memset(item, 0, sizeof(*item));
+    if (!k)
+    {
+        // NetKeyIndex and AppKeyIndex packed into three octets
+        item->opcode = ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD;
+        item->params[0] = key->net_idx;
+        item->params[1] = (key->net_idx >> 8 & 0x0f) | (key->app_idx & 0x0f) << 4;
+        item->params[2] = key->app_idx >> 4;
+        memcpy(item->params + 3, key->app_key, 16);
+        item->len = 19;
+        return true;
+    }
+
+    if (k <= binds)
+    {
+        target = cfg_bind_target(node, k - 1);
+        item->opcode = ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND;
+        put_le16(item->params, node->unicast + target / BIND_MODELS);
+        put_le16(item->params + 2, key->app_idx);
+        put_le16(item->params + 4, bind_models[target % BIND_MODELS]);
+        item->len = 6;
+        return true;
+    }
+
+    k -= binds + 1;
+    if (k >= prov_group_count || !cfg_subscribes(node))
+    {
+        return false;
+    }
+
+    item->opcode = ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD;
+    item->group = prov_groups[k];
+    if (!cfg_has_group(node, item->group))
+    {
+        put_le16(item->params, node->unicast);
+        put_le16(item->params + 2, item->group);
+        put_le16(item->params + 4, ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_SRV);
+        item->len = 6;
+    }
+
+    return true;
+}
+
+// Whether an item of the aggregated chain is left to send
+static bool agg_pending(const esp_ble_mesh_node_info_t *node)
+{
+    agg_item_t item;
+
+    for (uint8_t k = node->cfg_agg_idx; agg_item(node, k, &item); k++)
+    {
+        if (item.len)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static uint8_t agg_opcode_len(uint32_t opcode)
+{
+    return opcode > 0xffff ? 3 : opcode > 0xff ? 2 : 1;
+}
+
+static uint32_t agg_status_opcode(uint32_t opcode)
+{
+    switch (opcode)
+    {
+        case ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD:
+            return ESP_BLE_MESH_MODEL_OP_APP_KEY_STATUS;
+        case ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND:
+            return ESP_BLE_MESH_MODEL_OP_MODEL_APP_STATUS;
+        case ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD:
+            return ESP_BLE_MESH_MODEL_OP_MODEL_SUB_STATUS;
+        default:
+            return 0;
+    }
+}
+
+// Walks the responses of a status against the items the sequence carried and confirms
+// each successful one, cfg_lock held. False on the first failed or unexpected response.
+static bool agg_confirm(esp_ble_mesh_node_info_t *node, const uint8_t *data, size_t len)
+{
+    uint8_t k = node->cfg_agg_idx;
+    agg_item_t item;
+
+    while (len)
+    {
+        size_t item_len;
+        uint8_t oplen;
+        uint32_t opcode;
+
+        // Length_Format in bit 0, then a 7 or 15 bit length
+        if (data[0] & 1)
+        {
+            if (len < 2)
+            {
+                return false;
+            }
+            item_len = (data[0] | data[1] << 8) >> 1;
+            data += 2;
+            len -= 2;
+        }
+        else
+        {
+            item_len = data[0] >> 1;
+            data++;
+            len--;
+        }
+        if (!item_len || item_len > len)
+        {
+            return false;
+        }
+
+        oplen = !(data[0] & 0x80) ? 1 : !(data[0] & 0x40) ? 2 : 3;
+        opcode = oplen == 1 ? data[0] : oplen == 2 ? data[0] << 8 | data[1] : data[0] << 16 | data[1] << 8 | data[2];
+
+        // Groups confirmed before were not part of the sequence
+        while (agg_item(node, k, &item) && !item.len)
+        {
+            k++;
+        }
+        if (!item.len || opcode != agg_status_opcode(item.opcode) || item_len <= oplen || data[oplen])
+        {
+            ESP_LOGW(TAG, "node 0x%04x: aggregated opcode 0x%04" PRIx32 " failed", node->unicast, item.opcode);
+            return false;
+        }
+
+        if (item.opcode == ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD)
+        {
+            cfg_confirm_group(node, item.group);
+        }
+        node->cfg_agg_idx = ++k;
+        data += item_len;
+        len -= item_len;
+    }
+
+    return true;
+}
+
+#if CONFIG_BLE_MESH_AGG_CLI
+// Packs the items left into one sequence to the primary element, which hosts the
+// Configuration Server, as many as fit
+static esp_err_t cfg_send_sequence(esp_ble_mesh_node_info_t *node)
+{
+    esp_ble_mesh_client_common_param_t common = {};
+    esp_ble_mesh_agg_client_msg_t msg = {};
+    NET_BUF_SIMPLE_DEFINE(items, AGG_ITEMS_MAX);
+    agg_item_t item;
+
+    for (uint8_t k = node->cfg_agg_idx; agg_item(node, k, &item); k++)
+    {
+        uint8_t oplen = agg_opcode_len(item.opcode);
+        uint8_t *pos;
+
+        if (!item.len)
+        {
+            continue;
+        }
+        if (items.len + 1 + oplen + item.len > AGG_ITEMS_MAX)
+        {
+            break;
+        }
+
+        net_buf_simple_add_u8(&items, (oplen + item.len) << 1);
+        pos = net_buf_simple_add(&items, oplen);
+        for (uint8_t i = 0; i < oplen; i++)
+        {
+            pos[i] = item.opcode >> 8 * (oplen - 1 - i);
+        }
+        net_buf_simple_add_mem(&items, item.params, item.len);
+    }
+
+    ble_mesh_set_msg_common(&common, node, agg_client.model, ESP_BLE_MESH_MODEL_OP_AGG_SEQUENCE);
+    // Configuration messages are only accepted under the device key
+    common.ctx.app_idx = ESP_BLE_MESH_KEY_DEV;
+    msg.agg_sequence.element_addr = node->unicast;
+    msg.agg_sequence.items = &items;
+
+    return esp_ble_mesh_agg_client_send(&common, &msg);
+}
+#endif
+
+static esp_err_t cfg_send_step(esp_ble_mesh_node_info_t *node)
+{
+    esp_ble_mesh_client_common_param_t common = {};
+    esp_ble_mesh_cfg_client_get_state_t get_state = {};
+    esp_ble_mesh_cfg_client_set_state_t set_state = {};
+
+    switch (node->cfg_state)
+    {
+        case NODE_CFG_COMP_DATA_GET:
+            ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET);
+            get_state.comp_data_get.page = COMP_DATA_PAGE_0;
+            return esp_ble_mesh_config_client_get_state(&common, &get_state);
+#if CONFIG_BLE_MESH_AGG_CLI
+        case NODE_CFG_AGGREGATE:
+            return cfg_send_sequence(node);
+#endif
+        case NODE_CFG_APP_KEY_ADD:
+            ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD);
+            set_state.app_key_add.net_idx = team_key(node)->net_idx;
+            set_state.app_key_add.app_idx = team_key(node)->app_idx;
+            memcpy(set_state.app_key_add.app_key, team_key(node)->app_key, 16);
+            return esp_ble_mesh_config_client_set_state(&common, &set_state);
+        case NODE_CFG_MODEL_APP_BIND:
+            ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND);
+            set_state.model_app_bind.element_addr = node->unicast + node->cfg_bind_idx / BIND_MODELS;
+            set_state.model_app_bind.model_app_idx = team_key(node)->app_idx;
+            set_state.model_app_bind.model_id = bind_models[node->cfg_bind_idx % BIND_MODELS];
+            set_state.model_app_bind.company_id = ESP_BLE_MESH_CID_NVAL;
+            return esp_ble_mesh_config_client_set_state(&common, &set_state);
+        case NODE_CFG_MODEL_SUB_ADD:
+            ble_mesh_set_msg_common(&common, node, config_client.model, ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD);
+            set_state.model_sub_add.element_addr = node->unicast;
+            set_state.model_sub_add.sub_addr = prov_groups[node->cfg_sub_idx];
+            set_state.model_sub_add.model_id = ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_SRV;
+            set_state.model_sub_add.company_id = ESP_BLE_MESH_CID_NVAL;
+            return esp_ble_mesh_config_client_set_state(&common, &set_state);
+        default:
+            return ESP_ERR_INVALID_STATE;
+    }
+}
+
+static uint32_t cfg_opcode(uint8_t state)
+{
+    switch (state)
+    {
+        case NODE_CFG_COMP_DATA_GET:
+            return ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET;
+#if CONFIG_BLE_MESH_AGG_CLI
+        case NODE_CFG_AGGREGATE:
+            return ESP_BLE_MESH_MODEL_OP_AGG_SEQUENCE;
+#endif
+        case NODE_CFG_APP_KEY_ADD:
+            return ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD;
+        case NODE_CFG_MODEL_APP_BIND:
+            return ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND;
+        case NODE_CFG_MODEL_SUB_ADD:
+            return ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD;
+        default:
+            return 0;
+    }
+}
+
+static void cfg_backoff(esp_ble_mesh_node_info_t *node, int64_t now)
+{
+    uint32_t delay_ms;
+
+    cfg_retries_total++;
+
+    // A node that rejects aggregated sequences, or keeps losing them, is configured
+    // message by message
+    if (node->cfg_state == NODE_CFG_AGGREGATE && (!node->agg_srv || node->cfg_retries >= CFG_RETRY_MAX))
+    {
+        ESP_LOGW(TAG, "node 0x%04x: Opcodes Aggregator failed, falling back to single messages", node->unicast);
+        node->agg_srv = false;
+        node->cfg_state = NODE_CFG_APP_KEY_ADD;
+        node->cfg_retries = 0;
+        node->cfg_next_us = 0;
+        node->cfg_step_us = now;
+        return;
+    }
+    if (++node->cfg_retries > CFG_RETRY_MAX)
+    {
+        ESP_LOGE(TAG, "node 0x%04x: configuration step %d failed after %d retries",
+                 node->unicast, node->cfg_state, CFG_RETRY_MAX);
+        TRACE_STATE(TRACE_CFG_FAILED, node->unicast, node->cfg_state, 0);
+        node->cfg_state = NODE_CFG_FAILED;
+        return;
+    }
+
+    // Exponential backoff with up to 25% jitter so a fleet powered on together spreads out
+    delay_ms = CFG_BACKOFF_MIN_MS << (node->cfg_retries - 1);
+    if (delay_ms > CFG_BACKOFF_MAX_MS)
+    {
+        delay_ms = CFG_BACKOFF_MAX_MS;
+    }
+    delay_ms += esp_random() % (delay_ms / 4 + 1);
+
+    node->cfg_next_us = now + (int64_t)delay_ms * 1000;
+}
+
+static uint32_t topo_opcode(uint8_t step)
+{
+    switch (step)
+    {
+        case TOPO_PUB_SET:
+            return ESP_BLE_MESH_MODEL_OP_HEARTBEAT_PUB_SET;
+        case TOPO_SUB_SET:
+            return ESP_BLE_MESH_MODEL_OP_HEARTBEAT_SUB_SET;
+        case TOPO_SUB_GET:
+            return ESP_BLE_MESH_MODEL_OP_HEARTBEAT_SUB_GET;
+        default:
+            return 0;
+    }
+}
+
+static bool topo_is_opcode(uint32_t opcode)
+{
+    return opcode == ESP_BLE_MESH_MODEL_OP_HEARTBEAT_PUB_SET || opcode == ESP_BLE_MESH_MODEL_OP_HEARTBEAT_SUB_SET
+           || opcode == ESP_BLE_MESH_MODEL_OP_HEARTBEAT_SUB_GET;
+}
+
+static esp_err_t topo_send_step(esp_ble_mesh_node_info_t *node, uint16_t peer)
+{
+    esp_ble_mesh_client_common_param_t common = {};
+    esp_ble_mesh_cfg_client_get_state_t get_state = {};
+    esp_ble_mesh_cfg_client_set_state_t set_state = {};
+
+    ble_mesh_set_msg_common(&common, node, config_client.model, topo_opcode(node->topo_step));
+    switch (node->topo_step)
+    {
+        case TOPO_PUB_SET:
+            // Published with the TTL that reaches the provisioner, every relay on the way
+            // and the neighbors hear it too
+            set_state.heartbeat_pub_set.dst = ESP_BLE_MESH_ADDR_ALL_NODES;
+            set_state.heartbeat_pub_set.count = 0xff;
+            set_state.heartbeat_pub_set.period = TOPOLOGY_HB_PERIOD_LOG;
+            set_state.heartbeat_pub_set.ttl = common.ctx.send_ttl;
+            set_state.heartbeat_pub_set.feature = TOPOLOGY_FEAT_RELAY | TOPOLOGY_FEAT_PROXY
+                                                  | TOPOLOGY_FEAT_FRIEND | TOPOLOGY_FEAT_LPN;
+            set_state.heartbeat_pub_set.net_idx = team_key(node)->net_idx;
+            return esp_ble_mesh_config_client_set_state(&common, &set_state);
+        case TOPO_SUB_SET:
+            set_state.heartbeat_sub_set.src = peer;
+            set_state.heartbeat_sub_set.dst = ESP_BLE_MESH_ADDR_ALL_NODES;
+            set_state.heartbeat_sub_set.period = TOPOLOGY_PROBE_LOG;
+            return esp_ble_mesh_config_client_set_state(&common, &set_state);
+        case TOPO_SUB_GET:
+            return esp_ble_mesh_config_client_get_state(&common, &get_state);
+        default:
+            return ESP_ERR_INVALID_STATE;
+    }
+}
+
+static void topo_backoff(esp_ble_mesh_node_info_t *node, int64_t now)
+{
+    uint32_t delay_ms = TOPO_RETRY_MS << MIN(node->topo_retries, 8);
+
+    node->topo_retries += node->topo_retries < UINT8_MAX;
+    node->topo_next_us = now + (int64_t)MIN(delay_ms, TOPO_RETRY_MAX_MS) * 1000;
+}
+
+// Heartbeat steps of operational nodes whose configuration is not in flight, after the
+// configuration steps of the others got their share of the window, cfg_lock held
+static void topo_schedule(int64_t now, int64_t *next_due)
+{
+    for (size_t i = 0; i < ble_mesh_registry_count(); i++)
+    {
+        esp_ble_mesh_node_info_t *node = ble_mesh_registry_at(i);
+        uint16_t peer = ESP_BLE_MESH_ADDR_UNASSIGNED;
+
+        if (node->cfg_state != NODE_CFG_DONE || node->cfg_in_flight)
+        {
+            continue;
+        }
+
+        // A node that went silent may have moved beyond its heartbeat TTL, it publishes
+        // again with the default one. Until it is heard it is not asked again.
+        if (node->topo_step != TOPO_PUB_SET && ble_mesh_topology_heard(node->unicast)
+            && ble_mesh_topology_state(node->unicast, now) >= TOPOLOGY_LATE)
+        {
+            ESP_LOGW(TAG, "node 0x%04x: heartbeats missing, publishing them again", node->unicast);
+            ble_mesh_topology_add(node->unicast, team_key(node)->net_idx, now);
+            ble_mesh_ttl_forget(node->unicast);
+            node->topo_step = TOPO_PUB_SET;
+            node->topo_retries = 0;
+            node->topo_next_us = 0;
+        }
+
+        if (node->topo_next_us > now)
+        {
+            *next_due = MIN(*next_due, node->topo_next_us);
+            continue;
+        }
+
+        // Nodes already publishing, before a reboot of the provisioner, need no Set
+        if (node->topo_step == TOPO_PUB_SET && ble_mesh_topology_heard(node->unicast))
+        {
+            node->topo_step = TOPO_SUB_SET;
+        }
+        if (node->topo_step == TOPO_SUB_SET && !ble_mesh_topology_next_probe(node->unicast, &peer))
+        {
+            // Neither the node nor a peer within a hop of it was heard yet
+            node->topo_next_us = now + TOPOLOGY_HB_PERIOD_MS * 1000LL;
+            *next_due = MIN(*next_due, node->topo_next_us);
+            continue;
+        }
+
+        if (cfg_in_flight >= CFG_WINDOW || topo_in_flight >= TOPO_WINDOW)
+        {
+            break;
+        }
+
+        if (topo_send_step(node, peer) != ESP_OK)
+        {
+            ESP_LOGW(TAG, "node 0x%04x: send of heartbeat step %d failed", node->unicast, node->topo_step);
+            topo_backoff(node, now);
+            *next_due = MIN(*next_due, node->topo_next_us);
+            continue;
+        }
+
+        TRACE_MSG(TRACE_CFG_SEND, node->unicast, topo_opcode(node->topo_step), node->topo_step);
+        ble_mesh_metrics_sent(topo_opcode(node->topo_step));
+        node->cfg_sent_us = now;
+        node->cfg_in_flight = true;
+        node->topo_in_flight = true;
+        cfg_in_flight++;
+        topo_in_flight++;
+        ble_mesh_metrics_gauge(METRICS_GAUGE_CFG_IN_FLIGHT, cfg_in_flight);
+    }
+}
+
+// Fills the in-flight window with nodes whose next step is due, cfg_lock held
+static void cfg_schedule(void)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t next_due = INT64_MAX;
+
+    for (size_t i = 0; i < ble_mesh_registry_count(); i++)
+    {
+        esp_ble_mesh_node_info_t *node = ble_mesh_registry_at(i);
+
+        if (node->cfg_state >= NODE_CFG_DONE || node->cfg_in_flight)
+        {
+            continue;
+        }
+
+        if (node->cfg_next_us > now)
+        {
+            next_due = MIN(next_due, node->cfg_next_us);
+            continue;
+        }
+
+        if (cfg_in_flight >= CFG_WINDOW)
+        {
+            break;
+        }
+
+        if (cfg_send_step(node) != ESP_OK)
+        {
+            ESP_LOGW(TAG, "node 0x%04x: send of configuration step %d failed", node->unicast, node->cfg_state);
+            cfg_backoff(node, now);
+            if (node->cfg_state != NODE_CFG_FAILED)
+            {
+                next_due = MIN(next_due, node->cfg_next_us);
+            }
+            continue;
+        }
+
+        TRACE_MSG(TRACE_CFG_SEND, node->unicast, cfg_opcode(node->cfg_state), node->cfg_state);
+        ble_mesh_metrics_sent(cfg_opcode(node->cfg_state));
+        node->cfg_sent_us = now;
+        node->cfg_round_trips += node->cfg_round_trips < UINT8_MAX;
+        node->cfg_in_flight = true;
+        cfg_in_flight++;
+        ble_mesh_metrics_gauge(METRICS_GAUGE_CFG_IN_FLIGHT, cfg_in_flight);
+    }
+
+    topo_schedule(now, &next_due);
+
+    esp_timer_stop(cfg_timer);
+    if (next_due != INT64_MAX)
+    {
+        esp_timer_start_once(cfg_timer, MAX(next_due - now, 1000));
+    }
+}
+
+static void cfg_timer_cb(void *arg)
+{
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    cfg_schedule();
+    xSemaphoreGive(cfg_lock);
+}
+
+// Skips subscriptions the node already confirmed, before a reboot for instance,
+// and completes the chain once no group is left
+static void cfg_next_group(esp_ble_mesh_node_info_t *node, int64_t now)
+{
+    if (node->cfg_state == NODE_CFG_MODEL_SUB_ADD && !cfg_subscribes(node))
+    {
+        node->cfg_sub_idx = prov_group_count;
+    }
+
+    while (node->cfg_state == NODE_CFG_MODEL_SUB_ADD && node->cfg_sub_idx < prov_group_count
+           && cfg_has_group(node, prov_groups[node->cfg_sub_idx]))
+    {
+        node->cfg_sub_idx++;
+    }
+
+    if (node->cfg_state == NODE_CFG_MODEL_SUB_ADD && node->cfg_sub_idx >= prov_group_count)
+    {
+        node->cfg_state = NODE_CFG_DONE;
+    }
+
+    // A group added later reopens the chain, time to operational stays the first one
+    if (node->cfg_state == NODE_CFG_DONE && !node->ready_time_us)
+    {
+        node->ready_time_us = now;
+        TRACE_STATE(TRACE_CFG_DONE, node->unicast, 0, node->ready_time_us - node->prov_time_us);
+        ble_mesh_metrics_stage(METRICS_STAGE_OPERATIONAL, node->ready_time_us - node->prov_time_us);
+        ESP_LOGI(TAG, "node 0x%04x operational %" PRId64 " ms after provisioning",
+                 node->unicast, (node->ready_time_us - node->prov_time_us) / 1000);
+    }
+}
+
+// Moves to the next step, binding one model and subscribing one configured group per round trip
+static void cfg_advance(esp_ble_mesh_node_info_t *node, int64_t now)
+{
+    static const ble_mesh_metrics_stage_t step_stages[] = {
+        [NODE_CFG_COMP_DATA_GET] = METRICS_STAGE_COMP_DATA,
+        [NODE_CFG_AGGREGATE] = METRICS_STAGE_AGGREGATE,
+        [NODE_CFG_APP_KEY_ADD] = METRICS_STAGE_APP_KEY,
+        [NODE_CFG_MODEL_APP_BIND] = METRICS_STAGE_MODEL_BIND,
+        [NODE_CFG_MODEL_SUB_ADD] = METRICS_STAGE_MODEL_SUB,
+    };
+
+    // The bind batch and the aggregated sequences are timed as one step
+    if (node->cfg_state == NODE_CFG_MODEL_APP_BIND && cfg_next_bind(node, node->cfg_bind_idx + 1))
+    {
+        return;
+    }
+    if (node->cfg_state == NODE_CFG_AGGREGATE && agg_pending(node))
+    {
+        store_mark_dirty(node);
+        return;
+    }
+
+    ble_mesh_metrics_stage(step_stages[node->cfg_state], now - node->cfg_step_us);
+    node->cfg_step_us = now;
+
+    if (node->cfg_state == NODE_CFG_MODEL_SUB_ADD)
+    {
+        cfg_confirm_group(node, prov_groups[node->cfg_sub_idx]);
+        node->cfg_sub_idx++;
+    }
+    else if (node->cfg_state == NODE_CFG_AGGREGATE)
+    {
+        node->cfg_state = NODE_CFG_DONE;
+        node->cfg_aggregated = true;
+    }
+    else
+    {
+        node->cfg_state++;
+    }
+
+    if (node->cfg_state == NODE_CFG_AGGREGATE)
+    {
+        cfg_start_agg(node);
+    }
+    if (node->cfg_state == NODE_CFG_MODEL_APP_BIND)
+    {
+        cfg_start_bind(node);
+    }
+
+    cfg_next_group(node, now);
+    store_mark_dirty(node);
+}
+
+static void cfg_store_comp(esp_ble_mesh_node_info_t *node, const struct net_buf_simple *comp)
+{
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    node->comp_len = comp->len <= NODE_REGISTRY_COMP_MAX ? comp->len : 0;
+    memcpy(node->comp, comp->data, node->comp_len);
+    cfg_index_models(node);
+    xSemaphoreGive(cfg_lock);
+}
+
+// Late replies of an abandoned or already retried step are ignored
+static bool cfg_step_pending(const esp_ble_mesh_node_info_t *node, uint32_t opcode)
+{
+    return node->cfg_in_flight && cfg_opcode(node->cfg_state) == opcode;
+}
+
+// cfg_lock held, the step must be pending
+static void cfg_step_complete(esp_ble_mesh_node_info_t *node, uint32_t opcode, ble_mesh_metrics_outcome_t outcome)
+{
+    int64_t now = esp_timer_get_time();
+
+    node->cfg_in_flight = false;
+    cfg_in_flight--;
+    ble_mesh_metrics_result(opcode, outcome, now - node->cfg_sent_us);
+
+    if (outcome != METRICS_OK)
+    {
+        cfg_backoff(node, now);
+    }
+    else
+    {
+        node->cfg_retries = 0;
+        node->cfg_next_us = 0;
+        cfg_advance(node, now);
+    }
+
+    cfg_schedule();
+}
+
+static void cfg_step_result(esp_ble_mesh_node_info_t *node, uint32_t opcode, ble_mesh_metrics_outcome_t outcome)
+{
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    if (cfg_step_pending(node, opcode))
+    {
+        cfg_step_complete(node, opcode, outcome);
+    }
+    xSemaphoreGive(cfg_lock);
+}
+
+// Status or failure of a heartbeat step, sub is the subscription status of a Get
+static void topo_result(esp_ble_mesh_node_info_t *node, uint32_t opcode, ble_mesh_metrics_outcome_t outcome,
+                        const esp_ble_mesh_cfg_hb_sub_status_cb_t *sub)
+{
+    int64_t now = esp_timer_get_time();
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    if (!node->topo_in_flight || topo_opcode(node->topo_step) != opcode)
+    {
+        xSemaphoreGive(cfg_lock);
+        return;
+    }
+
+    node->cfg_in_flight = false;
+    node->topo_in_flight = false;
+    cfg_in_flight--;
+    topo_in_flight--;
+    ble_mesh_metrics_result(opcode, outcome, now - node->cfg_sent_us);
+
+    if (outcome != METRICS_OK)
+    {
+        topo_backoff(node, now);
+    }
+    else
+    {
+        node->topo_retries = 0;
+        node->topo_next_us = 0;
+        switch (node->topo_step)
+        {
+            case TOPO_PUB_SET:
+                ble_mesh_topology_add(node->unicast, team_key(node)->net_idx, now);
+                node->topo_step = TOPO_SUB_SET;
+                break;
+            case TOPO_SUB_SET:
+                // Both heartbeats of the peer fall into the subscription period
+                node->topo_step = TOPO_SUB_GET;
+                node->topo_next_us = now + TOPOLOGY_PROBE_MS * 1000LL;
+                break;
+            case TOPO_SUB_GET:
+                ble_mesh_topology_probed(node->unicast, sub->src, sub->count, sub->min_hops);
+                node->topo_step = TOPO_SUB_SET;
+                break;
+            default:
+                break;
+        }
+    }
+
+    cfg_schedule();
+    xSemaphoreGive(cfg_lock);
+}
+
+#if CONFIG_BLE_MESH_AGG_CLI
+static void cfg_agg_status(esp_ble_mesh_node_info_t *node, const esp_ble_mesh_agg_status_t *status)
+{
+    ble_mesh_metrics_outcome_t outcome = METRICS_OK;
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    if (!cfg_step_pending(node, ESP_BLE_MESH_MODEL_OP_AGG_SEQUENCE))
+    {
+        xSemaphoreGive(cfg_lock);
+        return;
+    }
+
+    if (status->status)
+    {
+        // The sequence was refused as a whole, retrying it will not help
+        ESP_LOGW(TAG, "node 0x%04x: aggregated sequence refused (status 0x%02x)", node->unicast, status->status);
+        node->agg_srv = false;
+        outcome = METRICS_FAIL;
+    }
+    else if (!status->items || !agg_confirm(node, status->items->data, status->items->len))
+    {
+        outcome = METRICS_FAIL;
+    }
+
+    cfg_step_complete(node, ESP_BLE_MESH_MODEL_OP_AGG_SEQUENCE, outcome);
+    xSemaphoreGive(cfg_lock);
+}
+#endif
+
+esp_err_t ble_mesh_provisioner_add_group(uint16_t group_addr)
+{
+    if (!ESP_BLE_MESH_ADDR_IS_GROUP(group_addr))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!cfg_lock)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+
+    for (uint8_t i = 0; i < prov_group_count; i++)
+    {
+        if (prov_groups[i] == group_addr)
+        {
+            xSemaphoreGive(cfg_lock);
+            return ESP_OK;
+        }
+    }
+
+    if (prov_group_count == PROV_GROUPS_MAX)
+    {
+        xSemaphoreGive(cfg_lock);
+        ESP_LOGE(TAG, "%s: group limit of %d reached", __func__, PROV_GROUPS_MAX);
+        return ESP_ERR_NO_MEM;
+    }
+
+    prov_groups[prov_group_count++] = group_addr;
+
+    // Operational nodes only need the new subscription
+    for (size_t i = 0; i < ble_mesh_registry_count(); i++)
+    {
+        esp_ble_mesh_node_info_t *node = ble_mesh_registry_at(i);
+
+        if (node->cfg_state == NODE_CFG_DONE && !cfg_has_group(node, group_addr))
+        {
+            node->cfg_state = NODE_CFG_MODEL_SUB_ADD;
+            node->cfg_sub_idx = prov_group_count - 1;
+            node->cfg_next_us = 0;
+            node->cfg_step_us = esp_timer_get_time();
+        }
+    }
+
+    cfg_schedule();
+    xSemaphoreGive(cfg_lock);
+
+    return ESP_OK;
+}
+
+size_t ble_mesh_provisioner_get_operational(uint16_t *addrs, size_t max)
+{
+    size_t count = 0;
+
+    // Not running as provisioner, there is no member list
+    if (!cfg_lock)
+    {
+        return 0;
+    }
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    for (size_t i = 0; i < ble_mesh_registry_count() && count < max; i++)
+    {
+        esp_ble_mesh_node_info_t *node = ble_mesh_registry_at(i);
+
+        if (node->ready_time_us)
+        {
+            addrs[count++] = node->unicast;
+        }
+    }
+    xSemaphoreGive(cfg_lock);
+
+    return count;
+}
+
+int32_t ble_mesh_provisioner_time_to_operational(uint16_t unicast)
+{
+    esp_ble_mesh_node_info_t *node = NULL;
+    int32_t ms = -1;
+
+    if (!cfg_lock)
+    {
+        return -1;
+    }
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    node = ble_mesh_get_node_info(unicast);
+    if (node && node->ready_time_us)
+    {
+        ms = (node->ready_time_us - node->prov_time_us) / 1000;
+    }
+    xSemaphoreGive(cfg_lock);
+
+    return ms;
+}
+
+esp_err_t ble_mesh_provisioner_has_model(uint16_t addr, uint16_t model_id)
+{
+    esp_ble_mesh_node_info_t *node = NULL;
+    int bit = bind_model_bit(model_id);
+    esp_err_t error = ESP_ERR_NOT_FOUND;
+    uint16_t elem;
+
+    if (bit < 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!cfg_lock)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    node = ble_mesh_get_node_info(addr);
+    if (node && node->comp_len)
+    {
+        elem = addr - node->unicast;
+        if (elem < NODE_REGISTRY_ELEMS_MAX)
+        {
+            error = node->models[elem] & 1 << bit ? ESP_OK : ESP_ERR_NOT_SUPPORTED;
+        }
+    }
+    xSemaphoreGive(cfg_lock);
+
+    return error;
+}
+
+size_t ble_mesh_provisioner_get_nodes_with_model(uint16_t model_id, uint16_t *addrs, size_t max)
+{
+    int bit = bind_model_bit(model_id);
+    size_t count = 0;
+
+    if (bit < 0 || !cfg_lock)
+    {
+        return 0;
+    }
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    for (size_t i = 0; i < ble_mesh_registry_count() && count < max; i++)
+    {
+        esp_ble_mesh_node_info_t *node = ble_mesh_registry_at(i);
+
+        for (uint8_t elem = 0; node->ready_time_us && elem < NODE_REGISTRY_ELEMS_MAX && count < max; elem++)
+        {
+            if (node->models[elem] & 1 << bit)
+            {
+                addrs[count++] = node->unicast + elem;
+            }
+        }
+    }
+    xSemaphoreGive(cfg_lock);
+
+    return count;
+}
+
+esp_err_t ble_mesh_provisioner_allow_device(const uint8_t uuid[16])
+{
+    esp_err_t error;
+
+    // Before init nothing else touches the filter
+    if (cfg_lock)
+    {
+        xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    }
+    error = ble_mesh_filter_allow(uuid);
+    if (cfg_lock)
+    {
+        xSemaphoreGive(cfg_lock);
+    }
+
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: allowlist full (%d devices)", __func__, BEACON_FILTER_ALLOW_MAX);
+    }
+
+    return error;
+}
+
+esp_err_t ble_mesh_provisioner_set_team(const uint8_t uuid[16], uint8_t team)
+{
+    esp_err_t error = ESP_OK;
+    size_t i;
+
+    if (!uuid || team >= BLE_MESH_TEAMS_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Before init nothing else reads the assignments
+    if (cfg_lock)
+    {
+        xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    }
+    for (i = 0; i < team_assign_count; i++)
+    {
+        if (!memcmp(team_assign[i].uuid, uuid, 16))
+        {
+            break;
+        }
+    }
+    // Only the devices outside the default team are listed
+    if (team == BLE_MESH_TEAM_DEFAULT)
+    {
+        if (i < team_assign_count)
+        {
+            team_assign[i] = team_assign[--team_assign_count];
+        }
+    }
+    else if (i < TEAM_ASSIGN_MAX)
+    {
+        memcpy(team_assign[i].uuid, uuid, 16);
+        team_assign[i].team = team;
+        team_assign_count = MAX(team_assign_count, i + 1);
+    }
+    else
+    {
+        error = ESP_ERR_NO_MEM;
+    }
+    if (cfg_lock)
+    {
+        xSemaphoreGive(cfg_lock);
+    }
+
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: team list full (%d devices)", __func__, TEAM_ASSIGN_MAX);
+    }
+
+    return error;
+}
+
+esp_err_t ble_mesh_provisioner_get_team(uint16_t addr, uint8_t *team)
+{
+    esp_ble_mesh_node_info_t *node = NULL;
+
+    if (!team)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!cfg_lock)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    node = ble_mesh_get_node_info(addr);
+    if (node)
+    {
+        *team = node->team;
+    }
+    xSemaphoreGive(cfg_lock);
+
+    return node ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+size_t ble_mesh_provisioner_get_team_members(uint8_t team, uint16_t *addrs, size_t max)
+{
+    size_t count = 0;
+
+    if (!cfg_lock)
+    {
+        return 0;
+    }
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    for (size_t i = 0; i < ble_mesh_registry_count() && count < max; i++)
+    {
+        esp_ble_mesh_node_info_t *node = ble_mesh_registry_at(i);
+
+        if (node->ready_time_us && node->team == team)
+        {
+            addrs[count++] = node->unicast;
+        }
+    }
+    xSemaphoreGive(cfg_lock);
+
+    return count;
+}
+
+esp_err_t ble_mesh_provisioner_remove_node(uint16_t unicast)
+{
+    esp_ble_mesh_node_info_t *node = NULL;
+    esp_err_t error;
+
+    if (!cfg_lock)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    node = ble_mesh_get_node_info(unicast);
+    if (!node || node->unicast != unicast)
+    {
+        xSemaphoreGive(cfg_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    error = esp_ble_mesh_provisioner_delete_node_with_addr(unicast);
+    if (error != ESP_OK)
+    {
+        xSemaphoreGive(cfg_lock);
+        ESP_LOGE(TAG, "%s: delete node 0x%04x failed (err %d)", __func__, unicast, error);
+        return error;
+    }
+
+    node_drop(node);
+    cfg_schedule();
+    xSemaphoreGive(cfg_lock);
+
+    ESP_LOGI(TAG, "node 0x%04x removed", unicast);
+
+    return ESP_OK;
+}
+
+uint16_t ble_mesh_provisioner_addr_high(void)
+{
+    uint16_t high;
+
+    if (!cfg_lock)
+    {
+        return 0;
+    }
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    high = ble_mesh_addr_high();
+    xSemaphoreGive(cfg_lock);
+
+    return high;
+}
+
+void ble_mesh_provisioner_get_fleet_stats(ble_mesh_provisioner_fleet_stats_t *stats)
+{
+    uint64_t ttop_sum_ms = 0;
+    int64_t last_ready_us = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    if (!cfg_lock)
+    {
+        return;
+    }
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    for (size_t i = 0; i < ble_mesh_registry_count(); i++)
+    {
+        esp_ble_mesh_node_info_t *node = ble_mesh_registry_at(i);
+
+        stats->nodes++;
+        if (node->cfg_state == NODE_CFG_FAILED)
+        {
+            stats->failed++;
+        }
+        else if (node->ready_time_us)
+        {
+            uint32_t ttop_ms = (node->ready_time_us - node->prov_time_us) / 1000;
+            stats->operational++;
+            stats->ttop_max_ms = MAX(stats->ttop_max_ms, ttop_ms);
+            ttop_sum_ms += ttop_ms;
+            last_ready_us = MAX(last_ready_us, node->ready_time_us);
+
+            // Only nodes configured since boot tell the cost of their path
+            if (node->cfg_round_trips)
+            {
+                ble_mesh_provisioner_path_stats_t *path = node->cfg_aggregated ? &stats->aggregated : &stats->chain;
+                path->nodes++;
+                path->round_trips += node->cfg_round_trips;
+                path->config_ms += ttop_ms;
+            }
+        }
+    }
+    stats->in_flight = cfg_in_flight;
+    stats->retries = cfg_retries_total;
+    stats->restored = restored_count;
+    ble_mesh_filter_get_stats(&stats->beacons);
+    ble_mesh_admission_get_stats(&stats->admission);
+    ble_mesh_ttl_get_stats(&stats->ttl);
+    ble_mesh_topology_get_stats(&stats->topology);
+    ble_mesh_dispatch_get_stats(&stats->dispatch);
+    if (stats->nodes && stats->operational == stats->nodes)
+    {
+        stats->boot_ready_ms = (last_ready_us - init_time_us) / 1000;
+    }
+    xSemaphoreGive(cfg_lock);
+
+    if (stats->operational)
+    {
+        stats->ttop_avg_ms = ttop_sum_ms / stats->operational;
+    }
+}
+
+esp_err_t ble_mesh_provisioner_get_topology(uint16_t unicast, ble_mesh_topology_node_t *node)
+{
+    esp_err_t error;
+
+    if (!cfg_lock)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    error = ble_mesh_topology_get(unicast, esp_timer_get_time(), node);
+    xSemaphoreGive(cfg_lock);
+
+    return error;
+}
+
+size_t ble_mesh_provisioner_get_neighbors(uint16_t unicast, uint16_t *addrs, size_t max)
+{
+    size_t count;
+
+    if (!cfg_lock)
+    {
+        return 0;
+    }
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    count = ble_mesh_topology_neighbors(unicast, addrs, max);
+    xSemaphoreGive(cfg_lock);
+
+    return count;
+}
+
+size_t ble_mesh_provisioner_get_at_risk(uint16_t *addrs, size_t max)
+{
+    size_t count;
+
+    if (!cfg_lock)
+    {
+        return 0;
+    }
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    count = ble_mesh_topology_at_risk(esp_timer_get_time(), addrs, max);
+    xSemaphoreGive(cfg_lock);
+
+    return count;
+}
+
+void ble_mesh_provisioner_dump_topology(void)
+{
+    ble_mesh_topology_stats_t stats;
+
+    if (!cfg_lock)
+    {
+        return;
+    }
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    ble_mesh_topology_get_stats(&stats);
+    printf("topology: %u nodes, %u links, %u relays, up to %u hops, %" PRIu32 " heartbeats, %" PRIu32 " probes\n",
+           stats.nodes, stats.links, stats.relays, stats.hops_max, stats.heartbeats, stats.probes);
+    ble_mesh_topology_dump(esp_timer_get_time());
+    xSemaphoreGive(cfg_lock);
+}
+
+static int topology_console_cmd(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        printf("usage: %s\n", argv[0]);
+        return 1;
+    }
+
+    ble_mesh_provisioner_dump_topology();
+    return 0;
+}
+
+esp_err_t ble_mesh_provisioner_register_console(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "mesh_topology",
+        .help = "Nodes of the fleet with their hop count, heartbeat state, RSSI, features and neighbors.",
+        .hint = NULL,
+        .func = topology_console_cmd,
+    };
+    esp_err_t error = esp_console_cmd_register(&cmd);
+
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: failed to register command (err %d)", __func__, error);
+    }
+
+    return error;
+}
+
+static esp_err_t prov_complete(
+    int node_idx,
+    const esp_ble_mesh_octet16_t uuid,
+    uint16_t unicast,
+    uint8_t elem_num,
+    uint16_t net_idx)
+{
+    esp_ble_mesh_node_info_t *node = NULL;
+    char name[11] = {0};
+    esp_err_t error;
+
+    TRACE_STATE(TRACE_PROV_COMPLETE, unicast, elem_num, node_idx);
+    if (link_open_us)
+    {
+        ble_mesh_metrics_stage(METRICS_STAGE_PROVISION, esp_timer_get_time() - link_open_us);
+        link_open_us = 0;
+    }
+    ESP_LOGI(TAG, "node index: 0x%x, unicast address: 0x%02x, element num: %d, "
+                  "netkey index: 0x%02x", node_idx, unicast, elem_num, net_idx);
+    ESP_LOGI(TAG, "device uuid: %s", bt_hex(uuid, 16));
+
+    sprintf(name, "%s%d", "NODE-", node_idx);
+    error = esp_ble_mesh_provisioner_set_node_name(node_idx, name);
+    if (error)
+    {
+        ESP_LOGE(TAG, "%s: Set node name failed", __func__);
+        return ESP_FAIL;
+    }
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+
+    prov_commit_addr(uuid, unicast, elem_num);
+    // Provisioned devices stop beaconing, after a factory reset the first beacon counts
+    ble_mesh_filter_forget(uuid);
+    ble_mesh_admission_complete(uuid);
+    error = ble_mesh_store_node_info(uuid, unicast, elem_num);
+    if (error)
+    {
+        xSemaphoreGive(cfg_lock);
+        ESP_LOGE(TAG, "%s: Store node info failed", __func__);
+        return ESP_FAIL;
+    }
+
+    node = ble_mesh_get_node_info(unicast);
+    if (!node)
+    {
+        xSemaphoreGive(cfg_lock);
+        ESP_LOGE(TAG, "%s: Get node info failed", __func__);
+        return ESP_FAIL;
+    }
+
+    if (node->cfg_in_flight)
+    {
+        cfg_in_flight--;
+    }
+    if (node->topo_in_flight)
+    {
+        topo_in_flight--;
+    }
+    node->cfg_state = NODE_CFG_COMP_DATA_GET;
+    node->cfg_retries = 0;
+    node->cfg_in_flight = false;
+    node->cfg_sub_idx = 0;
+    node->cfg_bind_idx = 0;
+    node->cfg_agg_idx = 0;
+    node->cfg_round_trips = 0;
+    node->cfg_aggregated = false;
+    node->agg_srv = false;
+    node->cfg_next_us = 0;
+    node->topo_step = TOPO_PUB_SET;
+    node->topo_retries = 0;
+    node->topo_in_flight = false;
+    node->topo_next_us = 0;
+    node->prov_time_us = esp_timer_get_time();
+    node->cfg_step_us = node->prov_time_us;
+    node->ready_time_us = 0;
+    node->team = BLE_MESH_NET_IDX_TEAM(net_idx);
+    node->comp_len = 0;
+    memset(node->models, 0, sizeof(node->models));
+    memset(node->cfg_groups, 0, sizeof(node->cfg_groups));
+    store_mark_dirty(node);
+
+    cfg_schedule();
+    xSemaphoreGive(cfg_lock);
+
+    return ESP_OK;
+}
+
+static void prov_link_open(esp_ble_mesh_prov_bearer_t bearer)
+{
+    link_open_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "%s link open", bearer == ESP_BLE_MESH_PROV_ADV ? "PB-ADV" : "PB-GATT");
+}
+
+// The stack provisions into one subnet for all of its links. Devices of that team go
+// first, one of another team only once it has none queued and its links are done, so
+// the subnet changes once per team rather than per device. cfg_lock held.
+static bool prov_admissible(const uint8_t uuid[16])
+{
+    uint8_t team = team_of_uuid(uuid);
+
+    return team_ready & 1u << team && (!prov_team_only || team == prov_team);
+}
+
+// Hands the free provisioning slots to the best ranked devices, cfg_lock held
+static void prov_admit(void)
+{
+    ble_mesh_admission_candidate_t candidate;
+    ble_mesh_admission_stats_t stats;
+    esp_ble_mesh_prov_bearer_t bearer;
+    int64_t now = esp_timer_get_time();
+
+    for (;;)
+    {
+        uint8_t team;
+        uint8_t elem_num = 0;
+        uint16_t unicast;
+        esp_err_t error;
+
+        prov_team_only = true;
+        if (!ble_mesh_admission_pick(now, prov_admissible, &candidate, &bearer))
+        {
+            ble_mesh_admission_get_stats(&stats);
+            prov_team_only = false;
+            if (stats.linking || !ble_mesh_admission_pick(now, prov_admissible, &candidate, &bearer))
+            {
+                break;
+            }
+        }
+
+        team = team_of_uuid(candidate.uuid);
+        if (team != prov_team)
+        {
+            esp_ble_mesh_prov_data_info_t info = {
+                .net_idx = team_keys[team].net_idx,
+                .flag = PROV_DATA_NET_IDX_FLAG,
+            };
+
+            error = esp_ble_mesh_provisioner_set_prov_data_info(&info);
+            if (error)
+            {
+                ESP_LOGE(TAG, "%s: Switching to the subnet of team %d failed", __func__, team);
+                break;
+            }
+            prov_team = team;
+        }
+
+        unicast = prov_reserve_addr(candidate.uuid, &elem_num);
+        if (!unicast)
+        {
+            ble_mesh_admission_drop(candidate.uuid);
+            continue;
+        }
+
+        // A device beaconing under a known UUID was reset; the stack's record of it
+        // would make its own range look taken
+        if (esp_ble_mesh_provisioner_get_node_with_uuid(candidate.uuid))
+        {
+            ESP_LOGI(TAG, "device 0x%04x was reset, provisioning it again", unicast);
+            esp_ble_mesh_provisioner_delete_node_with_uuid(candidate.uuid);
+        }
+
+        error = esp_ble_mesh_provisioner_prov_device_with_addr(candidate.uuid, candidate.addr, candidate.addr_type,
+                                                               bearer, candidate.oob_info, unicast);
+        if (error)
+        {
+            ESP_LOGE(TAG, "%s: Provision device with address 0x%04x failed", __func__, unicast);
+            ble_mesh_admission_drop(candidate.uuid);
+            continue;
+        }
+
+        ble_mesh_admission_start(candidate.uuid, bearer, now);
+        ESP_LOGD(TAG, "%s slot to 0x%04x, RSSI %d", bearer == ESP_BLE_MESH_PROV_ADV ? "PB-ADV" : "PB-GATT",
+                 unicast, candidate.rssi);
+    }
+}
+
+static void prov_link_close(esp_ble_mesh_prov_bearer_t bearer, uint8_t reason)
+{
+    ble_mesh_admission_stats_t stats;
+    ble_mesh_admission_link_stats_t *link;
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    ble_mesh_admission_link_close(bearer, esp_timer_get_time());
+    ble_mesh_admission_get_stats(&stats);
+    prov_admit();
+    xSemaphoreGive(cfg_lock);
+
+    link = bearer == ESP_BLE_MESH_PROV_ADV ? &stats.adv : &stats.gatt;
+    ESP_LOGI(TAG, "%s link close, reason 0x%02x, %" PRIu32 " of %" PRIu32 " links failed",
+             bearer == ESP_BLE_MESH_PROV_ADV ? "PB-ADV" : "PB-GATT", reason, link->failed,
+             link->completed + link->failed);
+}
+
+static void prov_dev_with_addr_comp(int err_code)
+{
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    ble_mesh_admission_answer(err_code, esp_timer_get_time());
+    prov_admit();
+    xSemaphoreGive(cfg_lock);
+
+    ESP_LOGD(TAG, "ESP_BLE_MESH_PROVISIONER_PROV_DEV_WITH_ADDR_COMP_EVT, err_code %d", err_code);
+}
+
+static void recv_unprov_adv_pkt(
+    const uint8_t dev_uuid_param[16],
+    const uint8_t addr[BD_ADDR_LEN],
+    esp_ble_mesh_addr_type_t addr_type,
+    uint16_t oob_info, int8_t rssi,
+    esp_ble_mesh_prov_bearer_t bearer)
+{
+    ble_mesh_admission_candidate_t candidate = {
+        .addr_type = addr_type,
+        .oob_info = oob_info,
+        .bearers = bearer,
+        .rssi = rssi,
+    };
+
+    // Every device repeats its beacon on each advertising channel; only the first report
+    // per beacon interval and bearer of a device on the allowlist goes further
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    if (!ble_mesh_filter_admit(dev_uuid_param, bearer, esp_timer_get_time()))
+    {
+        xSemaphoreGive(cfg_lock);
+        return;
+    }
+
+    memcpy(candidate.uuid, dev_uuid_param, 16);
+    memcpy(candidate.addr, addr, BD_ADDR_LEN);
+    ble_mesh_admission_offer(&candidate, esp_timer_get_time());
+    prov_admit();
+    xSemaphoreGive(cfg_lock);
+
+    TRACE_VERBOSE(TRACE_UNPROV_ADV, oob_info,
+                  (uint32_t)addr[0] << 24 | addr[1] << 16 | addr[2] << 8 | addr[3],
+                  addr[4] << 8 | addr[5] | bearer << 16);
+}
+
+#if CONFIG_BLE_MESH_PROVISIONER_RECV_HB
+static void prov_recv_heartbeat(uint16_t src, uint8_t hops, uint16_t feature, int8_t rssi)
+{
+    ble_mesh_ttl_learn(src, hops);
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    ble_mesh_topology_heartbeat(src, hops, feature, rssi, esp_timer_get_time());
+    xSemaphoreGive(cfg_lock);
+}
+#endif
+
+static void prov_unprov_adv_evt(const ble_mesh_dispatch_event_t *event)
+{
+    const esp_ble_mesh_prov_cb_param_t *param = &event->param.prov;
+
+    recv_unprov_adv_pkt(param->provisioner_recv_unprov_adv_pkt.dev_uuid, param->provisioner_recv_unprov_adv_pkt.addr,
+                        param->provisioner_recv_unprov_adv_pkt.addr_type, param->provisioner_recv_unprov_adv_pkt.oob_info,
+                        param->provisioner_recv_unprov_adv_pkt.rssi, param->provisioner_recv_unprov_adv_pkt.bearer);
+}
+
+static void prov_link_open_evt(const ble_mesh_dispatch_event_t *event)
+{
+    prov_link_open(event->param.prov.provisioner_prov_link_open.bearer);
+}
+
+static void prov_link_close_evt(const ble_mesh_dispatch_event_t *event)
+{
+    prov_link_close(event->param.prov.provisioner_prov_link_close.bearer, event->param.prov.provisioner_prov_link_close.reason);
+}
+
+static void prov_complete_evt(const ble_mesh_dispatch_event_t *event)
+{
+    const esp_ble_mesh_prov_cb_param_t *param = &event->param.prov;
+
+    prov_complete(param->provisioner_prov_complete.node_idx, param->provisioner_prov_complete.device_uuid,
+                  param->provisioner_prov_complete.unicast_addr, param->provisioner_prov_complete.element_num,
+                  param->provisioner_prov_complete.netkey_idx);
+}
+
+static void prov_dev_with_addr_comp_evt(const ble_mesh_dispatch_event_t *event)
+{
+    prov_dev_with_addr_comp(event->param.prov.provisioner_prov_dev_with_addr_comp.err_code);
+}
+
+#if CONFIG_BLE_MESH_PROVISIONER_RECV_HB
+static void prov_recv_heartbeat_evt(const ble_mesh_dispatch_event_t *event)
+{
+    const esp_ble_mesh_prov_cb_param_t *param = &event->param.prov;
+
+    prov_recv_heartbeat(param->provisioner_recv_heartbeat.hb_src, param->provisioner_recv_heartbeat.hops,
+                        param->provisioner_recv_heartbeat.feature, param->provisioner_recv_heartbeat.rssi);
+}
+#endif
+
+static void prov_node_name_comp_evt(const ble_mesh_dispatch_event_t *event)
+{
+    const esp_ble_mesh_prov_cb_param_t *param = &event->param.prov;
+    const char *name = NULL;
+
+    ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_SET_NODE_NAME_COMP_EVT, err_code %d",
+        param->provisioner_set_node_name_comp.err_code);
+
+    if (param->provisioner_set_node_name_comp.err_code == ESP_OK)
+    {
+        name = esp_ble_mesh_provisioner_get_node_name(param->provisioner_set_node_name_comp.node_index);
+        if (!name)
+        {
+            ESP_LOGE(TAG, "Get node name failed");
+            return;
+        }
+        ESP_LOGI(TAG, "Node %d name is: %s", param->provisioner_set_node_name_comp.node_index, name);
+    }
+}
+
+static void prov_net_key_comp_evt(const ble_mesh_dispatch_event_t *event)
+{
+    const esp_ble_mesh_prov_cb_param_t *param = &event->param.prov;
+    uint16_t net_idx = param->provisioner_add_net_key_comp.net_idx;
+    esp_err_t err = 0;
+
+    ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_ADD_LOCAL_NET_KEY_COMP_EVT, err_code %d",
+        param->provisioner_add_net_key_comp.err_code);
+
+    // A team's subnet is in, its AppKey is generated next. Both survive a reboot like
+    // the primary AppKey.
+    if (param->provisioner_add_net_key_comp.err_code == ESP_OK
+        || param->provisioner_add_net_key_comp.err_code == -EEXIST)
+    {
+        err = esp_ble_mesh_provisioner_add_local_app_key(NULL, net_idx,
+                BLE_MESH_TEAM_APP_IDX(BLE_MESH_NET_IDX_TEAM(net_idx)));
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Provisioner add AppKey of subnet 0x%03x failed", net_idx);
+        }
+    }
+}
+
+static void prov_app_key_comp_evt(const ble_mesh_dispatch_event_t *event)
+{
+    const esp_ble_mesh_prov_cb_param_t *param = &event->param.prov;
+    uint16_t net_idx = param->provisioner_add_app_key_comp.net_idx;
+    uint16_t app_idx = param->provisioner_add_app_key_comp.app_idx;
+    uint8_t team = BLE_MESH_NET_IDX_TEAM(net_idx);
+    const uint8_t *app_key = NULL;
+    esp_err_t err = 0;
+
+    ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_ADD_LOCAL_APP_KEY_COMP_EVT, err_code %d",
+        param->provisioner_add_app_key_comp.err_code);
+
+    // With the stack's settings enabled the AppKey survives a reboot
+    if (param->provisioner_add_app_key_comp.err_code != ESP_OK
+        && param->provisioner_add_app_key_comp.err_code != -EEXIST)
+    {
+        return;
+    }
+
+    app_key = esp_ble_mesh_provisioner_get_local_app_key(net_idx, app_idx);
+    if (team >= BLE_MESH_TEAMS_MAX || !app_key)
+    {
+        ESP_LOGE(TAG, "AppKey 0x%03x of subnet 0x%03x belongs to no team", app_idx, net_idx);
+        return;
+    }
+
+    // Nodes of the team get the key in their configuration, devices held back for it
+    // are provisioned from now on
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    if (team != BLE_MESH_TEAM_DEFAULT)
+    {
+        memcpy(team_keys[team].app_key, app_key, 16);
+    }
+    team_keys[team].app_idx = app_idx;
+    team_ready |= 1u << team;
+    prov_admit();
+    xSemaphoreGive(cfg_lock);
+
+    err = esp_ble_mesh_provisioner_bind_app_key_to_local_model(PROV_OWN_ADDR, app_idx,
+            ESP_BLE_MESH_MODEL_ID_GEN_ONOFF_CLI, ESP_BLE_MESH_CID_NVAL);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Provisioner bind local model appkey failed");
+    }
+}
+
+// Completion events that are only logged
+static void prov_comp_evt(const ble_mesh_dispatch_event_t *event)
+{
+    const esp_ble_mesh_prov_cb_param_t *param = &event->param.prov;
+
+    switch (event->event)
+    {
+        case ESP_BLE_MESH_PROVISIONER_PROV_ENABLE_COMP_EVT:
+            ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_PROV_ENABLE_COMP_EVT, err_code %d",
+                param->provisioner_prov_enable_comp.err_code);
+            break;
+        case ESP_BLE_MESH_PROVISIONER_PROV_DISABLE_COMP_EVT:
+            ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_PROV_DISABLE_COMP_EVT, err_code %d",
+                param->provisioner_prov_disable_comp.err_code);
+            break;
+        case ESP_BLE_MESH_PROVISIONER_ADD_UNPROV_DEV_COMP_EVT:
+            ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_ADD_UNPROV_DEV_COMP_EVT, err_code %d",
+                param->provisioner_add_unprov_dev_comp.err_code);
+            break;
+        case ESP_BLE_MESH_PROVISIONER_DELETE_NODE_WITH_UUID_COMP_EVT:
+            ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_DELETE_NODE_WITH_UUID_COMP_EVT, err_code %d",
+                param->provisioner_delete_node_with_uuid_comp.err_code);
+            break;
+        case ESP_BLE_MESH_PROVISIONER_DELETE_NODE_WITH_ADDR_COMP_EVT:
+            ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_DELETE_NODE_WITH_ADDR_COMP_EVT, err_code %d",
+                param->provisioner_delete_node_with_addr_comp.err_code);
+            break;
+#if CONFIG_BLE_MESH_PROVISIONER_RECV_HB
+        case ESP_BLE_MESH_PROVISIONER_ENABLE_HEARTBEAT_RECV_COMP_EVT:
+            ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_ENABLE_HEARTBEAT_RECV_COMP_EVT, err_code %d",
+                param->provisioner_enable_heartbeat_recv_comp.err_code);
+            break;
+        case ESP_BLE_MESH_PROVISIONER_SET_HEARTBEAT_FILTER_TYPE_COMP_EVT:
+            ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_SET_HEARTBEAT_FILTER_TYPE_COMP_EVT, err_code %d",
+                param->provisioner_set_heartbeat_filter_type_comp.err_code);
+            break;
+#endif
+        case ESP_BLE_MESH_PROVISIONER_SET_DEV_UUID_MATCH_COMP_EVT:
+            ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_SET_DEV_UUID_MATCH_COMP_EVT, err_code %d",
+                param->provisioner_set_dev_uuid_match_comp.err_code);
+            break;
+        case ESP_BLE_MESH_PROVISIONER_BIND_APP_KEY_TO_MODEL_COMP_EVT:
+            ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_BIND_APP_KEY_TO_MODEL_COMP_EVT, err_code %d",
+                param->provisioner_bind_app_key_to_model_comp.err_code);
+            break;
+        case ESP_BLE_MESH_PROVISIONER_SET_PROV_DATA_INFO_COMP_EVT:
+            ESP_LOGI(TAG, "ESP_BLE_MESH_PROVISIONER_SET_PROV_DATA_INFO_COMP_EVT, err_code %d",
+                param->provisioner_set_prov_data_info_comp.err_code);
+            break;
+        default:
+            break;
+    }
+}
+
+static void cfg_client_evt(const ble_mesh_dispatch_event_t *dispatched)
+{
+    esp_ble_mesh_cfg_client_cb_event_t event = dispatched->event;
+    const esp_ble_mesh_cfg_client_cb_param_t *param = &dispatched->param.cfg;
+    esp_ble_mesh_node_info_t *node = NULL;
+    uint32_t opcode;
+    uint16_t addr;
+
+    opcode = param->params->opcode;
+    addr = param->params->ctx.addr;
+
+    TRACE_MSG(event == ESP_BLE_MESH_CFG_CLIENT_TIMEOUT_EVT ? TRACE_CFG_TIMEOUT : TRACE_CFG_STATUS,
+              addr, opcode, param->error_code);
+
+    node = ble_mesh_get_node_info(addr);
+    if (!node)
+    {
+        ESP_LOGE(TAG, "%s: Get node info failed", __func__);
+        return;
+    }
+
+    if (param->error_code)
+    {
+        ESP_LOGE(TAG, "Send config client message failed, opcode 0x%04" PRIx32, opcode);
+        if (topo_is_opcode(opcode))
+        {
+            topo_result(node, opcode, METRICS_FAIL, NULL);
+            return;
+        }
+        cfg_step_result(node, opcode, METRICS_FAIL);
+        return;
+    }
+
+    if (event == ESP_BLE_MESH_CFG_CLIENT_GET_STATE_EVT || event == ESP_BLE_MESH_CFG_CLIENT_SET_STATE_EVT)
+    {
+        ble_mesh_ttl_learn_rx(addr, param->params->ctx.recv_ttl);
+    }
+
+    if (topo_is_opcode(opcode) && event != ESP_BLE_MESH_CFG_CLIENT_PUBLISH_EVT)
+    {
+        if (event == ESP_BLE_MESH_CFG_CLIENT_TIMEOUT_EVT)
+        {
+            ble_mesh_ttl_forget(addr);
+            topo_result(node, opcode, METRICS_TIMEOUT, NULL);
+        }
+        else if (opcode == ESP_BLE_MESH_MODEL_OP_HEARTBEAT_PUB_SET)
+        {
+            topo_result(node, opcode, param->status_cb.heartbeat_pub_status.status ? METRICS_FAIL : METRICS_OK, NULL);
+        }
+        else
+        {
+            topo_result(node, opcode, param->status_cb.heartbeat_sub_status.status ? METRICS_FAIL : METRICS_OK,
+                        &param->status_cb.heartbeat_sub_status);
+        }
+        return;
+    }
+
+    switch (event)
+    {
+        case ESP_BLE_MESH_CFG_CLIENT_GET_STATE_EVT:
+            if (opcode == ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_GET)
+            {
+                ESP_LOGD(TAG, "composition data %s", bt_hex(param->status_cb.comp_data_status.composition_data->data,
+                         param->status_cb.comp_data_status.composition_data->len));
+                cfg_store_comp(node, param->status_cb.comp_data_status.composition_data);
+            }
+            cfg_step_result(node, opcode, METRICS_OK);
+            break;
+        case ESP_BLE_MESH_CFG_CLIENT_SET_STATE_EVT:
+            switch (opcode)
+            {
+                case ESP_BLE_MESH_MODEL_OP_APP_KEY_ADD:
+                    cfg_step_result(node, opcode, param->status_cb.appkey_status.status ? METRICS_FAIL : METRICS_OK);
+                    break;
+                case ESP_BLE_MESH_MODEL_OP_MODEL_APP_BIND:
+                    cfg_step_result(node, opcode, param->status_cb.model_app_status.status ? METRICS_FAIL : METRICS_OK);
+                    break;
+                case ESP_BLE_MESH_MODEL_OP_MODEL_SUB_ADD:
+                    cfg_step_result(node, opcode, param->status_cb.model_sub_status.status ? METRICS_FAIL : METRICS_OK);
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case ESP_BLE_MESH_CFG_CLIENT_PUBLISH_EVT:
+            switch (opcode)
+            {
+                case ESP_BLE_MESH_MODEL_OP_COMPOSITION_DATA_STATUS:
+                    ESP_LOG_BUFFER_HEX("composition data %s", param->status_cb.comp_data_status.composition_data->data,
+                                       param->status_cb.comp_data_status.composition_data->len);
+                    break;
+                case ESP_BLE_MESH_MODEL_OP_APP_KEY_STATUS:
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case ESP_BLE_MESH_CFG_CLIENT_TIMEOUT_EVT:
+            ESP_LOGW(TAG, "node 0x%04x: config opcode 0x%04" PRIx32 " timed out", addr, opcode);
+            ble_mesh_ttl_forget(addr);
+            cfg_step_result(node, opcode, METRICS_TIMEOUT);
+            break;
+        default:
+            ESP_LOGE(TAG, "Not a config client status message event");
+            break;
+    }
+}
+
+#if CONFIG_BLE_MESH_AGG_CLI
+static void agg_client_evt(const ble_mesh_dispatch_event_t *dispatched)
+{
+    esp_ble_mesh_agg_cb_event_t event = dispatched->event;
+    const esp_ble_mesh_agg_cb_param_t *param = &dispatched->param.agg;
+    const esp_ble_mesh_client_common_param_t *params;
+    esp_ble_mesh_node_info_t *node = NULL;
+
+    switch (event)
+    {
+        case ESP_BLE_MESH_AGG_CLIENT_SEND_COMP_EVT:
+        case ESP_BLE_MESH_AGG_CLIENT_SEND_TIMEOUT_EVT:
+            params = param->client.send.params;
+            break;
+        case ESP_BLE_MESH_AGG_CLIENT_RECV_RSP_EVT:
+            params = param->client.recv.params;
+            break;
+        default:
+            return;
+    }
+
+    TRACE_MSG(event == ESP_BLE_MESH_AGG_CLIENT_SEND_TIMEOUT_EVT ? TRACE_CFG_TIMEOUT : TRACE_CFG_STATUS,
+              params->ctx.addr, params->opcode,
+              event == ESP_BLE_MESH_AGG_CLIENT_SEND_COMP_EVT ? param->client.send.err_code : 0);
+
+    node = ble_mesh_get_node_info(params->ctx.addr);
+    if (!node)
+    {
+        ESP_LOGE(TAG, "%s: Get node info failed", __func__);
+        return;
+    }
+
+    switch (event)
+    {
+        case ESP_BLE_MESH_AGG_CLIENT_SEND_COMP_EVT:
+            if (param->client.send.err_code)
+            {
+                ESP_LOGE(TAG, "Send aggregated sequence failed (err %d)", param->client.send.err_code);
+                cfg_step_result(node, params->opcode, METRICS_FAIL);
+            }
+            break;
+        case ESP_BLE_MESH_AGG_CLIENT_SEND_TIMEOUT_EVT:
+            ESP_LOGW(TAG, "node 0x%04x: aggregated sequence timed out", node->unicast);
+            ble_mesh_ttl_forget(node->unicast);
+            cfg_step_result(node, params->opcode, METRICS_TIMEOUT);
+            break;
+        default:
+            ble_mesh_ttl_learn_rx(node->unicast, params->ctx.recv_ttl);
+            cfg_agg_status(node, &param->client.recv.recv.agg_status);
+            break;
+    }
+}
+#endif
+
+// Stack events handled on the dispatcher's worker. Beacons and heartbeats repeat, and
+// statuses nobody waits for any more are only logged.
+static const ble_mesh_dispatch_entry_t dispatch_table[] = {
+    { DISPATCH_PROV, ESP_BLE_MESH_PROVISIONER_PROV_ENABLE_COMP_EVT, prov_comp_evt, false },
+    { DISPATCH_PROV, ESP_BLE_MESH_PROVISIONER_PROV_DISABLE_COMP_EVT, prov_comp_evt, false },
+    { DISPATCH_PROV, ESP_BLE_MESH_PROVISIONER_RECV_UNPROV_ADV_PKT_EVT, prov_unprov_adv_evt, true },
+    { DISPATCH_PROV, ESP_BLE_MESH_PROVISIONER_PROV_LINK_OPEN_EVT, prov_link_open_evt, false },
+    { DISPATCH_PROV, ESP_BLE_MESH_PROVISIONER_PROV_LINK_CLOSE_EVT, prov_link_close_evt, false },
+    { DISPATCH_PROV, ESP_BLE_MESH_PROVISIONER_PROV_COMPLETE_EVT, prov_complete_evt, false },
+    { DISPATCH_PROV, ESP_BLE_MESH_PROVISIONER_ADD_UNPROV_DEV_COMP_EVT, prov_comp_evt, false },
+    { DISPATCH_PROV, ESP_BLE_MESH_PROVISIONER_PROV_DEV_WITH_ADDR_COMP_EVT, prov_dev_with_addr_comp_evt, false },
+    { DISPATCH_PROV, ESP_BLE_MESH_PROVISIONER_DELETE_NODE_WITH_UUID_COMP_EVT, prov_comp_evt, false },
+    { DISPATCH_PROV, ESP_BLE_MESH_PROVISIONER_DELETE_NODE_WITH_ADDR_COMP_EVT, prov_comp_evt, false },
+#if CONFIG_BLE_MESH_PROVISIONER_RECV_HB
+    { DISPATCH_PROV, ESP_BLE_MESH_PROVISIONER_ENABLE_HEARTBEAT_RECV_COMP_EVT, prov_comp_evt, false },
+    { DISPATCH_PROV, ESP_BLE_MESH_PROVISIONER_SET_HEARTBEAT_FILTER_TYPE_COMP_EVT, prov_comp_evt, false },
+    { DISPATCH_PROV, ESP_BLE_MESH_PROVISIONER_RECV_HEARTBEAT_MESSAGE_EVT, prov_recv_heartbeat_evt, true },
+#endif
+    { DISPATCH_PROV, ESP_BLE_MESH_PROVISIONER_SET_DEV_UUID_MATCH_COMP_EVT, prov_comp_evt, false },
+    { DISPATCH_PROV, ESP_BLE_MESH_PROVISIONER_SET_NODE_NAME_COMP_EVT, prov_node_name_comp_evt, false },
+    { DISPATCH_PROV, ESP_BLE_MESH_PROVISIONER_ADD_LOCAL_NET_KEY_COMP_EVT, prov_net_key_comp_evt, false },
+    { DISPATCH_PROV, ESP_BLE_MESH_PROVISIONER_ADD_LOCAL_APP_KEY_COMP_EVT, prov_app_key_comp_evt, false },
+    { DISPATCH_PROV, ESP_BLE_MESH_PROVISIONER_SET_PROV_DATA_INFO_COMP_EVT, prov_comp_evt, false },
+    { DISPATCH_PROV, ESP_BLE_MESH_PROVISIONER_BIND_APP_KEY_TO_MODEL_COMP_EVT, prov_comp_evt, false },
+    { DISPATCH_CFG_CLIENT, ESP_BLE_MESH_CFG_CLIENT_GET_STATE_EVT, cfg_client_evt, false },
+    { DISPATCH_CFG_CLIENT, ESP_BLE_MESH_CFG_CLIENT_SET_STATE_EVT, cfg_client_evt, false },
+    { DISPATCH_CFG_CLIENT, ESP_BLE_MESH_CFG_CLIENT_PUBLISH_EVT, cfg_client_evt, true },
+    { DISPATCH_CFG_CLIENT, ESP_BLE_MESH_CFG_CLIENT_TIMEOUT_EVT, cfg_client_evt, false },
+#if CONFIG_BLE_MESH_AGG_CLI
+    { DISPATCH_AGG, ESP_BLE_MESH_AGG_CLIENT_SEND_COMP_EVT, agg_client_evt, false },
+    { DISPATCH_AGG, ESP_BLE_MESH_AGG_CLIENT_SEND_TIMEOUT_EVT, agg_client_evt, false },
+    { DISPATCH_AGG, ESP_BLE_MESH_AGG_CLIENT_RECV_RSP_EVT, agg_client_evt, false },
+#endif
+};
+
+// Node records of older store versions, cfg_lock held. Versions 1 and 2 numbered the
+// states without NODE_CFG_AGGREGATE. Version 1 bound only the OnOff Server, so bound
+// nodes go back to the bind step for the other models; they stay operational meanwhile.
+static bool store_migrate(esp_ble_mesh_node_info_t *node, uint8_t version)
+{
+    static const uint8_t v1_states[] = {
+        NODE_CFG_COMP_DATA_GET,
+        NODE_CFG_APP_KEY_ADD,
+        NODE_CFG_MODEL_APP_BIND,
+        NODE_CFG_MODEL_APP_BIND,    // subscriptions
+        NODE_CFG_MODEL_APP_BIND,    // done
+        NODE_CFG_FAILED,
+    };
+    static const uint8_t v2_states[] = {
+        NODE_CFG_COMP_DATA_GET,
+        NODE_CFG_APP_KEY_ADD,
+        NODE_CFG_MODEL_APP_BIND,
+        NODE_CFG_MODEL_SUB_ADD,
+        NODE_CFG_DONE,
+        NODE_CFG_FAILED,
+    };
+    const uint8_t *states = version == 1 ? v1_states : v2_states;
+
+    if (version > 2 || node->cfg_state >= sizeof(v2_states))
+    {
+        return false;
+    }
+
+    node->cfg_state = states[node->cfg_state];
+    store_mark_dirty(node);
+    return true;
+}
+
+// Nodes the stack still knows without a usable record of ours, dropped by a format or
+// AppKey change or provisioned just before a reboot, are configured from the start.
+// cfg_lock held.
+static size_t adopt_stack_nodes(int64_t now)
+{
+    const esp_ble_mesh_node_t **table;
+    size_t adopted = 0;
+
+    if (!esp_ble_mesh_provisioner_get_prov_node_count())
+    {
+        return 0;
+    }
+
+    table = esp_ble_mesh_provisioner_get_node_table_entry();
+    for (int i = 0; table && i < CONFIG_BLE_MESH_MAX_PROV_NODES; i++)
+    {
+        const esp_ble_mesh_node_t *known = table[i];
+        esp_ble_mesh_node_info_t *node;
+
+        if (!known || ble_mesh_registry_find_uuid(known->dev_uuid))
+        {
+            continue;
+        }
+
+        node = ble_mesh_registry_store(known->dev_uuid, known->unicast_addr, known->element_num);
+        if (!node)
+        {
+            ESP_LOGW(TAG, "%s: no registry slot for node 0x%04x", __func__, known->unicast_addr);
+            continue;
+        }
+
+        node->team = BLE_MESH_NET_IDX_TEAM(known->net_idx);
+        node->cfg_state = NODE_CFG_COMP_DATA_GET;
+        node->prov_time_us = now;
+        node->cfg_step_us = now;
+        store_mark_dirty(node);
+        adopted++;
+    }
+
+    return adopted;
+}
+
+// Rebuilds the registry from the node records in flash, when there are any, and the
+// stack's own node table
+static void ble_mesh_restore_nodes(bool from_store)
+{
+    int64_t now = esp_timer_get_time();
+    size_t restored = 0;
+    size_t adopted;
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    if (from_store)
+    {
+        ble_mesh_store_restore(store_migrate, &restored);
+    }
+    restored_count = restored;
+    adopted = adopt_stack_nodes(now);
+    for (size_t i = 0; i < ble_mesh_registry_count(); i++)
+    {
+        esp_ble_mesh_node_info_t *node = ble_mesh_registry_at(i);
+
+        // A step given up on before the reboot gets a fresh chain, an
+        // interrupted bind batch or aggregated chain starts over
+        if (node->cfg_state == NODE_CFG_FAILED)
+        {
+            node->cfg_state = NODE_CFG_COMP_DATA_GET;
+        }
+        cfg_index_models(node);
+        if (node->cfg_state == NODE_CFG_AGGREGATE)
+        {
+            cfg_start_agg(node);
+        }
+        if (node->cfg_state == NODE_CFG_MODEL_APP_BIND)
+        {
+            cfg_start_bind(node);
+        }
+        cfg_next_group(node, now);
+        ble_mesh_addr_claim(node->unicast, node->elem_num);
+
+        // Operational nodes kept publishing heartbeats, a Set is only sent to those
+        // not heard within a period and a half
+        if (node->cfg_state == NODE_CFG_DONE)
+        {
+            ble_mesh_topology_add(node->unicast, team_key(node)->net_idx, now);
+            node->topo_next_us = now + 3LL * TOPOLOGY_HB_PERIOD_MS * 1000 / 2;
+        }
+    }
+    cfg_schedule();
+    xSemaphoreGive(cfg_lock);
+
+    ESP_LOGI(TAG, "Restored %u nodes from flash, %u from the stack to configure again", (unsigned)restored,
+             (unsigned)adopted);
+}
+
+esp_err_t ble_mesh_provisioner_init(void)
+{
+    uint8_t match[] = BLE_MESH_UUID_MATCH;
+    esp_err_t error = ESP_OK;
+
+    esp_timer_create_args_t cfg_timer_args = {
+        .callback = cfg_timer_cb,
+        .name = "prov_cfg",
+    };
+
+    esp_timer_create_args_t store_timer_args = {
+        .callback = store_timer_cb,
+        .name = "prov_store",
+    };
+
+    init_time_us = esp_timer_get_time();
+    ble_mesh_boot_begin(BOOT_PROVISIONER);
+
+    ble_mesh_registry_init();
+    ble_mesh_filter_init();
+    ble_mesh_admission_init();
+    ble_mesh_addr_init(provision.prov_start_address);
+    ble_mesh_topology_init(PROV_OWN_ADDR, init_time_us);
+
+    cfg_lock = xSemaphoreCreateMutex();
+    if (!cfg_lock)
+    {
+        ESP_LOGE(TAG, "Failed to create configuration lock");
+        return ESP_ERR_NO_MEM;
+    }
+
+    error = esp_timer_create(&cfg_timer_args, &cfg_timer);
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to create configuration timer (err %d)", error);
+        return error;
+    }
+
+    for (uint8_t team = 0; team < BLE_MESH_TEAMS_MAX; team++)
+    {
+        team_keys[team].net_idx = BLE_MESH_TEAM_NET_IDX(team);
+        team_keys[team].app_idx = BLE_MESH_TEAM_APP_IDX(team);
+    }
+    memset(team_keys[BLE_MESH_TEAM_DEFAULT].app_key, APP_KEY_OCTET, 16);
+    team_ready = 1u << BLE_MESH_TEAM_DEFAULT;
+    prov_team = BLE_MESH_TEAM_DEFAULT;
+
+    error = ble_mesh_dispatch_init(dispatch_table, sizeof(dispatch_table) / sizeof(dispatch_table[0]));
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start event dispatcher (err %d)", error);
+        return error;
+    }
+
+    // Everything above runs while the host syncs
+    error = bluetooth_wait_sync();
+    if (error != ESP_OK)
+    {
+        return error;
+    }
+
+    ble_mesh_boot_begin(BOOT_PROVISIONER_MESH);
+    error = esp_ble_mesh_init(&provision, &composition);
     if (error != ESP_OK)
     {
         ESP_LOGE(TAG, "Failed to initialize mesh stack (error %d)", error);
         return error;
     }
 
+    // The stack has loaded its own node database by now, nodes it still knows
+    // resume from their last confirmed configuration step
+    if (ble_mesh_store_open(team_keys[BLE_MESH_TEAM_DEFAULT].net_idx, team_keys[BLE_MESH_TEAM_DEFAULT].app_idx,
+                            team_keys[BLE_MESH_TEAM_DEFAULT].app_key) == ESP_OK
+        && esp_timer_create(&store_timer_args, &store_timer) == ESP_OK)
+    {
+        ble_mesh_restore_nodes(true);
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Node database unavailable, configuration is not persisted");
+        ble_mesh_restore_nodes(false);
+    }
+
     error = esp_ble_mesh_provisioner_set_dev_uuid_match(match, sizeof(match), 0x0, false);
     if (error != ESP_OK)
     {
@@ -498,14 +2655,46 @@ static esp_err_t ble_mesh_init(void)
         return error;
     }
 
-    error = esp_ble_mesh_provisioner_add_local_app_key(prov_key.app_key, prov_key.net_idx, prov_key.app_idx);
+#if CONFIG_BLE_MESH_PROVISIONER_RECV_HB
+    // Heartbeats of every node, the filter rejects none
+    error = esp_ble_mesh_provisioner_recv_heartbeat(true);
+    if (error == ESP_OK)
+    {
+        error = esp_ble_mesh_provisioner_set_heartbeat_filter_type(ESP_BLE_MESH_PROVISIONER_HB_FILTER_REJECT_LIST);
+    }
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to enable heartbeat reception (err %d)", error);
+        return error;
+    }
+#endif
+
+    error = esp_ble_mesh_provisioner_add_local_app_key(team_keys[BLE_MESH_TEAM_DEFAULT].app_key,
+                                                       team_keys[BLE_MESH_TEAM_DEFAULT].net_idx,
+                                                       team_keys[BLE_MESH_TEAM_DEFAULT].app_idx);
     if (error != ESP_OK)
     {
         ESP_LOGE(TAG, "Failed to add local AppKey (err %d)", error);
         return error;
     }
 
+    // The other teams' keys are generated by the stack, their devices wait for them
+    for (uint8_t team = BLE_MESH_TEAM_DEFAULT + 1; team < BLE_MESH_TEAMS_MAX; team++)
+    {
+        error = esp_ble_mesh_provisioner_add_local_net_key(NULL, team_keys[team].net_idx);
+        if (error != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to add NetKey of team %d (err %d)", team, error);
+            return error;
+        }
+    }
+
+    ble_mesh_boot_end(BOOT_PROVISIONER_MESH);
+    ble_mesh_boot_end(BOOT_PROVISIONER);
     ESP_LOGI(TAG, "BLE Mesh Provisioner initialized");
 
-    return error;
+    // Without a console the fleet is still provisioned
+    ble_mesh_provisioner_register_console();
+
+    return ESP_OK;
 }
@@ -1,13 +1,14 @@
 #ifndef DEZIBOT_BLUETOOTH_MESH_PROVISIONER_H
 #define DEZIBOT_BLUETOOTH_MESH_PROVISIONER_H
 
+#include "admission.h"
+#include "beacon_filter.h"
 #include "common.h"
-
-typedef struct {
-    uint8_t  uuid[16];
-    uint16_t unicast;
-    uint8_t  elem_num;
-} esp_ble_mesh_node_info_t;
+#include "dispatcher.h"
+#include "node_registry.h"
+#include "team.h"
+#include "topology.h"
+#include "ttl_cache.h"
 
 typedef struct esp_ble_mesh_key {
     uint16_t net_idx;
@@ -15,6 +16,100 @@ typedef struct esp_ble_mesh_key {
     uint8_t  app_key[16];
 } esp_ble_mesh_prov_key_t;
 
-static esp_err_t ble_mesh_init(void);
+// Nodes configured since boot through one path, sums of messages sent and time to operational
+typedef struct {
+    uint16_t nodes;
+    uint32_t round_trips;
+    uint32_t config_ms;
+} ble_mesh_provisioner_path_stats_t;
+
+typedef struct {
+    uint16_t nodes;
+    uint16_t operational;
+    uint16_t failed;
+    uint16_t in_flight;
+    uint32_t retries;
+    uint32_t ttop_avg_ms;   // time from provisioning complete to models bound
+    uint32_t ttop_max_ms;
+    uint16_t restored;      // nodes loaded from flash at boot
+    uint32_t boot_ready_ms; // init until every known node was operational, 0 while one is not
+    ble_mesh_provisioner_path_stats_t aggregated;   // through Opcodes Aggregator sequences
+    ble_mesh_provisioner_path_stats_t chain;        // one configuration message at a time
+    ble_mesh_filter_stats_t beacons;                // unprovisioned device beacons reported by the stack
+    ble_mesh_admission_stats_t admission;           // provisioning slots and links per bearer
+    ble_mesh_ttl_stats_t ttl;                       // send TTLs taken from learned hop counts
+    ble_mesh_topology_stats_t topology;             // heartbeats and neighbor probes
+    ble_mesh_dispatch_stats_t dispatch;             // stack events handed to the worker task
+} ble_mesh_provisioner_fleet_stats_t;
+
+esp_err_t ble_mesh_provisioner_init(void);
+
+// Before ble_mesh_provisioner_init(), or on a node not running the provisioner, the calls
+// below other than allow_device() and set_team() find no nodes: ESP_ERR_INVALID_STATE,
+// an empty result or zeroed stats
+
+// Subscribes the primary Generic OnOff Server of every node, current and future, to group_addr
+// so one message to the group reaches the whole team it is sent to
+esp_err_t ble_mesh_provisioner_add_group(uint16_t group_addr);
+
+// Copies the unicast addresses of operational nodes in ascending order, returns the count.
+// These are the members of every group added with ble_mesh_provisioner_add_group(),
+// over all teams.
+size_t ble_mesh_provisioner_get_operational(uint16_t *addrs, size_t max);
+
+// Milliseconds the node needed from provisioning to operational, -1 while not operational
+int32_t ble_mesh_provisioner_time_to_operational(uint16_t unicast);
+
+// Looks up a server model in the composition data of the node owning the element
+// address. ESP_OK when the element has it, ESP_ERR_NOT_SUPPORTED when it does not,
+// ESP_ERR_NOT_FOUND while the node or its composition data is unknown. Only the
+// generic server models bound during configuration are indexed, ESP_ERR_INVALID_ARG otherwise.
+esp_err_t ble_mesh_provisioner_has_model(uint16_t addr, uint16_t model_id);
+
+// Copies the element addresses of operational nodes having the server model in
+// ascending order, returns the count
+size_t ble_mesh_provisioner_get_nodes_with_model(uint16_t model_id, uint16_t *addrs, size_t max);
+
+// Restricts provisioning to devices put on the allowlist, best called before
+// ble_mesh_provisioner_init(). Without any, every device with the fleet UUID prefix is provisioned.
+esp_err_t ble_mesh_provisioner_allow_device(const uint8_t uuid[16]);
+
+// Puts the device into a team, below BLE_MESH_TEAMS_MAX, best called before
+// ble_mesh_provisioner_init(). Devices not assigned join BLE_MESH_TEAM_DEFAULT. The team
+// takes effect when the device is provisioned; a node changes team after
+// ble_mesh_provisioner_remove_node() or a factory reset.
+esp_err_t ble_mesh_provisioner_set_team(const uint8_t uuid[16], uint8_t team);
+
+// Team of the node owning the element address, ESP_ERR_NOT_FOUND while the node is unknown
+esp_err_t ble_mesh_provisioner_get_team(uint16_t addr, uint8_t *team);
+
+// Like ble_mesh_provisioner_get_operational(), for the nodes of one team
+size_t ble_mesh_provisioner_get_team_members(uint8_t team, uint16_t *addrs, size_t max);
+
+// Removes a node from the mesh stack, the registry and flash. Its address range is
+// handed to the next device of the same size.
+esp_err_t ble_mesh_provisioner_remove_node(uint16_t unicast);
+
+// Highest unicast address held by a node or a device being provisioned, 0 while none is
+uint16_t ble_mesh_provisioner_addr_high(void);
+
+// Hop count, heartbeat state and neighbors of a node. Every operational node publishes
+// heartbeats to all nodes and in turn listens to each peer within a hop of its own
+// distance, a peer it heard directly is a neighbor.
+esp_err_t ble_mesh_provisioner_get_topology(uint16_t unicast, ble_mesh_topology_node_t *node);
+
+// Copies the neighbors of a node in ascending order, the provisioner included, returns the count
+size_t ble_mesh_provisioner_get_neighbors(uint16_t unicast, uint16_t *addrs, size_t max);
+
+// Copies the nodes whose heartbeats are late or whose link weakened, returns the count
+size_t ble_mesh_provisioner_get_at_risk(uint16_t *addrs, size_t max);
+
+// Prints the topology map
+void ble_mesh_provisioner_dump_topology(void);
+
+// Registers the "mesh_topology" console command, ble_mesh_provisioner_init() does
+esp_err_t ble_mesh_provisioner_register_console(void);
+
+void ble_mesh_provisioner_get_fleet_stats(ble_mesh_provisioner_fleet_stats_t *stats);
 
 #endif //DEZIBOT_BLUETOOTH_MESH_PROVISIONER_H
\ No newline at end of file
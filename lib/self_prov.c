@@ -0,0 +1,341 @@
+#include "self_prov.h"
+
+#include "esp_console.h"
+#include "addr_alloc.h"
+#include "nvs.h"
+#include "team.h"
+
+#define TAG                 "SELF_PROV"
+
+#define CREDS_NAMESPACE     "mesh_creds"
+#define CREDS_KEY           "creds"
+
+// Little endian record:
+//   version, net_idx, app_idx, iv_index, addr, net_key[16], app_key[16], dev_key[16]
+#define CREDS_LEN           (1 + 2 + 2 + 4 + 2 + 3 * 16)
+
+// The stack's task answers within a few queued events
+#define PROV_TIMEOUT_MS     1000
+
+#if SELF_PROV_ENABLED
+// The stack's own provisioning entry point, which a completed provisioning link ends
+// in as well. ESP-IDF has no public API for it.
+int bt_mesh_provision(const uint8_t net_key[16], uint16_t net_idx, uint8_t flags, uint32_t iv_index,
+                      uint16_t addr, const uint8_t dev_key[16]);
+#endif
+
+static bool enabled = SELF_PROV_ENABLED;
+
+// Credentials handed to the stack's task and its answer
+static SemaphoreHandle_t prov_done;
+static portMUX_TYPE prov_lock = portMUX_INITIALIZER_UNLOCKED;
+static ble_mesh_credentials_t prov_creds;
+static bool prov_pending;
+static int prov_err;
+
+static void put_le16(uint8_t *buf, uint16_t val)
+{
+    buf[0] = val;
+    buf[1] = val >> 8;
+}
+
+static uint16_t get_le16(const uint8_t *buf)
+{
+    return buf[0] | buf[1] << 8;
+}
+
+static void put_le32(uint8_t *buf, uint32_t val)
+{
+    put_le16(buf, val);
+    put_le16(buf + 2, val >> 16);
+}
+
+static uint32_t get_le32(const uint8_t *buf)
+{
+    return get_le16(buf) | (uint32_t)get_le16(buf + 2) << 16;
+}
+
+esp_err_t ble_mesh_self_prov_store(const ble_mesh_credentials_t *creds)
+{
+    uint8_t record[CREDS_LEN];
+    nvs_handle_t handle;
+    esp_err_t error;
+
+    if (!creds || !ESP_BLE_MESH_ADDR_IS_UNICAST(creds->addr))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // The provisioner would hand the address to another robot
+    if (creds->addr >= ADDR_ALLOC_START && creds->addr - ADDR_ALLOC_START < ADDR_ALLOC_WINDOW)
+    {
+        ESP_LOGE(TAG, "%s: 0x%04x is in the provisioner's range 0x%04x+%d", __func__, creds->addr,
+                 ADDR_ALLOC_START, ADDR_ALLOC_WINDOW);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    record[0] = SELF_PROV_VERSION;
+    put_le16(record + 1, creds->net_idx);
+    put_le16(record + 3, creds->app_idx);
+    put_le32(record + 5, creds->iv_index);
+    put_le16(record + 9, creds->addr);
+    memcpy(record + 11, creds->net_key, 16);
+    memcpy(record + 27, creds->app_key, 16);
+    for (int i = 0; i < 16; i += 4)
+    {
+        put_le32(record + 43 + i, esp_random());
+    }
+
+    error = nvs_open(CREDS_NAMESPACE, NVS_READWRITE, &handle);
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: open namespace failed (err %d)", __func__, error);
+        return error;
+    }
+    error = nvs_set_blob(handle, CREDS_KEY, record, sizeof(record));
+    if (error == ESP_OK)
+    {
+        error = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: write failed (err %d)", __func__, error);
+    }
+
+    return error;
+}
+
+esp_err_t ble_mesh_self_prov_load(ble_mesh_credentials_t *creds)
+{
+    uint8_t record[CREDS_LEN];
+    size_t len = sizeof(record);
+    nvs_handle_t handle;
+    esp_err_t error;
+
+    error = nvs_open(CREDS_NAMESPACE, NVS_READONLY, &handle);
+    if (error != ESP_OK)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    error = nvs_get_blob(handle, CREDS_KEY, record, &len);
+    nvs_close(handle);
+    if (error != ESP_OK || len != sizeof(record) || record[0] != SELF_PROV_VERSION)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    creds->net_idx = get_le16(record + 1);
+    creds->app_idx = get_le16(record + 3);
+    creds->iv_index = get_le32(record + 5);
+    creds->addr = get_le16(record + 9);
+    memcpy(creds->net_key, record + 11, 16);
+    memcpy(creds->app_key, record + 27, 16);
+    memcpy(creds->dev_key, record + 43, 16);
+
+    return ESP_OK;
+}
+
+esp_err_t ble_mesh_self_prov_erase(void)
+{
+    nvs_handle_t handle;
+    esp_err_t error;
+
+    error = nvs_open(CREDS_NAMESPACE, NVS_READWRITE, &handle);
+    if (error != ESP_OK)
+    {
+        return error;
+    }
+    error = nvs_erase_key(handle, CREDS_KEY);
+    if (error == ESP_OK)
+    {
+        error = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    return error == ESP_ERR_NVS_NOT_FOUND ? ESP_OK : error;
+}
+
+void ble_mesh_self_prov_set_enabled(bool enable)
+{
+    enabled = SELF_PROV_ENABLED && enable;
+}
+
+bool ble_mesh_self_prov_enabled(void)
+{
+    return enabled;
+}
+
+esp_err_t ble_mesh_self_prov_provision(const ble_mesh_credentials_t *creds)
+{
+#if SELF_PROV_ENABLED
+    esp_err_t error;
+    bool pending;
+
+    if (esp_ble_mesh_node_is_provisioned())
+    {
+        ESP_LOGE(TAG, "%s: node is already provisioned", __func__);
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!prov_done && !(prov_done = xSemaphoreCreateBinary()))
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // bt_mesh_provision() has to run on the stack's task. Disabling provisioning, off
+    // until the node is provisioned anyway, gets there and is answered from there.
+    prov_creds = *creds;
+    prov_pending = true;
+    error = esp_ble_mesh_node_prov_disable((esp_ble_mesh_prov_bearer_t)(ESP_BLE_MESH_PROV_ADV | ESP_BLE_MESH_PROV_GATT));
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: reaching the stack's task failed (err %d)", __func__, error);
+        prov_pending = false;
+        memset(&prov_creds, 0, sizeof(prov_creds));
+        return error;
+    }
+
+    if (xSemaphoreTake(prov_done, pdMS_TO_TICKS(PROV_TIMEOUT_MS)) != pdTRUE)
+    {
+        taskENTER_CRITICAL(&prov_lock);
+        pending = prov_pending;
+        prov_pending = false;
+        taskEXIT_CRITICAL(&prov_lock);
+        if (pending)
+        {
+            ESP_LOGE(TAG, "%s: no answer from the stack's task", __func__);
+            memset(&prov_creds, 0, sizeof(prov_creds));
+            return ESP_ERR_TIMEOUT;
+        }
+        // It took the credentials just now
+        xSemaphoreTake(prov_done, portMAX_DELAY);
+    }
+    memset(&prov_creds, 0, sizeof(prov_creds));
+
+    if (prov_err)
+    {
+        ESP_LOGE(TAG, "%s: provisioning as 0x%04x failed (err %d)", __func__, creds->addr, prov_err);
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Provisioned as 0x%04x from stored credentials", creds->addr);
+    return ESP_OK;
+#else
+    (void)creds;
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+void ble_mesh_self_prov_prov_disabled(void)
+{
+#if SELF_PROV_ENABLED
+    bool pending;
+
+    taskENTER_CRITICAL(&prov_lock);
+    pending = prov_pending;
+    prov_pending = false;
+    taskEXIT_CRITICAL(&prov_lock);
+    if (!pending)
+    {
+        return;
+    }
+
+    prov_err = bt_mesh_provision(prov_creds.net_key, prov_creds.net_idx, 0, prov_creds.iv_index, prov_creds.addr,
+                                 prov_creds.dev_key);
+    xSemaphoreGive(prov_done);
+#endif
+}
+
+static bool parse_key(const char *hex, uint8_t key[16])
+{
+    if (strlen(hex) != 32)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < 16; i++)
+    {
+        unsigned int byte;
+
+        if (sscanf(hex + 2 * i, "%2x", &byte) != 1)
+        {
+            return false;
+        }
+        key[i] = byte;
+    }
+
+    return true;
+}
+
+static int self_prov_console_cmd(int argc, char **argv)
+{
+    ble_mesh_credentials_t creds = {};
+
+    if (argc == 2 && !strcmp(argv[1], "erase"))
+    {
+        return ble_mesh_self_prov_erase() == ESP_OK ? 0 : 1;
+    }
+
+    if ((argc == 6 || argc == 7) && !strcmp(argv[1], "set"))
+    {
+        char *end;
+        unsigned long team = strtoul(argv[2], &end, 0);
+
+        // The keys are those of the team's subnet and AppKey, stored under its indexes
+        if (end == argv[2] || *end || team >= BLE_MESH_TEAMS_MAX)
+        {
+            printf("team is a number below %d\n", BLE_MESH_TEAMS_MAX);
+            return 1;
+        }
+        creds.net_idx = BLE_MESH_TEAM_NET_IDX(team);
+        creds.app_idx = BLE_MESH_TEAM_APP_IDX(team);
+        creds.addr = strtoul(argv[5], NULL, 0);
+        creds.iv_index = argc == 7 ? strtoul(argv[6], NULL, 0) : 0;
+        if (!parse_key(argv[3], creds.net_key) || !parse_key(argv[4], creds.app_key))
+        {
+            printf("keys are 32 hex digits\n");
+            return 1;
+        }
+        if (ble_mesh_self_prov_store(&creds) != ESP_OK)
+        {
+            return 1;
+        }
+        printf("stored, used from the next boot\n");
+        return 0;
+    }
+
+    if (argc > 1)
+    {
+        printf("usage: %s [set <team> <net_key> <app_key> <addr> [iv_index]|erase]\n", argv[0]);
+        return 1;
+    }
+
+    if (ble_mesh_self_prov_load(&creds) != ESP_OK)
+    {
+        printf("no credentials stored\n");
+        return 0;
+    }
+    printf("addr 0x%04x, team %u (net_idx 0x%03x, app_idx 0x%03x), iv_index %" PRIu32 ", zero-touch %s\n",
+           creds.addr, BLE_MESH_NET_IDX_TEAM(creds.net_idx), creds.net_idx, creds.app_idx, creds.iv_index,
+           enabled ? "on" : "off");
+    return 0;
+}
+
+esp_err_t ble_mesh_self_prov_register_console(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "mesh_creds",
+        .help = "Network credentials the node provisions itself with at boot. 'set' stores the "
+                "NetKey and AppKey of a team's subnet, 'erase' removes them, without arguments "
+                "they are shown (keys left out).",
+        .hint = "[set <team> <net_key> <app_key> <addr> [iv_index]|erase]",
+        .func = self_prov_console_cmd,
+    };
+    esp_err_t error = esp_console_cmd_register(&cmd);
+
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: failed to register command (err %d)", __func__, error);
+    }
+
+    return error;
+}
@@ -0,0 +1,57 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_SELF_PROV_H
+#define DEZIBOT_BLUETOOTH_MESH_SELF_PROV_H
+
+#include "common.h"
+
+// Build with 0 to leave out zero-touch provisioning, nodes then always wait for a provisioner
+#ifndef SELF_PROV_ENABLED
+#define SELF_PROV_ENABLED       1
+#endif
+
+// Bump when the record layout changes, records of other versions are ignored
+#define SELF_PROV_VERSION       1
+
+// Network credentials a robot provisions itself with. They are written once per robot,
+// at flashing time or through the console, and must match the fleet's provisioner.
+typedef struct {
+    uint8_t  net_key[16];
+    uint8_t  app_key[16];
+    uint16_t net_idx;
+    uint16_t app_idx;
+    uint32_t iv_index;
+    uint16_t addr;          // primary element address, unique in the fleet and outside the
+                            // provisioner's range, ADDR_ALLOC_WINDOW from ADDR_ALLOC_START
+    uint8_t  dev_key[16];   // generated when stored, nobody else configures the node
+} ble_mesh_credentials_t;
+
+// Stores creds with a new random device key. ESP_ERR_INVALID_ARG for an address the
+// provisioner may assign.
+esp_err_t ble_mesh_self_prov_store(const ble_mesh_credentials_t *creds);
+
+// ESP_ERR_NOT_FOUND without a stored record of this version
+esp_err_t ble_mesh_self_prov_load(ble_mesh_credentials_t *creds);
+
+esp_err_t ble_mesh_self_prov_erase(void);
+
+// Turns zero-touch provisioning off for this boot even with credentials stored,
+// call before ble_mesh_client_init()
+void ble_mesh_self_prov_set_enabled(bool enabled);
+bool ble_mesh_self_prov_enabled(void);
+
+// Provisions the local node with creds, without a provisioning link. The node is
+// provisioned when this returns ESP_OK; its AppKey and bindings are added after.
+// The stack's internal entry point runs on the stack's task, reached through
+// esp_ble_mesh_node_prov_disable(), so call it after esp_ble_mesh_init() on an
+// unprovisioned node, before provisioning is enabled. ble_mesh_client_init() does so.
+// ESP_ERR_INVALID_STATE on a provisioned node.
+esp_err_t ble_mesh_self_prov_provision(const ble_mesh_credentials_t *creds);
+
+// Hands pending credentials to the stack, call from the provisioning callback on
+// ESP_BLE_MESH_NODE_PROV_DISABLE_COMP_EVT
+void ble_mesh_self_prov_prov_disabled(void);
+
+// Registers "mesh_creds [set <team> <net_key> <app_key> <addr> [iv_index]|erase]",
+// ble_mesh_client_init() does
+esp_err_t ble_mesh_self_prov_register_console(void);
+
+#endif //DEZIBOT_BLUETOOTH_MESH_SELF_PROV_H
@@ -0,0 +1,21 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_TEAM_H
+#define DEZIBOT_BLUETOOTH_MESH_TEAM_H
+
+#include <stdint.h>
+#include <sys/param.h>
+
+#include "sdkconfig.h"
+
+// Robot teams, a subnet each. Team t's robots are provisioned with NetKey index t and
+// talk with AppKey index t, so they neither relay nor decrypt the other teams' traffic.
+// Team 0 is the primary subnet, the team of every robot not assigned to another.
+#define BLE_MESH_TEAMS_MAX          MIN(CONFIG_BLE_MESH_PROVISIONER_SUBNET_COUNT, \
+                                        CONFIG_BLE_MESH_PROVISIONER_APP_KEY_COUNT)
+#define BLE_MESH_TEAM_DEFAULT       0
+
+#define BLE_MESH_TEAM_NET_IDX(team) ((uint16_t)(team))
+#define BLE_MESH_TEAM_APP_IDX(team) ((uint16_t)(team))
+#define BLE_MESH_NET_IDX_TEAM(idx)  ((uint8_t)(idx))
+#define BLE_MESH_APP_IDX_TEAM(idx)  ((uint8_t)(idx))
+
+#endif //DEZIBOT_BLUETOOTH_MESH_TEAM_H
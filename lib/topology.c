@@ -0,0 +1,429 @@
+#include "topology.h"
+#include "common.h"
+
+typedef struct {
+    uint16_t addr;
+    uint8_t  hops;
+    bool     grew;          // more hops than at the heartbeat before
+    uint16_t features;
+    int8_t   rssi;
+    uint16_t probe;         // peer probed last
+    uint16_t net_idx;       // subnet of its heartbeats, peers elsewhere cannot be heard
+    int64_t  heard_us;      // last heartbeat, or when the node was added
+} topology_entry_t;
+
+// Each link once, lower address first
+typedef struct {
+    uint16_t a;
+    uint16_t b;
+} topology_link_t;
+
+static const char *const state_names[] = {
+    [TOPOLOGY_ONLINE] = "online",
+    [TOPOLOGY_WEAK] = "weak",
+    [TOPOLOGY_LATE] = "late",
+    [TOPOLOGY_LOST] = "lost",
+};
+
+static uint16_t own;
+static topology_entry_t entries[TOPOLOGY_NODES_MAX];   // ascending address
+static uint16_t entry_count;
+static topology_link_t links[TOPOLOGY_LINKS_MAX];
+static uint16_t link_count;
+
+// Compressed adjacency rebuilt from the link list after it or the entries changed:
+// the neighbors of entries[i] are the entry indexes adjacency[offsets[i]..offsets[i + 1])
+static uint16_t offsets[TOPOLOGY_NODES_MAX + 1];
+static uint16_t adjacency[2 * TOPOLOGY_LINKS_MAX];
+static bool adjacency_stale;
+
+static ble_mesh_topology_stats_t stats;
+
+// Index of the first entry at or above addr
+static uint16_t entry_lower_bound(uint16_t addr)
+{
+    uint16_t lo = 0;
+    uint16_t hi = entry_count;
+
+    while (lo < hi)
+    {
+        uint16_t mid = (lo + hi) / 2;
+
+        if (entries[mid].addr < addr)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static topology_entry_t *entry_find(uint16_t addr)
+{
+    uint16_t i = entry_lower_bound(addr);
+
+    return i < entry_count && entries[i].addr == addr ? &entries[i] : NULL;
+}
+
+static topology_entry_t *entry_insert(uint16_t addr, int64_t now_us)
+{
+    uint16_t i = entry_lower_bound(addr);
+
+    if (i < entry_count && entries[i].addr == addr)
+    {
+        return &entries[i];
+    }
+    if (entry_count == TOPOLOGY_NODES_MAX)
+    {
+        stats.dropped++;
+        return NULL;
+    }
+
+    memmove(&entries[i + 1], &entries[i], (entry_count - i) * sizeof(entries[0]));
+    memset(&entries[i], 0, sizeof(entries[i]));
+    entries[i].addr = addr;
+    entries[i].heard_us = now_us;
+    entry_count++;
+    adjacency_stale = true;
+
+    return &entries[i];
+}
+
+static int link_find(uint16_t a, uint16_t b)
+{
+    uint16_t lo = MIN(a, b);
+    uint16_t hi = MAX(a, b);
+
+    for (int i = 0; i < link_count; i++)
+    {
+        if (links[i].a == lo && links[i].b == hi)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void link_set(uint16_t a, uint16_t b, bool linked)
+{
+    int i = link_find(a, b);
+
+    if (linked && i < 0)
+    {
+        if (link_count == TOPOLOGY_LINKS_MAX)
+        {
+            stats.dropped++;
+            return;
+        }
+        links[link_count].a = MIN(a, b);
+        links[link_count].b = MAX(a, b);
+        link_count++;
+        adjacency_stale = true;
+    }
+    else if (!linked && i >= 0)
+    {
+        links[i] = links[--link_count];
+        adjacency_stale = true;
+    }
+}
+
+// Counting sort of both directions of every link by entry index
+static void adjacency_build(void)
+{
+    if (!adjacency_stale)
+    {
+        return;
+    }
+
+    memset(offsets, 0, sizeof(offsets));
+    for (uint16_t i = 0; i < link_count; i++)
+    {
+        offsets[entry_lower_bound(links[i].a) + 1]++;
+        offsets[entry_lower_bound(links[i].b) + 1]++;
+    }
+    // offsets[i + 1] becomes the start of entry i, filling moves it on to the start of i + 1
+    for (uint16_t i = 0, start = 0; i < entry_count; i++)
+    {
+        uint16_t degree = offsets[i + 1];
+
+        offsets[i + 1] = start;
+        start += degree;
+    }
+    for (uint16_t i = 0; i < link_count; i++)
+    {
+        uint16_t a = entry_lower_bound(links[i].a);
+        uint16_t b = entry_lower_bound(links[i].b);
+
+        adjacency[offsets[a + 1]++] = b;
+        adjacency[offsets[b + 1]++] = a;
+    }
+
+    // Neighbors in ascending address order, lists are short
+    for (uint16_t i = 0; i < entry_count; i++)
+    {
+        for (uint16_t j = offsets[i] + 1; j < offsets[i + 1]; j++)
+        {
+            uint16_t v = adjacency[j];
+            uint16_t k = j;
+
+            for (; k > offsets[i] && adjacency[k - 1] > v; k--)
+            {
+                adjacency[k] = adjacency[k - 1];
+            }
+            adjacency[k] = v;
+        }
+    }
+
+    adjacency_stale = false;
+}
+
+static ble_mesh_topology_state_t entry_state(const topology_entry_t *entry, int64_t now_us)
+{
+    int64_t silent_us = now_us - entry->heard_us;
+
+    if (entry->addr == own)
+    {
+        return TOPOLOGY_ONLINE;
+    }
+    if (silent_us > 3LL * TOPOLOGY_HB_PERIOD_MS * 1000)
+    {
+        return TOPOLOGY_LOST;
+    }
+    if (silent_us > 3LL * TOPOLOGY_HB_PERIOD_MS * 1000 / 2)
+    {
+        return TOPOLOGY_LATE;
+    }
+    if (entry->grew || (entry->hops == 1 && entry->rssi < TOPOLOGY_WEAK_RSSI))
+    {
+        return TOPOLOGY_WEAK;
+    }
+
+    return TOPOLOGY_ONLINE;
+}
+
+void ble_mesh_topology_init(uint16_t own_addr, int64_t now_us)
+{
+    memset(entries, 0, sizeof(entries));
+    memset(&stats, 0, sizeof(stats));
+    entry_count = 0;
+    link_count = 0;
+    adjacency_stale = true;
+    own = own_addr;
+    entry_insert(own_addr, now_us);
+}
+
+void ble_mesh_topology_add(uint16_t addr, uint16_t net_idx, int64_t now_us)
+{
+    topology_entry_t *entry = entry_insert(addr, now_us);
+
+    if (entry)
+    {
+        entry->net_idx = net_idx;
+        entry->hops = 0;
+        entry->grew = false;
+        entry->heard_us = now_us;
+    }
+}
+
+void ble_mesh_topology_heartbeat(uint16_t src, uint8_t hops, uint16_t features, int8_t rssi, int64_t now_us)
+{
+    topology_entry_t *entry;
+
+    if (src == own || !hops)
+    {
+        return;
+    }
+
+    entry = entry_insert(src, now_us);
+    if (!entry)
+    {
+        return;
+    }
+
+    stats.heartbeats++;
+    entry->grew = entry->hops && hops > entry->hops;
+    entry->hops = hops;
+    entry->features = features;
+    entry->rssi = rssi;
+    entry->heard_us = now_us;
+
+    // The provisioner's own links need no probe
+    link_set(own, src, hops == 1);
+}
+
+bool ble_mesh_topology_heard(uint16_t addr)
+{
+    const topology_entry_t *entry = entry_find(addr);
+
+    return entry && entry->hops;
+}
+
+bool ble_mesh_topology_next_probe(uint16_t addr, uint16_t *peer)
+{
+    topology_entry_t *entry = entry_find(addr);
+    uint16_t start;
+
+    if (!entry || !entry->hops)
+    {
+        return false;
+    }
+
+    start = entry_lower_bound(entry->probe + 1);
+    for (uint16_t n = 0; n < entry_count; n++)
+    {
+        const topology_entry_t *candidate = &entries[(start + n) % entry_count];
+
+        if (candidate == entry || candidate->addr == own || !candidate->hops
+            || candidate->net_idx != entry->net_idx || abs(candidate->hops - entry->hops) > 1)
+        {
+            continue;
+        }
+
+        entry->probe = candidate->addr;
+        *peer = candidate->addr;
+        return true;
+    }
+
+    return false;
+}
+
+void ble_mesh_topology_probed(uint16_t addr, uint16_t peer, bool heard, uint8_t min_hops)
+{
+    if (!entry_find(addr) || !entry_find(peer) || addr == peer)
+    {
+        return;
+    }
+
+    stats.probes++;
+    link_set(addr, peer, heard && min_hops == 1);
+}
+
+void ble_mesh_topology_forget(uint16_t addr)
+{
+    uint16_t i = entry_lower_bound(addr);
+
+    if (addr == own || i == entry_count || entries[i].addr != addr)
+    {
+        return;
+    }
+
+    for (int l = link_count - 1; l >= 0; l--)
+    {
+        if (links[l].a == addr || links[l].b == addr)
+        {
+            links[l] = links[--link_count];
+        }
+    }
+    memmove(&entries[i], &entries[i + 1], (entry_count - i - 1) * sizeof(entries[0]));
+    entry_count--;
+    adjacency_stale = true;
+}
+
+ble_mesh_topology_state_t ble_mesh_topology_state(uint16_t addr, int64_t now_us)
+{
+    const topology_entry_t *entry = entry_find(addr);
+
+    return entry ? entry_state(entry, now_us) : TOPOLOGY_LOST;
+}
+
+esp_err_t ble_mesh_topology_get(uint16_t addr, int64_t now_us, ble_mesh_topology_node_t *node)
+{
+    const topology_entry_t *entry = entry_find(addr);
+    uint16_t i;
+
+    if (!entry || !node)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    adjacency_build();
+    i = entry - entries;
+    memset(node, 0, sizeof(*node));
+    node->addr = entry->addr;
+    node->hops = entry->hops;
+    node->features = entry->features;
+    node->rssi = entry->rssi;
+    node->state = entry_state(entry, now_us);
+    node->neighbors = offsets[i + 1] - offsets[i];
+    node->silent_ms = MIN((now_us - entry->heard_us) / 1000, UINT32_MAX);
+    for (uint16_t j = offsets[i]; j < offsets[i + 1]; j++)
+    {
+        node->upstream += entries[adjacency[j]].addr == own ? entry->hops == 1
+                          : entries[adjacency[j]].hops && entries[adjacency[j]].hops + 1 == entry->hops;
+    }
+
+    return ESP_OK;
+}
+
+size_t ble_mesh_topology_neighbors(uint16_t addr, uint16_t *addrs, size_t max)
+{
+    const topology_entry_t *entry = entry_find(addr);
+    size_t count = 0;
+    uint16_t i;
+
+    if (!entry)
+    {
+        return 0;
+    }
+
+    adjacency_build();
+    i = entry - entries;
+    for (uint16_t j = offsets[i]; j < offsets[i + 1] && count < max; j++)
+    {
+        addrs[count++] = entries[adjacency[j]].addr;
+    }
+
+    return count;
+}
+
+size_t ble_mesh_topology_at_risk(int64_t now_us, uint16_t *addrs, size_t max)
+{
+    size_t count = 0;
+
+    for (uint16_t i = 0; i < entry_count && count < max; i++)
+    {
+        if (entry_state(&entries[i], now_us) != TOPOLOGY_ONLINE)
+        {
+            addrs[count++] = entries[i].addr;
+        }
+    }
+
+    return count;
+}
+
+void ble_mesh_topology_get_stats(ble_mesh_topology_stats_t *out)
+{
+    *out = stats;
+    out->nodes = entry_count;
+    out->links = link_count;
+    for (uint16_t i = 0; i < entry_count; i++)
+    {
+        out->relays += !!(entries[i].features & TOPOLOGY_FEAT_RELAY);
+        out->hops_max = MAX(out->hops_max, entries[i].hops);
+    }
+}
+
+void ble_mesh_topology_dump(int64_t now_us)
+{
+    adjacency_build();
+
+    printf("%-6s %4s %-6s %5s %4s %8s  %s\n", "addr", "hops", "state", "rssi", "feat", "silent s", "neighbors");
+    for (uint16_t i = 0; i < entry_count; i++)
+    {
+        const topology_entry_t *entry = &entries[i];
+
+        printf("0x%04x %4u %-6s %5d %04x %8" PRId64 " ", entry->addr, entry->hops,
+               state_names[entry_state(entry, now_us)], entry->rssi, entry->features,
+               entry->addr == own ? 0 : (now_us - entry->heard_us) / 1000000);
+        for (uint16_t j = offsets[i]; j < offsets[i + 1]; j++)
+        {
+            printf(" 0x%04x", entries[adjacency[j]].addr);
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_TOPOLOGY_H
+#define DEZIBOT_BLUETOOTH_MESH_TOPOLOGY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "node_registry.h"
+
+// Nodes on the map, the provisioner itself included
+#ifndef TOPOLOGY_NODES_MAX
+#define TOPOLOGY_NODES_MAX      (NODE_REGISTRY_MAX_NODES + 1)
+#endif
+
+// Neighbor links, each stored once; links found beyond this are dropped
+#ifndef TOPOLOGY_LINKS_MAX
+#define TOPOLOGY_LINKS_MAX      (NODE_REGISTRY_MAX_NODES * 8)
+#endif
+
+// Heartbeat publication period of every node, 2^(log - 1) seconds
+#define TOPOLOGY_HB_PERIOD_LOG  6
+#define TOPOLOGY_HB_PERIOD_MS   (1000 << (TOPOLOGY_HB_PERIOD_LOG - 1))
+
+// A node probes one peer this long, enough for two of its heartbeats
+#define TOPOLOGY_PROBE_LOG      (TOPOLOGY_HB_PERIOD_LOG + 1)
+#define TOPOLOGY_PROBE_MS       (1000 << (TOPOLOGY_PROBE_LOG - 1))
+
+// Direct neighbors of the provisioner heard below this are about to drop off
+#define TOPOLOGY_WEAK_RSSI      (-85)
+
+// Heartbeat feature bits
+#define TOPOLOGY_FEAT_RELAY     0x0001
+#define TOPOLOGY_FEAT_PROXY     0x0002
+#define TOPOLOGY_FEAT_FRIEND    0x0004
+#define TOPOLOGY_FEAT_LPN       0x0008
+
+typedef enum {
+    TOPOLOGY_ONLINE,
+    TOPOLOGY_WEAK,          // weak direct link, or the path grew since the heartbeat before
+    TOPOLOGY_LATE,          // a heartbeat is missing
+    TOPOLOGY_LOST,          // three heartbeats are missing
+} ble_mesh_topology_state_t;
+
+typedef struct {
+    uint16_t addr;
+    uint8_t  hops;          // from the provisioner, 0 until a heartbeat arrived
+    uint16_t features;      // TOPOLOGY_FEAT_* active at the last heartbeat
+    int8_t   rssi;          // of the last hop
+    ble_mesh_topology_state_t state;
+    uint16_t neighbors;     // links found by probing, the provisioner counts as one
+    uint16_t upstream;      // neighbors one hop closer to the provisioner
+    uint32_t silent_ms;     // since the last heartbeat
+} ble_mesh_topology_node_t;
+
+typedef struct {
+    uint16_t nodes;
+    uint16_t links;
+    uint16_t relays;        // nodes with the relay feature active
+    uint8_t  hops_max;
+    uint32_t heartbeats;
+    uint32_t probes;        // probe results recorded
+    uint32_t dropped;       // links or nodes not stored for lack of space
+} ble_mesh_topology_stats_t;
+
+// Empties the map, own_addr is the provisioner at hop 0
+void ble_mesh_topology_init(uint16_t own_addr, int64_t now_us);
+
+// Puts a node on the map that should send heartbeats from now on, on subnet net_idx.
+// Its hop count is unknown until the next one, silence counts from now.
+void ble_mesh_topology_add(uint16_t addr, uint16_t net_idx, int64_t now_us);
+
+// A heartbeat of src arrived over hops hops, rssi measured on the last one
+void ble_mesh_topology_heartbeat(uint16_t src, uint8_t hops, uint16_t features, int8_t rssi, int64_t now_us);
+
+// Whether a heartbeat of addr arrived since it was added
+bool ble_mesh_topology_heard(uint16_t addr);
+
+// Next peer addr should listen to: the peer after the last one probed, among those
+// on its subnet whose hop count differs by at most one, the only ones that can be neighbors
+bool ble_mesh_topology_next_probe(uint16_t addr, uint16_t *peer);
+
+// Result of a probe: addr heard peer's heartbeats, the closest over min_hops
+void ble_mesh_topology_probed(uint16_t addr, uint16_t peer, bool heard, uint8_t min_hops);
+
+// Drops a node and its links
+void ble_mesh_topology_forget(uint16_t addr);
+
+// TOPOLOGY_LOST for nodes not on the map
+ble_mesh_topology_state_t ble_mesh_topology_state(uint16_t addr, int64_t now_us);
+
+esp_err_t ble_mesh_topology_get(uint16_t addr, int64_t now_us, ble_mesh_topology_node_t *node);
+
+// Copies the neighbors of addr in ascending order, returns their count
+size_t ble_mesh_topology_neighbors(uint16_t addr, uint16_t *addrs, size_t max);
+
+// Copies the nodes whose state is not TOPOLOGY_ONLINE, returns their count
+size_t ble_mesh_topology_at_risk(int64_t now_us, uint16_t *addrs, size_t max);
+
+void ble_mesh_topology_get_stats(ble_mesh_topology_stats_t *stats);
+
+// Prints every node with its hop count, state and neighbors
+void ble_mesh_topology_dump(int64_t now_us);
+
+#endif //DEZIBOT_BLUETOOTH_MESH_TOPOLOGY_H
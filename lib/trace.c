@@ -0,0 +1,259 @@
+#include "trace.h"
+#include "common.h"
+
+#include "esp_console.h"
+
+#include <stdatomic.h>
+
+#define TAG "TRACE"
+
+#define TRACE_RING_MASK     (TRACE_RING_LEN - 1)
+#define TRACE_LOGGER_STACK  3072
+#define TRACE_LOGGER_BATCH  16
+
+_Static_assert((TRACE_RING_LEN & TRACE_RING_MASK) == 0, "TRACE_RING_LEN must be a power of two");
+
+// Producers claim a position with one fetch_add, take the slot by setting its sequence
+// to 0 and publish the record by storing position + 1. The reader skips slots that
+// were lapped.
+static ble_mesh_trace_record_t records[TRACE_RING_LEN];
+static atomic_uint seqs[TRACE_RING_LEN];
+static atomic_uint head;
+
+// Reader side, serialized by read_lock
+static SemaphoreHandle_t read_lock;
+static uint32_t tail;
+static atomic_uint lost;    // overwritten before they were read, or dropped on a held slot
+
+#define TRACE_EVENT_NAME(id, name, kind) [id] = name,
+static const char *const event_names[TRACE_EVENT_COUNT] = {
+    TRACE_EVENTS(TRACE_EVENT_NAME)
+};
+#undef TRACE_EVENT_NAME
+
+void ble_mesh_trace_emit(ble_mesh_trace_event_t event, uint16_t addr, uint32_t arg0, uint32_t arg1)
+{
+    uint32_t pos = atomic_fetch_add_explicit(&head, 1, memory_order_relaxed);
+    uint32_t slot = pos & TRACE_RING_MASK;
+    ble_mesh_trace_record_t *record = &records[slot];
+    uint32_t seq = atomic_load_explicit(&seqs[slot], memory_order_relaxed);
+
+    // Once the ring lapped, a writer a lap away may still hold the slot (sequence 0) or
+    // a later lap may have published it already. The record is lost then, not torn.
+    do
+    {
+        if ((seq == 0 && pos >= TRACE_RING_LEN) || (int32_t)(seq - (pos + 1)) > 0)
+        {
+            atomic_fetch_add(&lost, 1);
+            return;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&seqs[slot], &seq, 0, memory_order_acquire,
+                                                    memory_order_relaxed));
+    atomic_thread_fence(memory_order_release);
+
+    record->ts_us = (uint32_t)esp_timer_get_time();
+    record->event = event;
+    record->core = xPortGetCoreID();
+    record->addr = addr;
+    record->arg0 = arg0;
+    record->arg1 = arg1;
+
+    atomic_store_explicit(&seqs[slot], pos + 1, memory_order_release);
+}
+
+static void trace_lock(void)
+{
+    // The first reader creates the lock, emitting never needs it
+    if (!read_lock)
+    {
+        static portMUX_TYPE init_lock = portMUX_INITIALIZER_UNLOCKED;
+        SemaphoreHandle_t lock = xSemaphoreCreateMutex();
+
+        taskENTER_CRITICAL(&init_lock);
+        if (!read_lock)
+        {
+            read_lock = lock;
+            lock = NULL;
+        }
+        taskEXIT_CRITICAL(&init_lock);
+
+        if (lock)
+        {
+            vSemaphoreDelete(lock);
+        }
+    }
+
+    xSemaphoreTake(read_lock, portMAX_DELAY);
+}
+
+size_t ble_mesh_trace_read(ble_mesh_trace_record_t *out, size_t max)
+{
+    size_t count = 0;
+
+    trace_lock();
+
+    uint32_t end = atomic_load_explicit(&head, memory_order_acquire);
+    if (end - tail > TRACE_RING_LEN)
+    {
+        atomic_fetch_add(&lost, end - tail - TRACE_RING_LEN);
+        tail = end - TRACE_RING_LEN;
+    }
+
+    while (tail != end && count < max)
+    {
+        uint32_t slot = tail & TRACE_RING_MASK;
+        uint32_t seq = atomic_load_explicit(&seqs[slot], memory_order_acquire);
+
+        // Claimed but not yet published, try again on the next read
+        if (seq == 0 || (int32_t)(seq - (tail + 1)) < 0)
+        {
+            break;
+        }
+
+        if (seq == tail + 1)
+        {
+            out[count] = records[slot];
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&seqs[slot], memory_order_relaxed) == tail + 1)
+            {
+                count++;
+            }
+            else
+            {
+                atomic_fetch_add(&lost, 1);
+            }
+        }
+        else
+        {
+            atomic_fetch_add(&lost, 1);
+        }
+        tail++;
+    }
+
+    xSemaphoreGive(read_lock);
+
+    return count;
+}
+
+uint32_t ble_mesh_trace_lost(void)
+{
+    return atomic_load(&lost);
+}
+
+const char *ble_mesh_trace_event_name(uint8_t event)
+{
+    return event < TRACE_EVENT_COUNT ? event_names[event] : "unknown";
+}
+
+#define TRACE_RECORD_FMT    "%10" PRIu32 " %-13s 0x%04x 0x%08" PRIx32 " %" PRIu32
+#define TRACE_RECORD_ARGS(r) (r).ts_us, ble_mesh_trace_event_name((r).event), (r).addr, (r).arg0, (r).arg1
+
+static void trace_logger_task(void *arg)
+{
+    uint32_t period_ms = (uint32_t)(uintptr_t)arg;
+    ble_mesh_trace_record_t batch[TRACE_LOGGER_BATCH];
+
+    for (;;)
+    {
+        size_t count;
+
+        while ((count = ble_mesh_trace_read(batch, TRACE_LOGGER_BATCH)) > 0)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                ESP_LOGI(TAG, TRACE_RECORD_FMT, TRACE_RECORD_ARGS(batch[i]));
+            }
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(period_ms));
+    }
+}
+
+esp_err_t ble_mesh_trace_start_logger(uint32_t period_ms)
+{
+    if (xTaskCreate(trace_logger_task, "mesh_trace", TRACE_LOGGER_STACK, (void *)(uintptr_t)period_ms,
+                    tskIDLE_PRIORITY + 1, NULL) != pdPASS)
+    {
+        ESP_LOGE(TAG, "%s: failed to create logger task", __func__);
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+void ble_mesh_trace_export(ble_mesh_trace_write_t write, void *arg)
+{
+    ble_mesh_trace_export_header_t header = {
+        .magic = TRACE_EXPORT_MAGIC,
+        .version = TRACE_EXPORT_VERSION,
+        .record_size = sizeof(ble_mesh_trace_record_t),
+    };
+    ble_mesh_trace_record_t batch[TRACE_LOGGER_BATCH];
+    size_t count;
+
+    // Skipping the records already overwritten counts them in lost before the header
+    ble_mesh_trace_read(batch, 0);
+    header.lost = ble_mesh_trace_lost();
+    write(&header, sizeof(header), arg);
+
+    while ((count = ble_mesh_trace_read(batch, TRACE_LOGGER_BATCH)) > 0)
+    {
+        write(batch, count * sizeof(batch[0]), arg);
+    }
+}
+
+static void trace_write_hex(const void *data, size_t len, void *arg)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        printf("%02x", ((const uint8_t *)data)[i]);
+    }
+}
+
+static int trace_console_cmd(int argc, char **argv)
+{
+    ble_mesh_trace_record_t batch[TRACE_LOGGER_BATCH];
+    size_t count;
+
+    if (argc > 1 && !strcmp(argv[1], "dump"))
+    {
+        ble_mesh_trace_export(trace_write_hex, NULL);
+        printf("\n");
+        return 0;
+    }
+
+    if (argc > 1)
+    {
+        printf("usage: %s [dump]\n", argv[0]);
+        return 1;
+    }
+
+    while ((count = ble_mesh_trace_read(batch, TRACE_LOGGER_BATCH)) > 0)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            printf(TRACE_RECORD_FMT "\n", TRACE_RECORD_ARGS(batch[i]));
+        }
+    }
+    printf("%" PRIu32 " records lost\n", ble_mesh_trace_lost());
+    return 0;
+}
+
+esp_err_t ble_mesh_trace_register_console(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "mesh_trace",
+        .help = "Prints the trace records not read yet. 'dump' prints them as a hex export for "
+                "host/trace_decode instead.",
+        .hint = "[dump]",
+        .func = trace_console_cmd,
+    };
+    esp_err_t error = esp_console_cmd_register(&cmd);
+
+    if (error != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: failed to register command (err %d)", __func__, error);
+    }
+
+    return error;
+}
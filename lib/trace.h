@@ -0,0 +1,113 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_TRACE_H
+#define DEZIBOT_BLUETOOTH_MESH_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Compile-time tiers, everything above TRACE_LEVEL compiles to nothing
+#define TRACE_LEVEL_OFF     0
+#define TRACE_LEVEL_STATE   1   // provisioning and configuration progress
+#define TRACE_LEVEL_MSG     2   // every message sent or received
+#define TRACE_LEVEL_VERBOSE 3   // advertising reports and other high rate events
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_LEVEL_MSG
+#endif
+
+// Records kept, must be a power of two. The oldest records are overwritten.
+#ifndef TRACE_RING_LEN
+#define TRACE_RING_LEN 512
+#endif
+
+#define TRACE_EXPORT_MAGIC      0x52545a44  // "DZTR"
+#define TRACE_EXPORT_VERSION    1
+
+// Spans end at the record's timestamp and last arg1 microseconds
+#define TRACE_INSTANT   0
+#define TRACE_SPAN      1
+
+// X(id, name, kind); the host decoder expands the same list
+#define TRACE_EVENTS(X) \
+    X(TRACE_UNPROV_ADV,     "unprov_adv",     TRACE_INSTANT)  /* arg0 BD_ADDR[0..3], arg1 BD_ADDR[4..5] | bearer << 16 */ \
+    X(TRACE_PROV_COMPLETE,  "prov_complete",  TRACE_INSTANT)  /* arg0 element count, arg1 node index */ \
+    X(TRACE_CFG_SEND,       "cfg_send",       TRACE_INSTANT)  /* arg0 opcode, arg1 configuration step */ \
+    X(TRACE_CFG_STATUS,     "cfg_status",     TRACE_INSTANT)  /* arg0 opcode, arg1 error code */ \
+    X(TRACE_CFG_TIMEOUT,    "cfg_timeout",    TRACE_INSTANT)  /* arg0 opcode */ \
+    X(TRACE_CFG_DONE,       "cfg_done",       TRACE_SPAN)     /* arg0 0, arg1 time to operational in us */ \
+    X(TRACE_CFG_FAILED,     "cfg_failed",     TRACE_INSTANT)  /* arg0 configuration step */ \
+    X(TRACE_TX_ENQUEUE,     "tx_enqueue",     TRACE_INSTANT)  /* arg0 opcode, arg1 queue depth */ \
+    X(TRACE_TX_SEND,        "tx_send",        TRACE_SPAN)     /* arg0 opcode, arg1 enqueue to on air in us */ \
+    X(TRACE_TX_DROP,        "tx_drop",        TRACE_INSTANT)  /* arg0 opcode, arg1 error */ \
+    X(TRACE_RX_STATUS,      "rx_status",      TRACE_INSTANT)  /* arg0 opcode, arg1 error code */ \
+    X(TRACE_RX_PUBLISH,     "rx_publish",     TRACE_INSTANT)  /* arg0 opcode */ \
+    X(TRACE_RX_TIMEOUT,     "rx_timeout",     TRACE_INSTANT)  /* arg0 opcode */ \
+    X(TRACE_PROXY_ADV,      "proxy_adv",      TRACE_INSTANT)  /* arg0 net_idx */
+
+#define TRACE_EVENT_ID(id, name, kind) id,
+typedef enum {
+    TRACE_EVENTS(TRACE_EVENT_ID)
+    TRACE_EVENT_COUNT,
+} ble_mesh_trace_event_t;
+#undef TRACE_EVENT_ID
+
+typedef struct {
+    uint32_t ts_us;     // esp_timer time, wraps after 71 minutes
+    uint8_t  event;
+    uint8_t  core;
+    uint16_t addr;
+    uint32_t arg0;
+    uint32_t arg1;
+} ble_mesh_trace_record_t;
+
+_Static_assert(sizeof(ble_mesh_trace_record_t) == 16, "trace records are exported as 16 bytes");
+
+// Precedes the records of an export, which run to the end of the data. Little endian.
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t lost;      // records overwritten before they were read or dropped while lapped
+} ble_mesh_trace_export_header_t;
+
+#if TRACE_LEVEL >= TRACE_LEVEL_STATE
+#define TRACE_STATE(event, addr, arg0, arg1)    ble_mesh_trace_emit(event, addr, arg0, arg1)
+#else
+#define TRACE_STATE(event, addr, arg0, arg1)    do { } while (0)
+#endif
+
+#if TRACE_LEVEL >= TRACE_LEVEL_MSG
+#define TRACE_MSG(event, addr, arg0, arg1)      ble_mesh_trace_emit(event, addr, arg0, arg1)
+#else
+#define TRACE_MSG(event, addr, arg0, arg1)      do { } while (0)
+#endif
+
+#if TRACE_LEVEL >= TRACE_LEVEL_VERBOSE
+#define TRACE_VERBOSE(event, addr, arg0, arg1)  ble_mesh_trace_emit(event, addr, arg0, arg1)
+#else
+#define TRACE_VERBOSE(event, addr, arg0, arg1)  do { } while (0)
+#endif
+
+// Lock-free and safe from any task or ISR, use the TRACE_* macros instead
+void ble_mesh_trace_emit(ble_mesh_trace_event_t event, uint16_t addr, uint32_t arg0, uint32_t arg1);
+
+// Moves up to max unread records to out, oldest first
+size_t ble_mesh_trace_read(ble_mesh_trace_record_t *out, size_t max);
+
+uint32_t ble_mesh_trace_lost(void);
+
+const char *ble_mesh_trace_event_name(uint8_t event);
+
+// Starts a low priority task that formats unread records to the log every period_ms
+esp_err_t ble_mesh_trace_start_logger(uint32_t period_ms);
+
+// Writes a header and all unread records for host/trace_decode
+typedef void (*ble_mesh_trace_write_t)(const void *data, size_t len, void *arg);
+void ble_mesh_trace_export(ble_mesh_trace_write_t write, void *arg);
+
+// Registers the "mesh_trace [dump]" console command, pre_init() does
+esp_err_t ble_mesh_trace_register_console(void);
+
+#endif //DEZIBOT_BLUETOOTH_MESH_TRACE_H
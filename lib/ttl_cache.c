@@ -0,0 +1,133 @@
+#include "ttl_cache.h"
+#include "common.h"
+
+#define TTL_MAX 127
+
+typedef struct {
+    uint16_t addr;          // unassigned when free
+    uint8_t  min_hops;      // fewest hops seen since min_us
+    int64_t  min_us;
+    int64_t  heard_us;
+} ttl_entry_t;
+
+static portMUX_TYPE ttl_lock = portMUX_INITIALIZER_UNLOCKED;
+static ttl_entry_t entries[TTL_CACHE_SIZE];
+static ble_mesh_ttl_stats_t stats;
+
+// A message sent with TTL 0 is not relayed and reaches the neighbors, TTL 1 is not
+// allowed, any higher TTL reaches that many hops
+static uint8_t ttl_for_hops(uint32_t hops)
+{
+    if (hops <= 1)
+    {
+        return 0;
+    }
+
+    return MIN(hops, TTL_MAX);
+}
+
+static bool entry_valid(const ttl_entry_t *entry, int64_t now)
+{
+    return entry->addr != ESP_BLE_MESH_ADDR_UNASSIGNED && now - entry->heard_us <= TTL_CACHE_EXPIRE_MS * 1000LL;
+}
+
+void ble_mesh_ttl_learn(uint16_t src, uint8_t hops)
+{
+    int64_t now = esp_timer_get_time();
+    ttl_entry_t *entry = &entries[src % TTL_CACHE_SIZE];
+
+    if (!ESP_BLE_MESH_ADDR_IS_UNICAST(src) || !hops)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL(&ttl_lock);
+    if (entry->addr != src)
+    {
+        if (entry_valid(entry, now))
+        {
+            stats.evicted++;
+        }
+        entry->addr = src;
+        entry->min_hops = UINT8_MAX;
+    }
+    // A longer path only counts once the shorter one was not seen for a while
+    if (hops <= entry->min_hops || now - entry->min_us > TTL_CACHE_MIN_HOLD_MS * 1000LL)
+    {
+        entry->min_hops = hops;
+        entry->min_us = now;
+    }
+    entry->heard_us = now;
+    stats.learned++;
+    taskEXIT_CRITICAL(&ttl_lock);
+}
+
+void ble_mesh_ttl_learn_rx(uint16_t src, uint8_t recv_ttl)
+{
+    // Relays stop at TTL 1, a status received with 0 or above the default was not sent
+    // with the default TTL
+    if (!recv_ttl || recv_ttl > TTL_CACHE_DEFAULT)
+    {
+        return;
+    }
+
+    ble_mesh_ttl_learn(src, TTL_CACHE_DEFAULT - recv_ttl + 1);
+}
+
+void ble_mesh_ttl_forget(uint16_t dst)
+{
+    ttl_entry_t *entry = &entries[dst % TTL_CACHE_SIZE];
+
+    taskENTER_CRITICAL(&ttl_lock);
+    if (entry->addr == dst)
+    {
+        entry->addr = ESP_BLE_MESH_ADDR_UNASSIGNED;
+    }
+    taskEXIT_CRITICAL(&ttl_lock);
+}
+
+uint8_t ble_mesh_ttl_get(uint16_t dst)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t hops = 0;
+
+    taskENTER_CRITICAL(&ttl_lock);
+    if (ESP_BLE_MESH_ADDR_IS_UNICAST(dst))
+    {
+        const ttl_entry_t *entry = &entries[dst % TTL_CACHE_SIZE];
+
+        if (entry->addr == dst && entry_valid(entry, now))
+        {
+            hops = entry->min_hops;
+        }
+    }
+    else
+    {
+        // Members of a group are not known here, the farthest node learned decides
+        for (size_t i = 0; i < TTL_CACHE_SIZE; i++)
+        {
+            if (entry_valid(&entries[i], now))
+            {
+                hops = MAX(hops, entries[i].min_hops);
+            }
+        }
+    }
+
+    if (!hops)
+    {
+        stats.misses++;
+        taskEXIT_CRITICAL(&ttl_lock);
+        return TTL_CACHE_DEFAULT;
+    }
+    stats.hits++;
+    taskEXIT_CRITICAL(&ttl_lock);
+
+    return ttl_for_hops(hops + TTL_CACHE_MARGIN);
+}
+
+void ble_mesh_ttl_get_stats(ble_mesh_ttl_stats_t *out)
+{
+    taskENTER_CRITICAL(&ttl_lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&ttl_lock);
+}
@@ -0,0 +1,46 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_TTL_CACHE_H
+#define DEZIBOT_BLUETOOTH_MESH_TTL_CACHE_H
+
+#include <stdint.h>
+
+// Destinations remembered, direct mapped by unicast address
+#ifndef TTL_CACHE_SIZE
+#define TTL_CACHE_SIZE          128
+#endif
+
+// Default TTL of every robot: their statuses leave with it, and messages to destinations
+// not learned yet are sent with it
+#define TTL_CACHE_DEFAULT       7
+
+// Hops added to the fewest seen, a node that moved a little is still reached
+#define TTL_CACHE_MARGIN        1
+
+// The fewest hops seen are kept this long, then a longer path replaces them
+#define TTL_CACHE_MIN_HOLD_MS   60000
+
+// Destinations not heard from for this long are forgotten
+#define TTL_CACHE_EXPIRE_MS     300000
+
+typedef struct {
+    uint32_t learned;       // statuses and heartbeats that updated an entry
+    uint32_t hits;          // TTLs taken from a learned entry
+    uint32_t misses;        // destinations sent TTL_CACHE_DEFAULT
+    uint32_t evicted;       // entries replaced by another address mapping to their slot
+} ble_mesh_ttl_stats_t;
+
+// Records that a message from src travelled hops hops, 1 for a direct neighbor
+void ble_mesh_ttl_learn(uint16_t src, uint8_t hops);
+
+// Same, from the received TTL of a status the node sent with TTL_CACHE_DEFAULT
+void ble_mesh_ttl_learn_rx(uint16_t src, uint8_t recv_ttl);
+
+// Drops what is known about dst, e.g. after a timeout
+void ble_mesh_ttl_forget(uint16_t dst);
+
+// TTL for a message to dst: the fewest hops seen plus TTL_CACHE_MARGIN. A group gets the
+// largest TTL learned, destinations not learned yet get TTL_CACHE_DEFAULT.
+uint8_t ble_mesh_ttl_get(uint16_t dst);
+
+void ble_mesh_ttl_get_stats(ble_mesh_ttl_stats_t *stats);
+
+#endif //DEZIBOT_BLUETOOTH_MESH_TTL_CACHE_H
@@ -0,0 +1,106 @@
+#include "tx_queue.h"
+
+#include <stdatomic.h>
+
+#define TX_QUEUE_MASK   (TX_QUEUE_LEN - 1)
+
+_Static_assert((TX_QUEUE_LEN & TX_QUEUE_MASK) == 0, "TX_QUEUE_LEN must be a power of two");
+
+// Bounded MPMC ring after Vyukov: each cell carries a sequence number telling
+// producers and consumers whose turn it is, so no lock is ever taken.
+typedef struct {
+    atomic_uint        seq;
+    ble_mesh_tx_msg_t  msg;
+} tx_cell_t;
+
+static tx_cell_t cells[TX_QUEUE_LEN];
+static atomic_uint enqueue_pos;
+static atomic_uint dequeue_pos;
+
+void tx_queue_init(void)
+{
+    for (unsigned int i = 0; i < TX_QUEUE_LEN; i++)
+    {
+        atomic_init(&cells[i].seq, i);
+    }
+    atomic_init(&enqueue_pos, 0);
+    atomic_init(&dequeue_pos, 0);
+}
+
+bool tx_queue_push(const ble_mesh_tx_msg_t *msg)
+{
+    unsigned int pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+    tx_cell_t *cell;
+
+    for (;;)
+    {
+        cell = &cells[pos & TX_QUEUE_MASK];
+        unsigned int seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        int diff = (int)(seq - pos);
+
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            return false;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    cell->msg = *msg;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+    return true;
+}
+
+bool tx_queue_pop(ble_mesh_tx_msg_t *msg)
+{
+    unsigned int pos = atomic_load_explicit(&dequeue_pos, memory_order_relaxed);
+    tx_cell_t *cell;
+
+    for (;;)
+    {
+        cell = &cells[pos & TX_QUEUE_MASK];
+        unsigned int seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        int diff = (int)(seq - (pos + 1));
+
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            return false;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&dequeue_pos, memory_order_relaxed);
+        }
+    }
+
+    *msg = cell->msg;
+    atomic_store_explicit(&cell->seq, pos + TX_QUEUE_LEN, memory_order_release);
+
+    return true;
+}
+
+uint32_t tx_queue_depth(void)
+{
+    unsigned int tail = atomic_load_explicit(&dequeue_pos, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+
+    return head - tail;
+}
@@ -0,0 +1,43 @@
+#ifndef DEZIBOT_BLUETOOTH_MESH_TX_QUEUE_H
+#define DEZIBOT_BLUETOOTH_MESH_TX_QUEUE_H
+
+#include "common.h"
+
+// Slots in the ring, must be a power of two
+#define TX_QUEUE_LEN        32
+
+// Longest property value that can be queued
+#define TX_QUEUE_VALUE_MAX  64
+
+typedef struct {
+    uint32_t opcode;
+    uint16_t addr;
+    uint16_t net_idx;
+    uint16_t app_idx;
+    uint8_t  model;
+    uint8_t  ttl;
+    bool     get;
+    bool     ack;       // acknowledged opcode, answered with a status
+    uint8_t  slot;      // coalescing slot + 1, the slot holds the newest value
+    uint8_t  request;   // acknowledged request + 1 awaiting the status
+    uint16_t request_gen;   // generation of that request, a reused slot has another
+    uint8_t  attempts;  // sends the stack failed so far
+    int64_t  enqueue_us;
+    union {
+        esp_ble_mesh_generic_client_set_state_t set;
+        esp_ble_mesh_generic_client_get_state_t get_state;
+    };
+    uint8_t  value_len;
+    uint8_t  value[TX_QUEUE_VALUE_MAX];
+} ble_mesh_tx_msg_t;
+
+void tx_queue_init(void);
+
+// Lock-free, safe from any number of producer and consumer tasks.
+// Returns false when the ring is full or empty respectively.
+bool tx_queue_push(const ble_mesh_tx_msg_t *msg);
+bool tx_queue_pop(ble_mesh_tx_msg_t *msg);
+
+uint32_t tx_queue_depth(void);
+
+#endif //DEZIBOT_BLUETOOTH_MESH_TX_QUEUE_H
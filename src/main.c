@@ -1,28 +1,31 @@
 #include "esp_log.h"
-#include "nvs_flash.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "lib/boot_profile.h"
 #include "lib/client.h"
-#include "lib/bluetooth.h"
+#include "lib/init.h"
+#include "lib/lifecycle.h"
 
 #define TAG "MAIN"
+#define READY_LOG_INTERVAL_MS 30000
 
 void app_main(void)
 {
-    esp_err_t err = nvs_flash_init();
-    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        err = nvs_flash_init();
-    }
-    ESP_ERROR_CHECK(err);
-
     ESP_LOGI(TAG, "Starting BLE Mesh Client...");
 
-    ESP_ERROR_CHECK(bluetooth_init());
+    ESP_ERROR_CHECK(pre_init());
     ESP_ERROR_CHECK(ble_mesh_client_init());
 
-    // Give provisioning time to complete
-    vTaskDelay(pdMS_TO_TICKS(5000));
+    // Start as soon as the node is provisioned and configured, however long that takes
+    ble_mesh_boot_begin(BOOT_READY);
+    while (ble_mesh_lifecycle_wait(LIFECYCLE_READY, READY_LOG_INTERVAL_MS) == ESP_ERR_TIMEOUT) {
+        char state[64];
+        ESP_LOGW(TAG, "Waiting for provisioning and the AppKey bound to the OnOff Client, state: %s",
+                 ble_mesh_lifecycle_str(ble_mesh_lifecycle_get(), state, sizeof(state)));
+    }
+    ble_mesh_boot_end(BOOT_READY);
+    ESP_LOGI(TAG, "Node ready");
+    ble_mesh_boot_report();
 
     while (1) {
         ble_mesh_client_send(1, 0x0002);